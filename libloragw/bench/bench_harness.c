@@ -0,0 +1,285 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Microbenchmark harness: calibrated timing loops, optional CPU counters
+    (cycles, instructions, cache misses) through perf_event_open, and JSON
+    report for trend tracking.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE     /* syscall */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf, fprintf */
+#include <stdlib.h>     /* qsort */
+#include <string.h>     /* memset */
+#include <unistd.h>     /* syscall, read, close */
+#include <time.h>       /* clock_gettime, gmtime_r, strftime */
+#include <sys/ioctl.h>  /* ioctl */
+#include <sys/syscall.h>        /* __NR_perf_event_open */
+#include <linux/perf_event.h>   /* perf_event_attr */
+
+#include "bench_harness.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define CALIB_DIV       8       /* calibration until an eighth of min_ms is reached */
+#define NB_COUNTERS     3       /* cycles, instructions, cache misses, in this order */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int counters_fd[NB_COUNTERS] = {-1, -1, -1}; /* the first one is the group leader */
+
+static volatile uint64_t sink; /* results of the operations, so that they are not optimized out */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((uint64_t)t.tv_sec * 1000000000) + (uint64_t)t.tv_nsec;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int perf_open(uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof attr;
+    attr.config = config;
+    attr.disabled = (group_fd == -1) ? 1 : 0; /* the group is enabled through its leader */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* read the counters of the group, in the order they were opened */
+static int perf_read(uint64_t * val) {
+    uint64_t buff[1 + NB_COUNTERS];
+    int i;
+
+    if (read(counters_fd[0], buff, sizeof buff) != (ssize_t)sizeof buff) {
+        return -1;
+    }
+    for (i = 0; i < NB_COUNTERS; i++) {
+        val[i] = buff[1 + i];
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int compare_double(const void * a, const void * b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* run nb_op operations, return the elapsed time in ns and the number of items processed */
+static uint64_t run_ops(const struct bench_case_s * bc, uint64_t nb_op, uint64_t * nb_item) {
+    uint64_t start, n, items = 0;
+
+    start = now_ns();
+    for (n = 0; n < nb_op; n++) {
+        items += bc->run();
+    }
+    *nb_item = items;
+    sink += items;
+    return now_ns() - start;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* JSON number, or null for the counters not available */
+static void json_number(FILE * file, const char * key, double x, bool valid, bool last) {
+    if (valid == true) {
+        fprintf(file, "      \"%s\": %.3f%s\n", key, x, (last == true) ? "" : ",");
+    } else {
+        fprintf(file, "      \"%s\": null%s\n", key, (last == true) ? "" : ",");
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int bench_counters_open(void) {
+    static const uint64_t config[NB_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+    int i;
+
+    for (i = 0; i < NB_COUNTERS; i++) {
+        counters_fd[i] = perf_open(config[i], counters_fd[0]);
+        if (counters_fd[i] == -1) {
+            bench_counters_close();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void bench_counters_close(void) {
+    int i;
+
+    for (i = NB_COUNTERS - 1; i >= 0; i--) {
+        if (counters_fd[i] != -1) {
+            close(counters_fd[i]);
+            counters_fd[i] = -1;
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int bench_run(const struct bench_case_s * bc, uint32_t min_ms, uint32_t nb_rep, struct bench_result_s * res) {
+    double ns_per_op[BENCH_NB_REP_MAX];
+    uint64_t cnt_start[NB_COUNTERS], cnt_end[NB_COUNTERS], cnt_sum[NB_COUNTERS] = {0, 0, 0};
+    uint64_t nb_op = 1, nb_item, nb_item_sum = 0, elapsed_ns;
+    uint64_t min_ns = (uint64_t)min_ms * 1000000;
+    bool counters = (counters_fd[0] != -1);
+    uint32_t r;
+    int i;
+
+    memset(res, 0, sizeof *res);
+    res->name = bc->name;
+    res->unit = bc->unit;
+    if ((nb_rep == 0) || (nb_rep > BENCH_NB_REP_MAX)) {
+        return -1;
+    }
+    if ((bc->setup != NULL) && (bc->setup() != 0)) {
+        printf("ERROR: %s: setup failed\n", bc->name);
+        return -1;
+    }
+
+    /* calibration, which also warms the caches up */
+    while (true) {
+        elapsed_ns = run_ops(bc, nb_op, &nb_item);
+        if (nb_item == 0) {
+            printf("ERROR: %s: no item processed\n", bc->name);
+            return -1;
+        }
+        if ((elapsed_ns >= (min_ns / CALIB_DIV)) || (nb_op >= (UINT64_MAX / 2))) {
+            break;
+        }
+        nb_op *= 2;
+    }
+    nb_op = (elapsed_ns > 0) ? ((nb_op * min_ns + elapsed_ns - 1) / elapsed_ns) : nb_op;
+    if (nb_op == 0) {
+        nb_op = 1;
+    }
+
+    /* measurements */
+    for (r = 0; r < nb_rep; r++) {
+        if (counters == true) {
+            counters = (perf_read(cnt_start) == 0) && (ioctl(counters_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == 0);
+        }
+        elapsed_ns = run_ops(bc, nb_op, &nb_item);
+        if (counters == true) {
+            ioctl(counters_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            counters = (perf_read(cnt_end) == 0);
+            for (i = 0; i < NB_COUNTERS; i++) {
+                cnt_sum[i] += cnt_end[i] - cnt_start[i];
+            }
+        }
+        nb_item_sum += nb_item;
+        ns_per_op[r] = (double)elapsed_ns / (double)nb_op;
+    }
+
+    qsort(ns_per_op, nb_rep, sizeof ns_per_op[0], compare_double);
+    res->nb_op = nb_op;
+    res->nb_rep = nb_rep;
+    res->items_per_op = (double)nb_item_sum / ((double)nb_op * nb_rep);
+    res->ns_per_op = ns_per_op[nb_rep / 2];
+    res->ns_per_op_min = ns_per_op[0];
+    res->ns_per_op_max = ns_per_op[nb_rep - 1];
+    res->counters = counters;
+    if (counters == true) {
+        res->cycles_per_item = (double)cnt_sum[0] / (double)nb_item_sum;
+        res->instructions_per_item = (double)cnt_sum[1] / (double)nb_item_sum;
+        res->cache_misses_per_item = (double)cnt_sum[2] / (double)nb_item_sum;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void bench_print(const struct bench_result_s * res) {
+    printf("%-28s | %11.1f | %9.2f %-7s | %9.0f", res->name, res->ns_per_op, res->ns_per_op / res->items_per_op, res->unit, 1E9 * res->items_per_op / res->ns_per_op);
+    if (res->counters == true) {
+        printf(" | %7.1f | %7.1f | %7.3f", res->cycles_per_item, res->instructions_per_item, res->cache_misses_per_item);
+    }
+    printf("\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int bench_report_json(FILE * file, const char * suite, const char * version, const struct bench_result_s * res, int nb_res) {
+    char date[32];
+    struct tm tm;
+    time_t t;
+    bool counters = false;
+    int i;
+
+    t = time(NULL);
+    gmtime_r(&t, &tm);
+    strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%SZ", &tm);
+    for (i = 0; i < nb_res; i++) {
+        counters = counters || res[i].counters;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"suite\": \"%s\",\n", suite);
+    fprintf(file, "  \"version\": \"%s\",\n", version);
+    fprintf(file, "  \"date\": \"%s\",\n", date);
+    fprintf(file, "  \"cpu_counters\": %s,\n", (counters == true) ? "true" : "false");
+    fprintf(file, "  \"results\": [\n");
+    for (i = 0; i < nb_res; i++) {
+        fprintf(file, "    {\n");
+        fprintf(file, "      \"name\": \"%s\",\n", res[i].name);
+        fprintf(file, "      \"unit\": \"%s\",\n", res[i].unit);
+        fprintf(file, "      \"ops\": %llu,\n", (unsigned long long)res[i].nb_op);
+        fprintf(file, "      \"repeat\": %u,\n", res[i].nb_rep);
+        json_number(file, "items_per_op", res[i].items_per_op, true, false);
+        json_number(file, "ns_per_op", res[i].ns_per_op, true, false);
+        json_number(file, "ns_per_op_min", res[i].ns_per_op_min, true, false);
+        json_number(file, "ns_per_op_max", res[i].ns_per_op_max, true, false);
+        json_number(file, "ns_per_item", res[i].ns_per_op / res[i].items_per_op, true, false);
+        json_number(file, "items_per_s", 1E9 * res[i].items_per_op / res[i].ns_per_op, true, false);
+        json_number(file, "cycles_per_item", res[i].cycles_per_item, res[i].counters, false);
+        json_number(file, "instructions_per_item", res[i].instructions_per_item, res[i].counters, false);
+        json_number(file, "cache_misses_per_item", res[i].cache_misses_per_item, res[i].counters, true);
+        fprintf(file, "    }%s\n", (i < (nb_res - 1)) ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    return (ferror(file) != 0) ? -1 : 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
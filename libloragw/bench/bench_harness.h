@@ -0,0 +1,110 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Microbenchmark harness: calibrated timing loops, optional CPU counters
+    (cycles, instructions, cache misses) through perf_event_open, and JSON
+    report for trend tracking.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _BENCH_HARNESS_H
+#define _BENCH_HARNESS_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types*/
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* FILE */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define BENCH_DEFAULT_MIN_MS    100     /* minimum duration of a measurement, the number of operations is calibrated for it */
+#define BENCH_DEFAULT_NB_REP    5       /* measurements per benchmark, the median is reported */
+#define BENCH_NB_REP_MAX        101
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct bench_case_s
+@brief A microbenchmark: one operation, repeated by the harness
+*/
+struct bench_case_s {
+    const char *    name;               /*!> identifier in the report */
+    const char *    unit;               /*!> what an item is ("packet", "byte"...) */
+    int             (*setup)(void);     /*!> optional, called once before the measurements, 0 on success */
+    uint32_t        (*run)(void);       /*!> one operation, returns the number of items processed */
+};
+
+/**
+@struct bench_result_s
+@brief Measurements of a microbenchmark
+*/
+struct bench_result_s {
+    const char *    name;
+    const char *    unit;
+    uint64_t        nb_op;              /*!> operations per measurement */
+    uint32_t        nb_rep;             /*!> number of measurements */
+    double          items_per_op;
+    double          ns_per_op;          /*!> median of the measurements */
+    double          ns_per_op_min;
+    double          ns_per_op_max;
+    bool            counters;           /*!> the CPU counters below are valid */
+    double          cycles_per_item;
+    double          instructions_per_item;
+    double          cache_misses_per_item;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Open the CPU counters of the calling thread
+@return 0 if the counters are available, -1 else (not supported, or not allowed by perf_event_paranoid)
+*/
+int bench_counters_open(void);
+
+/**
+@brief Close the CPU counters, if open
+*/
+void bench_counters_close(void);
+
+/**
+@brief Run a microbenchmark: calibrate the number of operations to last min_ms, then measure nb_rep times
+@param bc the microbenchmark
+@param min_ms minimum duration of a measurement, in milliseconds
+@param nb_rep number of measurements, up to BENCH_NB_REP_MAX
+@param res pointer to the result structure to be filled
+@return 0 on success, -1 if the setup failed or the operation processed no item
+*/
+int bench_run(const struct bench_case_s * bc, uint32_t min_ms, uint32_t nb_rep, struct bench_result_s * res);
+
+/**
+@brief Print a result as a line of the console table
+*/
+void bench_print(const struct bench_result_s * res);
+
+/**
+@brief Write the JSON report of a set of results
+@param file the output file
+@param suite the name of the benchmark suite
+@param version the version of the code under test
+@param res array of nb_res results
+@param nb_res number of results
+@return 0 on success, -1 on write error
+*/
+int bench_report_json(FILE * file, const char * suite, const char * version, const struct bench_result_s * res, int nb_res);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,561 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Microbenchmarks of the HAL hot paths, without hardware: RX buffer fetch
+    and decoding, packet parsing and merging, fine timestamp, time on air,
+    JiT queue of the packet forwarder, base64 codec and register accesses.
+    The concentrator is emulated by the software (SIM) COM interface.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf, fopen */
+#include <stdlib.h>     /* rand */
+#include <string.h>     /* memset, memcpy, strstr */
+#include <unistd.h>     /* getopt */
+
+#include "loragw_hal.h"
+#include "loragw_hal_merge.h"
+#include "loragw_reg.h"
+#include "loragw_com.h"
+#include "loragw_sim.h"
+#include "loragw_sx1302.h"
+#include "loragw_sx1302_rx.h"
+#include "loragw_sx1302_timestamp.h"
+#include "base64.h"
+#include "jitqueue.h"
+
+#include "bench_harness.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PKT_HEAD_METADATA   9
+#define PKT_TAIL_METADATA   14
+#define NB_PKT_MAX          255
+
+#define NB_MERGE_PKT        32      /* packets per hal_merge_packets call, a quarter of them duplicated */
+#define NB_PPS_HISTORY      16      /* same as the library */
+#define NB_FTIME_PKT        256
+#define NB_TOA_PKT          256
+#define JIT_T0_US           1000000 /* concentrator time of the JiT queue operations */
+#define JIT_SPACING_US      100000  /* between the downlinks, more than their time on air and pre-delay */
+#define JIT_PEEK_LEAD_US    10000   /* each downlink is peeked that long before its time, within the JiT window */
+#define B64_SIZE            255     /* maximum LoRa payload */
+#define NB_REG_ACCESS       16      /* write and read pairs per operation */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* RX buffer image, as stored by the SX1302 */
+static uint8_t rx_image[LGW_SIM_RX_FIFO_SIZE];
+static uint16_t rx_image_size;
+static uint8_t rx_image_nb_pkt;
+
+static rx_buffer_t rx_buffer;
+static rx_packet_t rx_pkt[NB_PKT_MAX];
+
+static lgw_context_t context;
+static struct lgw_pkt_rx_s pkt_rx[NB_PKT_MAX];
+static struct lgw_pkt_rx_s merge_ref[NB_MERGE_PKT];
+
+static struct {
+    uint8_t     nb;
+    int8_t      metrics[2 * 255];
+    uint32_t    cnt;
+    int32_t     if_freq_hz;
+    double      freq_error;
+} ftime_pkt[NB_FTIME_PKT];
+static uint32_t pps_last;
+
+static struct lgw_pkt_tx_s toa_pkt[NB_TOA_PKT];
+
+static struct jit_queue_s jit_queue;
+static struct lgw_pkt_tx_s jit_pkt;
+
+static uint8_t b64_bin[B64_SIZE];
+static char b64_str[2 * B64_SIZE];
+static int b64_len;
+
+static const int32_t if_freq[LGW_MULTI_NB] = {-400000, -200000, 0, -400000, -200000, 0, 200000, 400000};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h            print this help\n");
+    printf(" -t <uint>     minimum duration of a measurement, in ms (default %u)\n", BENCH_DEFAULT_MIN_MS);
+    printf(" -r <uint>     number of measurements per benchmark, the median is reported (default %u)\n", BENCH_DEFAULT_NB_REP);
+    printf(" -f <string>   run only the benchmarks whose name contains this string\n");
+    printf(" -o <filename> write the JSON report to this file\n");
+    printf(" -p            do not read the CPU counters\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Format a LoRa packet with a valid payload CRC as stored by the SX1302 in its RX buffer, return its size */
+static int build_packet(uint8_t * buff, uint8_t size, uint8_t nb_ts) {
+    int i, n;
+    uint16_t crc;
+    uint8_t checksum = 0;
+    uint8_t * meta = buff + size;
+
+    n = PKT_HEAD_METADATA + size + PKT_TAIL_METADATA + (2 * nb_ts);
+    for (i = 0; i < n; i++) {
+        buff[i] = (uint8_t)rand();
+    }
+    buff[0] = 0xA5; /* syncword */
+    buff[1] = 0xC0;
+    buff[2] = size;
+    buff[3] = (uint8_t)(rand() % LGW_MULTI_NB);                               /* channel */
+    buff[4] = (uint8_t)(((5 + (rand() % 8)) << 4) | ((1 + (rand() % 4)) << 1) | 0x01); /* SF, CR, CRC_EN */
+    buff[5] = (uint8_t)(rand() % 16);                                         /* modem id */
+    buff[8] &= 0x0F;
+    meta[9] = 0x00; /* no error, timing not set: the fine timestamp is measured separately */
+    crc = sx1302_lora_payload_crc(&buff[PKT_HEAD_METADATA], size);
+    meta[19] = (uint8_t)(crc >> 0);
+    meta[20] = (uint8_t)(crc >> 8);
+    meta[21] = nb_ts;
+    for (i = 0; i < (n - 1); i++) {
+        checksum += buff[i];
+    }
+    buff[n - 1] = checksum;
+
+    return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* mixed-size packets, a third of them with fine timestamp metrics, up to a full RX buffer */
+static void build_rx_image(void) {
+    uint8_t payload_size;
+    int nb_ts;
+
+    srand(1);
+    rx_image_size = 0;
+    rx_image_nb_pkt = 0;
+    while (true) {
+        payload_size = (uint8_t)(1 + (rand() % 255));
+        nb_ts = ((rand() % 3) == 0) ? (1 + (rand() % 32)) : 0;
+        if ((rx_image_size + PKT_HEAD_METADATA + payload_size + PKT_TAIL_METADATA + (2 * nb_ts)) >= (int)sizeof rx_image) {
+            break;
+        }
+        rx_image_size += build_packet(&rx_image[rx_image_size], payload_size, (uint8_t)nb_ts);
+        rx_image_nb_pkt += 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int8_t random_metric(void) {
+    /* metrics are mostly small, with some outliers up to the int8 range */
+    return ((rand() % 16) == 0) ? (int8_t)(rand() % 256 - 128) : (int8_t)(rand() % 33 - 16);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARKS ----------------------------------------------------------- */
+
+/* rx_buffer_new and rx_buffer_fetch: a full RX buffer read through the SIM COM interface */
+static uint32_t run_rx_buffer_fetch(void) {
+    lgw_sim_rx_push(lgw_com_target(), rx_image, rx_image_size);
+    if ((rx_buffer_new(&rx_buffer) != LGW_REG_SUCCESS) || (rx_buffer_fetch(&rx_buffer) != LGW_REG_SUCCESS)) {
+        return 0;
+    }
+    return rx_buffer.buffer_pkt_nb;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* rx_buffer_pop: decoding of all the packets of a fetched RX buffer */
+static int setup_rx_buffer_pop(void) {
+    return ((run_rx_buffer_fetch() == rx_image_nb_pkt) && (rx_buffer.buffer_size == rx_image_size)) ? 0 : -1;
+}
+
+static uint32_t run_rx_buffer_pop(void) {
+    uint32_t n = 0;
+
+    rx_buffer.buffer_index = 0;
+    rx_buffer.buffer_pkt_nb = rx_image_nb_pkt;
+    while (rx_buffer.buffer_pkt_nb > 0) {
+        if (rx_buffer_pop(&rx_buffer, &rx_pkt[n]) != LGW_REG_SUCCESS) {
+            return 0;
+        }
+        n += 1;
+    }
+    return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* sx1302_parse: the HAL only parses its own RX buffer, so sx1302_fetch of a full RX buffer is included */
+static int setup_sx1302_parse(void) {
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    int i;
+
+    memset(&context, 0, sizeof context);
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.type = LGW_RADIO_TYPE_SX1250;
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        rfconf.freq_hz = (i == 0) ? 867500000 : 868500000;
+        context.rf_chain_cfg[i] = rfconf;
+    }
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    for (i = 0; i < LGW_MULTI_NB; i++) {
+        ifconf.rf_chain = (i < 3) ? 1 : 0;
+        ifconf.freq_hz = if_freq[i];
+        context.if_chain_cfg[i] = ifconf;
+    }
+    return 0;
+}
+
+static uint32_t run_sx1302_parse(void) {
+    uint8_t nb_pkt = 0;
+    uint32_t n;
+
+    lgw_sim_rx_push(lgw_com_target(), rx_image, rx_image_size);
+    if (sx1302_fetch(&nb_pkt) != LGW_REG_SUCCESS) {
+        return 0;
+    }
+    for (n = 0; n < nb_pkt; n++) {
+        if (sx1302_parse(&context, &pkt_rx[n]) != LGW_REG_SUCCESS) {
+            return 0;
+        }
+    }
+    return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* hal_merge_packets: duplicates removal and sort of the packets of a fetch, copy of the input included */
+static int setup_merge_packets(void) {
+    int i, j;
+
+    srand(2);
+    memset(merge_ref, 0, sizeof merge_ref);
+    for (i = 0; i < NB_MERGE_PKT; i++) {
+        j = ((i % 4) == 3) ? (rand() % i) : -1;
+        if (j >= 0) {
+            /* same packet received by another modem, with a bad CRC */
+            merge_ref[i] = merge_ref[j];
+            merge_ref[i].count_us += 8;
+            merge_ref[i].status = STAT_CRC_BAD;
+            continue;
+        }
+        merge_ref[i].if_chain = (uint8_t)(rand() % LGW_MULTI_NB);
+        merge_ref[i].status = STAT_CRC_OK;
+        merge_ref[i].count_us = 1000000 + (uint32_t)(rand() % 100000);
+        merge_ref[i].modulation = MOD_LORA;
+        merge_ref[i].datarate = DR_LORA_SF7 + (rand() % 6);
+        merge_ref[i].size = (uint16_t)(12 + (rand() % 40));
+        for (j = 0; j < merge_ref[i].size; j++) {
+            merge_ref[i].payload[j] = (uint8_t)rand();
+        }
+    }
+    return 0;
+}
+
+static uint32_t run_merge_packets(void) {
+    uint8_t nb_pkt = NB_MERGE_PKT;
+
+    memcpy(pkt_rx, merge_ref, sizeof merge_ref);
+    if (hal_merge_packets(pkt_rx, &nb_pkt) != 0) {
+        return 0;
+    }
+    return NB_MERGE_PKT;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* precise_timestamp_calculate: SF5 to SF12, 1 to 255 metrics */
+static int setup_precise_timestamp(void) {
+    uint32_t pps0;
+    int i, j;
+
+    srand(3);
+    pps0 = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    for (i = 0; i < NB_PPS_HISTORY; i++) {
+        pps_last = pps0 + (uint32_t)(32E6 * i);
+        timestamp_pps_history_save(pps_last);
+    }
+    for (i = 0; i < NB_FTIME_PKT; i++) {
+        ftime_pkt[i].nb = (uint8_t)(1 + (rand() % 255));
+        for (j = 0; j < (2 * ftime_pkt[i].nb); j++) {
+            ftime_pkt[i].metrics[j] = random_metric();
+        }
+        ftime_pkt[i].cnt = pps0 + 48000000 + (uint32_t)(rand() % 400000000);
+        ftime_pkt[i].if_freq_hz = (rand() % 801000) - 400000;
+        ftime_pkt[i].freq_error = ((double)(rand() % 2001) - 1000.0) * 1E-8;
+    }
+    return 0;
+}
+
+static uint32_t run_precise_timestamp(void) {
+    uint32_t ftime, n = 0;
+    int i;
+
+    for (i = 0; i < NB_FTIME_PKT; i++) {
+        if (precise_timestamp_calculate(ftime_pkt[i].nb, ftime_pkt[i].metrics, ftime_pkt[i].cnt, pps_last, (uint8_t)(5 + (i % 8)), ftime_pkt[i].if_freq_hz, ftime_pkt[i].freq_error, &ftime) == 0) {
+            n += 1;
+        }
+    }
+    return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* lgw_time_on_air: LoRa SF5 to SF12, 125 to 500 kHz, random size and coding rate */
+static int setup_time_on_air(void) {
+    static const uint8_t bw[3] = {BW_125KHZ, BW_250KHZ, BW_500KHZ};
+    int i;
+
+    srand(4);
+    memset(toa_pkt, 0, sizeof toa_pkt);
+    for (i = 0; i < NB_TOA_PKT; i++) {
+        toa_pkt[i].modulation = MOD_LORA;
+        toa_pkt[i].bandwidth = bw[rand() % 3];
+        toa_pkt[i].datarate = DR_LORA_SF5 + (i % 8);
+        toa_pkt[i].coderate = CR_LORA_4_5 + (rand() % 4);
+        toa_pkt[i].preamble = 8;
+        toa_pkt[i].no_crc = ((rand() % 2) == 0);
+        toa_pkt[i].size = (uint16_t)(rand() % 256);
+    }
+    return 0;
+}
+
+static uint32_t run_time_on_air(void) {
+    uint32_t toa = 0;
+    int i;
+
+    for (i = 0; i < NB_TOA_PKT; i++) {
+        toa += lgw_time_on_air(&toa_pkt[i]);
+    }
+    return (toa > 0) ? NB_TOA_PKT : 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* jit_enqueue/peek: a full queue of class A downlinks enqueued in reverse order, then peeked and dequeued */
+static int setup_jit(void) {
+    memset(&jit_pkt, 0, sizeof jit_pkt);
+    jit_pkt.freq_hz = 869525000;
+    jit_pkt.tx_mode = TIMESTAMPED;
+    jit_pkt.rf_power = 14;
+    jit_pkt.modulation = MOD_LORA;
+    jit_pkt.bandwidth = BW_125KHZ;
+    jit_pkt.datarate = DR_LORA_SF7;
+    jit_pkt.coderate = CR_LORA_4_5;
+    jit_pkt.invert_pol = true;
+    jit_pkt.preamble = 8;
+    jit_pkt.size = 12;
+    return 0;
+}
+
+static uint32_t run_jit(void) {
+    struct lgw_pkt_tx_s pkt;
+    enum jit_pkt_type_e pkt_type;
+    uint64_t count_us;
+    int i, idx;
+
+    jit_queue_init(&jit_queue);
+    for (i = JIT_QUEUE_MAX - 1; i >= 0; i--) {
+        jit_pkt.count_us = JIT_T0_US + (uint32_t)((i + 1) * JIT_SPACING_US);
+        if (jit_enqueue(&jit_queue, JIT_T0_US, &jit_pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_A) != JIT_ERROR_OK) {
+            return 0;
+        }
+    }
+    for (i = 0; i < JIT_QUEUE_MAX; i++) {
+        count_us = JIT_T0_US + (uint64_t)((i + 1) * JIT_SPACING_US);
+        if ((jit_peek(&jit_queue, count_us - JIT_PEEK_LEAD_US, &idx) != JIT_ERROR_OK) || (idx < 0)) {
+            return 0;
+        }
+        if (jit_dequeue(&jit_queue, idx, &pkt, &pkt_type) != JIT_ERROR_OK) {
+            return 0;
+        }
+    }
+    return JIT_QUEUE_MAX;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* base64 codec: maximum LoRa payload, as in the rxpk/txpk "data" field */
+static int setup_base64(void) {
+    int i;
+
+    srand(5);
+    for (i = 0; i < B64_SIZE; i++) {
+        b64_bin[i] = (uint8_t)rand();
+    }
+    b64_len = bin_to_b64(b64_bin, B64_SIZE, b64_str, sizeof b64_str);
+    return (b64_len > 0) ? 0 : -1;
+}
+
+static uint32_t run_base64_encode(void) {
+    return (bin_to_b64(b64_bin, B64_SIZE, b64_str, sizeof b64_str) == b64_len) ? B64_SIZE : 0;
+}
+
+static uint32_t run_base64_decode(void) {
+    return (b64_to_bin(b64_str, b64_len, b64_bin, sizeof b64_bin) == B64_SIZE) ? B64_SIZE : 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* lgw_reg_w/lgw_reg_r: register field write and read back through the SIM COM interface */
+static uint32_t run_reg_w_r(void) {
+    int32_t val;
+    int i;
+
+    for (i = 0; i < NB_REG_ACCESS; i++) {
+        lgw_reg_w(SX1302_REG_GPIO_GPIO_DIR_L_DIRECTION, i);
+        lgw_reg_r(SX1302_REG_GPIO_GPIO_DIR_L_DIRECTION, &val);
+        if (val != i) {
+            return 0;
+        }
+    }
+    return 2 * NB_REG_ACCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static const struct bench_case_s bench_cases[] = {
+    {"rx_buffer_fetch",             "packet",   NULL,                       run_rx_buffer_fetch},
+    {"rx_buffer_pop",               "packet",   setup_rx_buffer_pop,        run_rx_buffer_pop},
+    {"sx1302_parse",                "packet",   setup_sx1302_parse,         run_sx1302_parse},
+    {"merge_packets",               "packet",   setup_merge_packets,        run_merge_packets},
+    {"precise_timestamp_calculate", "packet",   setup_precise_timestamp,    run_precise_timestamp},
+    {"lgw_time_on_air",             "packet",   setup_time_on_air,          run_time_on_air},
+    {"jit_enqueue_peek",            "packet",   setup_jit,                  run_jit},
+    {"base64_encode",               "byte",     setup_base64,               run_base64_encode},
+    {"base64_decode",               "byte",     setup_base64,               run_base64_decode},
+    {"reg_w_reg_r",                 "access",   NULL,                       run_reg_w_r}
+};
+
+#define NB_BENCH_CASES  (int)(sizeof bench_cases / sizeof bench_cases[0])
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    struct bench_result_s res[NB_BENCH_CASES];
+    unsigned int arg_u;
+    unsigned int min_ms = BENCH_DEFAULT_MIN_MS;
+    unsigned int nb_rep = BENCH_DEFAULT_NB_REP;
+    const char * filter = NULL;
+    const char * json_fname = NULL;
+    bool counters = true;
+    FILE * file;
+    int i, x, nb_res = 0;
+    int nb_err = 0;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "ht:r:f:o:p")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 't':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -t argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                min_ms = arg_u;
+                break;
+            case 'r':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1) || (arg_u > BENCH_NB_REP_MAX)) {
+                    printf("ERROR: argument parsing of -r argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_rep = arg_u;
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 'o':
+                json_fname = optarg;
+                break;
+            case 'p':
+                counters = false;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    printf("===== libloragw microbenchmarks (SIM) =====\n");
+
+    x = lgw_connect(LGW_COM_SIM, "sim");
+    if (x != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to connect to the SIM interface\n");
+        return EXIT_FAILURE;
+    }
+    build_rx_image();
+    printf("RX buffer: %u bytes, %u packets\n", rx_image_size, rx_image_nb_pkt);
+    if ((counters == true) && (bench_counters_open() != 0)) {
+        printf("INFO: CPU counters not available (see /proc/sys/kernel/perf_event_paranoid)\n");
+        counters = false;
+    }
+
+    printf("benchmark                    |       ns/op |   ns/item         |   items/s%s\n", (counters == true) ? " | cyc/itm | ins/itm | miss/itm" : "");
+    for (i = 0; i < NB_BENCH_CASES; i++) {
+        if ((filter != NULL) && (strstr(bench_cases[i].name, filter) == NULL)) {
+            continue;
+        }
+        if (bench_run(&bench_cases[i], min_ms, nb_rep, &res[nb_res]) != 0) {
+            nb_err += 1;
+            continue;
+        }
+        bench_print(&res[nb_res]);
+        nb_res += 1;
+    }
+    bench_counters_close();
+    lgw_disconnect();
+
+    if (json_fname != NULL) {
+        file = fopen(json_fname, "w");
+        if (file == NULL) {
+            printf("ERROR: failed to open %s\n", json_fname);
+            nb_err += 1;
+        } else {
+            if (bench_report_json(file, "libloragw", lgw_version_info(), res, nb_res) != 0) {
+                printf("ERROR: failed to write %s\n", json_fname);
+                nb_err += 1;
+            }
+            fclose(file);
+            printf("JSON report written to %s\n", json_fname);
+        }
+    }
+
+    printf("errors: %d\n", nb_err);
+    printf("=========== Test End ===========\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,17 @@
+#ifndef _LORAGW_CONFIGURATION_H
+#define _LORAGW_CONFIGURATION_H
+	#define LIBLORAGW_VERSION	"2.1.0"
+	#define DEBUG_AUX		0
+	#define DEBUG_COM		0
+	#define DEBUG_MCU		0
+	#define DEBUG_I2C		0
+	#define DEBUG_REG		0
+	#define DEBUG_HAL		0
+	#define DEBUG_GPS		0
+	#define DEBUG_GPIO		
+	#define DEBUG_LBT		0
+	#define DEBUG_RAD		0
+	#define DEBUG_CAL		0
+	#define DEBUG_SX1302	0
+	#define DEBUG_FTIME		0
+#endif
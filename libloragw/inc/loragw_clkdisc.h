@@ -0,0 +1,106 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Clock discipline of a concentrator counter on GPS PPS captures.
+    A 2-states Kalman filter (phase, frequency) tracks the counter value at each
+    PPS pulse, and gives the XTAL frequency error, the filtered phase of the PPS
+    pulses, and their uncertainty.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_CLKDISC_H
+#define _LORAGW_CLKDISC_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_CLKDISC_SUCCESS  0
+#define LGW_CLKDISC_ERROR   -1
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_clkdisc_s
+@brief State of the clock discipline filter of a counter
+*/
+struct lgw_clkdisc_s {
+    double      tick_hz;    /*!> nominal frequency of the counter */
+    double      r_meas;     /*!> variance of a PPS capture (quantization + PPS jitter), in ticks^2 */
+    double      q_freq;     /*!> variance of the frequency random walk, per second */
+    uint32_t    cnt_last;   /*!> last PPS capture accepted */
+    double      phase;      /*!> filtered phase of the last PPS, relative to cnt_last, in ticks */
+    double      freq;       /*!> filtered frequency, relative to nominal (eg. <1 'slow' XTAL) */
+    double      p[2][2];    /*!> covariance of (phase, freq) */
+    uint32_t    nb_update;  /*!> number of PPS captures accepted since the filter start */
+    uint8_t     nb_reject;  /*!> number of successive PPS captures rejected */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Initialize a clock discipline filter
+@param cd pointer to the filter state
+@param tick_hz nominal frequency of the disciplined counter (eg. 1E6 or 32E6)
+@param pps_jitter_s standard deviation of the PPS pulse jitter, in seconds
+*/
+void lgw_clkdisc_init(struct lgw_clkdisc_s *cd, double tick_hz, double pps_jitter_s);
+
+/**
+@brief Restart the phase tracking on the next PPS capture, keeping the frequency estimate
+@param cd pointer to the filter state
+*/
+void lgw_clkdisc_reset(struct lgw_clkdisc_s *cd);
+
+/**
+@brief Update the filter with the counter value captured on a PPS pulse
+@param cd pointer to the filter state
+@param cnt_pps counter value captured on the PPS pulse
+@return success if the capture was used, error if it was rejected as aberrant
+
+Captures may be missing (eg. GPS loss), the filter predicts the elapsed PPS
+pulses and widens its uncertainty accordingly. After 3 successive aberrant
+captures, the phase tracking is restarted (eg. counter reset) and success is
+returned.
+*/
+int lgw_clkdisc_update(struct lgw_clkdisc_s *cd, uint32_t cnt_pps);
+
+/**
+@brief Get the clock discipline estimates
+@param cd pointer to the filter state
+@param freq pointer to store the counter frequency relative to nominal (NULL to ignore)
+@param freq_std pointer to store the standard deviation of freq (NULL to ignore)
+@param phase_std pointer to store the standard deviation of the PPS phase, in ticks (NULL to ignore)
+@return true if the filter is tracking (at least 2 PPS captures)
+*/
+bool lgw_clkdisc_get(const struct lgw_clkdisc_s *cd, double *freq, double *freq_std, double *phase_std);
+
+/**
+@brief Get the correction to apply to a PPS capture to get the filtered PPS phase
+@param cd pointer to the filter state
+@param cnt_pps counter value captured on a PPS pulse, the last one or a previous one
+@param corr pointer to store the correction, in ticks (filtered phase - cnt_pps)
+@return success if the filter is tracking and cnt_pps matches a tracked PPS pulse
+*/
+int lgw_clkdisc_pps_correction(const struct lgw_clkdisc_s *cd, uint32_t cnt_pps, double *corr);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -41,6 +41,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 typedef enum com_type_e {
     LGW_COM_SPI,
     LGW_COM_USB,
+    LGW_COM_SIM,
     LGW_COM_UNKNOWN
 } lgw_com_type_t;
 
@@ -0,0 +1,49 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Table-driven CRC16 (polynomial 0x1021), 8 bytes per iteration.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_CRC_H
+#define _LORAGW_CRC_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stddef.h>     /* size_t */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Compute the CRC16 of a LoRa payload, as computed by the SX1302 modems
+@param data pointer to the payload
+@param size size of the payload, in bytes
+@return the CRC16 of the payload
+
+The payload bytes are added to the low end of the CRC register, after it has
+been shifted, instead of the high end as for the usual CRC-16/CCITT.
+*/
+uint16_t lgw_crc16_lora(const uint8_t * data, size_t size);
+
+/**
+@brief Compute the CRC-16/CCITT of a buffer, with a 0x0000 initial value (eg. LoRaWAN beacon CRC)
+@param data pointer to the buffer
+@param size size of the buffer, in bytes
+@return the CRC16 of the buffer
+*/
+uint16_t lgw_crc16_ccitt(const uint8_t * data, size_t size);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
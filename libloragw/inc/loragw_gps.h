@@ -23,6 +23,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define _GNU_SOURCE
 #include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
 #include <time.h>       /* time library */
 #include <termios.h>    /* speed_t */
 #include <unistd.h>     /* ssize_t */
@@ -41,7 +43,8 @@ struct tref {
     uint32_t        count_us;   /*!> reference concentrator internal timestamp */
     struct timespec utc;        /*!> reference UTC time (from GPS/NMEA) */
     struct timespec gps;        /*!> reference GPS time (since 01.Jan.1980) */
-    double          xtal_err;   /*!> raw clock error (eg. <1 'slow' XTAL) */
+    double          xtal_err;   /*!> clock error (eg. <1 'slow' XTAL) */
+    double          xtal_err_std; /*!> standard deviation of xtal_err */
 };
 
 /**
@@ -82,6 +85,51 @@ enum gps_msg {
     UBX_NAV_TIMEUTC  /*!> UTC Time Solution */
 };
 
+/**
+@struct lgw_gps_field_s
+@brief Numeric accumulators of the NMEA field being received
+*/
+struct lgw_gps_field_s {
+    uint32_t    int_val;    /*!> integer part */
+    uint64_t    frac_val;   /*!> fractional part mantissa */
+    uint8_t     int_len;    /*!> number of digits of the integer part */
+    uint8_t     frac_len;   /*!> number of digits of the fractional part */
+    uint8_t     len;        /*!> number of characters of the field */
+    char        first;      /*!> first character of the field */
+    bool        neg;        /*!> leading minus sign */
+    bool        dot;        /*!> decimal point found */
+    bool        bad;        /*!> not a number */
+};
+
+/**
+@struct lgw_gps_parser_s
+@brief State of the incremental NMEA/UBX stream parser (see lgw_gps_parse_stream)
+*/
+struct lgw_gps_parser_s {
+    uint8_t     state;          /*!> current state of the parser */
+    uint16_t    len;            /*!> UBX payload length / NMEA sentence length */
+    uint16_t    idx;            /*!> index in the UBX payload */
+    uint8_t     ck_a;           /*!> UBX Fletcher checksum A / NMEA XOR checksum */
+    uint8_t     ck_b;           /*!> UBX Fletcher checksum B / received NMEA checksum */
+    uint8_t     ubx_class;      /*!> UBX message class */
+    uint8_t     ubx_id;         /*!> UBX message ID */
+    uint8_t     ubx_payload[16];/*!> beginning of the UBX payload (NAV-TIMEGPS) */
+    enum gps_msg nmea_type;     /*!> type of the NMEA sentence being received */
+    char        label[5];       /*!> NMEA address field (talker + sentence) */
+    uint8_t     field;          /*!> NMEA field index */
+    struct lgw_gps_field_s fld; /*!> NMEA field being received */
+    /* NMEA fields of interest, committed once the checksum is verified */
+    short       hou, min, sec;  /*!> RMC time */
+    float       fra;            /*!> RMC fractions of seconds */
+    short       day, mon, yea;  /*!> RMC date */
+    char        mod;            /*!> RMC mode */
+    short       dla, dlo, alt;  /*!> GGA degrees of latitude/longitude, altitude */
+    double      mla, mlo;       /*!> GGA minutes of latitude/longitude */
+    char        ola, olo;       /*!> GGA orientation of latitude/longitude */
+    short       sat;            /*!> GGA number of satellites */
+    uint8_t     ok;             /*!> bitmask of the fields successfully decoded */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
@@ -92,6 +140,8 @@ enum gps_msg {
 #define LGW_GPS_UBX_SYNC_CHAR     (0xB5)
 #define LGW_GPS_NMEA_SYNC_CHAR    (0x24)
 
+#define LGW_GPS_ISO8601_SIZE      (28) /* "YYYY-MM-DDThh:mm:ss.uuuuuuZ" + null char */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -143,6 +193,33 @@ lock must be acquired before calling either function.
 */
 enum gps_msg lgw_parse_ubx(const char* serial_buff, size_t buff_size, size_t *msg_size);
 
+/**
+@brief Initialize the state of an incremental NMEA/UBX stream parser
+
+@param parser pointer to the parser state to be initialized
+*/
+void lgw_gps_parser_init(struct lgw_gps_parser_s *parser);
+
+/**
+@brief Parse a chunk of the serial stream coming from the GPS, byte by byte
+@param parser pointer to the parser state, kept from one call to the next
+@param buff pointer to the received bytes (not modified, not copied)
+@param buff_size number of bytes available in buff
+@param nb_parsed pointer to store the number of bytes consumed from buff
+@return type of the frame completed, or INCOMPLETE if all bytes were consumed
+        without completing a frame
+
+Frames may be split across any number of calls, so the bytes can be parsed in
+place as they are received (eg. the two parts of a ring buffer). The parsing
+stops after each complete frame, so the caller must call this function again
+with the remaining bytes (buff + *nb_parsed).
+Only the UBX NAV-TIMEGPS, and NMEA RMC and GGA frames are decoded, to the same
+global set of variables as lgw_parse_ubx/lgw_parse_nmea. Other frames with a
+valid checksum are returned as IGNORED, corrupted ones as INVALID.
+The same locking constraints as lgw_parse_ubx/lgw_parse_nmea apply.
+*/
+enum gps_msg lgw_gps_parse_stream(struct lgw_gps_parser_s *parser, const uint8_t *buff, size_t buff_size, size_t *nb_parsed);
+
 /**
 @brief Get the GPS solution (space & time) for the concentrator
 
@@ -170,6 +247,8 @@ int lgw_gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s
 @return success if timestamp was read and time reference could be refreshed
 
 Set systime to 0 in ref to trigger initial synchronization.
+The PPS timestamps are tracked by a clock discipline filter (see loragw_clkdisc),
+which gives the reference count_us (filtered PPS phase) and xtal_err.
 */
 int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struct timespec gps_time);
 
@@ -215,6 +294,26 @@ the order of a millisecond.
 */
 int lgw_cnt2gps(struct tref ref, uint32_t count_us, struct timespec* gps_time);
 
+/**
+@brief Convert a batch of concentrator timestamp counter values to UTC and GPS time
+
+@param ref time reference structure required for time conversion
+@param count_us array of internal timestamp counter values of the LoRa concentrator
+@param nb number of values in count_us
+@param utc array of nb elements to store UTC times, with ns precision (NULL to ignore)
+@param gps_time array of nb elements to store GPS times, with ns precision (NULL to ignore)
+@param utc_iso array of nb strings to store UTC times in ISO 8601 format, with
+       us precision (eg. 2020-01-02T03:04:05.123456Z) (NULL to ignore)
+@return success if the function was able to convert all timestamps
+
+Equivalent to calling lgw_cnt2utc and lgw_cnt2gps for each value (within 1ns),
+but the reference is checked and prepared once for the whole batch (typically
+all the packets of a lgw_receive call), and the conversion is done in integer
+arithmetic. The calendar date of the ISO 8601 strings is only computed again
+when the day changes within the batch.
+*/
+int lgw_cnt2time_batch(struct tref ref, const uint32_t *count_us, unsigned int nb, struct timespec *utc, struct timespec *gps_time, char utc_iso[][LGW_GPS_ISO8601_SIZE]);
+
 /**
 @brief Convert GPS time to concentrator timestamp counter value
 
@@ -134,6 +134,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* Spectral Scan */
 #define LGW_SPECTRAL_SCAN_RESULT_SIZE 33 /* The number of results returned by spectral scan function, to be used for memory allocation */
 
+/* Virtual concentrator */
+#define LGW_VIRT_SF_NB      8       /* number of spreading factors of the traffic model (SF5 to SF12) */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
@@ -224,6 +227,7 @@ struct lgw_pkt_rx_s {
     uint8_t     if_chain;       /*!> by which IF chain was packet received */
     uint8_t     status;         /*!> status of the received packet */
     uint32_t    count_us;       /*!> internal concentrator counter for timestamping, 1 microsecond resolution */
+    uint64_t    count_us64;     /*!> internal concentrator counter extended to 64-bits (never wraps), 32 LSBs equal to count_us */
     uint8_t     rf_chain;       /*!> through which RF chain the packet was received */
     uint8_t     modem_id;
     uint8_t     modulation;     /*!> modulation used by the packet */
@@ -242,6 +246,21 @@ struct lgw_pkt_rx_s {
     uint32_t    ftime;          /*!> packet fine timestamp (nanoseconds since last PPS) */
 };
 
+/**
+@struct lgw_rx_stats_s
+@brief Structure containing the RX losses counters, since the concentrator was started
+*/
+struct lgw_rx_stats_s {
+    uint32_t    nb_fetch;           /*!> number of RX buffer fetches which returned data */
+    uint32_t    nb_buffer_full;     /*!> number of fetches which found the RX buffer full (packets may have been dropped by the SX1302) */
+    uint32_t    nb_resync;          /*!> number of corrupted regions skipped in the RX buffer, the valid packets around are kept */
+    uint32_t    nb_checksum_err;    /*!> number of packets truncated or with a wrong checksum */
+    uint32_t    nb_bytes_discarded; /*!> number of bytes fetched from the RX buffer but not parsed */
+    uint32_t    nb_pkt_lost;        /*!> number of packets fetched but not returned by lgw_receive (estimate, lower bound) */
+    uint32_t    nb_detect[LGW_MULTI_NB]; /*!> number of preambles detected per multi-SF channel, for the SF selected for the ARB statistics (SF7) */
+    uint32_t    nb_alloc[LGW_MULTI_NB];  /*!> number of demodulators allocated per multi-SF channel, nb_detect - nb_alloc is the number of detections lost */
+};
+
 /**
 @struct lgw_pkt_tx_s
 @brief Structure containing the configuration of a packet to send and a pointer to the payload
@@ -365,6 +384,42 @@ struct lgw_conf_sx1261_s {
     struct lgw_conf_lbt_s       lbt_conf;           /*!> listen-before-talk configuration */
 };
 
+/**
+@struct lgw_conf_virt_s
+@brief Configuration structure for the virtual concentrator, a synthetic traffic model replacing the hardware
+*/
+struct lgw_conf_virt_s {
+    bool        enable;             /*!> enable the virtual concentrator, no hardware is accessed when enabled */
+    uint32_t    nb_dev;             /*!> number of simulated end-devices */
+    float       period_s;           /*!> mean uplink period of each end-device, in seconds (Poisson arrivals) */
+    uint8_t     sf_weight[LGW_VIRT_SF_NB]; /*!> relative weights of SF5 to SF12 in the end-devices population */
+    uint8_t     size_min;           /*!> minimum payload size, in bytes */
+    uint8_t     size_max;           /*!> maximum payload size, in bytes */
+    float       rssi_mean;          /*!> mean RSSI of the end-devices, in dBm */
+    float       rssi_std;           /*!> standard deviation of the end-devices RSSI, in dB */
+    float       snr_mean;           /*!> mean SNR of the end-devices, in dB */
+    float       snr_std;            /*!> standard deviation of the end-devices SNR, in dB */
+    float       crc_error_ratio;    /*!> ratio of packets received with a bad CRC, between 0 and 1 */
+    uint32_t    dev_addr;           /*!> DevAddr of the first end-device, the next ones are consecutive */
+    uint32_t    seed;               /*!> seed of the pseudo-random generator, to be different for each instance */
+    bool        host_counter;       /*!> use the host monotonic clock as counter, to measure latencies against count_us on the same host */
+};
+
+/**
+@struct lgw_virt_tx_stats_s
+@brief TX timing counters of the virtual concentrator, since it was started
+*/
+struct lgw_virt_tx_stats_s {
+    uint32_t    nb_tx;              /*!> number of packets sent */
+    uint32_t    nb_tx_late;         /*!> number of timestamped packets programmed after their TX trigger time (missed) */
+    uint32_t    nb_tx_overlap;      /*!> number of packets programmed while the previous one was not sent yet */
+    uint32_t    nb_tstamp;          /*!> number of timestamped packets, used for the slack statistics */
+    int32_t     slack_min_us;       /*!> minimum time between lgw_send and the TX trigger, for timestamped packets */
+    int32_t     slack_max_us;       /*!> maximum time between lgw_send and the TX trigger, for timestamped packets */
+    int64_t     slack_sum_us;       /*!> sum of the times between lgw_send and the TX trigger, for the average */
+    uint64_t    airtime_us;         /*!> total time on air of the packets sent */
+};
+
 /**
 @struct lgw_context_s
 @brief Configuration context shared across modules
@@ -384,6 +439,7 @@ typedef struct lgw_context_s {
     /* Misc */
     struct lgw_conf_ftime_s     ftime_cfg;
     struct lgw_conf_sx1261_s    sx1261_cfg;
+    struct lgw_conf_virt_s      virt_cfg;
     /* Debug */
     struct lgw_conf_debug_s     debug_cfg;
 } lgw_context_t;
@@ -454,6 +510,15 @@ int lgw_ftime_setconf(struct lgw_conf_ftime_s * conf);
 */
 int lgw_sx1261_setconf(struct lgw_conf_sx1261_s * conf);
 
+/**
+@brief Configure the virtual concentrator
+When enabled, lgw_start does not access the hardware, lgw_receive returns packets generated by a synthetic
+traffic model and lgw_send only records the TX timing. The concentrator counter is derived from the host clock.
+@param conf pointer to structure defining the config to be applied
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_virt_setconf(struct lgw_conf_virt_s * conf);
+
 /**
 @brief Configure the debug context
 @param conf pointer to structure defining the config to be applied
@@ -535,6 +600,24 @@ int lgw_get_trigcnt(uint32_t * trig_cnt_us);
 */
 int lgw_get_instcnt(uint32_t * inst_cnt_us);
 
+/**
+@brief Return instateneous value of internal counter, extended to 64-bits
+@param inst_cnt_us pointer to receive timestamp value, never wraps (32 LSBs equal to lgw_get_instcnt() value)
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_get_instcnt64(uint64_t * inst_cnt_us);
+
+/**
+@brief Return an estimate of the instantaneous value of internal counter (64-bits), without accessing the concentrator
+@brief The estimate is computed from the host monotonic clock, using a model refreshed at each counter read
+       (lgw_receive, lgw_get_instcnt...). This function is lock-free, and can be called without holding
+       the lock used to serialize the other HAL calls.
+@param inst_cnt_us pointer to receive the estimated timestamp value
+@param error_us pointer to receive the estimate error bound, in microseconds
+@return LGW_HAL_ERROR if no estimate is available yet (concentrator not started or counter not read yet), LGW_HAL_SUCCESS else
+*/
+int lgw_get_instcnt_estimate(uint64_t * inst_cnt_us, uint32_t * error_us);
+
 /**
 @brief Return the LoRa concentrator EUI
 @param eui pointer to receive eui
@@ -549,6 +632,22 @@ int lgw_get_eui(uint64_t * eui);
 */
 int lgw_get_temperature(float * temperature);
 
+/**
+@brief Return the counters of the packets lost on the RX path, and of the demodulator allocation failures
+The demodulator counters are accumulated from 8-bit hardware counters at each call, this function has to be called
+before 255 preambles are detected on a channel for them to be accurate.
+@param stats pointer to return the counters, since the concentrator was started
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_get_rx_stats(struct lgw_rx_stats_s * stats);
+
+/**
+@brief Return the TX timing counters of the virtual concentrator
+@param stats pointer to return the counters, since the concentrator was started
+@return LGW_HAL_ERROR id the operation failed or the virtual concentrator is not running, LGW_HAL_SUCCESS else
+*/
+int lgw_virt_get_tx_stats(struct lgw_virt_tx_stats_s * stats);
+
 /**
 @brief Allow user to check the version/options of the library once compiled
 @return pointer on a human-readable null terminated string
@@ -570,6 +669,13 @@ uint32_t lgw_time_on_air(const struct lgw_pkt_tx_s * packet);
 */
 int lgw_spectral_scan_start(uint32_t freq_hz, uint16_t nb_scan);
 
+/**
+@brief Estimate the time needed by the SX1261 to complete a scan, so that the status polling can start only when the scan should be done
+@param nb_scan number of measures to be done for the scan
+@return the nominal scan duration, in microseconds
+*/
+uint32_t lgw_spectral_scan_duration_us(uint16_t nb_scan);
+
 /**
 @brief Get the current scan status
 @param status a pointer to the returned status
@@ -0,0 +1,41 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator HAL internals: merge of the packets of a fetch, when the
+    fine timestamp makes the multi-SF modems demodulate a packet twice.
+    Not part of the HAL API, shared with the microbenchmarks.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_HAL_MERGE_H
+#define _LORAGW_HAL_MERGE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types*/
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Remove the duplicated packets of a fetch and sort the others by timestamp
+@param p array of packets, modified in place
+@param nb_pkt number of packets in the array, updated with the number left
+@return 0 if success, LGW_HAL_ERROR if a parameter is NULL
+*/
+int hal_merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -38,6 +38,18 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/**
+@brief Derive the LBT channels parameters from the configuration
+@param sx1261_context the sx1261 radio parameters, with the LBT channels
+@return 0 for success, -1 for failure
+*/
+int lgw_lbt_init(const struct lgw_conf_sx1261_s * sx1261_context);
+
+/**
+@brief Notify that the SX1261 RX parameters have been set by another user (spectral scan, setup)
+*/
+void lgw_lbt_rx_params_changed(void);
+
 /**
 @brief Configure the SX1261 and start LBT channel scanning
 @param sx1261_context the sx1261 radio parameters to take into account for scanning
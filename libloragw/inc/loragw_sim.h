@@ -0,0 +1,146 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Software communication interface emulating the LoRa concentrator registers
+    and RX buffer in host memory, for tests and benchmarks without hardware.
+    Single-byte read/write and burst read/write, with transaction counters.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_SIM_H
+#define _LORAGW_SIM_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>   /* C99 types*/
+
+#include "loragw_com.h"
+
+#include "config.h"   /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_SIM_SUCCESS     0
+#define LGW_SIM_ERROR       -1
+
+#define LGW_SIM_RX_FIFO_SIZE    4096 /* size of the emulated SX1302 RX buffer, in bytes */
+#define LGW_SIM_MUX_TARGET_SX1261   0x03 /* SX1261 commands, counted as bursts but not emulated */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_sim_stats_s
+@brief Bus transactions counters of the software interface
+*/
+struct lgw_sim_stats_s {
+    uint32_t nb_w;          /*!> number of single-byte writes */
+    uint32_t nb_r;          /*!> number of single-byte reads */
+    uint32_t nb_rmw;        /*!> number of read-modify-writes */
+    uint32_t nb_wb;         /*!> number of burst writes */
+    uint32_t nb_rb;         /*!> number of burst reads */
+    uint64_t nb_bytes_w;    /*!> total number of bytes written */
+    uint64_t nb_bytes_r;    /*!> total number of bytes read */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Allocate the emulated concentrator memory
+@param com_path not used, only kept for interface consistency
+@param com_target_ptr pointer on a generic pointer to the emulated target
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_open(const char * com_path, void **com_target_ptr);
+
+/**
+@brief Release the emulated concentrator memory
+@param com_target generic pointer to the emulated target
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_close(void *com_target);
+
+/**
+@brief Emulated single-byte write
+*/
+int lgw_sim_w(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t data);
+
+/**
+@brief Emulated single-byte read
+*/
+int lgw_sim_r(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data);
+
+/**
+@brief Emulated single-byte read-modify-write
+*/
+int lgw_sim_rmw(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t leng, uint8_t data);
+
+/**
+@brief Emulated burst (multiple-byte) write
+*/
+int lgw_sim_wb(void *com_target, uint8_t spi_mux_target, uint16_t address, const uint8_t *data, uint16_t size);
+
+/**
+@brief Emulated burst (multiple-byte) read
+@note Reads at the RX buffer address pop data from the emulated RX FIFO
+*/
+int lgw_sim_rb(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t size);
+
+/**
+@brief Maximum burst size of the emulated interface
+*/
+uint16_t lgw_sim_chunk_size(void);
+
+/**
+@brief Get the emulated concentrator temperature
+*/
+int lgw_sim_get_temperature(void *com_target, float * temperature);
+
+/**
+@brief Write the emulated SX1302 memory, without counting a bus transaction
+@param com_target generic pointer to the emulated target
+@param address memory address to be written
+@param data pointer to the bytes to be written
+@param size number of bytes to be written
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_mem_set(void *com_target, uint16_t address, const uint8_t *data, uint16_t size);
+
+/**
+@brief Append data to the emulated SX1302 RX FIFO, as if received by the modems
+@param com_target generic pointer to the emulated target
+@param data pointer to the RX buffer formatted bytes
+@param size number of bytes to be appended
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_rx_push(void *com_target, const uint8_t *data, uint16_t size);
+
+/**
+@brief Get the bus transactions counters
+@param com_target generic pointer to the emulated target
+@param stats pointer to the structure to be filled
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_get_stats(void *com_target, struct lgw_sim_stats_s * stats);
+
+/**
+@brief Reset the bus transactions counters
+@param com_target generic pointer to the emulated target
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_reset_stats(void *com_target);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
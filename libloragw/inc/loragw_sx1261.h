@@ -52,11 +52,13 @@ int sx1261_load_pram(void);
 int sx1261_calibrate(uint32_t freq_hz);
 int sx1261_setup(void);
 int sx1261_set_rx_params(uint32_t freq_hz, uint8_t bandwidth);
+int sx1261_resume_rx(void);
 
 int sx1261_lbt_start(lgw_lbt_scan_time_t scan_time_us, int8_t threshold_dbm);
 int sx1261_lbt_stop(void);
 
 int sx1261_spectral_scan_start(uint16_t nb_scan);
+uint32_t sx1261_spectral_scan_duration_us(uint16_t nb_scan);
 int sx1261_spectral_scan_status(lgw_spectral_scan_status_t * status);
 int sx1261_spectral_scan_get_results(int8_t rssi_offset, int16_t * levels_dbm, uint16_t * results);
 int sx1261_spectral_scan_abort(void);
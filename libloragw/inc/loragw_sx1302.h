@@ -253,6 +253,13 @@ int sx1302_gps_enable(bool enable);
 */
 uint32_t sx1302_timestamp_counter(bool pps);
 
+/**
+@brief Get the current SX1302 internal counter value, extended to 64-bits
+@param pps      True for getting the counter value at last PPS
+@return the counter value in microseconds (64-bits, never wraps)
+*/
+uint64_t sx1302_timestamp_counter64(bool pps);
+
 /**
 @brief Load firmware to AGC MCU memory
 @param firmware A pointer to the fw binary to be loaded
@@ -351,6 +358,14 @@ uint8_t sx1302_arb_get_debug_stats_detect(uint8_t channel);
 */
 uint8_t sx1302_arb_get_debug_stats_alloc(uint8_t channel);
 
+/**
+@brief Read the detect and alloc ARB debug counters of all the multi-SF channels in a single burst
+@param nb_detect pointer to return the number of preambles detected, for the LGW_MULTI_NB channels
+@param nb_alloc pointer to return the number of demodulators allocated, for the LGW_MULTI_NB channels
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+int sx1302_arb_get_debug_stats(uint8_t * nb_detect, uint8_t * nb_alloc);
+
 /**
 @brief TODO
 @param TODO
@@ -373,6 +388,13 @@ uint16_t sx1302_lora_payload_crc(const uint8_t * data, uint8_t size);
 */
 int sx1302_fetch(uint8_t * nb_pkt);
 
+/**
+@brief Get the counters of the data lost while fetching and parsing the RX buffer
+@param  stats A pointer to the structure to be filled, the ARB counters are not modified
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+int sx1302_get_rx_stats(struct lgw_rx_stats_s * stats);
+
 /**
 @brief Parse and return the next packet available in rx_buffer.
 @param context      Gateway configuration context
@@ -44,7 +44,8 @@ typedef struct rx_packet_s {
     uint8_t     rx_rate_sf;                 /* LoRa only */
     uint8_t     modem_id;
     int32_t     frequency_offset_error;     /* LoRa only */
-    uint8_t     payload[255];
+    uint8_t     payload[255];               /* not filled by rx_buffer_pop_ref */
+    const uint8_t * payload_ref;            /* payload in the rx_buffer, valid until the next fetch */
     bool        payload_crc_error;
     bool        sync_error;                 /* LoRa only */
     bool        header_error;               /* LoRa only */
@@ -64,6 +65,19 @@ typedef struct rx_packet_s {
     uint8_t     packet_checksum;
 } rx_packet_t;
 
+/**
+@struct rx_buffer_stats_s
+@brief counters of the data lost while fetching and parsing the sx1302 RX buffer
+*/
+typedef struct rx_buffer_stats_s {
+    uint32_t nb_fetch;              /*!> number of fetches which returned data */
+    uint32_t nb_buffer_full;        /*!> number of fetches which found the RX buffer full */
+    uint32_t nb_resync;             /*!> number of corrupted regions skipped */
+    uint32_t nb_checksum_err;       /*!> number of packets with a wrong checksum or truncated */
+    uint32_t nb_bytes_discarded;    /*!> number of bytes fetched but not parsed */
+    uint32_t nb_pkt_lost;           /*!> number of packets in the bytes discarded (at least 1 per discard) */
+} rx_buffer_stats_t;
+
 /**
 @struct rx_buffer_s
 @brief buffer to hold the data fetched from the sx1302 RX buffer
@@ -73,6 +87,7 @@ typedef struct rx_buffer_s {
     uint16_t buffer_size;   /*!> The number of bytes currently stored in the buffer */
     int buffer_index;       /*!> Current parsing index in the buffer */
     uint8_t buffer_pkt_nb;
+    rx_buffer_stats_t stats; /*!> kept by rx_buffer_new and rx_buffer_del, cleared by rx_buffer_reset_stats */
 } rx_buffer_t;
 
 /* -------------------------------------------------------------------------- */
@@ -94,6 +109,7 @@ int rx_buffer_del(rx_buffer_t * self);
 
 /**
 @brief Fetch packets from the SX1302 internal RX buffer, and count packets available.
+The packets are checked (syncword, length and checksum), corrupted regions are skipped and the valid packets kept.
 @param self     A pointer to a rx_buffer handler
 @return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
 */
@@ -101,12 +117,28 @@ int rx_buffer_fetch(rx_buffer_t * self);
 
 /**
 @brief Parse the rx_buffer and return the first packet available in the given structure.
+The checksum is not checked again, rx_buffer_fetch only keeps the valid packets.
 @param self     A pointer to a rx_buffer handler
 @param pkt      A pointer to the structure to receive the packet parsed
-@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR if there is no more packet or it is truncated
 */
 int rx_buffer_pop(rx_buffer_t * self, rx_packet_t * pkt);
 
+/**
+@brief Same as rx_buffer_pop, without copying the payload: only pkt->payload_ref is set, pointing into the rx_buffer.
+@param self     A pointer to a rx_buffer handler
+@param pkt      A pointer to the structure to receive the packet parsed
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR if there is no more packet or it is truncated
+*/
+int rx_buffer_pop_ref(rx_buffer_t * self, rx_packet_t * pkt);
+
+/**
+@brief Clear the counters of the data lost
+@param self     A pointer to a rx_buffer handler
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+int rx_buffer_reset_stats(rx_buffer_t * self);
+
 /* -------------------------------------------------------------------------- */
 /* --- DEBUG FUNCTIONS PROTOTYPES ------------------------------------------- */
 
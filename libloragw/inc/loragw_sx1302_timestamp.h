@@ -47,11 +47,12 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 */
 struct timestamp_info_s {
     uint32_t counter_us_27bits_ref;     /* reference value (last read) */
-    uint8_t  counter_us_27bits_wrap;    /* rollover/wrap status */
+    uint32_t counter_us_27bits_wrap;    /* rollover/wrap status (number of rollovers since counter reset) */
 };
 typedef struct timestamp_counter_s {
     struct timestamp_info_s inst; /* holds current reference of the instantaneous counter */
     struct timestamp_info_s pps;  /* holds current reference of the pps-trigged counter */
+    uint32_t pps_reg;             /* raw 32MHz pps-trigged counter captured at last read, reference for fine timestamps */
 } timestamp_counter_t;
 
 /* -------------------------------------------------------------------------- */
@@ -97,8 +98,26 @@ uint32_t timestamp_counter_expand(timestamp_counter_t * self, bool pps, uint32_t
 */
 uint32_t timestamp_pkt_expand(timestamp_counter_t * self, uint32_t cnt_us);
 
+/**
+@brief Convert the 27-bits counter given by the SX1302 to a 64-bits counter which never wraps.
+@param self     Pointer to the counter handler
+@param pps      Set to true to expand the counter based on the PPS trig wrapping status
+@param cnt_us   The 27-bits counter to be expanded
+@return the 64-bits counter, its 32 LSBs are equal to the counter returned by timestamp_counter_expand()
+*/
+uint64_t timestamp_counter_expand64(timestamp_counter_t * self, bool pps, uint32_t cnt_us);
+
+/**
+@brief Convert the 27-bits packet timestamp to a 64-bits counter which never wraps.
+@param self     Pointer to the counter handler
+@param cnt_us   The packet 27-bits counter to be expanded
+@return the 64-bits counter, its 32 LSBs are equal to the counter returned by timestamp_pkt_expand()
+*/
+uint64_t timestamp_pkt_expand64(timestamp_counter_t * self, uint32_t cnt_us);
+
 /**
 @brief Reads the SX1302 internal counter register, and return the 32-bits 1 MHz counter
+@brief The raw PPS counter is also saved to the PPS history and kept in self->pps_reg for fine timestamping
 @param self     Pointer to the counter handler
 @param pps      Current value of the freerun counter
 @param pps      Current value of the PPS counter
@@ -106,6 +125,16 @@ uint32_t timestamp_pkt_expand(timestamp_counter_t * self, uint32_t cnt_us);
 */
 int timestamp_counter_get(timestamp_counter_t * self, uint32_t * inst, uint32_t * pps);
 
+/**
+@brief Estimate the current 64-bits 1 MHz freerun counter from the host clock, without bus access
+@brief The estimate is based on a linear model (offset and drift) refreshed at each timestamp_counter_get() call
+@brief This function is lock-free, it can be called from any thread
+@param inst     Pointer to store the estimated counter value
+@param err_us   Pointer to store the estimate error bound, in microseconds
+@return 0 if success, -1 if no estimate is available yet
+*/
+int timestamp_counter_estimate(uint64_t * inst, uint32_t * err_us);
+
 /**
 @brief Get the correction to applied to the LoRa packet timestamp (count_us)
 @param context          gateway configuration context
@@ -131,17 +160,24 @@ int32_t timestamp_counter_correction(lgw_context_t * context, uint8_t bandwidth,
 */
 int timestamp_counter_mode(bool ftime_enable);
 
+/**
+@brief Save a raw 32MHz PPS counter to the PPS history used for fine timestamping (done by timestamp_counter_get)
+@param timestamp_pps_reg The raw 32MHz PPS counter, ignored if equal to the last one saved
+*/
+void timestamp_pps_history_save(uint32_t timestamp_pps_reg);
+
 /**
 @brief Compute a precise timestamp (fine timestamp) based on given coarse timestamp, metrics given by sx1302 and current GW xtal drift
 @param ts_metrics_nb The number of timestamp metrics given in ts_metrics array
 @param ts_metrics An array containing timestamp metrics to compute fine timestamp
 @param pkt_coarse_tmst The packet coarse timestamp
+@param timestamp_pps_reg The raw 32MHz PPS counter captured after the packets were fetched (see timestamp_counter_get)
 @param sf packet spreading factor, used to shift timestamp from end of header to end of preamble
 @param if_freq_hz the IF frequency, to take into account DC noth delay
 @param result_ftime A pointer to store the resulting fine timestamp
 @return 0 if success, -1 otherwise
 */
-int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t pkt_coarse_tmst, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime);
+int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t pkt_coarse_tmst, uint32_t timestamp_pps_reg, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime);
 
 #endif
 
@@ -0,0 +1,107 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Virtual concentrator: synthetic uplink traffic model and TX timing
+    recorder, used by the HAL in place of the hardware when enabled.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_VIRT_H
+#define _LORAGW_VIRT_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types*/
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define VIRT_RX_BUFFER_SIZE     4096    /* size of the emulated SX1302 RX buffer, in bytes */
+#define VIRT_TEMPERATURE        25.0f   /* constant board temperature */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Check the virtual concentrator configuration, create the end-devices population and start the counter
+@param context the HAL context, for the virtual concentrator and RX channels configuration
+@return LGW_HAL_ERROR if the configuration is not valid, LGW_HAL_SUCCESS else
+*/
+int virt_start(const lgw_context_t * context);
+
+/**
+@brief Stop the virtual concentrator and release the end-devices population
+@return LGW_HAL_SUCCESS
+*/
+int virt_stop(void);
+
+/**
+@brief Return the packets received since the previous call, following the traffic model
+The packets arrived while the emulated RX buffer is full are dropped and counted as lost.
+@param context the HAL context, for the RX channels configuration
+@param max_pkt maximum number of packets to be returned, the next ones are kept for the next call
+@param pkt_data pointer to an array of max_pkt structures to receive the packets
+@return the number of packets returned, LGW_HAL_ERROR if the virtual concentrator is not started
+*/
+int virt_receive(const lgw_context_t * context, uint8_t max_pkt, struct lgw_pkt_rx_s * pkt_data);
+
+/**
+@brief Record the timing of a TX request, and emulate the TX status accordingly
+A timestamped packet programmed after its TX trigger time is counted as late and is not emitted.
+@param pkt_data the packet to be sent, already checked by lgw_send
+@param toa_us time on air of the packet, in microseconds
+@return LGW_HAL_SUCCESS
+*/
+int virt_send(const struct lgw_pkt_tx_s * pkt_data, uint32_t toa_us);
+
+/**
+@brief Get the emulated TX status of a RF chain
+@return TX_OFF, TX_FREE, TX_SCHEDULED or TX_EMITTING
+*/
+uint8_t virt_tx_status(uint8_t rf_chain);
+
+/**
+@brief Abort the TX scheduled or ongoing on a RF chain
+@return LGW_HAL_SUCCESS
+*/
+int virt_tx_abort(uint8_t rf_chain);
+
+/**
+@brief Get the emulated concentrator counter, derived from the host monotonic clock
+@param pps if true, return the counter latched on the last emulated PPS (every counter second)
+@return the 64-bit counter value, in microseconds since the virtual concentrator was started, or the host monotonic clock if host_counter is set
+*/
+uint64_t virt_counter(bool pps);
+
+/**
+@brief Get the emulated concentrator EUI, derived from the traffic model seed
+*/
+uint64_t virt_eui(void);
+
+/**
+@brief Get the RX losses counters of the emulated RX buffer
+*/
+int virt_get_rx_stats(struct lgw_rx_stats_s * stats);
+
+/**
+@brief Get the TX timing counters
+*/
+int virt_get_tx_stats(struct lgw_virt_tx_stats_s * stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
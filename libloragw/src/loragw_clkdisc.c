@@ -0,0 +1,192 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Clock discipline of a concentrator counter on GPS PPS captures.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <string.h>     /* memset */
+#include <math.h>       /* sqrt round */
+
+#include "loragw_clkdisc.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_GPS == 1
+    #define DEBUG_MSG(args...)  fprintf(stderr, args)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+#else
+    #define DEBUG_MSG(args...)
+    #define DEBUG_PRINTF(fmt, args...)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define CLKDISC_FREQ_INIT_STD   20E-6   /* frequency uncertainty before the first measurement (XTAL tolerance) */
+#define CLKDISC_FREQ_WANDER     1E-9    /* frequency random walk (temperature...), per sqrt(second) */
+#define CLKDISC_GATE_SIGMA      5.0     /* captures further from the prediction are aberrant */
+#define CLKDISC_REJECT_MAX      3       /* successive aberrant captures before restarting the tracking */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void lgw_clkdisc_init(struct lgw_clkdisc_s *cd, double tick_hz, double pps_jitter_s) {
+    if (cd == NULL) {
+        return;
+    }
+
+    memset(cd, 0, sizeof *cd);
+    cd->tick_hz = tick_hz;
+    cd->r_meas = (1.0 / 12.0) + ((pps_jitter_s * tick_hz) * (pps_jitter_s * tick_hz)); /* quantization + jitter */
+    cd->q_freq = CLKDISC_FREQ_WANDER * CLKDISC_FREQ_WANDER;
+    cd->freq = 1.0;
+    cd->p[1][1] = CLKDISC_FREQ_INIT_STD * CLKDISC_FREQ_INIT_STD;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_clkdisc_reset(struct lgw_clkdisc_s *cd) {
+    if (cd == NULL) {
+        return;
+    }
+
+    /* the XTAL frequency did not change, only the phase is lost */
+    cd->nb_update = 0;
+    cd->nb_reject = 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_clkdisc_update(struct lgw_clkdisc_s *cd, uint32_t cnt_pps) {
+    double (*p)[2];
+    double diff, period, n, nh;
+    double phase_pred, y, s, k0, k1;
+    double p00, p01, p10, p11;
+
+    if ((cd == NULL) || (cd->tick_hz <= 0)) {
+        return LGW_CLKDISC_ERROR;
+    }
+    p = cd->p;
+
+    /* first capture: phase reference */
+    if (cd->nb_update == 0) {
+        cd->cnt_last = cnt_pps;
+        cd->phase = 0.0;
+        p[0][0] = cd->r_meas;
+        p[0][1] = 0.0;
+        p[1][0] = 0.0;
+        cd->nb_update = 1;
+        cd->nb_reject = 0;
+        return LGW_CLKDISC_SUCCESS;
+    }
+
+    /* number of PPS pulses since the last capture (may be more than 1 after a GPS loss) */
+    diff = (double)(uint32_t)(cnt_pps - cd->cnt_last);
+    period = cd->tick_hz * cd->freq;
+    n = round((diff - cd->phase) / period);
+    if (n < 1.0) {
+        DEBUG_PRINTF("WARNING: PPS capture too close to the previous one (%u, %u)\n", cnt_pps, cd->cnt_last);
+        return LGW_CLKDISC_ERROR;
+    }
+
+    /* predict: phase += n * period, with a frequency random walk */
+    nh = n * cd->tick_hz;
+    phase_pred = cd->phase + (n * period);
+    p00 = p[0][0] + (2.0 * nh * p[0][1]) + (nh * nh * p[1][1]) + (cd->q_freq * nh * nh * n / 3.0);
+    p01 = p[0][1] + (nh * p[1][1]) + (cd->q_freq * nh * n / 2.0);
+    p10 = p01;
+    p11 = p[1][1] + (cd->q_freq * n);
+
+    /* innovation and gating */
+    y = diff - phase_pred;
+    s = p00 + cd->r_meas;
+    if ((y * y) > (CLKDISC_GATE_SIGMA * CLKDISC_GATE_SIGMA * s)) {
+        cd->nb_reject += 1;
+        DEBUG_PRINTF("WARNING: aberrant PPS capture (%.1f ticks from prediction, sigma %.1f)\n", y, sqrt(s));
+        if (cd->nb_reject < CLKDISC_REJECT_MAX) {
+            return LGW_CLKDISC_ERROR;
+        }
+        /* restart phase tracking on this capture */
+        DEBUG_MSG("WARNING: clock discipline restarted\n");
+        cd->nb_update = 0;
+        return lgw_clkdisc_update(cd, cnt_pps);
+    }
+
+    /* update */
+    k0 = p00 / s;
+    k1 = p10 / s;
+    cd->phase = phase_pred + (k0 * y) - diff; /* now relative to cnt_pps */
+    cd->freq += k1 * y;
+    p[0][0] = (1.0 - k0) * p00;
+    p[0][1] = (1.0 - k0) * p01;
+    p[1][0] = p10 - (k1 * p00);
+    p[1][1] = p11 - (k1 * p01);
+
+    cd->cnt_last = cnt_pps;
+    cd->nb_update += 1;
+    cd->nb_reject = 0;
+
+    return LGW_CLKDISC_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool lgw_clkdisc_get(const struct lgw_clkdisc_s *cd, double *freq, double *freq_std, double *phase_std) {
+    if ((cd == NULL) || (cd->nb_update < 2)) {
+        return false;
+    }
+
+    if (freq != NULL) {
+        *freq = cd->freq;
+    }
+    if (freq_std != NULL) {
+        *freq_std = sqrt(cd->p[1][1]);
+    }
+    if (phase_std != NULL) {
+        *phase_std = sqrt(cd->p[0][0]);
+    }
+
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_clkdisc_pps_correction(const struct lgw_clkdisc_s *cd, uint32_t cnt_pps, double *corr) {
+    double diff, period, n, c;
+
+    if ((cd == NULL) || (corr == NULL) || (cd->nb_update < 2)) {
+        return LGW_CLKDISC_ERROR;
+    }
+
+    /* filtered phase of the PPS pulse closest to the capture */
+    diff = (double)(int32_t)(cnt_pps - cd->cnt_last);
+    period = cd->tick_hz * cd->freq;
+    n = round((diff - cd->phase) / period);
+    c = cd->phase + (n * period) - diff;
+
+    /* check that the capture is one of the tracked pulses */
+    if ((c * c) > (CLKDISC_GATE_SIGMA * CLKDISC_GATE_SIGMA * (cd->p[0][0] + cd->r_meas + (n * n * cd->tick_hz * cd->tick_hz * cd->p[1][1])))) {
+        return LGW_CLKDISC_ERROR;
+    }
+
+    *corr = c;
+    return LGW_CLKDISC_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
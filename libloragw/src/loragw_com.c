@@ -24,6 +24,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_com.h"
 #include "loragw_usb.h"
 #include "loragw_spi.h"
+#include "loragw_sim.h"
 #include "loragw_aux.h"
 
 /* -------------------------------------------------------------------------- */
@@ -64,7 +65,7 @@ int lgw_com_open(lgw_com_type_t com_type, const char * com_path) {
 
     /* Check input parameters */
     CHECK_NULL(com_path);
-    if ((com_type != LGW_COM_SPI) && (com_type != LGW_COM_USB)) {
+    if ((com_type != LGW_COM_SPI) && (com_type != LGW_COM_USB) && (com_type != LGW_COM_SIM)) {
         DEBUG_MSG("ERROR: COMMUNICATION INTERFACE TYPE IS NOT SUPPORTED\n");
         return LGW_COM_ERROR;
     }
@@ -86,6 +87,10 @@ int lgw_com_open(lgw_com_type_t com_type, const char * com_path) {
             printf("Opening USB communication interface\n");
             com_stat = lgw_usb_open(com_path, &_lgw_com_target);
             break;
+        case LGW_COM_SIM:
+            printf("Opening SIM communication interface\n");
+            com_stat = lgw_sim_open(com_path, &_lgw_com_target);
+            break;
         default:
             com_stat = LGW_COM_ERROR;
             break;
@@ -114,6 +119,10 @@ int lgw_com_close(void) {
             printf("Closing USB communication interface\n");
             com_stat = lgw_usb_close(_lgw_com_target);
             break;
+        case LGW_COM_SIM:
+            printf("Closing SIM communication interface\n");
+            com_stat = lgw_sim_close(_lgw_com_target);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -146,6 +155,9 @@ int lgw_com_w(uint8_t spi_mux_target, uint16_t address, uint8_t data) {
         case LGW_COM_USB:
             com_stat = lgw_usb_w(_lgw_com_target, spi_mux_target, address, data);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_w(_lgw_com_target, spi_mux_target, address, data);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -180,6 +192,9 @@ int lgw_com_r(uint8_t spi_mux_target, uint16_t address, uint8_t *data) {
         case LGW_COM_USB:
             com_stat = lgw_usb_r(_lgw_com_target, spi_mux_target, address, data);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_r(_lgw_com_target, spi_mux_target, address, data);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -212,6 +227,9 @@ int lgw_com_rmw(uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t
         case LGW_COM_USB:
             com_stat = lgw_usb_rmw(_lgw_com_target, address, offs, leng, data);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_rmw(_lgw_com_target, spi_mux_target, address, offs, leng, data);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -246,6 +264,9 @@ int lgw_com_wb(uint8_t spi_mux_target, uint16_t address, const uint8_t *data, ui
         case LGW_COM_USB:
             com_stat = lgw_usb_wb(_lgw_com_target, spi_mux_target, address, data, size);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_wb(_lgw_com_target, spi_mux_target, address, data, size);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -280,6 +301,9 @@ int lgw_com_rb(uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t
         case LGW_COM_USB:
             com_stat = lgw_usb_rb(_lgw_com_target, spi_mux_target, address, data, size);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_rb(_lgw_com_target, spi_mux_target, address, data, size);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -304,6 +328,9 @@ int lgw_com_set_write_mode(lgw_com_write_mode_t write_mode) {
         case LGW_COM_USB:
             com_stat = lgw_usb_set_write_mode(write_mode);
             break;
+        case LGW_COM_SIM:
+            /* Do nothing: no bulk mode for the software interface */
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -325,6 +352,9 @@ int lgw_com_flush(void) {
         case LGW_COM_USB:
             com_stat = lgw_usb_flush(_lgw_com_target);
             break;
+        case LGW_COM_SIM:
+            /* Do nothing: no bulk mode for the software interface */
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -343,6 +373,8 @@ uint16_t lgw_com_chunk_size(void) {
         case LGW_COM_USB:
             return lgw_usb_chunk_size();
             break;
+        case LGW_COM_SIM:
+            return lgw_sim_chunk_size();
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             return 0;
@@ -362,6 +394,8 @@ int lgw_com_get_temperature(float * temperature) {
             return -1;
         case LGW_COM_USB:
             return lgw_usb_get_temperature(_lgw_com_target, temperature);
+        case LGW_COM_SIM:
+            return lgw_sim_get_temperature(_lgw_com_target, temperature);
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             return LGW_COM_ERROR;
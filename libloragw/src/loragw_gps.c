@@ -28,9 +28,10 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <time.h>       /* struct timespec */
 #include <fcntl.h>      /* open */
 #include <termios.h>    /* tcflush */
-#include <math.h>       /* modf */
+#include <math.h>       /* modf lround llround */
 
 #include "loragw_gps.h"
+#include "loragw_clkdisc.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -59,6 +60,36 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define UBX_MSG_NAVTIMEGPS_LEN  16
 
+#define PPS_JITTER_S            30E-9   /* typical timepulse jitter of a GPS module */
+#define XTAL_ERR_STD_UNKNOWN    (PLUS_10PPM - 1.0)
+
+#define UBX_MAX_PAYLOAD_LEN     1024    /* longer frames are considered corrupted */
+#define NMEA_MAX_LEN            255     /* same limit as lgw_parse_nmea */
+
+/* states of the stream parser */
+enum gps_parser_state_e {
+    PARSER_IDLE,        /* looking for a sync char */
+    PARSER_UBX_SYNC2,
+    PARSER_UBX_CLASS,
+    PARSER_UBX_ID,
+    PARSER_UBX_LEN1,
+    PARSER_UBX_LEN2,
+    PARSER_UBX_PAYLOAD,
+    PARSER_UBX_CK_A,
+    PARSER_UBX_CK_B,
+    PARSER_NMEA_DATA,   /* from the char after '$' until '*' */
+    PARSER_NMEA_CK1,
+    PARSER_NMEA_CK2
+};
+
+/* NMEA fields decoded by the stream parser */
+#define FIELD_OK_TIME   0x01
+#define FIELD_OK_DATE   0x02
+#define FIELD_OK_LAT    0x04
+#define FIELD_OK_LON    0x08
+#define FIELD_OK_ALT    0x10
+#define FIELD_OK_SAT    0x20
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
@@ -90,6 +121,10 @@ static short gps_sat = 0; /* number of satellites used for fix */
 
 static struct termios ttyopt_restore;
 
+/* clock discipline of the 1MHz counter on PPS, for lgw_gps_sync */
+static struct lgw_clkdisc_s gps_clkdisc;
+static bool gps_clkdisc_init = false;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
@@ -103,6 +138,22 @@ static bool match_label(const char *s, char *label, int size, char wildcard);
 
 static int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx);
 
+static int hexchar_to_nibble(uint8_t c);
+
+static void parser_field_char(struct lgw_gps_field_s *f, uint8_t c);
+
+static bool parser_field_degrees(const struct lgw_gps_field_s *f, int deg_len, short *deg, double *min);
+
+static void parser_nmea_field_end(struct lgw_gps_parser_s *p);
+
+static enum gps_msg parser_nmea_end(struct lgw_gps_parser_s *p);
+
+static enum gps_msg parser_ubx_end(struct lgw_gps_parser_s *p);
+
+static void days_to_civil(int64_t days, int *year, int *month, int *day);
+
+static char * write_digits(char *s, uint32_t val, int nb_digits);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -248,6 +299,300 @@ int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx)
     return j;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Return the value of an upper case hexadecimal character (as generated by
+nmea_checksum), -1 otherwise
+*/
+static int hexchar_to_nibble(uint8_t c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    } else if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    } else {
+        return -1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Accumulate one character of a NMEA field, as a decimal number if possible
+*/
+static void parser_field_char(struct lgw_gps_field_s *f, uint8_t c) {
+    if (f->len == 0) {
+        f->first = (char)c;
+    }
+    if (f->len < 255) {
+        f->len += 1;
+    }
+
+    if ((c >= '0') && (c <= '9')) {
+        if (f->dot == false) {
+            if (f->int_len < 9) {
+                f->int_val = (f->int_val * 10) + (c - '0');
+                f->int_len += 1;
+            } else {
+                f->bad = true;
+            }
+        } else if (f->frac_len < 9) { /* ignore extra precision */
+            f->frac_val = (f->frac_val * 10) + (c - '0');
+            f->frac_len += 1;
+        }
+    } else if ((c == '.') && (f->dot == false)) {
+        f->dot = true;
+    } else if ((c == '-') && (f->len == 1)) {
+        f->neg = true;
+    } else {
+        f->bad = true;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Split a NMEA (d)ddmm.mmmm field in degrees and minutes, the same way as the
+"%2hd%10lf" / "%3hd%10lf" formats of lgw_parse_nmea (bit-exact minutes)
+*/
+static bool parser_field_degrees(const struct lgw_gps_field_s *f, int deg_len, short *deg, double *min) {
+    static const double pow10[10] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    uint32_t div = 1;
+    uint64_t mant;
+    int min_len = f->int_len - deg_len; /* number of digits of the integer part of minutes */
+    int frac_len = f->frac_len;
+    uint64_t frac_val = f->frac_val;
+    int i;
+
+    if (f->bad || f->neg || (min_len < 1)) {
+        return false;
+    }
+
+    /* %10lf reads at most 10 characters of minutes */
+    if (f->dot) {
+        while ((frac_len > 0) && ((min_len + 1 + frac_len) > 10)) {
+            frac_val /= 10;
+            frac_len -= 1;
+        }
+    }
+
+    for (i = 0; i < min_len; i++) {
+        div *= 10;
+    }
+    *deg = (short)(f->int_val / div);
+    mant = (uint64_t)(f->int_val % div);
+    for (i = 0; i < frac_len; i++) {
+        mant *= 10;
+    }
+    /* exact mantissa divided by an exact power of 10: correctly rounded, as strtod */
+    *min = (double)(mant + frac_val) / pow10[frac_len];
+
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Decode the NMEA field just completed, if it is one of interest
+*/
+static void parser_nmea_field_end(struct lgw_gps_parser_s *p) {
+    struct lgw_gps_field_s *f = &(p->fld);
+    uint32_t frac;
+    int i;
+
+    if (p->field == 0) {
+        /* address field: $G?RMC / $G?GGA */
+        if ((f->len == 5) && (p->label[0] == 'G')) {
+            if (memcmp(&(p->label[2]), "RMC", 3) == 0) {
+                p->nmea_type = NMEA_RMC;
+            } else if (memcmp(&(p->label[2]), "GGA", 3) == 0) {
+                p->nmea_type = NMEA_GGA;
+            }
+        }
+    } else if (p->nmea_type == NMEA_RMC) {
+        switch (p->field) {
+            case 1: /* time hhmmss.ss */
+                if (!f->bad && !f->neg && (f->int_len == 6) && (f->frac_len > 0)) {
+                    p->hou = (short)(f->int_val / 10000);
+                    p->min = (short)((f->int_val / 100) % 100);
+                    p->sec = (short)(f->int_val % 100);
+                    /* "%4f" reads the decimal point and at most 3 digits */
+                    frac = (uint32_t)f->frac_val;
+                    for (i = f->frac_len; i > 3; i--) {
+                        frac /= 10;
+                    }
+                    p->fra = (float)((double)frac / ((i == 1) ? 1e1 : ((i == 2) ? 1e2 : 1e3)));
+                    p->ok |= FIELD_OK_TIME;
+                }
+                break;
+            case 9: /* date ddmmyy */
+                if (!f->bad && !f->neg && !f->dot && (f->int_len == 6)) {
+                    p->day = (short)(f->int_val / 10000);
+                    p->mon = (short)((f->int_val / 100) % 100);
+                    p->yea = (short)(f->int_val % 100);
+                    p->ok |= FIELD_OK_DATE;
+                }
+                break;
+            case 12: /* mode */
+                p->mod = (f->len > 0) ? f->first : 'N';
+                break;
+            default:
+                break;
+        }
+    } else if (p->nmea_type == NMEA_GGA) {
+        switch (p->field) {
+            case 2: /* latitude ddmm.mmmm */
+                if (parser_field_degrees(f, 2, &(p->dla), &(p->mla))) {
+                    p->ok |= FIELD_OK_LAT;
+                }
+                break;
+            case 3:
+                p->ola = (f->len > 0) ? f->first : 0;
+                break;
+            case 4: /* longitude dddmm.mmmm */
+                if (parser_field_degrees(f, 3, &(p->dlo), &(p->mlo))) {
+                    p->ok |= FIELD_OK_LON;
+                }
+                break;
+            case 5:
+                p->olo = (f->len > 0) ? f->first : 0;
+                break;
+            case 7: /* number of satellites, "%hd" */
+                if (f->int_len > 0) {
+                    p->sat = (short)f->int_val;
+                    p->ok |= FIELD_OK_SAT;
+                }
+                break;
+            case 9: /* altitude, "%hd" keeps the integer part */
+                if (f->int_len > 0) {
+                    p->alt = (short)(f->neg ? -(int32_t)f->int_val : (int32_t)f->int_val);
+                    p->ok |= FIELD_OK_ALT;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    memset(f, 0, sizeof *f);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Commit the NMEA sentence just verified, same rules as lgw_parse_nmea
+*/
+static enum gps_msg parser_nmea_end(struct lgw_gps_parser_s *p) {
+    int nb_fields = p->field + 1;
+
+    if (p->nmea_type == NMEA_RMC) {
+        if ((nb_fields != 13) && (nb_fields != 14)) {
+            DEBUG_MSG("Warning: invalid RMC sentence (number of fields)\n");
+            return IGNORED;
+        }
+        gps_mod = p->mod;
+        if ((gps_mod != 'N') && (gps_mod != 'A') && (gps_mod != 'D')) {
+            gps_mod = 'N';
+        }
+        if ((p->ok & (FIELD_OK_TIME | FIELD_OK_DATE)) == (FIELD_OK_TIME | FIELD_OK_DATE)) {
+            gps_hou = p->hou;
+            gps_min = p->min;
+            gps_sec = p->sec;
+            gps_fra = p->fra;
+            gps_day = p->day;
+            gps_mon = p->mon;
+            gps_yea = p->yea;
+            gps_time_ok = ((gps_mod == 'A') || (gps_mod == 'D'));
+        } else {
+            gps_time_ok = false;
+        }
+        return NMEA_RMC;
+    } else if (p->nmea_type == NMEA_GGA) {
+        if (nb_fields != 15) {
+            DEBUG_MSG("Warning: invalid GGA sentence (number of fields)\n");
+            return IGNORED;
+        }
+        if (p->ok & FIELD_OK_SAT) {
+            gps_sat = p->sat;
+        }
+        if (((p->ok & (FIELD_OK_LAT | FIELD_OK_LON | FIELD_OK_ALT)) == (FIELD_OK_LAT | FIELD_OK_LON | FIELD_OK_ALT)) && ((p->ola == 'N') || (p->ola == 'S')) && ((p->olo == 'E') || (p->olo == 'W'))) {
+            gps_dla = p->dla;
+            gps_mla = p->mla;
+            gps_ola = p->ola;
+            gps_dlo = p->dlo;
+            gps_mlo = p->mlo;
+            gps_olo = p->olo;
+            gps_alt = p->alt;
+            gps_pos_ok = true;
+        } else {
+            gps_pos_ok = false;
+        }
+        return NMEA_GGA;
+    } else {
+        return IGNORED;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Commit the UBX frame just verified, same rules as lgw_parse_ubx
+*/
+static enum gps_msg parser_ubx_end(struct lgw_gps_parser_s *p) {
+    const uint8_t *pl = p->ubx_payload;
+
+    if ((p->ubx_class == 0x01) && (p->ubx_id == 0x20) && (p->len >= 12)) {
+        if (pl[11] & 0x3) { /* towValid, weekValid */
+            gps_iTOW = (uint32_t)pl[0] | ((uint32_t)pl[1] << 8) | ((uint32_t)pl[2] << 16) | ((uint32_t)pl[3] << 24);
+            gps_fTOW = (int32_t)((uint32_t)pl[4] | ((uint32_t)pl[5] << 8) | ((uint32_t)pl[6] << 16) | ((uint32_t)pl[7] << 24));
+            gps_week = (int16_t)((uint16_t)pl[8] | ((uint16_t)pl[9] << 8));
+            gps_time_ok = true;
+        } else {
+            gps_time_ok = false;
+        }
+        return UBX_NAV_TIMEGPS;
+    }
+
+    return IGNORED;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Convert a number of days since 1970-01-01 to a proleptic Gregorian calendar
+date (same result as gmtime)
+*/
+static void days_to_civil(int64_t days, int *year, int *month, int *day) {
+    int64_t era, z;
+    uint32_t doe, yoe, doy, mp;
+
+    z = days + 719468; /* shift epoch to 0000-03-01 */
+    era = ((z >= 0) ? z : (z - 146096)) / 146097;
+    doe = (uint32_t)(z - (era * 146097));                           /* [0, 146096] */
+    yoe = (doe - (doe / 1460) + (doe / 36524) - (doe / 146096)) / 365; /* [0, 399] */
+    doy = doe - ((365 * yoe) + (yoe / 4) - (yoe / 100));            /* [0, 365] */
+    mp = ((5 * doy) + 2) / 153;                                     /* [0, 11] */
+    *day = (int)(doy - (((153 * mp) + 2) / 5) + 1);                 /* [1, 31] */
+    *month = (int)((mp < 10) ? (mp + 3) : (mp - 9));                /* [1, 12] */
+    *year = (int)((int64_t)yoe + (era * 400) + ((*month <= 2) ? 1 : 0));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Write a zero-padded decimal number, return a pointer after the last digit
+*/
+static char * write_digits(char *s, uint32_t val, int nb_digits) {
+    int i;
+
+    for (i = nb_digits - 1; i >= 0; i--) {
+        s[i] = (char)('0' + (val % 10));
+        val /= 10;
+    }
+
+    return s + nb_digits;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
@@ -598,6 +943,178 @@ enum gps_msg lgw_parse_nmea(const char *serial_buff, int buff_size) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+void lgw_gps_parser_init(struct lgw_gps_parser_s *parser) {
+    if (parser != NULL) {
+        memset(parser, 0, sizeof *parser);
+        parser->state = PARSER_IDLE;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+enum gps_msg lgw_gps_parse_stream(struct lgw_gps_parser_s *parser, const uint8_t *buff, size_t buff_size, size_t *nb_parsed) {
+    struct lgw_gps_parser_s *p = parser;
+    size_t i = 0;
+    uint8_t c;
+    int nibble;
+
+    /* check input parameters */
+    if ((parser == NULL) || (buff == NULL) || (nb_parsed == NULL)) {
+        if (nb_parsed != NULL) {
+            *nb_parsed = buff_size;
+        }
+        return IGNORED;
+    }
+
+    while (i < buff_size) {
+        c = buff[i];
+        switch (p->state) {
+            case PARSER_IDLE:
+                if (c == LGW_GPS_UBX_SYNC_CHAR) {
+                    p->state = PARSER_UBX_SYNC2;
+                } else if (c == LGW_GPS_NMEA_SYNC_CHAR) {
+                    p->nmea_type = IGNORED;
+                    p->len = 1;
+                    p->ck_a = 0;
+                    p->field = 0;
+                    p->ok = 0;
+                    p->mod = 'N';
+                    memset(&(p->fld), 0, sizeof p->fld);
+                    p->state = PARSER_NMEA_DATA;
+                }
+                break;
+
+            /* UBX frame: B5 62 class id len(2, LE) payload ck_a ck_b */
+            case PARSER_UBX_SYNC2:
+                if (c != 0x62) {
+                    p->state = PARSER_IDLE;
+                    continue; /* may be a sync char itself */
+                }
+                p->ck_a = 0;
+                p->ck_b = 0;
+                p->state = PARSER_UBX_CLASS;
+                break;
+            case PARSER_UBX_CLASS:
+            case PARSER_UBX_ID:
+            case PARSER_UBX_LEN1:
+            case PARSER_UBX_LEN2:
+            case PARSER_UBX_PAYLOAD:
+                /* 8-bit Fletcher checksum */
+                p->ck_a += c;
+                p->ck_b += p->ck_a;
+                if (p->state == PARSER_UBX_CLASS) {
+                    p->ubx_class = c;
+                    p->state = PARSER_UBX_ID;
+                } else if (p->state == PARSER_UBX_ID) {
+                    p->ubx_id = c;
+                    p->state = PARSER_UBX_LEN1;
+                } else if (p->state == PARSER_UBX_LEN1) {
+                    p->len = c;
+                    p->state = PARSER_UBX_LEN2;
+                } else if (p->state == PARSER_UBX_LEN2) {
+                    p->len |= (uint16_t)c << 8;
+                    p->idx = 0;
+                    if (p->len > UBX_MAX_PAYLOAD_LEN) {
+                        DEBUG_MSG("ERROR: UBX message is corrupted, length too big\n");
+                        p->state = PARSER_IDLE;
+                        *nb_parsed = i + 1;
+                        return INVALID;
+                    }
+                    p->state = (p->len > 0) ? PARSER_UBX_PAYLOAD : PARSER_UBX_CK_A;
+                } else {
+                    if (p->idx < sizeof p->ubx_payload) {
+                        p->ubx_payload[p->idx] = c;
+                    }
+                    p->idx += 1;
+                    if (p->idx == p->len) {
+                        p->state = PARSER_UBX_CK_A;
+                    }
+                }
+                break;
+            case PARSER_UBX_CK_A:
+                if (c != p->ck_a) {
+                    DEBUG_MSG("ERROR: UBX message is corrupted, checksum failed\n");
+                    p->state = PARSER_IDLE;
+                    *nb_parsed = i + 1;
+                    return INVALID;
+                }
+                p->state = PARSER_UBX_CK_B;
+                break;
+            case PARSER_UBX_CK_B:
+                p->state = PARSER_IDLE;
+                *nb_parsed = i + 1;
+                if (c != p->ck_b) {
+                    DEBUG_MSG("ERROR: UBX message is corrupted, checksum failed\n");
+                    return INVALID;
+                }
+                return parser_ubx_end(p);
+
+            /* NMEA sentence: $<address>,<field>,...,<field>*hh<CR><LF> */
+            case PARSER_NMEA_DATA:
+                if ((c < 0x20) || (c >= 0x7F) || (c == LGW_GPS_NMEA_SYNC_CHAR) || (p->len >= NMEA_MAX_LEN)) {
+                    /* truncated sentence, let the new frame be parsed */
+                    DEBUG_MSG("Warning: invalid NMEA sentence (truncated)\n");
+                    p->state = PARSER_IDLE;
+                    *nb_parsed = i;
+                    return INVALID;
+                }
+                p->len += 1;
+                if (c == '*') {
+                    parser_nmea_field_end(p);
+                    p->state = PARSER_NMEA_CK1;
+                    break;
+                }
+                p->ck_a ^= c;
+                if (c == ',') {
+                    parser_nmea_field_end(p);
+                    if (p->field < 255) {
+                        p->field += 1;
+                    }
+                } else if (p->field == 0) {
+                    if (p->fld.len < sizeof p->label) {
+                        p->label[p->fld.len] = (char)c;
+                    }
+                    p->fld.len += (p->fld.len < 255) ? 1 : 0;
+                } else if (p->nmea_type != IGNORED) {
+                    parser_field_char(&(p->fld), c);
+                }
+                break;
+            case PARSER_NMEA_CK1:
+            case PARSER_NMEA_CK2:
+                nibble = hexchar_to_nibble(c);
+                if (nibble < 0) {
+                    DEBUG_MSG("Warning: invalid NMEA sentence (bad checksum)\n");
+                    p->state = PARSER_IDLE;
+                    *nb_parsed = i;
+                    return INVALID;
+                }
+                if (p->state == PARSER_NMEA_CK1) {
+                    p->ck_b = (uint8_t)(nibble << 4);
+                    p->state = PARSER_NMEA_CK2;
+                    break;
+                }
+                p->ck_b |= (uint8_t)nibble;
+                p->state = PARSER_IDLE;
+                *nb_parsed = i + 1;
+                if (p->ck_a != p->ck_b) {
+                    DEBUG_MSG("Warning: invalid NMEA sentence (bad checksum)\n");
+                    return INVALID;
+                }
+                return parser_nmea_end(p);
+
+            default:
+                p->state = PARSER_IDLE;
+                break;
+        }
+        i += 1;
+    }
+
+    *nb_parsed = buff_size;
+    return INCOMPLETE;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s *loc, struct coord_s *err) {
     struct tm x;
     time_t y;
@@ -665,6 +1182,7 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
     double cnt_diff; /* internal concentrator time difference (in seconds) */
     double utc_diff; /* UTC time difference (in seconds) */
     double slope; /* time slope between new reference and old reference (for sanity check) */
+    double freq, freq_std, corr; /* clock discipline estimates */
 
     bool aber_n0; /* is the update value for synchronization aberrant or not ? */
     static bool aber_min1 = false; /* keep track of whether value at sync N-1 was aberrant or not  */
@@ -672,6 +1190,11 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
 
     CHECK_NULL(ref);
 
+    if (gps_clkdisc_init == false) {
+        lgw_clkdisc_init(&gps_clkdisc, TS_CPS, PPS_JITTER_S);
+        gps_clkdisc_init = true;
+    }
+
     /* calculate the slope */
 
     cnt_diff = (double)(count_us - ref->count_us) / (double)(TS_CPS); /* uncorrected by xtal_err */
@@ -691,16 +1214,32 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
         aber_n0 = true;
     }
 
+    /* track the PPS timestamps, the clock discipline rejects the ones too far from its prediction */
+    if (aber_n0 == false) {
+        if (lgw_clkdisc_update(&gps_clkdisc, count_us) != LGW_CLKDISC_SUCCESS) {
+            DEBUG_MSG("Warning: PPS timestamp rejected by clock discipline\n");
+            aber_n0 = true;
+        }
+    }
+
     /* watch if the 3 latest sync point were aberrant or not */
     if (aber_n0 == false) {
-        /* value no aberrant -> sync with smoothed slope */
+        /* value no aberrant -> sync with filtered PPS phase and XTAL error */
         ref->systime = time(NULL);
-        ref->count_us = count_us;
         ref->utc.tv_sec = utc.tv_sec;
         ref->utc.tv_nsec = utc.tv_nsec;
         ref->gps.tv_sec = gps_time.tv_sec;
         ref->gps.tv_nsec = gps_time.tv_nsec;
-        ref->xtal_err = slope;
+        if ((lgw_clkdisc_get(&gps_clkdisc, &freq, &freq_std, NULL) == true) && (lgw_clkdisc_pps_correction(&gps_clkdisc, count_us, &corr) == LGW_CLKDISC_SUCCESS)) {
+            ref->count_us = count_us + (uint32_t)(int32_t)lround(corr);
+            ref->xtal_err = freq;
+            ref->xtal_err_std = freq_std;
+        } else {
+            /* clock discipline not tracking yet, use raw values */
+            ref->count_us = count_us;
+            ref->xtal_err = slope;
+            ref->xtal_err_std = XTAL_ERR_STD_UNKNOWN;
+        }
         aber_min2 = aber_min1;
         aber_min1 = aber_n0;
         return LGW_GPS_SUCCESS;
@@ -716,6 +1255,10 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
         if ((ref->xtal_err > PLUS_10PPM) || (ref->xtal_err < MINUS_10PPM)) {
             ref->xtal_err = 1.0;
         }
+        ref->xtal_err_std = XTAL_ERR_STD_UNKNOWN;
+        /* restart the PPS tracking from this timestamp */
+        lgw_clkdisc_reset(&gps_clkdisc);
+        lgw_clkdisc_update(&gps_clkdisc, count_us);
         DEBUG_MSG("Warning: 3 successive aberrant sync attempts, sync reset\n");
         aber_min2 = aber_min1;
         aber_min1 = aber_n0;
@@ -813,6 +1356,83 @@ int lgw_cnt2gps(struct tref ref, uint32_t count_us, struct timespec *gps_time) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_cnt2time_batch(struct tref ref, const uint32_t *count_us, unsigned int nb, struct timespec *utc, struct timespec *gps_time, char utc_iso[][LGW_GPS_ISO8601_SIZE]) {
+    int64_t corr_q32; /* 1E3/xtal_err - 1E3, in ns per us, Q32 */
+    int64_t delta_ns;
+    int64_t t_ns;
+    int64_t days, day_cached = INT64_MIN;
+    int64_t sec;
+    uint32_t sod; /* second of day */
+    uint32_t delta_us;
+    int year = 0, month = 0, day = 0;
+    char date[11]; /* "YYYY-MM-DD" */
+    char *s;
+    unsigned int i;
+
+    CHECK_NULL(count_us);
+    if ((ref.systime == 0) || (ref.xtal_err > PLUS_10PPM) || (ref.xtal_err < MINUS_10PPM)) {
+        DEBUG_MSG("ERROR: INVALID REFERENCE FOR CNT -> UTC/GPS CONVERSION\n");
+        return LGW_GPS_ERROR;
+    }
+
+    /* the correction is below 10ppm: |corr| < 0.01ns/us, so delta_us * corr_q32 fits in 64 bits */
+    corr_q32 = llround(((1E3 / ref.xtal_err) - 1E3) * 4294967296.0);
+
+    for (i = 0; i < nb; i++) {
+        /* delta in ns between reference count_us and target count_us (unsigned difference, as lgw_cnt2utc) */
+        delta_us = count_us[i] - ref.count_us;
+        delta_ns = ((int64_t)delta_us * 1000) + (((int64_t)delta_us * corr_q32) >> 32);
+
+        if (gps_time != NULL) {
+            t_ns = (int64_t)ref.gps.tv_nsec + delta_ns;
+            gps_time[i].tv_sec = ref.gps.tv_sec + (time_t)(t_ns / 1000000000);
+            gps_time[i].tv_nsec = (long)(t_ns % 1000000000);
+        }
+
+        if ((utc == NULL) && (utc_iso == NULL)) {
+            continue;
+        }
+        t_ns = (int64_t)ref.utc.tv_nsec + delta_ns;
+        sec = (int64_t)ref.utc.tv_sec + (t_ns / 1000000000);
+        t_ns = t_ns % 1000000000;
+        if (utc != NULL) {
+            utc[i].tv_sec = (time_t)sec;
+            utc[i].tv_nsec = (long)t_ns;
+        }
+
+        if (utc_iso != NULL) {
+            days = ((sec >= 0) ? sec : (sec - 86399)) / 86400;
+            sod = (uint32_t)(sec - (days * 86400));
+            if (days != day_cached) {
+                days_to_civil(days, &year, &month, &day);
+                s = write_digits(date, (uint32_t)year, 4);
+                *s++ = '-';
+                s = write_digits(s, (uint32_t)month, 2);
+                *s++ = '-';
+                write_digits(s, (uint32_t)day, 2);
+                day_cached = days;
+            }
+            s = utc_iso[i];
+            memcpy(s, date, 10);
+            s += 10;
+            *s++ = 'T';
+            s = write_digits(s, sod / 3600, 2);
+            *s++ = ':';
+            s = write_digits(s, (sod / 60) % 60, 2);
+            *s++ = ':';
+            s = write_digits(s, sod % 60, 2);
+            *s++ = '.';
+            s = write_digits(s, (uint32_t)(t_ns / 1000), 6);
+            *s++ = 'Z';
+            *s = '\0';
+        }
+    }
+
+    return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_gps2cnt(struct tref ref, struct timespec gps_time, uint32_t *count_us) {
     double delta_sec;
 
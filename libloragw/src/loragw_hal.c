@@ -35,6 +35,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include "loragw_reg.h"
 #include "loragw_hal.h"
+#include "loragw_hal_merge.h"
 #include "loragw_aux.h"
 #include "loragw_com.h"
 #include "loragw_i2c.h"
@@ -47,6 +48,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_stts751.h"
 #include "loragw_ad5338r.h"
 #include "loragw_debug.h"
+#include "loragw_virt.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- DEBUG CONSTANTS ------------------------------------------------------ */
@@ -84,6 +86,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define CONTEXT_TX_GAIN_LUT     lgw_context.tx_gain_lut
 #define CONTEXT_FINE_TIMESTAMP  lgw_context.ftime_cfg
 #define CONTEXT_SX1261          lgw_context.sx1261_cfg
+#define CONTEXT_VIRT            lgw_context.virt_cfg
 #define CONTEXT_DEBUG           lgw_context.debug_cfg
 
 /* -------------------------------------------------------------------------- */
@@ -193,6 +196,9 @@ static lgw_context_t lgw_context = {
             .channels = {{ 0 }}
         }
     },
+    .virt_cfg = {
+        .enable = false
+    },
     .debug_cfg = {
         .nb_ref_payload = 0,
         .log_file_name = "loragw_hal.log"
@@ -209,6 +215,12 @@ static uint8_t ts_addr = 0xFF;
 /* I2C AD5338 handles */
 static int     ad_fd = -1;
 
+/* RX losses: ARB counters accumulated since start */
+static uint8_t  arb_last_detect[LGW_MULTI_NB];
+static uint8_t  arb_last_alloc[LGW_MULTI_NB];
+static uint32_t arb_nb_detect[LGW_MULTI_NB];
+static uint32_t arb_nb_alloc[LGW_MULTI_NB];
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
@@ -217,7 +229,6 @@ int32_t lgw_bw_getval(int x);
 
 static bool is_same_pkt(struct lgw_pkt_rx_s *p1, struct lgw_pkt_rx_s *p2);
 static int remove_pkt(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt, uint8_t pkt_index);
-static int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
@@ -316,7 +327,7 @@ int compare_pkt_tmst(const void *a, const void *b, void *arg)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
+int hal_merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
     uint8_t cpt;
     int j, k, pkt_dup_idx, x;
 #if DEBUG_HAL == 1
@@ -817,6 +828,27 @@ int lgw_sx1261_setconf(struct lgw_conf_sx1261_s * conf) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_virt_setconf(struct lgw_conf_virt_s * conf) {
+    CHECK_NULL(conf);
+
+    if (conf->enable == true) {
+        if ((conf->nb_dev == 0) || (conf->period_s <= 0)) {
+            printf("ERROR: virtual concentrator needs at least one end-device and a positive uplink period\n");
+            return LGW_HAL_ERROR;
+        }
+        if ((conf->size_min > conf->size_max) || (conf->crc_error_ratio < 0) || (conf->crc_error_ratio > 1)) {
+            printf("ERROR: virtual concentrator payload size or CRC error ratio not valid\n");
+            return LGW_HAL_ERROR;
+        }
+    }
+
+    CONTEXT_VIRT = *conf;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_debug_setconf(struct lgw_conf_debug_s * conf) {
     int i;
 
@@ -855,6 +887,17 @@ int lgw_start(void) {
         DEBUG_MSG("Note: LoRa concentrator already started, restarting it now\n");
     }
 
+    /* Virtual concentrator: no hardware access */
+    if (CONTEXT_VIRT.enable == true) {
+        err = virt_start(&lgw_context);
+        if (err != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to start the virtual concentrator\n");
+            return LGW_HAL_ERROR;
+        }
+        CONTEXT_STARTED = true;
+        return LGW_HAL_SUCCESS;
+    }
+
     err = lgw_connect(CONTEXT_COM_TYPE, CONTEXT_COM_PATH);
     if (err == LGW_REG_ERROR) {
         DEBUG_MSG("ERROR: FAIL TO CONNECT BOARD\n");
@@ -1047,6 +1090,15 @@ int lgw_start(void) {
         return LGW_HAL_ERROR;
     }
 
+    /* reference of the RX losses counters */
+    memset(arb_nb_detect, 0, sizeof arb_nb_detect);
+    memset(arb_nb_alloc, 0, sizeof arb_nb_alloc);
+    err = sx1302_arb_get_debug_stats(arb_last_detect, arb_last_alloc);
+    if (err != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to get ARB debug stats\n");
+        return LGW_HAL_ERROR;
+    }
+
     /* static TX configuration */
     err = sx1302_tx_configure(CONTEXT_RF_CHAIN[CONTEXT_BOARD.clksrc].type);
     if (err != LGW_REG_SUCCESS) {
@@ -1169,6 +1221,16 @@ int lgw_start(void) {
             printf("ERROR: failed to setup sx1261 radio\n");
             return LGW_HAL_ERROR;
         }
+
+        /* Derive the LBT channels, the sx1261 RX parameters are not set yet */
+        if (CONTEXT_SX1261.lbt_conf.enable == true) {
+            err = lgw_lbt_init(&CONTEXT_SX1261);
+            if (err != 0) {
+                printf("ERROR: failed to initialize LBT\n");
+                return LGW_HAL_ERROR;
+            }
+        }
+        lgw_lbt_rx_params_changed();
     }
 
     /* Set CONFIG_DONE GPIO to 1 (turn on the corresponding LED) */
@@ -1198,6 +1260,11 @@ int lgw_stop(void) {
         return LGW_HAL_SUCCESS;
     }
 
+    if (CONTEXT_VIRT.enable == true) {
+        CONTEXT_STARTED = false;
+        return virt_stop();
+    }
+
     /* Abort current TX if needed */
     for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
         DEBUG_PRINTF("INFO: aborting TX on chain %u\n", i);
@@ -1259,6 +1326,11 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 
     DEBUG_PRINTF(" --- %s\n", "IN");
 
+    /* Get packets from the traffic model */
+    if (CONTEXT_VIRT.enable == true) {
+        return virt_receive(&lgw_context, max_pkt, pkt_data);
+    }
+
     /* Record function start time */
     _meas_time_start(&tm);
 
@@ -1297,10 +1369,7 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
     for (nb_pkt_found = 0; nb_pkt_found < ((nb_pkt_fetched <= max_pkt) ? nb_pkt_fetched : max_pkt); nb_pkt_found++) {
         /* Get packet and move to next one */
         res = sx1302_parse(&lgw_context, &pkt_data[nb_pkt_found]);
-        if (res == LGW_REG_WARNING) {
-            printf("WARNING: parsing error on packet %d, discarding fetched packets\n", nb_pkt_found);
-            return LGW_HAL_SUCCESS;
-        } else if (res == LGW_REG_ERROR) {
+        if (res == LGW_REG_ERROR) {
             printf("ERROR: fatal parsing error on packet %d, aborting...\n", nb_pkt_found);
             return LGW_HAL_ERROR;
         }
@@ -1319,7 +1388,7 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 
     /* Remove duplicated packets generated by double demod when precision timestamp is enabled */
     if ((nb_pkt_found > 0) && (CONTEXT_FINE_TIMESTAMP.enable == true)) {
-        res = merge_packets(pkt_data, &nb_pkt_found);
+        res = hal_merge_packets(pkt_data, &nb_pkt_found);
         if (res != 0) {
             printf("WARNING: failed to remove duplicated packets\n");
         }
@@ -1411,6 +1480,11 @@ int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
         return LGW_HAL_ERROR;
     }
 
+    /* Record the TX timing only */
+    if (CONTEXT_VIRT.enable == true) {
+        return virt_send(pkt_data, (pkt_data->modulation == MOD_CW) ? 0 : (lgw_time_on_air(pkt_data) * 1000));
+    }
+
     /* Set PA gain with AD5338R when using full duplex CN490 ref design */
     if (CONTEXT_BOARD.full_duplex == true) {
         uint8_t volt_val[AD5338R_CMD_SIZE] = {0x39, VOLTAGE2HEX_H(2.51), VOLTAGE2HEX_L(2.51)}; /* set to 2.51V */
@@ -1501,12 +1575,16 @@ int lgw_status(uint8_t rf_chain, uint8_t select, uint8_t *code) {
     if (select == TX_STATUS) {
         if (CONTEXT_STARTED == false) {
             *code = TX_OFF;
+        } else if (CONTEXT_VIRT.enable == true) {
+            *code = virt_tx_status(rf_chain);
         } else {
             *code = sx1302_tx_status(rf_chain);
         }
     } else if (select == RX_STATUS) {
         if (CONTEXT_STARTED == false) {
             *code = RX_OFF;
+        } else if (CONTEXT_VIRT.enable == true) {
+            *code = RX_ON;
         } else {
             *code = sx1302_rx_status(rf_chain);
         }
@@ -1535,7 +1613,11 @@ int lgw_abort_tx(uint8_t rf_chain) {
     }
 
     /* Abort current TX */
-    err = sx1302_tx_abort(rf_chain);
+    if (CONTEXT_VIRT.enable == true) {
+        err = virt_tx_abort(rf_chain);
+    } else {
+        err = sx1302_tx_abort(rf_chain);
+    }
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1549,7 +1631,11 @@ int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
 
     CHECK_NULL(trig_cnt_us);
 
-    *trig_cnt_us = sx1302_timestamp_counter(true);
+    if (CONTEXT_VIRT.enable == true) {
+        *trig_cnt_us = (uint32_t)virt_counter(true);
+    } else {
+        *trig_cnt_us = sx1302_timestamp_counter(true);
+    }
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1563,7 +1649,29 @@ int lgw_get_instcnt(uint32_t* inst_cnt_us) {
 
     CHECK_NULL(inst_cnt_us);
 
-    *inst_cnt_us = sx1302_timestamp_counter(false);
+    if (CONTEXT_VIRT.enable == true) {
+        *inst_cnt_us = (uint32_t)virt_counter(false);
+    } else {
+        *inst_cnt_us = sx1302_timestamp_counter(false);
+    }
+
+    DEBUG_PRINTF(" --- %s\n", "OUT");
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_instcnt64(uint64_t* inst_cnt_us) {
+    DEBUG_PRINTF(" --- %s\n", "IN");
+
+    CHECK_NULL(inst_cnt_us);
+
+    if (CONTEXT_VIRT.enable == true) {
+        *inst_cnt_us = virt_counter(false);
+    } else {
+        *inst_cnt_us = sx1302_timestamp_counter64(false);
+    }
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1572,11 +1680,36 @@ int lgw_get_instcnt(uint32_t* inst_cnt_us) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_get_instcnt_estimate(uint64_t* inst_cnt_us, uint32_t* error_us) {
+    CHECK_NULL(inst_cnt_us);
+    CHECK_NULL(error_us);
+
+    /* the virtual counter is the host clock, no estimate needed */
+    if (CONTEXT_VIRT.enable == true) {
+        *inst_cnt_us = virt_counter(false);
+        *error_us = 0;
+        return LGW_HAL_SUCCESS;
+    }
+
+    if (timestamp_counter_estimate(inst_cnt_us, error_us) != 0) {
+        return LGW_HAL_ERROR;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_get_eui(uint64_t* eui) {
     DEBUG_PRINTF(" --- %s\n", "IN");
 
     CHECK_NULL(eui);
 
+    if (CONTEXT_VIRT.enable == true) {
+        *eui = virt_eui();
+        return LGW_HAL_SUCCESS;
+    }
+
     if (sx1302_get_eui(eui) != LGW_REG_SUCCESS) {
         return LGW_HAL_ERROR;
     }
@@ -1595,6 +1728,11 @@ int lgw_get_temperature(float* temperature) {
 
     CHECK_NULL(temperature);
 
+    if (CONTEXT_VIRT.enable == true) {
+        *temperature = VIRT_TEMPERATURE;
+        return LGW_HAL_SUCCESS;
+    }
+
     switch (CONTEXT_COM_TYPE) {
         case LGW_COM_SPI:
             err = stts751_get_temperature(ts_fd, ts_addr, temperature);
@@ -1614,6 +1752,61 @@ int lgw_get_temperature(float* temperature) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_get_rx_stats(struct lgw_rx_stats_s * stats) {
+    uint8_t nb_detect[LGW_MULTI_NB];
+    uint8_t nb_alloc[LGW_MULTI_NB];
+    int i;
+
+    CHECK_NULL(stats);
+
+    if (CONTEXT_STARTED == false) {
+        printf("ERROR: concentrator is not running\n");
+        return LGW_HAL_ERROR;
+    }
+
+    if (CONTEXT_VIRT.enable == true) {
+        return virt_get_rx_stats(stats);
+    }
+
+    /* accumulate the ARB counters, the differences are taken modulo 256 */
+    if (sx1302_arb_get_debug_stats(nb_detect, nb_alloc) != LGW_REG_SUCCESS) {
+        return LGW_HAL_ERROR;
+    }
+    for (i = 0; i < LGW_MULTI_NB; i++) {
+        arb_nb_detect[i] += (uint8_t)(nb_detect[i] - arb_last_detect[i]);
+        arb_nb_alloc[i] += (uint8_t)(nb_alloc[i] - arb_last_alloc[i]);
+        arb_last_detect[i] = nb_detect[i];
+        arb_last_alloc[i] = nb_alloc[i];
+    }
+
+    if (sx1302_get_rx_stats(stats) != LGW_REG_SUCCESS) {
+        return LGW_HAL_ERROR;
+    }
+    memcpy(stats->nb_detect, arb_nb_detect, sizeof stats->nb_detect);
+    memcpy(stats->nb_alloc, arb_nb_alloc, sizeof stats->nb_alloc);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_virt_get_tx_stats(struct lgw_virt_tx_stats_s * stats) {
+    CHECK_NULL(stats);
+
+    if ((CONTEXT_STARTED == false) || (CONTEXT_VIRT.enable == false)) {
+        printf("ERROR: virtual concentrator is not running\n");
+        return LGW_HAL_ERROR;
+    }
+
+    if (virt_get_tx_stats(stats) != LGW_HAL_SUCCESS) {
+        return LGW_HAL_ERROR;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 const char* lgw_version_info() {
     return lgw_version_string;
 }
@@ -1667,6 +1860,9 @@ int lgw_spectral_scan_start(uint32_t freq_hz, uint16_t nb_scan) {
         return LGW_HAL_ERROR;
     }
 
+    /* LBT will have to set its own RX parameters again */
+    lgw_lbt_rx_params_changed();
+
     err = sx1261_set_rx_params(freq_hz, BW_125KHZ);
     if (err != LGW_REG_SUCCESS) {
         printf("ERROR: Failed to set RX params for Spectral Scan\n");
@@ -1684,6 +1880,12 @@ int lgw_spectral_scan_start(uint32_t freq_hz, uint16_t nb_scan) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+uint32_t lgw_spectral_scan_duration_us(uint16_t nb_scan) {
+    return sx1261_spectral_scan_duration_us(nb_scan);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_spectral_scan_get_status(lgw_spectral_scan_status_t * status) {
     return sx1261_spectral_scan_status(status);
 }
@@ -25,6 +25,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include <stdio.h>      /* printf */
 #include <stdlib.h>     /* llabs */
+#include <string.h>     /* memset */
 
 #include "loragw_aux.h"
 #include "loragw_lbt.h"
@@ -43,6 +44,43 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
     #define DEBUG_PRINTF(fmt, args...)
 #endif
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define LBT_SENSE_MARGIN_US     1500    /* channel sensing is checked 1.5ms before the packet departure time */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* LBT channel, with the parameters derived from the configuration */
+struct lbt_channel_s {
+    uint32_t freq_hz;
+    uint8_t bandwidth;
+    lgw_lbt_scan_time_t scan_time_us;
+    uint16_t transmit_time_ms;
+    uint32_t max_toa_us;        /* maximum packet time on air, 0 if transmit_time_ms is too short */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lbt_channel_s lbt_channels[LGW_LBT_CHANNEL_NB_MAX];
+static uint8_t lbt_nb_channel = 0;
+static int8_t lbt_threshold_dbm = 0;    /* rssi_target + rssi_offset */
+static bool lbt_ready = false;          /* the channels have been derived from the configuration */
+
+static int lbt_last_channel = -1;       /* channel of the previous downlink */
+
+/* SX1261 RX parameters programmed by the previous LBT start, kept by LBT stop */
+static bool lbt_rx_params_ok = false;
+static uint32_t lbt_rx_freq_hz;
+static uint8_t lbt_rx_bandwidth;
+
+/* Time on air of the previous downlink */
+static bool lbt_toa_ok = false;
+static struct lgw_pkt_tx_s lbt_toa_pkt;
+static uint32_t lbt_toa_ms;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -63,13 +101,18 @@ static bool is_equal_freq(uint32_t a, uint32_t b) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int is_lbt_channel(const struct lgw_conf_lbt_s * lbt_context, uint32_t freq_hz, uint8_t bandwidth) {
+static int is_lbt_channel(uint32_t freq_hz, uint8_t bandwidth) {
     int i;
     int lbt_channel_match = -1;
 
-    for (i = 0; i <  lbt_context->nb_channel; i++) {
-        if ((is_equal_freq(freq_hz, lbt_context->channels[i].freq_hz) == true) && (bandwidth == lbt_context->channels[i].bandwidth)) {
-            DEBUG_PRINTF("LBT: select channel %d (freq:%u Hz, bw:0x%02X)\n", i, lbt_context->channels[i].freq_hz, lbt_context->channels[i].bandwidth);
+    /* back-to-back downlinks are often on the same channel */
+    if ((lbt_last_channel >= 0) && (lbt_last_channel < lbt_nb_channel) && (bandwidth == lbt_channels[lbt_last_channel].bandwidth) && (is_equal_freq(freq_hz, lbt_channels[lbt_last_channel].freq_hz) == true)) {
+        return lbt_last_channel;
+    }
+
+    for (i = 0; i < lbt_nb_channel; i++) {
+        if ((is_equal_freq(freq_hz, lbt_channels[i].freq_hz) == true) && (bandwidth == lbt_channels[i].bandwidth)) {
+            DEBUG_PRINTF("LBT: select channel %d (freq:%u Hz, bw:0x%02X)\n", i, lbt_channels[i].freq_hz, lbt_channels[i].bandwidth);
             lbt_channel_match = i;
             break;
         }
@@ -79,9 +122,70 @@ static int is_lbt_channel(const struct lgw_conf_lbt_s * lbt_context, uint32_t fr
     return lbt_channel_match;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* packets with the same modulation parameters and size have the same time on air */
+static uint32_t lbt_time_on_air(const struct lgw_pkt_tx_s * pkt) {
+    if ((lbt_toa_ok == false) ||
+        (pkt->modulation != lbt_toa_pkt.modulation) || (pkt->bandwidth != lbt_toa_pkt.bandwidth) ||
+        (pkt->datarate != lbt_toa_pkt.datarate) || (pkt->coderate != lbt_toa_pkt.coderate) ||
+        (pkt->preamble != lbt_toa_pkt.preamble) || (pkt->no_header != lbt_toa_pkt.no_header) ||
+        (pkt->no_crc != lbt_toa_pkt.no_crc) || (pkt->size != lbt_toa_pkt.size)) {
+        lbt_toa_ms = lgw_time_on_air(pkt);
+        lbt_toa_pkt.modulation = pkt->modulation;
+        lbt_toa_pkt.bandwidth = pkt->bandwidth;
+        lbt_toa_pkt.datarate = pkt->datarate;
+        lbt_toa_pkt.coderate = pkt->coderate;
+        lbt_toa_pkt.preamble = pkt->preamble;
+        lbt_toa_pkt.no_header = pkt->no_header;
+        lbt_toa_pkt.no_crc = pkt->no_crc;
+        lbt_toa_pkt.size = pkt->size;
+        lbt_toa_ok = true;
+    }
+
+    return lbt_toa_ms;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+int lgw_lbt_init(const struct lgw_conf_sx1261_s * sx1261_context) {
+    int i;
+
+    if (sx1261_context->lbt_conf.nb_channel > LGW_LBT_CHANNEL_NB_MAX) {
+        printf("ERROR: Cannot init LBT - too many channels\n");
+        return -1;
+    }
+
+    memset(lbt_channels, 0, sizeof lbt_channels);
+    for (i = 0; i < sx1261_context->lbt_conf.nb_channel; i++) {
+        lbt_channels[i].freq_hz = sx1261_context->lbt_conf.channels[i].freq_hz;
+        lbt_channels[i].bandwidth = sx1261_context->lbt_conf.channels[i].bandwidth;
+        lbt_channels[i].scan_time_us = sx1261_context->lbt_conf.channels[i].scan_time_us;
+        lbt_channels[i].transmit_time_ms = sx1261_context->lbt_conf.channels[i].transmit_time_ms;
+        if (((uint32_t)lbt_channels[i].transmit_time_ms * 1000) > LBT_SENSE_MARGIN_US) {
+            lbt_channels[i].max_toa_us = (uint32_t)lbt_channels[i].transmit_time_ms * 1000 - LBT_SENSE_MARGIN_US;
+        } else {
+            lbt_channels[i].max_toa_us = 0;
+        }
+    }
+    lbt_nb_channel = sx1261_context->lbt_conf.nb_channel;
+    lbt_threshold_dbm = sx1261_context->lbt_conf.rssi_target + sx1261_context->rssi_offset;
+    lbt_last_channel = -1;
+    lbt_rx_params_ok = false;
+    lbt_ready = true;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_lbt_rx_params_changed(void) {
+    lbt_rx_params_ok = false;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_lbt_start(const struct lgw_conf_sx1261_s * sx1261_context, const struct lgw_pkt_tx_s * pkt) {
     int err;
     int lbt_channel_selected;
@@ -92,34 +196,52 @@ int lgw_lbt_start(const struct lgw_conf_sx1261_s * sx1261_context, const struct
     /* Record function start time */
     _meas_time_start(&tm);
 
+    /* Derive the LBT channels from the configuration, if not done by lgw_start */
+    if (lbt_ready == false) {
+        err = lgw_lbt_init(sx1261_context);
+        if (err != 0) {
+            return -1;
+        }
+    }
+
     /* Check if we have a LBT channel for this transmit frequency */
-    lbt_channel_selected = is_lbt_channel(&(sx1261_context->lbt_conf), pkt->freq_hz, pkt->bandwidth);
+    lbt_channel_selected = is_lbt_channel(pkt->freq_hz, pkt->bandwidth);
     if (lbt_channel_selected == -1) {
         printf("ERROR: Cannot start LBT - wrong channel\n");
         return -1;
     }
+    lbt_last_channel = lbt_channel_selected;
 
     /* Check if the packet Time On Air exceeds the maximum allowed transmit time on this channel */
     /* Channel sensing is checked 1.5ms before the packet departure time, so need to take this into account */
-    if (sx1261_context->lbt_conf.channels[lbt_channel_selected].transmit_time_ms * 1000 <= 1500) {
+    if (lbt_channels[lbt_channel_selected].max_toa_us == 0) {
         printf("ERROR: Cannot start LBT - channel transmit_time_ms must be > 1.5ms\n");
         return -1;
     }
-    toa_ms = lgw_time_on_air(pkt);
-    if ((toa_ms * 1000) > (uint32_t)(sx1261_context->lbt_conf.channels[lbt_channel_selected].transmit_time_ms * 1000 - 1500)) {
-        printf("ERROR: Cannot start LBT - packet time on air exceeds allowed transmit time (toa:%ums, max:%ums)\n", toa_ms, sx1261_context->lbt_conf.channels[lbt_channel_selected].transmit_time_ms);
+    toa_ms = lbt_time_on_air(pkt);
+    if ((toa_ms * 1000) > lbt_channels[lbt_channel_selected].max_toa_us) {
+        printf("ERROR: Cannot start LBT - packet time on air exceeds allowed transmit time (toa:%ums, max:%ums)\n", toa_ms, lbt_channels[lbt_channel_selected].transmit_time_ms);
         return -1;
     }
 
-    /* Set LBT scan frequency */
-    err = sx1261_set_rx_params(pkt->freq_hz, pkt->bandwidth);
+    /* Set LBT scan frequency, only resume RX if the SX1261 is still configured for it */
+    if ((lbt_rx_params_ok == true) && (pkt->freq_hz == lbt_rx_freq_hz) && (pkt->bandwidth == lbt_rx_bandwidth)) {
+        err = sx1261_resume_rx();
+    } else {
+        lbt_rx_params_ok = false;
+        err = sx1261_set_rx_params(pkt->freq_hz, pkt->bandwidth);
+    }
     if (err != 0) {
         printf("ERROR: Cannot start LBT - unable to set sx1261 RX parameters\n");
+        lbt_rx_params_ok = false;
         return -1;
     }
+    lbt_rx_params_ok = true;
+    lbt_rx_freq_hz = pkt->freq_hz;
+    lbt_rx_bandwidth = pkt->bandwidth;
 
     /* Start LBT */
-    err = sx1261_lbt_start(sx1261_context->lbt_conf.channels[lbt_channel_selected].scan_time_us, sx1261_context->lbt_conf.rssi_target + sx1261_context->rssi_offset);
+    err = sx1261_lbt_start(lbt_channels[lbt_channel_selected].scan_time_us, lbt_threshold_dbm);
     if (err != 0) {
         printf("ERROR: Cannot start LBT - sx1261 LBT start\n");
         return -1;
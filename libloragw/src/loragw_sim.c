@@ -0,0 +1,300 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Software communication interface emulating the LoRa concentrator registers
+    and RX buffer in host memory, for tests and benchmarks without hardware.
+    Single-byte read/write and burst read/write, with transaction counters.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memcpy memset */
+
+#include "loragw_com.h"
+#include "loragw_sim.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_COM == 1
+    #define DEBUG_MSG(str)                fprintf(stdout, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stdout,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_SIM_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_SIM_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define LGW_SIM_BURST_CHUNK     1024    /* same as SPI */
+#define LGW_SIM_MEM_SIZE        65536   /* full SX1302 address space */
+#define LGW_SIM_TEMPERATURE     25.0f   /* constant board temperature */
+
+/* SX1302 addresses with a dedicated behaviour */
+#define SIM_ADDR_RX_BUFFER          0x4000  /* RX buffer, read in FIFO mode */
+#define SIM_ADDR_RX_NB_BYTES_MSB    0x58C8  /* RX_TOP_RX_BUFFER_NB_BYTES_MSB */
+#define SIM_ADDR_RX_NB_BYTES_LSB    0x58C9  /* RX_TOP_RX_BUFFER_NB_BYTES_LSB */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef struct lgw_sim_target_s {
+    uint8_t mem[LGW_SIM_MEM_SIZE];          /* SX1302 registers and memories */
+    uint8_t rx_fifo[LGW_SIM_RX_FIFO_SIZE];  /* pending RX buffer data */
+    uint16_t rx_fifo_size;                  /* number of bytes available in rx_fifo */
+    struct lgw_sim_stats_s stats;
+} lgw_sim_target_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint8_t sim_mem_read(lgw_sim_target_t * sim, uint16_t address) {
+    switch (address) {
+        case SIM_ADDR_RX_NB_BYTES_MSB:
+            return (uint8_t)((sim->rx_fifo_size >> 8) & 0x1F);
+        case SIM_ADDR_RX_NB_BYTES_LSB:
+            return (uint8_t)(sim->rx_fifo_size & 0xFF);
+        default:
+            return sim->mem[address];
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sim_rx_fifo_pop(lgw_sim_target_t * sim, uint8_t * data, uint16_t size) {
+    uint16_t n = (size > sim->rx_fifo_size) ? sim->rx_fifo_size : size;
+
+    memcpy(data, sim->rx_fifo, n);
+    memset(data + n, 0, size - n); /* reading an empty FIFO returns zeros */
+    memmove(sim->rx_fifo, sim->rx_fifo + n, sim->rx_fifo_size - n);
+    sim->rx_fifo_size -= n;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_sim_open(const char * com_path, void **com_target_ptr) {
+    lgw_sim_target_t * sim;
+
+    /* check input variables */
+    CHECK_NULL(com_target_ptr);
+    (void)com_path;
+
+    sim = calloc(1, sizeof(lgw_sim_target_t));
+    if (sim == NULL) {
+        DEBUG_MSG("ERROR: MALLOC FAIL\n");
+        return LGW_SIM_ERROR;
+    }
+
+    *com_target_ptr = (void *)sim;
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_close(void *com_target) {
+    CHECK_NULL(com_target);
+
+    free(com_target);
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_w(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t data) {
+    lgw_sim_target_t * sim = (lgw_sim_target_t *)com_target;
+
+    CHECK_NULL(com_target);
+
+    sim->stats.nb_w += 1;
+    sim->stats.nb_bytes_w += 1;
+
+    /* Only the SX1302 memory is emulated, radio accesses are accepted and ignored */
+    if (spi_mux_target == LGW_SPI_MUX_TARGET_SX1302) {
+        sim->mem[address] = data;
+    }
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_r(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data) {
+    lgw_sim_target_t * sim = (lgw_sim_target_t *)com_target;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    sim->stats.nb_r += 1;
+    sim->stats.nb_bytes_r += 1;
+
+    *data = (spi_mux_target == LGW_SPI_MUX_TARGET_SX1302) ? sim_mem_read(sim, address) : 0;
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_rmw(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t leng, uint8_t data) {
+    lgw_sim_target_t * sim = (lgw_sim_target_t *)com_target;
+    uint8_t mask;
+
+    CHECK_NULL(com_target);
+
+    sim->stats.nb_rmw += 1;
+    sim->stats.nb_bytes_r += 1;
+    sim->stats.nb_bytes_w += 1;
+
+    if (spi_mux_target == LGW_SPI_MUX_TARGET_SX1302) {
+        mask = ((1 << leng) - 1) << offs;
+        sim->mem[address] = (~mask & sim->mem[address]) | (mask & (uint8_t)(data << offs));
+    }
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_wb(void *com_target, uint8_t spi_mux_target, uint16_t address, const uint8_t *data, uint16_t size) {
+    lgw_sim_target_t * sim = (lgw_sim_target_t *)com_target;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    sim->stats.nb_wb += 1;
+    sim->stats.nb_bytes_w += size;
+
+    if (spi_mux_target == LGW_SPI_MUX_TARGET_SX1302) {
+        return lgw_sim_mem_set(com_target, address, data, size);
+    }
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_rb(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t size) {
+    lgw_sim_target_t * sim = (lgw_sim_target_t *)com_target;
+    int i;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    sim->stats.nb_rb += 1;
+    sim->stats.nb_bytes_r += size;
+
+    if (spi_mux_target != LGW_SPI_MUX_TARGET_SX1302) {
+        memset(data, 0, size);
+        return LGW_SIM_SUCCESS;
+    }
+
+    if (address == SIM_ADDR_RX_BUFFER) {
+        sim_rx_fifo_pop(sim, data, size);
+    } else {
+        for (i = 0; i < size; i++) {
+            data[i] = sim_mem_read(sim, (uint16_t)(address + i));
+        }
+    }
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint16_t lgw_sim_chunk_size(void) {
+    return (uint16_t)LGW_SIM_BURST_CHUNK;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_get_temperature(void *com_target, float * temperature) {
+    CHECK_NULL(com_target);
+    CHECK_NULL(temperature);
+
+    *temperature = LGW_SIM_TEMPERATURE;
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_mem_set(void *com_target, uint16_t address, const uint8_t *data, uint16_t size) {
+    lgw_sim_target_t * sim = (lgw_sim_target_t *)com_target;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    if (((uint32_t)address + size) > LGW_SIM_MEM_SIZE) {
+        printf("ERROR: SIM: memory write out of range (0x%04X + %u)\n", address, size);
+        return LGW_SIM_ERROR;
+    }
+
+    memcpy(&(sim->mem[address]), data, size);
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_rx_push(void *com_target, const uint8_t *data, uint16_t size) {
+    lgw_sim_target_t * sim = (lgw_sim_target_t *)com_target;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    if ((sim->rx_fifo_size + size) > LGW_SIM_RX_FIFO_SIZE) {
+        DEBUG_PRINTF("WARNING: SIM: RX FIFO full, dropping %u bytes\n", size);
+        return LGW_SIM_ERROR;
+    }
+
+    memcpy(&(sim->rx_fifo[sim->rx_fifo_size]), data, size);
+    sim->rx_fifo_size += size;
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_get_stats(void *com_target, struct lgw_sim_stats_s * stats) {
+    lgw_sim_target_t * sim = (lgw_sim_target_t *)com_target;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(stats);
+
+    *stats = sim->stats;
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_reset_stats(void *com_target) {
+    lgw_sim_target_t * sim = (lgw_sim_target_t *)com_target;
+
+    CHECK_NULL(com_target);
+
+    memset(&(sim->stats), 0, sizeof sim->stats);
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -55,6 +55,10 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define SX1261_PRAM_VERSION_FULL_SIZE 16 /* 15 bytes + terminating char */
 
+#define SX1261_SPECTRAL_SCAN_INTERVAL       11      /* interval between 2 scan points - 8.2 us */
+#define SX1261_SPECTRAL_SCAN_POINT_NS       8200    /* duration of one scan point */
+#define SX1261_SPECTRAL_SCAN_SETUP_US       1000    /* RX start margin, before the first point */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
@@ -470,6 +474,53 @@ int sx1261_set_rx_params(uint32_t freq_hz, uint8_t bandwidth) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int sx1261_resume_rx(void) {
+    int err;
+    uint8_t buff[16];
+    /* performances variables */
+    struct timeval tm;
+
+    /* Record function start time */
+    _meas_time_start(&tm);
+
+    /* Set SPI write bulk mode to optimize speed on USB */
+    err = sx1261_com_set_write_mode(LGW_COM_WRITE_MODE_BULK);
+    CHECK_ERR(err);
+
+    /* Configure RSSI averaging window (cleared by LBT stop and spectral scan abort) */
+    buff[0] = 0x08;
+    buff[1] = 0x9B;
+    buff[2] = 0x05 << 2;
+    err = sx1261_reg_w(SX1261_WRITE_REGISTER, buff, 3);
+    CHECK_ERR(err);
+
+    /* Set Radio in Rx continuous mode, frequency and modulation are kept from the previous RX */
+    buff[0] = 0xFF;
+    buff[1] = 0xFF;
+    buff[2] = 0xFF;
+    err = sx1261_reg_w(SX1261_SET_RX, buff, 3);
+    CHECK_ERR(err);
+
+    /* Flush write (USB BULK mode) */
+    err = sx1261_com_flush();
+    if (err != 0) {
+        printf("ERROR: %s: Failed to flush sx1261 SPI\n", __FUNCTION__);
+        return -1;
+    }
+
+    /* Setting back to SINGLE BULK write mode */
+    err = sx1261_com_set_write_mode(LGW_COM_WRITE_MODE_SINGLE);
+    CHECK_ERR(err);
+
+    DEBUG_MSG("SX1261: RX resumed\n");
+
+    _meas_time_stop(4, tm, __FUNCTION__);
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int sx1261_lbt_start(lgw_lbt_scan_time_t scan_time_us, int8_t threshold_dbm) {
     int err;
     uint8_t buff[16];
@@ -562,7 +613,7 @@ int sx1261_spectral_scan_start(uint16_t nb_scan) {
     /* Start spectral scan */
     buff[0] = (nb_scan >> 8) & 0xFF; /* nb_scan MSB */
     buff[1] = (nb_scan >> 0) & 0xFF; /* nb_scan LSB */
-    buff[2] = 11; /* interval between scans - 8.2 us */
+    buff[2] = SX1261_SPECTRAL_SCAN_INTERVAL; /* interval between scans - 8.2 us */
     err = sx1261_reg_w(0x9b, buff, 9);
     CHECK_ERR(err);
 
@@ -575,6 +626,12 @@ int sx1261_spectral_scan_start(uint16_t nb_scan) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+uint32_t sx1261_spectral_scan_duration_us(uint16_t nb_scan) {
+    return SX1261_SPECTRAL_SCAN_SETUP_US + (uint32_t)(((uint64_t)nb_scan * SX1261_SPECTRAL_SCAN_POINT_NS + 999) / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int sx1261_spectral_scan_get_results(int8_t rssi_offset, int16_t * levels_dbm, uint16_t * results) {
     int err, i;
     uint8_t buff[69]; /* 66 bytes for spectral scan results + 2 bytes register address + 1 dummy byte for reading */
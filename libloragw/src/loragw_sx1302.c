@@ -18,7 +18,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include <stdint.h>     /* C99 types */
 #include <stdio.h>      /* printf fprintf */
-#include <string.h>     /* memcmp */
+#include <string.h>     /* memcmp, memcpy */
 #include <math.h>       /* pow, cell */
 #include <inttypes.h>
 #include <time.h>
@@ -28,6 +28,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_hal.h"
 #include "loragw_sx1302.h"
 #include "loragw_sx1302_timestamp.h"
+#include "loragw_crc.h"
 #include "loragw_sx1302_rx.h"
 #include "loragw_sx1250.h"
 #include "loragw_agc_params.h"
@@ -144,13 +145,6 @@ extern int32_t lgw_sf_getval(int x);
 */
 extern int32_t lgw_bw_getval(int x);
 
-/**
-@brief TODO
-@param TODO
-@return TODO
-*/
-void lora_crc16(const char data, int *crc);
-
 /* -------------------------------------------------------------------------- */
 /* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
 
@@ -189,29 +183,6 @@ int calculate_freq_to_time_drift(uint32_t freq_hz, uint8_t bw, uint16_t * mant,
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-void lora_crc16(const char data, int *crc) {
-    int next = 0;
-    next  =  (((data>>0)&1) ^ ((*crc>>12)&1) ^ ((*crc>> 8)&1)                 )      ;
-    next += ((((data>>1)&1) ^ ((*crc>>13)&1) ^ ((*crc>> 9)&1)                 )<<1 ) ;
-    next += ((((data>>2)&1) ^ ((*crc>>14)&1) ^ ((*crc>>10)&1)                 )<<2 ) ;
-    next += ((((data>>3)&1) ^ ((*crc>>15)&1) ^ ((*crc>>11)&1)                 )<<3 ) ;
-    next += ((((data>>4)&1) ^ ((*crc>>12)&1)                                  )<<4 ) ;
-    next += ((((data>>5)&1) ^ ((*crc>>13)&1) ^ ((*crc>>12)&1) ^ ((*crc>> 8)&1))<<5 ) ;
-    next += ((((data>>6)&1) ^ ((*crc>>14)&1) ^ ((*crc>>13)&1) ^ ((*crc>> 9)&1))<<6 ) ;
-    next += ((((data>>7)&1) ^ ((*crc>>15)&1) ^ ((*crc>>14)&1) ^ ((*crc>>10)&1))<<7 ) ;
-    next += ((((*crc>>0)&1) ^ ((*crc>>15)&1) ^ ((*crc>>11)&1)                 )<<8 ) ;
-    next += ((((*crc>>1)&1) ^ ((*crc>>12)&1)                                  )<<9 ) ;
-    next += ((((*crc>>2)&1) ^ ((*crc>>13)&1)                                  )<<10) ;
-    next += ((((*crc>>3)&1) ^ ((*crc>>14)&1)                                  )<<11) ;
-    next += ((((*crc>>4)&1) ^ ((*crc>>15)&1) ^ ((*crc>>12)&1) ^ ((*crc>> 8)&1))<<12) ;
-    next += ((((*crc>>5)&1) ^ ((*crc>>13)&1) ^ ((*crc>> 9)&1)                 )<<13) ;
-    next += ((((*crc>>6)&1) ^ ((*crc>>14)&1) ^ ((*crc>>10)&1)                 )<<14) ;
-    next += ((((*crc>>7)&1) ^ ((*crc>>15)&1) ^ ((*crc>>11)&1)                 )<<15) ;
-    (*crc) = next;
-}
-
-/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
-
 int sx1302_config_gpio(void) {
     int err;
 
@@ -252,6 +223,7 @@ int sx1302_init(const struct lgw_conf_ftime_s * ftime_context) {
 
     /* Initialize RX buffer */
     rx_buffer_new(&rx_buffer);
+    rx_buffer_reset_stats(&rx_buffer);
 
     /* Configure timestamping mode */
     if (ftime_context->enable == true) {
@@ -352,7 +324,8 @@ int sx1302_update(void) {
     }
 #endif
 
-    /* Update internal timestamp counter wrapping status */
+    /* Update internal timestamp counter wrapping status, and capture the PPS counter used as reference
+        for the fine timestamp of all packets fetched (one bus access per fetch instead of per packet) */
     timestamp_counter_get(&counter_us, &inst, &pps);
 
     _meas_time_stop(2, tm, __FUNCTION__);
@@ -1151,6 +1124,14 @@ uint32_t sx1302_timestamp_counter(bool pps) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+uint64_t sx1302_timestamp_counter64(bool pps) {
+    uint32_t inst_cnt, pps_cnt;
+    timestamp_counter_get(&counter_us, &inst_cnt, &pps_cnt);
+    return timestamp_counter_expand64(&counter_us, pps, ((pps == true) ? counter_us.pps.counter_us_27bits_ref : counter_us.inst.counter_us_27bits_ref));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int sx1302_gps_enable(bool enable) {
     int err = LGW_REG_SUCCESS;
 
@@ -1778,30 +1759,45 @@ uint8_t sx1302_arb_get_debug_stats_alloc(uint8_t channel) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int sx1302_arb_get_debug_stats(uint8_t * nb_detect, uint8_t * nb_alloc) {
+    uint8_t buff[2 * LGW_MULTI_NB];
+
+    CHECK_NULL(nb_detect);
+    CHECK_NULL(nb_alloc);
+
+    /* ARB_DEBUG_STS_0..7 hold the detect counters, ARB_DEBUG_STS_8..15 the alloc counters: one burst for all */
+    if (lgw_reg_rb(SX1302_REG_ARB_MCU_ARB_DEBUG_STS_0_ARB_DEBUG_STS_0, buff, sizeof buff) != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to read ARB debug stats\n");
+        return LGW_REG_ERROR;
+    }
+    memcpy(nb_detect, &buff[0], LGW_MULTI_NB);
+    memcpy(nb_alloc, &buff[LGW_MULTI_NB], LGW_MULTI_NB);
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 void sx1302_arb_print_debug_stats(void) {
     int i;
-    uint8_t nb_detect;
-    uint8_t nb_alloc;
-    int nb_detect_total = 0;
-    int nb_alloc_total = 0;
+    uint8_t nb_detect[LGW_MULTI_NB];
+    uint8_t nb_alloc[LGW_MULTI_NB];
+
+    if (sx1302_arb_get_debug_stats(nb_detect, nb_alloc) != LGW_REG_SUCCESS) {
+        return;
+    }
 
     /* Get number of detects for all channels */
-    nb_detect_total = 0;
     DEBUG_MSG("ARB: nb_detect: [");
-    for (i = 0; i < 8; i++) {
-        nb_detect = sx1302_arb_get_debug_stats_detect(i);
-        DEBUG_PRINTF("%u ", nb_detect);
-        nb_detect_total += nb_detect;
+    for (i = 0; i < LGW_MULTI_NB; i++) {
+        DEBUG_PRINTF("%u ", nb_detect[i]);
     }
     DEBUG_MSG("]\n");
 
     /* Get number of modem allocation for all channels */
-    nb_alloc_total = 0;
     DEBUG_MSG("ARB: nb_alloc:  [");
-    for (i = 0; i < 8; i++) {
-        nb_alloc = sx1302_arb_get_debug_stats_alloc(i);
-        DEBUG_PRINTF("%u ", nb_alloc);
-        nb_alloc_total += nb_alloc;
+    for (i = 0; i < LGW_MULTI_NB; i++) {
+        DEBUG_PRINTF("%u ", nb_alloc[i]);
     }
     DEBUG_MSG("]\n");
 }
@@ -1894,6 +1890,22 @@ int sx1302_fetch(uint8_t * nb_pkt) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int sx1302_get_rx_stats(struct lgw_rx_stats_s * stats) {
+    /* Check input params */
+    CHECK_NULL(stats);
+
+    stats->nb_fetch = rx_buffer.stats.nb_fetch;
+    stats->nb_buffer_full = rx_buffer.stats.nb_buffer_full;
+    stats->nb_resync = rx_buffer.stats.nb_resync;
+    stats->nb_checksum_err = rx_buffer.stats.nb_checksum_err;
+    stats->nb_bytes_discarded = rx_buffer.stats.nb_bytes_discarded;
+    stats->nb_pkt_lost = rx_buffer.stats.nb_pkt_lost;
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
     int err;
     int ifmod; /* type of if_chain/modem a packet was received by */
@@ -1921,16 +1933,13 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
 #endif
 
     /* get packet from RX buffer */
-    err = rx_buffer_pop(&rx_buffer, &pkt);
-    if (err == LGW_REG_WARNING) {
-        rx_buffer_del(&rx_buffer); /* clear the buffer */
-        return err;
-    } else if (err == LGW_REG_ERROR) {
+    err = rx_buffer_pop_ref(&rx_buffer, &pkt);
+    if (err != LGW_REG_SUCCESS) {
         return err;
     }
 
     /* copy payload to result struct */
-    memcpy((void *)p->payload, (void *)(&(pkt.payload)), pkt.rxbytenb_modem);
+    memcpy((void *)p->payload, (const void *)pkt.payload_ref, pkt.rxbytenb_modem);
     p->size = pkt.rxbytenb_modem;
 
     /* process metadata */
@@ -2093,7 +2102,7 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
             pkt_freq_error = ((double)(p->freq_hz + p->freq_offset) / (double)(p->freq_hz)) - 1.0;
 
             /* Compute the fine timestamp */
-            err = precise_timestamp_calculate(pkt.num_ts_metrics_stored, &pkt.timestamp_avg[0], pkt.timestamp_cnt, pkt.rx_rate_sf, context->if_chain_cfg[p->if_chain].freq_hz, pkt_freq_error, &(p->ftime));
+            err = precise_timestamp_calculate(pkt.num_ts_metrics_stored, &pkt.timestamp_avg[0], pkt.timestamp_cnt, counter_us.pps_reg, pkt.rx_rate_sf, context->if_chain_cfg[p->if_chain].freq_hz, pkt_freq_error, &(p->ftime));
             if (err == 0) {
                 p->ftime_received = true;
             }
@@ -2149,8 +2158,9 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
     /* Scale 32 MHz packet timestamp to 1 MHz (microseconds) */
     p->count_us = pkt.timestamp_cnt / 32;
 
-    /* Expand 27-bits counter to 32-bits counter, based on current wrapping status (updated after fetch) */
-    p->count_us = timestamp_pkt_expand(&counter_us, p->count_us);
+    /* Expand 27-bits counter to 64-bits counter, based on current wrapping status (updated after fetch) */
+    p->count_us64 = timestamp_pkt_expand64(&counter_us, p->count_us);
+    p->count_us = (uint32_t)p->count_us64;
 
 
 #if 0 // debug code to check for failed submicros/micros handling
@@ -2176,7 +2186,8 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
 #endif
 
     /* Packet timestamp corrected */
-    p->count_us = p->count_us + timestamp_correction;
+    p->count_us64 = p->count_us64 + (int64_t)timestamp_correction;
+    p->count_us = (uint32_t)p->count_us64;
 
     /* Packet CRC status */
     p->crc = pkt.rx_crc16_value;
@@ -2189,15 +2200,7 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 uint16_t sx1302_lora_payload_crc(const uint8_t * data, uint8_t size) {
-    int i;
-    int crc = 0;
-
-    for (i = 0; i < size; i++) {
-        lora_crc16(data[i], &crc);
-    }
-
-    //printf("CRC16: 0x%02X 0x%02X (%X)\n", (uint8_t)(crc >> 8), (uint8_t)crc, crc);
-    return (uint16_t)crc;
+    return lgw_crc16_lora(data, size);
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -21,6 +21,12 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <string.h>     /* memset */
 #include <assert.h>     /* assert */
 
+#if defined(__SSE2__)
+    #include <emmintrin.h>  /* SSE2 intrinsics */
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>   /* NEON intrinsics */
+#endif
+
 #include "loragw_aux.h"
 #include "loragw_reg.h"
 #include "loragw_sx1302_rx.h"
@@ -91,9 +97,116 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
+static void rx_buffer_discard(rx_buffer_t * self, int start, int size);
+
+static uint8_t rx_buffer_checksum(const uint8_t * data, int size);
+
+static int rx_buffer_pkt_check(const rx_buffer_t * self, int idx);
+
+static int rx_buffer_resync(const rx_buffer_t * self, int idx);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* account for size bytes of the buffer which will not be parsed, the packets lost are estimated from the syncwords found */
+static void rx_buffer_discard(rx_buffer_t * self, int start, int size) {
+    uint32_t nb_pkt = 0;
+    int i;
+
+    for (i = start; i < (start + size - 1); i++) {
+        if ((self->buffer[i] == SX1302_PKT_SYNCWORD_BYTE_0) && (self->buffer[i + 1] == SX1302_PKT_SYNCWORD_BYTE_1)) {
+            nb_pkt += 1;
+        }
+    }
+
+    self->stats.nb_bytes_discarded += (uint32_t)size;
+    self->stats.nb_pkt_lost += (nb_pkt > 0) ? nb_pkt : 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* sum of size bytes, modulo 256 */
+static uint8_t rx_buffer_checksum(const uint8_t * data, int size) {
+    uint32_t sum = 0;
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+
+    for (; i <= (size - 16); i += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)&data[i]), zero)); /* 2 sums of 8 bytes */
+    }
+    sum = (uint32_t)_mm_cvtsi128_si32(acc) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(__ARM_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    uint64x2_t acc_64;
+
+    for (; i <= (size - 16); i += 16) {
+        acc = vpadalq_u8(acc, vld1q_u8(&data[i])); /* the 16-bits lanes may wrap, only the sum modulo 256 is needed */
+    }
+    acc_64 = vpaddlq_u32(vpaddlq_u16(acc));
+    sum = (uint32_t)(vgetq_lane_u64(acc_64, 0) + vgetq_lane_u64(acc_64, 1));
+#endif
+
+    /* remaining bytes (all of them without SIMD) */
+    for (; i < size; i++) {
+        sum += data[i];
+    }
+
+    return (uint8_t)sum;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* return the size of the packet starting at idx, or 0 if there is no syncword, or if the packet is truncated or has a wrong checksum */
+static int rx_buffer_pkt_check(const rx_buffer_t * self, int idx) {
+    const uint8_t * p = self->buffer + idx;
+    int avail = self->buffer_size - idx;
+    int pkt_size;
+    uint8_t payload_len;
+
+    if ((avail < (SX1302_PKT_HEAD_METADATA + SX1302_PKT_TAIL_METADATA)) || (p[0] != SX1302_PKT_SYNCWORD_BYTE_0) || (p[1] != SX1302_PKT_SYNCWORD_BYTE_1)) {
+        return 0;
+    }
+
+    payload_len = SX1302_PKT_PAYLOAD_LENGTH(p, 0);
+    if ((SX1302_PKT_HEAD_METADATA + payload_len + SX1302_PKT_TAIL_METADATA) > avail) {
+        return 0;
+    }
+    pkt_size = SX1302_PKT_HEAD_METADATA + payload_len + SX1302_PKT_TAIL_METADATA + (2 * SX1302_PKT_NUM_TS_METRICS(p, payload_len));
+    if (pkt_size > avail) {
+        return 0;
+    }
+
+    if (rx_buffer_checksum(p, pkt_size - 1) != p[pkt_size - 1]) {
+        return 0;
+    }
+
+    return pkt_size;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* return the index of the first valid packet found from idx, or the buffer size if there is none */
+static int rx_buffer_resync(const rx_buffer_t * self, int idx) {
+    const uint8_t * p;
+
+    while (idx < (self->buffer_size - 1)) {
+        p = memchr(self->buffer + idx, SX1302_PKT_SYNCWORD_BYTE_0, self->buffer_size - 1 - idx);
+        if (p == NULL) {
+            break;
+        }
+        idx = (int)(p - self->buffer);
+        if ((p[1] == SX1302_PKT_SYNCWORD_BYTE_1) && (rx_buffer_pkt_check(self, idx) > 0)) {
+            return idx;
+        }
+        idx += 1;
+    }
+
+    return self->buffer_size;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
@@ -129,9 +242,7 @@ int rx_buffer_del(rx_buffer_t * self) {
 int rx_buffer_fetch(rx_buffer_t * self) {
     int i, res;
     uint8_t buff[2];
-    uint8_t payload_len;
-    uint16_t next_pkt_idx;
-    int idx;
+    int idx, wr_idx, next_idx, pkt_size;
     uint16_t nb_bytes_1, nb_bytes_2;
 
     /* Check input params */
@@ -147,8 +258,16 @@ int rx_buffer_fetch(rx_buffer_t * self) {
 
     self->buffer_size = (nb_bytes_2 > nb_bytes_1) ? nb_bytes_2 : nb_bytes_1;
 
+    /* A full buffer cannot take new packets, the sx1302 may have dropped some */
+    if (self->buffer_size >= sizeof self->buffer) {
+        printf("WARNING: RX buffer full (%u bytes), packets may have been lost\n", self->buffer_size);
+        self->buffer_size = sizeof self->buffer;
+        self->stats.nb_buffer_full += 1;
+    }
+
     /* Fetch bytes from fifo if any */
     if (self->buffer_size > 0) {
+        self->stats.nb_fetch += 1;
         DEBUG_MSG   ("-----------------\n");
         DEBUG_PRINTF("%s: nb_bytes to be fetched: %u (%u %u)\n", __FUNCTION__, self->buffer_size, buff[1], buff[0]);
 
@@ -169,50 +288,39 @@ int rx_buffer_fetch(rx_buffer_t * self) {
         /* Sanity check: is there at least 1 complete packet in the buffer */
         if (self->buffer_size < (SX1302_PKT_HEAD_METADATA + SX1302_PKT_TAIL_METADATA)) {
             printf("WARNING: not enough data to have a complete packet, discard rx_buffer\n");
+            rx_buffer_discard(self, 0, self->buffer_size);
             return rx_buffer_del(self);
         }
 
-        /* Sanity check: is there a syncword at 0 ? If not, move to the first syncword found */
-        idx = 0;
-        while (idx <= (self->buffer_size - 2)) {
-            if ((self->buffer[idx] == SX1302_PKT_SYNCWORD_BYTE_0) && (self->buffer[idx + 1] == SX1302_PKT_SYNCWORD_BYTE_1)) {
-                DEBUG_PRINTF("INFO: syncword found at idx %d\n", idx);
-                break;
-            } else {
-                printf("INFO: syncword not found at idx %d\n", idx);
-                idx += 1;
-            }
-        }
-        if (idx > self->buffer_size - 2) {
-            printf("WARNING: no syncword found, discard rx_buffer\n");
-            return rx_buffer_del(self);
-        }
-        if (idx != 0) {
-            printf("INFO: re-sync rx_buffer at idx %d\n", idx);
-            memmove((void *)(self->buffer), (void *)(self->buffer + idx), self->buffer_size - idx);
-            self->buffer_size -= idx;
-        }
-
-        /* Rewind and parse buffer to get the number of packet fetched */
+        /* Parse buffer to get the number of packets fetched, corrupted regions are removed and the valid packets kept contiguous */
         idx = 0;
+        wr_idx = 0;
         while (idx < self->buffer_size) {
-            if ((self->buffer[idx] != SX1302_PKT_SYNCWORD_BYTE_0) || (self->buffer[idx + 1] != SX1302_PKT_SYNCWORD_BYTE_1)) {
-                printf("WARNING: syncword not found at idx %d, discard the rx_buffer\n", idx);
-                return rx_buffer_del(self);
+            pkt_size = rx_buffer_pkt_check(self, idx);
+            if (pkt_size == 0) {
+                if (((idx + 1) < self->buffer_size) && (self->buffer[idx] == SX1302_PKT_SYNCWORD_BYTE_0) && (self->buffer[idx + 1] == SX1302_PKT_SYNCWORD_BYTE_1)) {
+                    self->stats.nb_checksum_err += 1; /* truncated or wrong checksum */
+                }
+                /* Skip to the next syncword starting a valid packet */
+                next_idx = rx_buffer_resync(self, idx + 1);
+                printf("WARNING: RX buffer corrupted at idx %d, %d bytes skipped\n", idx, next_idx - idx);
+                self->stats.nb_resync += 1;
+                rx_buffer_discard(self, idx, next_idx - idx);
+                idx = next_idx;
+                continue;
             }
+
             /* One packet found in the buffer */
+            if (wr_idx != idx) {
+                memmove((void *)(self->buffer + wr_idx), (void *)(self->buffer + idx), pkt_size);
+            }
             self->buffer_pkt_nb += 1;
 
-            /* Compute the number of bytes for this packet */
-            payload_len = SX1302_PKT_PAYLOAD_LENGTH(self->buffer, idx);
-            next_pkt_idx =  SX1302_PKT_HEAD_METADATA +
-                            payload_len +
-                            SX1302_PKT_TAIL_METADATA +
-                            (2 * SX1302_PKT_NUM_TS_METRICS(self->buffer, idx + payload_len));
-
             /* Move to next packet */
-            idx += (int)next_pkt_idx;
+            idx += pkt_size;
+            wr_idx += pkt_size;
         }
+        self->buffer_size = (uint16_t)wr_idx;
     }
 
     /* Initialize the current buffer index to iterate on */
@@ -224,10 +332,26 @@ int rx_buffer_fetch(rx_buffer_t * self) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int rx_buffer_pop(rx_buffer_t * self, rx_packet_t * pkt) {
-    int i;
-    uint8_t checksum_rcv, checksum_calc = 0;
-    uint16_t checksum_idx;
+    int err;
+
+    err = rx_buffer_pop_ref(self, pkt);
+    if (err == LGW_REG_SUCCESS) {
+        memcpy((void *)pkt->payload, (const void *)pkt->payload_ref, pkt->rxbytenb_modem);
+    }
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int rx_buffer_pop_ref(rx_buffer_t * self, rx_packet_t * pkt) {
+    const uint8_t * head; /* start of the packet, for the fields before the payload */
+    const uint8_t * meta; /* start of the packet + payload length, for the fields after the payload */
+    int avail;
     uint16_t pkt_num_bytes;
+#if DEBUG_SX1302 == 1
+    int i;
+#endif
 
     /* Check input params */
     CHECK_NULL(self);
@@ -239,76 +363,64 @@ int rx_buffer_pop(rx_buffer_t * self, rx_packet_t * pkt) {
         return LGW_REG_ERROR;
     }
 
+    /* The fields are read at fixed offsets from local pointers, not reloaded from self at each write to pkt */
+    head = self->buffer + self->buffer_index;
+    avail = self->buffer_size - self->buffer_index;
+
     /* Get pkt sync words */
-    if ((self->buffer[self->buffer_index] != SX1302_PKT_SYNCWORD_BYTE_0) || (self->buffer[self->buffer_index + 1] != SX1302_PKT_SYNCWORD_BYTE_1)) {
+    if ((avail < 2) || (head[0] != SX1302_PKT_SYNCWORD_BYTE_0) || (head[1] != SX1302_PKT_SYNCWORD_BYTE_1)) {
         return LGW_REG_ERROR;
     }
     DEBUG_PRINTF("INFO: pkt syncword found at index %u\n", self->buffer_index);
 
     /* Get payload length */
-    pkt->rxbytenb_modem = SX1302_PKT_PAYLOAD_LENGTH(self->buffer, self->buffer_index);
+    pkt->rxbytenb_modem = SX1302_PKT_PAYLOAD_LENGTH(head, 0);
+    meta = head + pkt->rxbytenb_modem;
+
+    /* The checksum has been checked by rx_buffer_fetch, the length is checked again to never read past the buffer */
+    if ((SX1302_PKT_HEAD_METADATA + pkt->rxbytenb_modem + SX1302_PKT_TAIL_METADATA) > avail) {
+        return LGW_REG_ERROR;
+    }
 
     /* Get fine timestamp metrics */
-    pkt->num_ts_metrics_stored = SX1302_PKT_NUM_TS_METRICS(self->buffer, self->buffer_index + pkt->rxbytenb_modem);
+    pkt->num_ts_metrics_stored = SX1302_PKT_NUM_TS_METRICS(meta, 0);
 
     /* Calculate the total number of bytes in the packet */
     pkt_num_bytes = SX1302_PKT_HEAD_METADATA + pkt->rxbytenb_modem + SX1302_PKT_TAIL_METADATA + (2 * pkt->num_ts_metrics_stored);
-
-    /* Check if we have a complete packet in the rx buffer fetched */
-    if((self->buffer_index + pkt_num_bytes) > self->buffer_size) {
-        printf("WARNING: aborting truncated message (size=%u)\n", self->buffer_size);
-        return LGW_REG_WARNING;
-    }
-
-    /* Get the checksum as received in the RX buffer */
-    checksum_idx = pkt_num_bytes - 1;
-    checksum_rcv = self->buffer[self->buffer_index + pkt_num_bytes - 1];
-
-    /* Calculate the checksum from the actual payload bytes received */
-    for (i = 0; i < (int)checksum_idx; i++) {
-        checksum_calc += self->buffer[self->buffer_index + i];
-    }
-
-    /* Check if the checksum is correct */
-    if (checksum_rcv != checksum_calc) {
-        printf("WARNING: checksum failed (got:0x%02X calc:0x%02X)\n", checksum_rcv, checksum_calc);
-        return LGW_REG_WARNING;
-    } else {
-        DEBUG_PRINTF("Packet checksum OK (0x%02X)\n", checksum_rcv);
+    if (pkt_num_bytes > avail) {
+        return LGW_REG_ERROR;
     }
+    pkt->packet_checksum = head[pkt_num_bytes - 1];
 
     /* Parse packet metadata */
-    pkt->modem_id = SX1302_PKT_MODEM_ID(self->buffer, self->buffer_index);
-    pkt->rx_channel_in = SX1302_PKT_CHANNEL(self->buffer, self->buffer_index);
-    pkt->crc_en = SX1302_PKT_CRC_EN(self->buffer, self->buffer_index);
-    pkt->payload_crc_error = SX1302_PKT_CRC_ERROR(self->buffer, self->buffer_index + pkt->rxbytenb_modem);
-    pkt->sync_error = SX1302_PKT_SYNC_ERROR(self->buffer, self->buffer_index + pkt->rxbytenb_modem);
-    pkt->header_error = SX1302_PKT_HEADER_ERROR(self->buffer, self->buffer_index + pkt->rxbytenb_modem);
-    pkt->timing_set = SX1302_PKT_TIMING_SET(self->buffer, self->buffer_index + pkt->rxbytenb_modem);
-    pkt->coding_rate = SX1302_PKT_CODING_RATE(self->buffer, self->buffer_index);
-    pkt->rx_rate_sf = SX1302_PKT_DATARATE(self->buffer, self->buffer_index);
-    pkt->rssi_chan_avg = SX1302_PKT_RSSI_CHAN(self->buffer, self->buffer_index + pkt->rxbytenb_modem);
-    pkt->rssi_signal_avg = SX1302_PKT_RSSI_SIG(self->buffer, self->buffer_index + pkt->rxbytenb_modem);
-    pkt->rx_crc16_value  = (uint16_t)((SX1302_PKT_CRC_PAYLOAD_7_0(self->buffer, self->buffer_index + pkt->rxbytenb_modem) <<  0) & 0x00FF);
-    pkt->rx_crc16_value |= (uint16_t)((SX1302_PKT_CRC_PAYLOAD_15_8(self->buffer, self->buffer_index + pkt->rxbytenb_modem) <<  8) & 0xFF00);
-    pkt->snr_average = (int8_t)SX1302_PKT_SNR_AVG(self->buffer, self->buffer_index + pkt->rxbytenb_modem);
-
-    pkt->frequency_offset_error = (int32_t)((SX1302_PKT_FREQ_OFFSET_19_16(self->buffer, self->buffer_index) << 16) | (SX1302_PKT_FREQ_OFFSET_15_8(self->buffer, self->buffer_index) << 8) | (SX1302_PKT_FREQ_OFFSET_7_0(self->buffer, self->buffer_index) << 0));
+    pkt->modem_id = SX1302_PKT_MODEM_ID(head, 0);
+    pkt->rx_channel_in = SX1302_PKT_CHANNEL(head, 0);
+    pkt->crc_en = SX1302_PKT_CRC_EN(head, 0);
+    pkt->payload_crc_error = SX1302_PKT_CRC_ERROR(meta, 0);
+    pkt->sync_error = SX1302_PKT_SYNC_ERROR(meta, 0);
+    pkt->header_error = SX1302_PKT_HEADER_ERROR(meta, 0);
+    pkt->timing_set = SX1302_PKT_TIMING_SET(meta, 0);
+    pkt->coding_rate = SX1302_PKT_CODING_RATE(head, 0);
+    pkt->rx_rate_sf = SX1302_PKT_DATARATE(head, 0);
+    pkt->rssi_chan_avg = SX1302_PKT_RSSI_CHAN(meta, 0);
+    pkt->rssi_signal_avg = SX1302_PKT_RSSI_SIG(meta, 0);
+    pkt->rx_crc16_value = (uint16_t)((SX1302_PKT_CRC_PAYLOAD_15_8(meta, 0) << 8) | SX1302_PKT_CRC_PAYLOAD_7_0(meta, 0));
+    pkt->snr_average = (int8_t)SX1302_PKT_SNR_AVG(meta, 0);
+
+    pkt->frequency_offset_error = (int32_t)((SX1302_PKT_FREQ_OFFSET_19_16(head, 0) << 16) | (SX1302_PKT_FREQ_OFFSET_15_8(head, 0) << 8) | (SX1302_PKT_FREQ_OFFSET_7_0(head, 0) << 0));
     if (pkt->frequency_offset_error >= (1<<19)) { /* Handle signed value on 20bits */
         pkt->frequency_offset_error = (pkt->frequency_offset_error - (1<<20));
     }
 
     /* Packet timestamp (32MHz ) */
-    pkt->timestamp_cnt  = (uint32_t)((SX1302_PKT_TIMESTAMP_7_0(self->buffer, self->buffer_index + pkt->rxbytenb_modem) <<  0) & 0x000000FF);
-    pkt->timestamp_cnt |= (uint32_t)((SX1302_PKT_TIMESTAMP_15_8(self->buffer, self->buffer_index + pkt->rxbytenb_modem) <<  8) & 0x0000FF00);
-    pkt->timestamp_cnt |= (uint32_t)((SX1302_PKT_TIMESTAMP_23_16(self->buffer, self->buffer_index + pkt->rxbytenb_modem) << 16) & 0x00FF0000);
-    pkt->timestamp_cnt |= (uint32_t)((SX1302_PKT_TIMESTAMP_31_24(self->buffer, self->buffer_index + pkt->rxbytenb_modem) << 24) & 0xFF000000);
-
-    /* TS metrics: it is expected the nb_symbols parameter is set to 0 here */
-    for (i = 0; i < (pkt->num_ts_metrics_stored * 2); i++) {
-        pkt->timestamp_avg[i] = (int8_t)SX1302_PKT_NUM_TS_METRICS(self->buffer, self->buffer_index + pkt->rxbytenb_modem + 1 + i);
-        pkt->timestamp_stddev[i] = 0; /* no stddev when nb_symbols == 0 */
-    }
+    pkt->timestamp_cnt = ((uint32_t)SX1302_PKT_TIMESTAMP_31_24(meta, 0) << 24) |
+                         ((uint32_t)SX1302_PKT_TIMESTAMP_23_16(meta, 0) << 16) |
+                         ((uint32_t)SX1302_PKT_TIMESTAMP_15_8(meta, 0) << 8) |
+                         ((uint32_t)SX1302_PKT_TIMESTAMP_7_0(meta, 0) << 0);
+
+    /* TS metrics: it is expected the nb_symbols parameter is set to 0 here, no stddev */
+    memcpy((void *)pkt->timestamp_avg, (const void *)(meta + 22), pkt->num_ts_metrics_stored * 2);
+    memset((void *)pkt->timestamp_stddev, 0, pkt->num_ts_metrics_stored * 2);
 
     DEBUG_MSG   ("-----------------\n");
     DEBUG_PRINTF("  modem:      %u\n", pkt->modem_id);
@@ -322,6 +434,7 @@ int rx_buffer_pop(rx_buffer_t * self, rx_packet_t * pkt) {
     DEBUG_PRINTF("  codr:       %u\n", pkt->coding_rate);
     DEBUG_PRINTF("  datr:       %u\n", pkt->rx_rate_sf);
     DEBUG_PRINTF("  num_ts:     %u\n", pkt->num_ts_metrics_stored);
+#if DEBUG_SX1302 == 1
     if (pkt->num_ts_metrics_stored > 0) {
         DEBUG_MSG("  ts_avg:     ");
         for (i = 0; i < (pkt->num_ts_metrics_stored * 2); i++) {
@@ -330,6 +443,7 @@ int rx_buffer_pop(rx_buffer_t * self, rx_packet_t * pkt) {
         DEBUG_MSG("\n");
         DEBUG_MSG("  ts_stdev:   NONE (nb_symbols=0)\n");
     }
+#endif
     DEBUG_MSG   ("-----------------\n");
 
     /* Sanity checks: check the range of few metadata */
@@ -351,11 +465,11 @@ int rx_buffer_pop(rx_buffer_t * self, rx_packet_t * pkt) {
         }
     }
 
-    /* Parse & copy payload in packet struct */
-    memcpy((void *)pkt->payload, (void *)(&(self->buffer[self->buffer_index + SX1302_PKT_HEAD_METADATA])), pkt->rxbytenb_modem);
+    /* Reference the payload in the rx_buffer, valid until the next fetch */
+    pkt->payload_ref = head + SX1302_PKT_HEAD_METADATA;
 
     /* Move buffer index toward next message */
-    self->buffer_index += (SX1302_PKT_HEAD_METADATA + pkt->rxbytenb_modem + SX1302_PKT_TAIL_METADATA + (2 * pkt->num_ts_metrics_stored));
+    self->buffer_index += pkt_num_bytes;
 
     /* Update the number of packets currently stored in the rx_buffer */
     self->buffer_pkt_nb -= 1;
@@ -363,6 +477,17 @@ int rx_buffer_pop(rx_buffer_t * self, rx_packet_t * pkt) {
     return LGW_REG_SUCCESS;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int rx_buffer_reset_stats(rx_buffer_t * self) {
+    /* Check input params */
+    CHECK_NULL(self);
+
+    memset(&(self->stats), 0, sizeof self->stats);
+
+    return LGW_REG_SUCCESS;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- DEBUG FUNCTIONS DEFINITION ------------------------------------------- */
 
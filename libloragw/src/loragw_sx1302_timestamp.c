@@ -21,16 +21,32 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* boolean type */
 #include <stdio.h>      /* printf fprintf */
 #include <memory.h>     /* memset */
+#include <time.h>       /* clock_gettime */
+#include <math.h>       /* fabs */
 #include <inttypes.h>   /* PRIx64, PRIu64... */
 #include <assert.h>
 
+#if defined(__SSE2__)
+    #include <emmintrin.h>  /* SSE2 intrinsics */
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>   /* NEON intrinsics */
+#endif
+
 #include "loragw_sx1302_timestamp.h"
 #include "loragw_reg.h"
 #include "loragw_aux.h"
+#include "loragw_clkdisc.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -56,12 +72,42 @@ struct timestamp_pps_history_s {
     uint8_t size; /* current size */
 };
 
+/* Linear model mapping the host CLOCK_MONOTONIC to the 64-bits concentrator counter.
+    Written by the thread accessing the concentrator (under the caller lock), read lock-free
+    by any thread thanks to the sequence counter (odd while an update is in progress) */
+struct timestamp_model_s {
+    uint32_t seq;               /* sequence counter */
+    uint32_t valid;             /* set once a first sample has been taken */
+    uint64_t host_ref_ns;       /* host time of the reference sample */
+    uint64_t cnt_ref_us;        /* concentrator counter of the reference sample */
+    int64_t  drift_ppb;         /* concentrator counter drift versus host clock, in parts per billion */
+    int64_t  drift_err_ppb;     /* drift uncertainty, in parts per billion */
+    uint64_t err_ref_ns;        /* uncertainty of the reference sample (half of the bus read duration) */
+    /* writer only */
+    uint64_t host_anchor_ns;    /* host time of the sample used as start of the drift measurement */
+    uint64_t cnt_anchor_us;     /* concentrator counter of the sample used as start of the drift measurement */
+    bool     drift_valid;       /* set once the drift has been measured */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
 #define PRECISION_TIMESTAMP_TS_METRICS_MAX  32 /* reduce number of metrics to better match GW v2 fine timestamp (max is 255) */
 #define PRECISION_TIMESTAMP_NB_SYMBOLS      0
 
+#define PRECISION_TIMESTAMP_PPS_JITTER_S    30E-9 /* typical timepulse jitter of a GPS module */
+#define PRECISION_TIMESTAMP_XTAL_STD_MAX    50E-9 /* use the clock discipline XTAL error once it is that accurate */
+
+#define PRECISION_TIMESTAMP_METRICS_MAX     (2 * PRECISION_TIMESTAMP_TS_METRICS_MAX) /* 2 metrics per symbol */
+
+/* Coarse timestamp correction to match with GW v2 (end of header -> end of preamble), in 32MHz ticks (32e6 / 125e3 = 256) */
+#define PREAMBLE_HDR_OFFSET(sf, nb_symb)    ((256 * (1 << (sf)) * (nb_symb)) + (256 * (((1 << (sf)) / 4) - 1)))
+
+#define TIMESTAMP_MODEL_DRIFT_INTERVAL_NS   1000000000ULL /* minimum interval between 2 samples to measure the drift */
+#define TIMESTAMP_MODEL_DRIFT_MAX_PPB       200000        /* above, the counter is considered reset or corrupted */
+#define TIMESTAMP_MODEL_DRIFT_ERR_PPB       100000        /* drift uncertainty until it has been measured */
+#define TIMESTAMP_MODEL_DRIFT_ERR_MIN_PPB   1000          /* minimum drift uncertainty */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
@@ -72,6 +118,40 @@ static struct timestamp_pps_history_s timestamp_pps_history = {
     .size = 0
 };
 
+/* clock discipline of the 32MHz counter on the PPS history */
+static struct lgw_clkdisc_s timestamp_clkdisc;
+static bool timestamp_clkdisc_init = false;
+
+/* host clock to concentrator counter model */
+static struct timestamp_model_s timestamp_model;
+
+/* per SF, end of header to end of preamble offset (8 preamble + 4 sync symbols, +2 for SF5/SF6) */
+static const uint32_t precise_timestamp_offset_preamble_hdr[13] = {
+    0, 0, 0, 0, 0,
+    PREAMBLE_HDR_OFFSET(5, 14),
+    PREAMBLE_HDR_OFFSET(6, 14),
+    PREAMBLE_HDR_OFFSET(7, 12),
+    PREAMBLE_HDR_OFFSET(8, 12),
+    PREAMBLE_HDR_OFFSET(9, 12),
+    PREAMBLE_HDR_OFFSET(10, 12),
+    PREAMBLE_HDR_OFFSET(11, 12),
+    PREAMBLE_HDR_OFFSET(12, 12)
+};
+
+/* per SF, max number of timestamp metrics used, reduce fine timestamp variation versus packet duration */
+static const uint8_t precise_timestamp_metrics_clip[13] = {
+    0, 0, 0, 0, 0,
+    32, 32, 32, 32, 32, 16, 8, 4
+};
+
+/* weights of the metrics in the sum of their cumulative sum, the last N are used for N metrics */
+static const int16_t precise_timestamp_metrics_weight[PRECISION_TIMESTAMP_METRICS_MAX] = {
+    64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49,
+    48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33,
+    32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+    16, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
@@ -91,11 +171,27 @@ int32_t precision_timestamp_correction(uint8_t bandwidth, uint8_t datarate, uint
 
 
 /**
-@brief TODO
-@param TODO
-@return The correction to be applied to the packet timestamp, in microseconds
+@brief Sum the cumulative sum of the timestamp metrics, as sum(metrics[i] * (nb - i))
+@param metrics timestamp metrics
+@param nb number of metrics, up to PRECISION_TIMESTAMP_METRICS_MAX
+@return the sum of the cumulative sum
+*/
+static int32_t precise_timestamp_metrics_sum(const int8_t * metrics, int nb);
+
+/**
+@brief Find the PPS of the history in the second preceding the given timestamp (first one in the history array)
+@param timestamp_cnt 32MHz timestamp
+@return index in the PPS history, -1 if not found
+*/
+static int timestamp_pps_history_search(uint32_t timestamp_cnt);
+
+/**
+@brief Update the host clock to concentrator counter model with a new sample
+@param host_start_ns host time before the counter read
+@param host_end_ns host time after the counter read
+@param cnt_us the 64-bits concentrator counter read
 */
-void timestamp_pps_history_save(uint32_t timestamp_pps_reg);
+void timestamp_model_update(uint64_t host_start_ns, uint64_t host_end_ns, uint64_t cnt_us);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
@@ -274,6 +370,13 @@ void timestamp_pps_history_save(uint32_t timestamp_pps_reg) {
             timestamp_pps_history.size += 1;
         }
 
+        /* Track the PPS phase and XTAL error */
+        if (timestamp_clkdisc_init == false) {
+            lgw_clkdisc_init(&timestamp_clkdisc, 32E6, PRECISION_TIMESTAMP_PPS_JITTER_S);
+            timestamp_clkdisc_init = true;
+        }
+        lgw_clkdisc_update(&timestamp_clkdisc, timestamp_pps_reg);
+
 #if 0
         printf("---- timestamp PPS history (idx:%u size:%u) ----\n",  timestamp_pps_history.idx,  timestamp_pps_history.size);
         for (int i = 0; i < timestamp_pps_history.size; i++) {
@@ -284,11 +387,134 @@ void timestamp_pps_history_save(uint32_t timestamp_pps_reg) {
     }
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int timestamp_pps_history_search(uint32_t timestamp_cnt) {
+    int i;
+    uint32_t found = 0;
+
+    /* no early exit, the whole history is checked in a fixed loop the compiler can unroll */
+    for (i = 0; i < MAX_TIMESTAMP_PPS_HISTORY; i++) {
+        found |= (uint32_t)((timestamp_cnt - timestamp_pps_history.history[i]) < 32000000) << i;
+    }
+    found &= (1U << timestamp_pps_history.size) - 1;
+
+    return (found != 0) ? __builtin_ctz(found) : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int32_t precise_timestamp_metrics_sum(const int8_t * metrics, int nb) {
+    const int16_t * weight = &precise_timestamp_metrics_weight[PRECISION_TIMESTAMP_METRICS_MAX - nb];
+    int32_t sum = 0;
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    __m128i m, m_lo, m_hi;
+
+    for (; i <= (nb - 16); i += 16) {
+        m = _mm_loadu_si128((const __m128i *)&metrics[i]);
+        m_lo = _mm_srai_epi16(_mm_unpacklo_epi8(m, m), 8); /* sign extension to 16-bits */
+        m_hi = _mm_srai_epi16(_mm_unpackhi_epi8(m, m), 8);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(m_lo, _mm_loadu_si128((const __m128i *)&weight[i])));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(m_hi, _mm_loadu_si128((const __m128i *)&weight[i + 8])));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_cvtsi128_si32(acc);
+#elif defined(__ARM_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+    int16x8_t m, w;
+
+    for (; i <= (nb - 8); i += 8) {
+        m = vmovl_s8(vld1_s8(&metrics[i]));
+        w = vld1q_s16(&weight[i]);
+        acc = vmlal_s16(acc, vget_low_s16(m), vget_low_s16(w));
+        acc = vmlal_s16(acc, vget_high_s16(m), vget_high_s16(w));
+    }
+    sum = vgetq_lane_s32(acc, 0) + vgetq_lane_s32(acc, 1) + vgetq_lane_s32(acc, 2) + vgetq_lane_s32(acc, 3);
+#endif
+
+    /* remaining metrics (all of them without SIMD) */
+    for (; i < nb; i++) {
+        sum += (int32_t)metrics[i] * weight[i];
+    }
+
+    return sum;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t host_time_ns(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void timestamp_model_update(uint64_t host_start_ns, uint64_t host_end_ns, uint64_t cnt_us) {
+    struct timestamp_model_s * m = &timestamp_model;
+    uint64_t host_ns = host_start_ns + ((host_end_ns - host_start_ns) / 2); /* middle of the bus read */
+    int64_t drift_ppb = m->drift_ppb;
+    int64_t drift_err_ppb = m->drift_err_ppb;
+    double dt_ns, meas_ppb;
+
+    if (m->valid == 0) {
+        m->host_anchor_ns = host_ns;
+        m->cnt_anchor_us = cnt_us;
+        m->drift_valid = false;
+        drift_ppb = 0;
+        drift_err_ppb = TIMESTAMP_MODEL_DRIFT_ERR_PPB;
+    } else if ((host_ns - m->host_anchor_ns) >= TIMESTAMP_MODEL_DRIFT_INTERVAL_NS) {
+        /* Measure the drift since the anchor sample */
+        dt_ns = (double)(host_ns - m->host_anchor_ns);
+        meas_ppb = (((double)(int64_t)(cnt_us - m->cnt_anchor_us) * 1e3) - dt_ns) * 1e9 / dt_ns;
+        if (fabs(meas_ppb) > TIMESTAMP_MODEL_DRIFT_MAX_PPB) {
+            /* Counter has been reset or read wrongly, restart the model from this sample */
+            DEBUG_PRINTF("WARNING: timestamp model reset (drift %.0lf ppb)\n", meas_ppb);
+            m->drift_valid = false;
+            drift_ppb = 0;
+            drift_err_ppb = TIMESTAMP_MODEL_DRIFT_ERR_PPB;
+        } else if (m->drift_valid == false) {
+            m->drift_valid = true;
+            drift_ppb = (int64_t)meas_ppb;
+            drift_err_ppb = (int64_t)(fabs(meas_ppb) / 4) + TIMESTAMP_MODEL_DRIFT_ERR_MIN_PPB;
+        } else {
+            /* Low-pass filter the drift, and take the last measurement deviation as uncertainty */
+            drift_err_ppb = (int64_t)fabs(meas_ppb - (double)drift_ppb) + TIMESTAMP_MODEL_DRIFT_ERR_MIN_PPB;
+            drift_ppb += ((int64_t)meas_ppb - drift_ppb) / 4;
+        }
+        m->host_anchor_ns = host_ns;
+        m->cnt_anchor_us = cnt_us;
+    }
+
+    /* Publish the new reference */
+    __atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&m->host_ref_ns, host_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&m->cnt_ref_us, cnt_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&m->drift_ppb, drift_ppb, __ATOMIC_RELAXED);
+    __atomic_store_n(&m->drift_err_ppb, drift_err_ppb, __ATOMIC_RELAXED);
+    __atomic_store_n(&m->err_ref_ns, (host_end_ns - host_start_ns) / 2, __ATOMIC_RELAXED);
+    __atomic_store_n(&m->valid, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELEASE);
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 void timestamp_counter_new(timestamp_counter_t * self) {
     memset(self, 0, sizeof(*self));
+
+    /* The counter is restarted, so is the model */
+    __atomic_store_n(&timestamp_model.seq, timestamp_model.seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&timestamp_model.valid, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&timestamp_model.seq, timestamp_model.seq + 1, __ATOMIC_RELEASE);
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -303,13 +529,12 @@ void timestamp_counter_update(timestamp_counter_t * self, uint32_t pps, uint32_t
     //struct timestamp_info_s* tinfo = (pps == true) ? &self->pps : &self->inst;
 
     /* Check if counter has wrapped, and update wrap status if necessary */
+    /* Note: the total number of rollovers is kept to provide a 64-bits counter, the 32-bits counter only uses its 5 LSBs */
     if (pps < self->pps.counter_us_27bits_ref) {
         self->pps.counter_us_27bits_wrap += 1;
-        self->pps.counter_us_27bits_wrap %= 32;
     }
     if (inst < self->inst.counter_us_27bits_ref) {
         self->inst.counter_us_27bits_wrap += 1;
-        self->inst.counter_us_27bits_wrap %= 32;
     }
 
     /* Update counter reference */
@@ -325,16 +550,19 @@ int timestamp_counter_get(timestamp_counter_t * self, uint32_t * inst, uint32_t
     uint8_t buff_wa[8];
     uint32_t counter_inst_us_raw_27bits_now;
     uint32_t counter_pps_us_raw_27bits_now;
+    uint64_t host_start_ns, host_end_ns;
 
     /* Get the freerun and pps 32MHz timestamp counters - 8 bytes
             0 -> 3 : PPS counter
             4 -> 7 : Freerun counter (inst)
     */
+    host_start_ns = host_time_ns();
     x = lgw_reg_rb(SX1302_REG_TIMESTAMP_TIMESTAMP_PPS_MSB2_TIMESTAMP_PPS, &buff[0], 8);
     if (x != LGW_REG_SUCCESS) {
         printf("ERROR: Failed to get timestamp counter value\n");
         return -1;
     }
+    host_end_ns = host_time_ns();
 
     /* Workaround concentrator chip issue:
         - read MSB again
@@ -346,19 +574,22 @@ int timestamp_counter_get(timestamp_counter_t * self, uint32_t * inst, uint32_t
         return -1;
     }
     if ((buff[0] != buff_wa[0]) || (buff[4] != buff_wa[4])) {
+        host_start_ns = host_time_ns();
         x = lgw_reg_rb(SX1302_REG_TIMESTAMP_TIMESTAMP_PPS_MSB2_TIMESTAMP_PPS, &buff_wa[0], 8);
         if (x != LGW_REG_SUCCESS) {
             printf("ERROR: Failed to get timestamp counter MSB value\n");
             return -1;
         }
+        host_end_ns = host_time_ns();
         memcpy(buff, buff_wa, 8); /* use the new read value */
     }
 
     counter_pps_us_raw_27bits_now  = (buff[0]<<24) | (buff[1]<<16) | (buff[2]<<8) | buff[3];
     counter_inst_us_raw_27bits_now = (buff[4]<<24) | (buff[5]<<16) | (buff[6]<<8) | buff[7];
 
-    /* Store PPS counter to history, for fine timestamp calculation */
+    /* Store PPS counter to history, and keep it as reference for the fine timestamp of packets fetched */
     timestamp_pps_history_save(counter_pps_us_raw_27bits_now);
+    self->pps_reg = counter_pps_us_raw_27bits_now;
 
     /* Scale to 1MHz */
     counter_pps_us_raw_27bits_now /= 32;
@@ -371,16 +602,54 @@ int timestamp_counter_get(timestamp_counter_t * self, uint32_t * inst, uint32_t
     *inst = timestamp_counter_expand(self, false, counter_inst_us_raw_27bits_now);
     *pps  = timestamp_counter_expand(self, true, counter_pps_us_raw_27bits_now);
 
+    /* Refresh the host clock to concentrator counter model */
+    timestamp_model_update(host_start_ns, host_end_ns, timestamp_counter_expand64(self, false, counter_inst_us_raw_27bits_now));
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int timestamp_counter_estimate(uint64_t * inst, uint32_t * err_us) {
+    struct timestamp_model_s * m = &timestamp_model;
+    uint32_t seq, valid;
+    uint64_t host_ref_ns, cnt_ref_us, err_ref_ns;
+    int64_t drift_ppb, drift_err_ppb;
+    double elapsed_ns;
+
+    CHECK_NULL(inst);
+    CHECK_NULL(err_us);
+
+    /* Get a consistent copy of the model, retry if it has been updated meanwhile */
+    do {
+        seq = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE);
+        valid = __atomic_load_n(&m->valid, __ATOMIC_RELAXED);
+        host_ref_ns = __atomic_load_n(&m->host_ref_ns, __ATOMIC_RELAXED);
+        cnt_ref_us = __atomic_load_n(&m->cnt_ref_us, __ATOMIC_RELAXED);
+        drift_ppb = __atomic_load_n(&m->drift_ppb, __ATOMIC_RELAXED);
+        drift_err_ppb = __atomic_load_n(&m->drift_err_ppb, __ATOMIC_RELAXED);
+        err_ref_ns = __atomic_load_n(&m->err_ref_ns, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (((seq & 1) != 0) || (seq != __atomic_load_n(&m->seq, __ATOMIC_RELAXED)));
+
+    if (valid == 0) {
+        return -1;
+    }
+
+    /* Extrapolate from the reference sample */
+    elapsed_ns = (double)(int64_t)(host_time_ns() - host_ref_ns);
+    *inst = cnt_ref_us + (uint64_t)((elapsed_ns + (elapsed_ns * (double)drift_ppb / 1e9)) / 1e3);
+    *err_us = (uint32_t)(((double)err_ref_ns + (fabs(elapsed_ns) * (double)drift_err_ppb / 1e9)) / 1e3) + 1; /* +1 for 1us resolution */
+
     return 0;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 uint32_t timestamp_counter_expand(timestamp_counter_t * self, bool pps, uint32_t cnt_us) {
-    struct timestamp_info_s* tinfo = (pps == true) ? &self->pps : &self->inst;
     uint32_t counter_us_32bits;
 
-    counter_us_32bits = (tinfo->counter_us_27bits_wrap << 27) | cnt_us;
+    counter_us_32bits = (uint32_t)timestamp_counter_expand64(self, pps, cnt_us);
 
 #if 0
     /* DEBUG: to be enabled when running test_loragw_counter test application
@@ -388,19 +657,31 @@ uint32_t timestamp_counter_expand(timestamp_counter_t * self, bool pps, uint32_t
         > set datafile separator comma
         > plot for [col=1:2:1] 'log_count.txt' using col with lines
     */
-    printf("%u,%u,%u\n", cnt_us, counter_us_32bits, tinfo->counter_us_27bits_wrap);
+    printf("%u,%u,%u\n", cnt_us, counter_us_32bits, (pps == true) ? self->pps.counter_us_27bits_wrap : self->inst.counter_us_27bits_wrap);
 #endif
 
     return counter_us_32bits;
 }
 
-
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 uint32_t timestamp_pkt_expand(timestamp_counter_t * self, uint32_t pkt_cnt_us) {
+    return (uint32_t)timestamp_pkt_expand64(self, pkt_cnt_us);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t timestamp_counter_expand64(timestamp_counter_t * self, bool pps, uint32_t cnt_us) {
+    struct timestamp_info_s* tinfo = (pps == true) ? &self->pps : &self->inst;
+
+    return ((uint64_t)tinfo->counter_us_27bits_wrap << 27) | cnt_us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t timestamp_pkt_expand64(timestamp_counter_t * self, uint32_t pkt_cnt_us) {
     struct timestamp_info_s* tinfo = &self->inst;
-    uint32_t counter_us_32bits;
-    uint8_t wrap_status;
+    uint32_t wrap_status;
 
     /* Check if counter has wrapped since the packet has been received in the sx1302 internal FIFO */
     /* If the sx1302 counter was greater than the pkt timestamp, it means that the internal counter
@@ -413,14 +694,14 @@ uint32_t timestamp_pkt_expand(timestamp_counter_t * self, uint32_t pkt_cnt_us) {
         ||: sx1302 internal counter rollover (wrap)
     */
 
-    /* Use current wrap counter or previous ? */
-    wrap_status = tinfo->counter_us_27bits_wrap - ((tinfo->counter_us_27bits_ref >= pkt_cnt_us) ? 0 : 1);
-    wrap_status &= 0x1F; /* [0..31] */
+    /* Use current wrap counter or previous ? (no previous one before the first rollover) */
+    wrap_status = tinfo->counter_us_27bits_wrap;
+    if ((tinfo->counter_us_27bits_ref < pkt_cnt_us) && (wrap_status > 0)) {
+        wrap_status -= 1;
+    }
 
     /* Expand packet counter */
-    counter_us_32bits = (wrap_status << 27) | pkt_cnt_us;
-
-    return counter_us_32bits;
+    return ((uint64_t)wrap_status << 27) | pkt_cnt_us;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -475,24 +756,27 @@ int32_t timestamp_counter_correction(lgw_context_t * context, uint8_t bandwidth,
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t timestamp_cnt, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime) {
-    int i, x, timestamp_pps_idx, timestamp_pps_idx_next, timestamp_pps_idx_prev;
+int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t timestamp_cnt, uint32_t timestamp_pps_reg, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime) {
+    int timestamp_pps_idx, timestamp_pps_idx_next, timestamp_pps_idx_prev;
     int32_t ftime_sum;
-    int32_t ftime[256];
     float ftime_mean;
     uint32_t timestamp_cnt_end_of_preamble;
     uint32_t timestamp_pps = 0;
-    uint32_t timestamp_pps_reg = 0;
     uint32_t offset_preamble_hdr;
-    uint8_t buff[4];
     uint32_t diff_pps;
     double pkt_ftime;
     uint8_t ts_metrics_nb_clipped;
     double xtal_correct;
+    double xtal_freq, xtal_freq_std;
+    double pps_corr = 0.0;
 
     /* Check input parameters */
     CHECK_NULL(ts_metrics);
     CHECK_NULL(result_ftime);
+    if ((sf < 5) || (sf > 12) || (ts_metrics_nb == 0)) {
+        printf("ERROR: cannot compute ftime for SF%u with %u metrics\n", sf, ts_metrics_nb);
+        return -1;
+    }
 
     /* Check if we can calculate a ftime */
     if (timestamp_pps_history.size < MAX_TIMESTAMP_PPS_HISTORY) {
@@ -501,8 +785,7 @@ int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics
     }
 
     /* Coarse timestamp correction to match with GW v2 (end of header -> end of preamble) */
-    offset_preamble_hdr =   256 * (1 << sf) * (8 + 4 + (((sf == 5) || (sf == 6)) ? 2 : 0)) +
-                            256 * ((1 << sf) / 4 - 1); /* 32e6 / 125e3 = 256 */
+    offset_preamble_hdr = precise_timestamp_offset_preamble_hdr[sf];
 
     /* Take the packet frequency error in account in the offset */
     offset_preamble_hdr += ((double)offset_preamble_hdr * pkt_freq_error + 0.5);
@@ -513,87 +796,60 @@ int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics
     timestamp_cnt = timestamp_cnt_end_of_preamble;
 
     /* Clip the number of metrics depending on Spreading Factor, reduce fine timestamp variation versus packet duration */
-    switch (sf) {
-        case 12:
-            ts_metrics_nb_clipped = MIN(4, ts_metrics_nb);
-            break;
-        case 11:
-            ts_metrics_nb_clipped = MIN(8, ts_metrics_nb);
-            break;
-        case 10:
-            ts_metrics_nb_clipped = MIN(16, ts_metrics_nb);
-            break;
-        default:
-            ts_metrics_nb_clipped = MIN(32, ts_metrics_nb);
-            break;
-    }
+    ts_metrics_nb_clipped = MIN(precise_timestamp_metrics_clip[sf], ts_metrics_nb);
 
 #if 0
     printf("%s\n", __FUNCTION__);
     printf("ts_metrics_nb_clipped*2: %u\n", ts_metrics_nb_clipped * 2);
-    for (i = 0; i < (2 * ts_metrics_nb_clipped); i++) {
+    for (int i = 0; i < (2 * ts_metrics_nb_clipped); i++) {
         printf("%d ", ts_metrics[i]);
     }
     printf("\n");
 #endif
 
-    /* Compute the ftime cumulative sum */
-    ftime[0] = (int32_t)ts_metrics[0];
-    ftime_sum = ftime[0];
-    for (i = 1; i < (2 * ts_metrics_nb_clipped); i++) {
-        ftime[i] = ftime[i-1] + ts_metrics[i];
-        ftime_sum += ftime[i];
-    }
-
-    /* Compute the mean of the cumulative sum */
+    /* Compute the sum of the ftime cumulative sum, and its mean */
+    ftime_sum = precise_timestamp_metrics_sum(ts_metrics, 2 * ts_metrics_nb_clipped);
     ftime_mean = (float)ftime_sum / (float)(2 * ts_metrics_nb_clipped);
 
     /* Find the last timestamp_pps before packet to use as reference for ftime */
-    x = lgw_reg_rb(SX1302_REG_TIMESTAMP_TIMESTAMP_PPS_MSB2_TIMESTAMP_PPS , &buff[0], 4);
-    if (x != LGW_REG_SUCCESS) {
-        printf("ERROR: Failed to get timestamp counter value\n");
-        return 0;
-    }
-    timestamp_pps_reg  = (uint32_t)((buff[0] << 24) & 0xFF000000);
-    timestamp_pps_reg |= (uint32_t)((buff[1] << 16) & 0x00FF0000);
-    timestamp_pps_reg |= (uint32_t)((buff[2] << 8)  & 0x0000FF00);
-    timestamp_pps_reg |= (uint32_t)((buff[3] << 0)  & 0x000000FF);
-
-    /* Ensure that the timestamp PPS history is up-to-date */
-    timestamp_pps_history_save(timestamp_pps_reg);
-
-    /* Check if timestamp_pps_reg we just read is the reference to be used to compute ftime or not */
-    if ((timestamp_cnt - timestamp_pps_reg) > 32e6) {
-        /* The timestamp_pps_reg we just read is after the packet timestamp, we need to rewind */
-        for (timestamp_pps_idx = 0; timestamp_pps_idx < timestamp_pps_history.size; timestamp_pps_idx++) {
-            /* search the pps counter in history */
-            if ((timestamp_cnt - timestamp_pps_history.history[timestamp_pps_idx]) < 32e6) {
-                timestamp_pps = timestamp_pps_history.history[timestamp_pps_idx];
-                DEBUG_PRINTF("==> timestamp_pps found at history[%d] => %u\n", timestamp_pps_idx, timestamp_pps);
-                break;
-            }
-        }
-        if (timestamp_pps_idx == timestamp_pps_history.size) {
+    /* Note: timestamp_pps_reg has been captured, and saved to the PPS history, once for all the packets
+        fetched (see timestamp_counter_get), so that no register access is needed here */
+
+    /* Check if timestamp_pps_reg captured is the reference to be used to compute ftime or not */
+    if ((timestamp_cnt - timestamp_pps_reg) > 32000000) {
+        /* The timestamp_pps_reg captured is after the packet timestamp, we need to rewind */
+        timestamp_pps_idx = timestamp_pps_history_search(timestamp_cnt);
+        if (timestamp_pps_idx < 0) {
             printf("ERROR: failed to find the reference timestamp_pps, cannot compute ftime\n");
             return -1;
         }
+        timestamp_pps = timestamp_pps_history.history[timestamp_pps_idx];
+        DEBUG_PRINTF("==> timestamp_pps found at history[%d] => %u\n", timestamp_pps_idx, timestamp_pps);
 
         /* Calculate the Xtal error between the reference PPS we just found and the next one */
-        timestamp_pps_idx_next = (timestamp_pps_idx == (MAX_TIMESTAMP_PPS_HISTORY - 1)) ? 0 : timestamp_pps_idx + 1;
-        diff_pps = timestamp_pps_history.history[timestamp_pps_idx_next] - timestamp_pps_history.history[timestamp_pps_idx];
+        timestamp_pps_idx_next = (timestamp_pps_idx + 1) % MAX_TIMESTAMP_PPS_HISTORY;
+        diff_pps = timestamp_pps_history.history[timestamp_pps_idx_next] - timestamp_pps;
         xtal_correct = (double)32e6 / (double)(diff_pps);
     } else {
-        /* The timestamp_pps_reg we just read is the reference we use to calculate the fine timestamp */
+        /* The timestamp_pps_reg captured is the reference we use to calculate the fine timestamp */
         timestamp_pps = timestamp_pps_reg;
         DEBUG_PRINTF("==> timestamp_pps => %u\n", timestamp_pps);
 
         /* Calculate the Xtal error between the reference PPS we just found and the previous one */
         timestamp_pps_idx = timestamp_pps_history.idx;
-        timestamp_pps_idx_prev = (timestamp_pps_idx == 0) ? (MAX_TIMESTAMP_PPS_HISTORY - 1) : (timestamp_pps_idx - 1);
+        timestamp_pps_idx_prev = (timestamp_pps_idx + MAX_TIMESTAMP_PPS_HISTORY - 1) % MAX_TIMESTAMP_PPS_HISTORY;
         diff_pps = timestamp_pps_history.history[timestamp_pps_idx] - timestamp_pps_history.history[timestamp_pps_idx_prev];
         xtal_correct = (double)32e6 / (double)(diff_pps);
     }
 
+    /* Prefer the PPS phase and XTAL error tracked over the whole PPS history, less sensitive to PPS jitter */
+    if ((lgw_clkdisc_get(&timestamp_clkdisc, &xtal_freq, &xtal_freq_std, NULL) == true) && (xtal_freq_std < PRECISION_TIMESTAMP_XTAL_STD_MAX)) {
+        xtal_correct = 1.0 / xtal_freq;
+        if (lgw_clkdisc_pps_correction(&timestamp_clkdisc, timestamp_pps, &pps_corr) != LGW_CLKDISC_SUCCESS) {
+            pps_corr = 0.0;
+        }
+    }
+
     /* Sanity Check on xtal_correct */
     if ((xtal_correct > 1.2) || (xtal_correct < 0.8)) {
         printf("ERROR: xtal_error is invalid (%.15lf)\n", xtal_correct);
@@ -608,7 +864,7 @@ int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics
     DEBUG_PRINTF("diff_pps : %d\n", diff_pps);
 
     /* Compute the fine timestamp */
-    pkt_ftime = (double)diff_pps + (double)ftime_mean;
+    pkt_ftime = (double)diff_pps + (double)ftime_mean - pps_corr;
     DEBUG_PRINTF("pkt_ftime = %f\n", pkt_ftime);
 
     /* Add the DC notch filtering delay if necessary */
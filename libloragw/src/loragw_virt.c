@@ -0,0 +1,481 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Virtual concentrator: synthetic uplink traffic model and TX timing
+    recorder, used by the HAL in place of the hardware when enabled.
+
+    The end-devices population is drawn once at start: each device has a
+    DevAddr, a spreading factor (following the SF weights and the enabled
+    SFs), a mean RSSI and a mean SNR. Uplinks form a Poisson process of
+    rate nb_dev / period_s, each one sent by a random device on a random
+    enabled multi-SF channel, as a LoRaWAN unconfirmed data up frame when
+    the payload is large enough. The concentrator counter is the host
+    monotonic clock since start, wrapping on 32 bits like the SX1302 one.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset */
+#include <math.h>       /* log sqrt cos */
+#include <time.h>       /* clock_gettime */
+
+#include "loragw_hal.h"
+#include "loragw_sx1302.h"
+#include "loragw_virt.h"
+#include "tinymt32.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_HAL == 1
+    #define DEBUG_MSG(str)                fprintf(stdout, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stdout,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                 if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_HAL_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                 if(a==NULL){return LGW_HAL_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define VIRT_PKT_METADATA       23      /* RX buffer bytes added to each payload (header and tail metadata) */
+#define VIRT_FADING_STD         2.0     /* standard deviation of the RSSI and SNR variations between packets of a device, in dB */
+#define VIRT_SNR_MIN            -20.0   /* SNR limits of the demodulators, in dB */
+#define VIRT_SNR_MAX            15.0
+#define VIRT_EUI_BASE           0x00FFFE0000000000 /* the low 32 bits are the seed */
+
+#define LORAWAN_MHDR_UNCONF_UP  0x40
+#define LORAWAN_HDR_SIZE        8       /* MHDR + DevAddr + FCtrl + FCnt */
+#define LORAWAN_MIC_SIZE        4
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef struct virt_dev_s {
+    uint32_t    dev_addr;
+    uint16_t    fcnt;
+    uint8_t     datarate;
+    float       rssi;
+    float       snr;
+} virt_dev_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static bool virt_started = false;
+static uint32_t virt_seed;
+static uint64_t virt_t0_us;                     /* host monotonic time of the counter origin */
+static tinymt32_t virt_random;
+
+static virt_dev_t * virt_dev = NULL;
+static uint32_t virt_nb_dev;
+static uint8_t virt_chan[LGW_MULTI_NB];        /* enabled multi-SF IF chains */
+static uint8_t virt_nb_chan;
+static double virt_rate_us;                     /* aggregated uplink rate, per microsecond */
+static uint64_t virt_next_rx_us;                /* counter value at the end of the next uplink */
+
+static uint64_t virt_tx_trig_us[LGW_RF_CHAIN_NB];
+static uint64_t virt_tx_end_us[LGW_RF_CHAIN_NB];
+
+static struct lgw_rx_stats_s virt_rx_stats;
+static struct lgw_virt_tx_stats_s virt_tx_stats;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint64_t host_time_us(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)t.tv_sec * 1000000 + (uint64_t)t.tv_nsec / 1000;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double random_uniform(void) {
+    return (double)tinymt32_generate_float01(&virt_random); /* [0,1) */
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double random_gauss(double mean, double std) {
+    double u1 = 1.0 - random_uniform(); /* (0,1] for the log */
+    double u2 = random_uniform();
+
+    return mean + std * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t random_interval_us(void) {
+    return (uint64_t)(-log(1.0 - random_uniform()) / virt_rate_us) + 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void virt_make_payload(const struct lgw_conf_virt_s * conf, virt_dev_t * dev, struct lgw_pkt_rx_s * p) {
+    int i;
+
+    p->size = conf->size_min + (uint16_t)(tinymt32_generate_uint32(&virt_random) % (conf->size_max - conf->size_min + 1));
+    for (i = 0; i < p->size; i++) {
+        p->payload[i] = (uint8_t)tinymt32_generate_uint32(&virt_random);
+    }
+
+    /* LoRaWAN frame header, the MIC is left random */
+    if (p->size >= (LORAWAN_HDR_SIZE + LORAWAN_MIC_SIZE)) {
+        p->payload[0] = LORAWAN_MHDR_UNCONF_UP;
+        p->payload[1] = (uint8_t)(dev->dev_addr >> 0);
+        p->payload[2] = (uint8_t)(dev->dev_addr >> 8);
+        p->payload[3] = (uint8_t)(dev->dev_addr >> 16);
+        p->payload[4] = (uint8_t)(dev->dev_addr >> 24);
+        p->payload[5] = 0x00; /* FCtrl, no FOpts */
+        p->payload[6] = (uint8_t)(dev->fcnt >> 0);
+        p->payload[7] = (uint8_t)(dev->fcnt >> 8);
+        if (p->size > (LORAWAN_HDR_SIZE + LORAWAN_MIC_SIZE)) {
+            p->payload[8] = 1; /* FPort */
+        }
+    }
+    dev->fcnt += 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void virt_make_packet(const lgw_context_t * context, uint64_t count_us, struct lgw_pkt_rx_s * p) {
+    const struct lgw_conf_virt_s * conf = &context->virt_cfg;
+    virt_dev_t * dev;
+    uint8_t if_chain;
+    double snr;
+
+    memset(p, 0, sizeof *p);
+
+    dev = &virt_dev[tinymt32_generate_uint32(&virt_random) % virt_nb_dev];
+    if_chain = virt_chan[tinymt32_generate_uint32(&virt_random) % virt_nb_chan];
+
+    p->if_chain = if_chain;
+    p->rf_chain = context->if_chain_cfg[if_chain].rf_chain;
+    p->freq_hz = (uint32_t)((int32_t)context->rf_chain_cfg[p->rf_chain].freq_hz + context->if_chain_cfg[if_chain].freq_hz);
+    p->modem_id = if_chain;
+    p->count_us64 = count_us;
+    p->count_us = (uint32_t)count_us;
+    p->modulation = MOD_LORA;
+    p->bandwidth = BW_125KHZ;
+    p->datarate = dev->datarate;
+    p->coderate = CR_LORA_4_5;
+
+    snr = random_gauss(dev->snr, VIRT_FADING_STD);
+    snr = (snr < VIRT_SNR_MIN) ? VIRT_SNR_MIN : ((snr > VIRT_SNR_MAX) ? VIRT_SNR_MAX : snr);
+    p->snr = (float)snr;
+    p->snr_min = p->snr - (float)VIRT_FADING_STD;
+    p->snr_max = p->snr + (float)VIRT_FADING_STD;
+    p->rssic = (float)random_gauss(dev->rssi, VIRT_FADING_STD);
+    p->rssis = (p->snr < 0) ? (p->rssic + p->snr) : p->rssic;
+
+    virt_make_payload(conf, dev, p);
+    p->crc = (uint16_t)tinymt32_generate_uint32(&virt_random);
+    if (random_uniform() < conf->crc_error_ratio) {
+        p->status = STAT_CRC_BAD;
+        if (p->size > 0) {
+            p->payload[p->size - 1] ^= 0x01;
+        }
+    } else {
+        p->status = STAT_CRC_OK;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int virt_start(const lgw_context_t * context) {
+    const struct lgw_conf_virt_s * conf;
+    uint32_t sf_weight[LGW_VIRT_SF_NB];
+    uint32_t weight_sum = 0;
+    uint32_t i, x;
+    int sf;
+
+    CHECK_NULL(context);
+    conf = &context->virt_cfg;
+
+    /* check the traffic model */
+    if ((conf->nb_dev == 0) || (conf->period_s <= 0)) {
+        printf("ERROR: virtual concentrator needs at least one end-device and a positive uplink period\n");
+        return LGW_HAL_ERROR;
+    }
+    if (conf->size_min > conf->size_max) {
+        printf("ERROR: virtual concentrator payload size_min is bigger than size_max\n");
+        return LGW_HAL_ERROR;
+    }
+    virt_nb_chan = 0;
+    for (i = 0; i < LGW_MULTI_NB; i++) {
+        if ((context->if_chain_cfg[i].enable == true) && (context->rf_chain_cfg[context->if_chain_cfg[i].rf_chain].enable == true)) {
+            virt_chan[virt_nb_chan++] = (uint8_t)i;
+        }
+    }
+    if (virt_nb_chan == 0) {
+        printf("ERROR: virtual concentrator needs at least one enabled multi-SF channel\n");
+        return LGW_HAL_ERROR;
+    }
+    for (sf = 0; sf < LGW_VIRT_SF_NB; sf++) {
+        /* only the SFs enabled on the correlators can be received */
+        sf_weight[sf] = ((context->demod_cfg.multisf_datarate >> sf) & 0x01) ? conf->sf_weight[sf] : 0;
+        weight_sum += sf_weight[sf];
+    }
+    if (weight_sum == 0) {
+        printf("ERROR: virtual concentrator SF weights are null for all the enabled SFs\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* draw the end-devices population */
+    virt_seed = conf->seed;
+    virt_random.mat1 = 0x8f7011ee;
+    virt_random.mat2 = 0xfc78ff1f;
+    virt_random.tmat = 0x3793fdff;
+    tinymt32_init(&virt_random, virt_seed);
+
+    free(virt_dev);
+    virt_dev = malloc(conf->nb_dev * sizeof(virt_dev_t));
+    if (virt_dev == NULL) {
+        printf("ERROR: failed to allocate %u virtual end-devices\n", conf->nb_dev);
+        return LGW_HAL_ERROR;
+    }
+    virt_nb_dev = conf->nb_dev;
+    for (i = 0; i < virt_nb_dev; i++) {
+        x = tinymt32_generate_uint32(&virt_random) % weight_sum;
+        for (sf = 0; x >= sf_weight[sf]; sf++) {
+            x -= sf_weight[sf];
+        }
+        virt_dev[i].dev_addr = conf->dev_addr + i;
+        virt_dev[i].fcnt = (uint16_t)tinymt32_generate_uint32(&virt_random);
+        virt_dev[i].datarate = (uint8_t)(DR_LORA_SF5 + sf);
+        virt_dev[i].rssi = (float)random_gauss(conf->rssi_mean, conf->rssi_std);
+        virt_dev[i].snr = (float)random_gauss(conf->snr_mean, conf->snr_std);
+    }
+
+    /* start the counter and the arrivals */
+    virt_rate_us = (double)virt_nb_dev / conf->period_s / 1E6;
+    virt_t0_us = (conf->host_counter == true) ? 0 : host_time_us();
+    virt_next_rx_us = (host_time_us() - virt_t0_us) + random_interval_us();
+
+    memset(virt_tx_trig_us, 0, sizeof virt_tx_trig_us);
+    memset(virt_tx_end_us, 0, sizeof virt_tx_end_us);
+    memset(&virt_rx_stats, 0, sizeof virt_rx_stats);
+    memset(&virt_tx_stats, 0, sizeof virt_tx_stats);
+    virt_tx_stats.slack_min_us = INT32_MAX;
+    virt_tx_stats.slack_max_us = INT32_MIN;
+
+    virt_started = true;
+
+    printf("INFO: virtual concentrator started: %u end-devices, %u channels, %.1f uplinks/s\n", virt_nb_dev, virt_nb_chan, virt_rate_us * 1E6);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int virt_stop(void) {
+    free(virt_dev);
+    virt_dev = NULL;
+    virt_nb_dev = 0;
+    virt_started = false;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int virt_receive(const lgw_context_t * context, uint8_t max_pkt, struct lgw_pkt_rx_s * pkt_data) {
+    struct lgw_pkt_rx_s lost;
+    struct lgw_pkt_rx_s * p;
+    uint64_t now_us;
+    int nb_bytes = 0;
+    int nb_pkt = 0;
+    bool full = false;
+
+    CHECK_NULL(context);
+    CHECK_NULL(pkt_data);
+
+    if (virt_started == false) {
+        return LGW_HAL_ERROR;
+    }
+
+    now_us = virt_counter(false);
+    while ((virt_next_rx_us <= now_us) && (nb_pkt < max_pkt)) {
+        if (full == false) {
+            p = &pkt_data[nb_pkt];
+            virt_make_packet(context, virt_next_rx_us, p);
+            nb_bytes += VIRT_PKT_METADATA + p->size;
+            full = (nb_bytes > VIRT_RX_BUFFER_SIZE);
+        } else {
+            p = &lost;
+            virt_make_packet(context, virt_next_rx_us, p);
+        }
+        /* the SX1302 drops the packets received while its RX buffer is full */
+        if (full == false) {
+            nb_pkt += 1;
+        } else {
+            virt_rx_stats.nb_pkt_lost += 1;
+        }
+        /* ARB statistics, for the SF7 preambles only */
+        if (p->datarate == DR_LORA_SF7) {
+            virt_rx_stats.nb_detect[p->if_chain] += 1;
+            virt_rx_stats.nb_alloc[p->if_chain] += (full == false) ? 1 : 0;
+        }
+        virt_next_rx_us += random_interval_us();
+    }
+
+    if (nb_pkt > 0) {
+        virt_rx_stats.nb_fetch += 1;
+    }
+    if (full == true) {
+        virt_rx_stats.nb_buffer_full += 1;
+    }
+
+    DEBUG_PRINTF("INFO: virtual concentrator: %d packets, %d bytes\n", nb_pkt, nb_bytes);
+
+    return nb_pkt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int virt_send(const struct lgw_pkt_tx_s * pkt_data, uint32_t toa_us) {
+    uint64_t now_us, trig_us;
+    int32_t slack_us;
+    uint8_t rf_chain;
+
+    CHECK_NULL(pkt_data);
+
+    rf_chain = pkt_data->rf_chain;
+    now_us = virt_counter(false);
+
+    switch (pkt_data->tx_mode) {
+        case TIMESTAMPED:
+            /* the TX is triggered TX_START_DELAY before count_us, to compensate for the TX path delay */
+            slack_us = (int32_t)((pkt_data->count_us - TX_START_DELAY_DEFAULT) - (uint32_t)now_us);
+            virt_tx_stats.nb_tstamp += 1;
+            virt_tx_stats.slack_sum_us += slack_us;
+            if (slack_us < virt_tx_stats.slack_min_us) {
+                virt_tx_stats.slack_min_us = slack_us;
+            }
+            if (slack_us > virt_tx_stats.slack_max_us) {
+                virt_tx_stats.slack_max_us = slack_us;
+            }
+            if (slack_us < 0) {
+                /* the SX1302 would wait for the counter to wrap, the packet is considered lost */
+                virt_tx_stats.nb_tx_late += 1;
+                return LGW_HAL_SUCCESS;
+            }
+            trig_us = now_us + (uint64_t)slack_us;
+            break;
+        case ON_GPS:
+            trig_us = virt_counter(true) + 1000000;
+            break;
+        default:
+            trig_us = now_us;
+            break;
+    }
+
+    if (now_us < virt_tx_end_us[rf_chain]) {
+        virt_tx_stats.nb_tx_overlap += 1;
+    }
+    virt_tx_trig_us[rf_chain] = trig_us;
+    virt_tx_end_us[rf_chain] = trig_us + TX_START_DELAY_DEFAULT + toa_us;
+
+    virt_tx_stats.nb_tx += 1;
+    virt_tx_stats.airtime_us += toa_us;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint8_t virt_tx_status(uint8_t rf_chain) {
+    uint64_t now_us;
+
+    if ((virt_started == false) || (rf_chain >= LGW_RF_CHAIN_NB)) {
+        return TX_OFF;
+    }
+
+    now_us = virt_counter(false);
+    if (now_us < virt_tx_trig_us[rf_chain]) {
+        return TX_SCHEDULED;
+    } else if (now_us < virt_tx_end_us[rf_chain]) {
+        return TX_EMITTING;
+    } else {
+        return TX_FREE;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int virt_tx_abort(uint8_t rf_chain) {
+    if (rf_chain < LGW_RF_CHAIN_NB) {
+        virt_tx_trig_us[rf_chain] = 0;
+        virt_tx_end_us[rf_chain] = 0;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t virt_counter(bool pps) {
+    uint64_t cnt_us = host_time_us() - virt_t0_us;
+
+    return (pps == true) ? (cnt_us - (cnt_us % 1000000)) : cnt_us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t virt_eui(void) {
+    return VIRT_EUI_BASE | virt_seed;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int virt_get_rx_stats(struct lgw_rx_stats_s * stats) {
+    CHECK_NULL(stats);
+
+    *stats = virt_rx_stats;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int virt_get_tx_stats(struct lgw_virt_tx_stats_s * stats) {
+    CHECK_NULL(stats);
+
+    if (virt_started == false) {
+        return LGW_HAL_ERROR;
+    }
+
+    *stats = virt_tx_stats;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -21,6 +21,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include "loragw_com.h"
 #include "loragw_spi.h"
+#include "loragw_sim.h"
 #include "sx1261_com.h"
 #include "sx1261_spi.h"
 #include "sx1261_usb.h"
@@ -81,6 +82,11 @@ int sx1261_com_open(lgw_com_type_t com_type, const char *com_path) {
             _sx1261_com_target = lgw_com_target();
             DEBUG_MSG("SX1261: connected with USB\n");
             break;
+        case LGW_COM_SIM:
+            /* commands are counted by the emulated interface (lgw_connect) */
+            _sx1261_com_target = lgw_com_target();
+            DEBUG_MSG("SX1261: connected with SIM\n");
+            break;
         default:
             printf("ERROR: %s: wrong COM type\n", __FUNCTION__);
             return LGW_COM_ERROR;
@@ -104,6 +110,7 @@ int sx1261_com_close(void) {
             }
             break;
         case LGW_COM_USB:
+        case LGW_COM_SIM:
             break;
         default:
             printf("ERROR: %s: sx1261 not connected\n", __FUNCTION__);
@@ -132,6 +139,9 @@ int sx1261_com_w(sx1261_op_code_t op_code, uint8_t *data, uint16_t size) {
         case LGW_COM_USB:
             com_stat = sx1261_usb_w(_sx1261_com_target, op_code, data, size);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_wb(_sx1261_com_target, LGW_SIM_MUX_TARGET_SX1261, (uint16_t)op_code, data, size);
+            break;
         default:
             printf("ERROR: wrong communication type (SHOULD NOT HAPPEN)\n");
             com_stat = LGW_COM_ERROR;
@@ -157,6 +167,9 @@ int sx1261_com_r(sx1261_op_code_t op_code, uint8_t *data, uint16_t size) {
         case LGW_COM_USB:
             com_stat = sx1261_usb_r(_sx1261_com_target, op_code, data, size);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_rb(_sx1261_com_target, LGW_SIM_MUX_TARGET_SX1261, (uint16_t)op_code, data, size);
+            break;
         default:
             printf("ERROR: wrong communication type (SHOULD NOT HAPPEN)\n");
             com_stat = LGW_COM_ERROR;
@@ -173,6 +186,7 @@ int sx1261_com_set_write_mode(lgw_com_write_mode_t write_mode) {
 
     switch (_sx1261_com_type) {
         case LGW_COM_SPI:
+        case LGW_COM_SIM:
             /* Do nothing: only single mode is supported on SPI */
             break;
         case LGW_COM_USB:
@@ -194,6 +208,7 @@ int sx1261_com_flush(void) {
 
     switch (_sx1261_com_type) {
         case LGW_COM_SPI:
+        case LGW_COM_SIM:
             /* Do nothing: only single mode is supported on SPI */
             break;
         case LGW_COM_USB:
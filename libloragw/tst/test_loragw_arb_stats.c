@@ -0,0 +1,169 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Check and benchmark the snapshot of the ARB debug statistics, using the
+    software (SIM) COM interface: bus transactions and bytes per snapshot of
+    the detect/alloc counters of all the multi-SF channels, read per channel
+    and in a single burst.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_com.h"
+#include "loragw_sim.h"
+#include "loragw_sx1302.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SIM_ADDR_ARB_DEBUG_STS_0    0x608D  /* ARB_DEBUG_STS_0, followed by ARB_DEBUG_STS_1..15 */
+
+#define DEFAULT_NB_SNAPSHOT         10000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -n <uint> number of snapshots per run\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* take nb snapshots of the counters, return the number of errors */
+static int run(const char * name, unsigned int nb, bool burst) {
+    uint8_t nb_detect[LGW_MULTI_NB];
+    uint8_t nb_alloc[LGW_MULTI_NB];
+    struct lgw_sim_stats_s stats;
+    struct timespec start, stop;
+    double elapsed_us;
+    uint32_t nb_cmd;
+    unsigned int i, j;
+    int nb_err = 0;
+
+    lgw_sim_reset_stats(lgw_com_target());
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < nb; i++) {
+        if (burst == true) {
+            if (sx1302_arb_get_debug_stats(nb_detect, nb_alloc) != LGW_REG_SUCCESS) {
+                nb_err += 1;
+            }
+        } else {
+            for (j = 0; j < LGW_MULTI_NB; j++) {
+                nb_detect[j] = sx1302_arb_get_debug_stats_detect(j);
+                nb_alloc[j] = sx1302_arb_get_debug_stats_alloc(j);
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    lgw_sim_get_stats(lgw_com_target(), &stats);
+    elapsed_us = (double)(stop.tv_sec - start.tv_sec) * 1e6 + (double)(stop.tv_nsec - start.tv_nsec) / 1e3;
+
+    /* counters set by main: detect = 10 * (ch + 1), alloc = detect - ch */
+    for (j = 0; j < LGW_MULTI_NB; j++) {
+        if ((nb_detect[j] != (10 * (j + 1))) || (nb_alloc[j] != (10 * (j + 1) - j))) {
+            printf("ERROR: wrong counters for channel %u: %u/%u\n", j, nb_detect[j], nb_alloc[j]);
+            nb_err += 1;
+        }
+    }
+
+    nb_cmd = stats.nb_w + stats.nb_r + stats.nb_rmw + stats.nb_wb + stats.nb_rb;
+    printf("%-11s | %18.2f | %16.1f | %18.3f\n", name,
+            (double)nb_cmd / nb,
+            (double)(stats.nb_bytes_w + stats.nb_bytes_r) / nb,
+            elapsed_us / nb);
+
+    return nb_err;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x;
+    unsigned int arg_u;
+    unsigned int nb = DEFAULT_NB_SNAPSHOT;
+    uint8_t buff[2 * LGW_MULTI_NB];
+    int nb_err = 0;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hn:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    printf("===== ARB debug statistics snapshot (SIM) =====\n");
+
+    x = lgw_connect(LGW_COM_SIM, "sim");
+    if (x != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to connect to the SIM interface\n");
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < LGW_MULTI_NB; i++) {
+        buff[i] = (uint8_t)(10 * (i + 1));
+        buff[LGW_MULTI_NB + i] = (uint8_t)(10 * (i + 1) - i);
+    }
+    lgw_sim_mem_set(lgw_com_target(), SIM_ADDR_ARB_DEBUG_STS_0, buff, sizeof buff);
+
+    printf("%u snapshots of %d channels per run\n", nb, LGW_MULTI_NB);
+    printf("read        | transactions/snap. | bytes/snapshot   | host time/snap. (us)\n");
+    nb_err += run("per channel", nb, false);
+    nb_err += run("burst", nb, true);
+
+    lgw_disconnect();
+
+    printf("errors: %d\n", nb_err);
+    printf("=========== Test End ===========\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,236 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Simulation of the clock discipline on PPS captures of a drifting counter,
+    with PPS jitter, counter quantization and a GPS outage. The XTAL error and
+    PPS phase estimates are compared with the ones of the previous method
+    (raw PPS captures, slope averaged on 16 PPS then low-pass filtered by 256).
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* rand */
+#include <unistd.h>     /* getopt */
+#include <math.h>       /* sqrt log cos floor fmod */
+
+#include "loragw_clkdisc.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_DURATION_S  1200
+#define DEFAULT_TICK_HZ     1E6
+#define DEFAULT_JITTER_NS   30
+#define XTAL_OFFSET         3E-6    /* initial XTAL error */
+#define XTAL_WANDER         1E-9    /* XTAL random walk, per sqrt(s) */
+#define OUTAGE_START_S      400     /* GPS outage */
+#define OUTAGE_DURATION_S   120
+#define CONVERGED_ERR       5E-8    /* XTAL error considered as converged */
+#define XERR_INIT_AVG       16      /* previous method parameters */
+#define XERR_FILT_COEF      256
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -d <uint> duration of the simulation, in seconds\n");
+    printf(" -f <uint> counter frequency, in Hz (1000000 or 32000000)\n");
+    printf(" -j <uint> PPS jitter standard deviation, in ns\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double randn(void) {
+    double u1 = ((double)rand() + 1.0) / ((double)RAND_MAX + 2.0);
+    double u2 = ((double)rand() + 1.0) / ((double)RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double wrap_diff(double cnt, double true_phase) {
+    /* difference between a 32-bit counter value and the unwrapped phase, in ticks */
+    double d = fmod(cnt - true_phase, 4294967296.0);
+
+    if (d > 2147483648.0) {
+        d -= 4294967296.0;
+    } else if (d < -2147483648.0) {
+        d += 4294967296.0;
+    }
+    return d;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i;
+    unsigned int arg_u;
+    unsigned int duration = DEFAULT_DURATION_S;
+    double tick_hz = DEFAULT_TICK_HZ;
+    double jitter_s = DEFAULT_JITTER_NS * 1E-9;
+    struct lgw_clkdisc_s cd;
+    double true_freq = 1.0 + XTAL_OFFSET;
+    double true_phase = 12345.0; /* counter value at the current PPS, not quantized */
+    uint32_t cnt, cnt_prev = 0;
+    bool cnt_prev_ok = false;
+    unsigned int t, init_cpt = 0;
+    double init_acc = 0.0, old_correct = 1.0;
+    bool old_ok = false;
+    double freq, freq_std, corr, err;
+    double sum_old_f = 0, sum_new_f = 0, sum_old_p = 0, sum_new_p = 0;
+    unsigned int nb_f = 0, nb_p = 0;
+    int conv_old = -1, conv_new = -1, reconv_old = -1, reconv_new = -1;
+    unsigned int nb_rejected = 0;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hd:f:j:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 'd':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < (OUTAGE_START_S + OUTAGE_DURATION_S + 60))) {
+                    printf("ERROR: argument parsing of -d argument, min %u. Use -h to print help\n", OUTAGE_START_S + OUTAGE_DURATION_S + 60);
+                    return EXIT_FAILURE;
+                }
+                duration = arg_u;
+                break;
+            case 'f':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1000)) {
+                    printf("ERROR: argument parsing of -f argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                tick_hz = (double)arg_u;
+                break;
+            case 'j':
+                if (sscanf(optarg, "%u", &arg_u) != 1) {
+                    printf("ERROR: argument parsing of -j argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                jitter_s = (double)arg_u * 1E-9;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    printf("Counter %.0f Hz, XTAL error %.1f ppm, PPS jitter %.0f ns, GPS outage from %us to %us\n", tick_hz, XTAL_OFFSET * 1E6, jitter_s * 1E9, OUTAGE_START_S, OUTAGE_START_S + OUTAGE_DURATION_S);
+    srand(1);
+    lgw_clkdisc_init(&cd, tick_hz, jitter_s);
+
+    for (t = 0; t < duration; t++) {
+        /* the counter runs for one second, its frequency wanders */
+        true_freq += XTAL_WANDER * randn();
+        true_phase += tick_hz * true_freq;
+
+        if ((t >= OUTAGE_START_S) && (t < (OUTAGE_START_S + OUTAGE_DURATION_S))) {
+            /* no PPS, previous method invalidates its correction after GPS_REF_MAX_AGE */
+            if (t == (OUTAGE_START_S + 30)) {
+                old_ok = false;
+                old_correct = 1.0;
+                init_cpt = 0;
+                init_acc = 0.0;
+            }
+            cnt_prev_ok = false;
+            continue;
+        }
+
+        /* PPS capture, with jitter and quantization */
+        cnt = (uint32_t)(uint64_t)floor(true_phase + (jitter_s * tick_hz * randn()));
+
+        /* previous method */
+        if (cnt_prev_ok) {
+            double slope = (double)(uint32_t)(cnt - cnt_prev) / tick_hz;
+            if (init_cpt < XERR_INIT_AVG) {
+                init_acc += slope;
+                init_cpt += 1;
+            } else if (init_cpt == XERR_INIT_AVG) {
+                old_correct = (double)XERR_INIT_AVG / init_acc;
+                old_ok = true;
+                init_cpt += 1;
+            } else {
+                old_correct = old_correct - old_correct / XERR_FILT_COEF + (1 / slope) / XERR_FILT_COEF;
+            }
+        }
+        cnt_prev = cnt;
+        cnt_prev_ok = true;
+
+        /* clock discipline */
+        if (lgw_clkdisc_update(&cd, cnt) != LGW_CLKDISC_SUCCESS) {
+            nb_rejected += 1;
+        }
+
+        /* convergence */
+        err = fabs(old_correct - (1 / true_freq));
+        if (old_ok && (err < CONVERGED_ERR)) {
+            if ((conv_old < 0) && (t < OUTAGE_START_S)) conv_old = t;
+            if ((reconv_old < 0) && (t >= OUTAGE_START_S)) reconv_old = t - (OUTAGE_START_S + OUTAGE_DURATION_S);
+        }
+        if (lgw_clkdisc_get(&cd, &freq, &freq_std, NULL) && (freq_std < CONVERGED_ERR)) {
+            err = fabs((1 / freq) - (1 / true_freq));
+            if (err < CONVERGED_ERR) {
+                if ((conv_new < 0) && (t < OUTAGE_START_S)) conv_new = t;
+                if ((reconv_new < 0) && (t >= OUTAGE_START_S)) reconv_new = t - (OUTAGE_START_S + OUTAGE_DURATION_S);
+            }
+        }
+
+        /* steady state accuracy, after the initial convergence and outside of the outage recovery */
+        if ((t > 300) && ((t < OUTAGE_START_S) || (t > (OUTAGE_START_S + OUTAGE_DURATION_S + 300)))) {
+            if (old_ok && lgw_clkdisc_get(&cd, &freq, NULL, NULL)) {
+                err = old_correct - (1 / true_freq);
+                sum_old_f += err * err;
+                err = (1 / freq) - (1 / true_freq);
+                sum_new_f += err * err;
+                nb_f += 1;
+            }
+            /* PPS phase error, in ns */
+            err = wrap_diff((double)cnt, true_phase - 0.5) / tick_hz * 1E9; /* floor is half a tick late on average */
+            sum_old_p += err * err;
+            if (lgw_clkdisc_pps_correction(&cd, cnt, &corr) == LGW_CLKDISC_SUCCESS) {
+                err = wrap_diff((double)cnt + corr, true_phase - 0.5) / tick_hz * 1E9;
+            }
+            sum_new_p += err * err;
+            nb_p += 1;
+        }
+    }
+
+    printf("                      previous   clock discipline\n");
+    printf("XTAL error RMS (ppb): %8.2f   %8.2f\n", sqrt(sum_old_f / nb_f) * 1E9, sqrt(sum_new_f / nb_f) * 1E9);
+    printf("PPS phase RMS (ns):   %8.2f   %8.2f\n", sqrt(sum_old_p / nb_p), sqrt(sum_new_p / nb_p));
+    printf("convergence (s):      %8d   %8d\n", conv_old, conv_new);
+    printf("reacquisition (s):    %8d   %8d\n", reconv_old, reconv_new);
+    printf("PPS captures rejected: %u\n", nb_rejected);
+    printf("=========== Test End ===========\n");
+
+    return ((conv_new >= 0) && (reconv_new >= 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,320 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Benchmark of the fine timestamp computation (precise_timestamp_calculate)
+    versus the previous implementation (runtime SF offset, cumulative sum copied
+    to a temporary array, linear search of the PPS history), for SF5 to SF12
+    and 1 to 255 timestamp metrics. The results of both must be bit-exact.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* rand */
+#include <unistd.h>     /* getopt */
+#include <time.h>       /* clock_gettime */
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "loragw_sx1302.h"
+#include "loragw_sx1302_timestamp.h"
+#include "loragw_clkdisc.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_NB_LOOP     200
+#define NB_PPS_HISTORY      16      /* same as the library */
+#define NB_PKT              256     /* packets per PPS history and SF */
+#define PPS_JITTER_S        30E-9   /* same as the library */
+#define XTAL_STD_MAX        50E-9   /* same as the library */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* reference copy of the library PPS history and clock discipline */
+static struct {
+    uint32_t history[NB_PPS_HISTORY];
+    uint8_t idx;
+    uint8_t size;
+} ref_history;
+static struct lgw_clkdisc_s ref_clkdisc;
+
+static struct {
+    uint8_t nb;
+    int8_t metrics[255];
+    uint32_t cnt;
+    int32_t if_freq_hz;
+    double freq_error;
+} pkt[NB_PKT];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -n <uint> number of PPS histories per SF\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double diff_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void ref_pps_history_save(uint32_t timestamp_pps_reg) {
+    if ((timestamp_pps_reg != ref_history.history[ref_history.idx] || (ref_history.size == 0))) {
+        if (ref_history.size > 0) {
+            ref_history.idx += 1;
+        }
+        if (ref_history.idx == NB_PPS_HISTORY) {
+            ref_history.idx = 0;
+        }
+        ref_history.history[ref_history.idx] = timestamp_pps_reg;
+        if (ref_history.size < NB_PPS_HISTORY) {
+            ref_history.size += 1;
+        }
+        lgw_clkdisc_update(&ref_clkdisc, timestamp_pps_reg);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* previous implementation of precise_timestamp_calculate */
+static int ref_precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t timestamp_cnt, uint32_t timestamp_pps_reg, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime) {
+    int i, timestamp_pps_idx, timestamp_pps_idx_next, timestamp_pps_idx_prev;
+    int32_t ftime_sum;
+    int32_t ftime[256];
+    float ftime_mean;
+    uint32_t timestamp_cnt_end_of_preamble;
+    uint32_t timestamp_pps = 0;
+    uint32_t offset_preamble_hdr;
+    uint32_t diff_pps;
+    double pkt_ftime;
+    uint8_t ts_metrics_nb_clipped;
+    double xtal_correct;
+    double xtal_freq, xtal_freq_std;
+    double pps_corr = 0.0;
+
+    if (ref_history.size < NB_PPS_HISTORY) {
+        return -1;
+    }
+
+    offset_preamble_hdr =   256 * (1 << sf) * (8 + 4 + (((sf == 5) || (sf == 6)) ? 2 : 0)) +
+                            256 * ((1 << sf) / 4 - 1);
+    offset_preamble_hdr += ((double)offset_preamble_hdr * pkt_freq_error + 0.5);
+    timestamp_cnt_end_of_preamble = timestamp_cnt - offset_preamble_hdr + 2138;
+    timestamp_cnt = timestamp_cnt_end_of_preamble;
+
+    switch (sf) {
+        case 12:
+            ts_metrics_nb_clipped = MIN(4, ts_metrics_nb);
+            break;
+        case 11:
+            ts_metrics_nb_clipped = MIN(8, ts_metrics_nb);
+            break;
+        case 10:
+            ts_metrics_nb_clipped = MIN(16, ts_metrics_nb);
+            break;
+        default:
+            ts_metrics_nb_clipped = MIN(32, ts_metrics_nb);
+            break;
+    }
+
+    ftime[0] = (int32_t)ts_metrics[0];
+    ftime_sum = ftime[0];
+    for (i = 1; i < (2 * ts_metrics_nb_clipped); i++) {
+        ftime[i] = ftime[i-1] + ts_metrics[i];
+        ftime_sum += ftime[i];
+    }
+    ftime_mean = (float)ftime_sum / (float)(2 * ts_metrics_nb_clipped);
+
+    if ((timestamp_cnt - timestamp_pps_reg) > 32e6) {
+        for (timestamp_pps_idx = 0; timestamp_pps_idx < ref_history.size; timestamp_pps_idx++) {
+            if ((timestamp_cnt - ref_history.history[timestamp_pps_idx]) < 32e6) {
+                timestamp_pps = ref_history.history[timestamp_pps_idx];
+                break;
+            }
+        }
+        if (timestamp_pps_idx == ref_history.size) {
+            return -1;
+        }
+        timestamp_pps_idx_next = (timestamp_pps_idx == (NB_PPS_HISTORY - 1)) ? 0 : timestamp_pps_idx + 1;
+        diff_pps = ref_history.history[timestamp_pps_idx_next] - ref_history.history[timestamp_pps_idx];
+        xtal_correct = (double)32e6 / (double)(diff_pps);
+    } else {
+        timestamp_pps = timestamp_pps_reg;
+        timestamp_pps_idx = ref_history.idx;
+        timestamp_pps_idx_prev = (timestamp_pps_idx == 0) ? (NB_PPS_HISTORY - 1) : (timestamp_pps_idx - 1);
+        diff_pps = ref_history.history[timestamp_pps_idx] - ref_history.history[timestamp_pps_idx_prev];
+        xtal_correct = (double)32e6 / (double)(diff_pps);
+    }
+
+    if ((lgw_clkdisc_get(&ref_clkdisc, &xtal_freq, &xtal_freq_std, NULL) == true) && (xtal_freq_std < XTAL_STD_MAX)) {
+        xtal_correct = 1.0 / xtal_freq;
+        if (lgw_clkdisc_pps_correction(&ref_clkdisc, timestamp_pps, &pps_corr) != LGW_CLKDISC_SUCCESS) {
+            pps_corr = 0.0;
+        }
+    }
+    if ((xtal_correct > 1.2) || (xtal_correct < 0.8)) {
+        return -1;
+    }
+
+    diff_pps = timestamp_cnt - timestamp_pps;
+    pkt_ftime = (double)diff_pps + (double)ftime_mean - pps_corr;
+    pkt_ftime += sx1302_dc_notch_delay((double)if_freq_hz / 1E3);
+    pkt_ftime *= 31.25;
+    pkt_ftime *= xtal_correct;
+
+    *result_ftime = (uint32_t)pkt_ftime;
+    if (*result_ftime > 1E9) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int8_t random_metric(void) {
+    /* metrics are mostly small, with some outliers up to the int8 range */
+    return ((rand() % 16) == 0) ? (int8_t)(rand() % 256 - 128) : (int8_t)(rand() % 33 - 16);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i;
+    unsigned int arg_u;
+    unsigned int nb_loop = DEFAULT_NB_LOOP;
+    unsigned int n, k, j;
+    uint8_t sf;
+    uint32_t pps[NB_PPS_HISTORY];
+    double xtal_err;
+    uint32_t ftime_ref, ftime_new;
+    int err_ref, err_new;
+    struct timespec start, end;
+    double t_ref, t_new;
+    unsigned long nb_calc, nb_ok, nb_diff = 0, nb_diff_sf;
+    volatile uint32_t sink = 0;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hn:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 'n':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_loop = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    printf("Computing %u x %u fine timestamps per SF\n", nb_loop, NB_PKT);
+    srand(time(NULL));
+    lgw_clkdisc_init(&ref_clkdisc, 32E6, PPS_JITTER_S);
+
+    printf("SF  | previous (ns/pkt) | new (ns/pkt) | computed | different\n");
+    for (sf = 5; sf <= 12; sf++) {
+        t_ref = 0.0;
+        t_new = 0.0;
+        nb_calc = 0;
+        nb_ok = 0;
+        nb_diff_sf = nb_diff;
+        for (n = 0; n < nb_loop; n++) {
+            /* new PPS history, saved to the library and to the reference */
+            xtal_err = 1.0 + ((double)(rand() % 20001) - 10000.0) * 1E-9; /* +/-10ppm */
+            pps[0] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+            for (k = 1; k < NB_PPS_HISTORY; k++) {
+                pps[k] = pps[0] + (uint32_t)(32E6 * xtal_err * k) + (uint32_t)(rand() % 3) - 1;
+            }
+            for (k = 0; k < NB_PPS_HISTORY; k++) {
+                timestamp_pps_history_save(pps[k]);
+                ref_pps_history_save(pps[k]);
+            }
+
+            /* packets received between 1.5s after the oldest PPS and the last one, 1 to 255 metrics */
+            for (k = 0; k < NB_PKT; k++) {
+                pkt[k].nb = 1 + (rand() % 255);
+                for (j = 0; j < pkt[k].nb; j++) {
+                    pkt[k].metrics[j] = random_metric();
+                }
+                pkt[k].cnt = pps[0] + 48000000 + (uint32_t)(rand() % 460000000);
+                pkt[k].if_freq_hz = (rand() % 801000) - 400000;
+                pkt[k].freq_error = ((double)(rand() % 2001) - 1000.0) * 1E-8;
+            }
+
+            /* compare */
+            for (k = 0; k < NB_PKT; k++) {
+                err_ref = ref_precise_timestamp_calculate(pkt[k].nb, pkt[k].metrics, pkt[k].cnt, pps[NB_PPS_HISTORY - 1], sf, pkt[k].if_freq_hz, pkt[k].freq_error, &ftime_ref);
+                err_new = precise_timestamp_calculate(pkt[k].nb, pkt[k].metrics, pkt[k].cnt, pps[NB_PPS_HISTORY - 1], sf, pkt[k].if_freq_hz, pkt[k].freq_error, &ftime_new);
+                if ((err_ref != err_new) || ((err_ref == 0) && (ftime_ref != ftime_new))) {
+                    if (nb_diff < 10) {
+                        printf("ERROR: SF%u %u metrics cnt %u: previous %d/%u, new %d/%u\n", sf, pkt[k].nb, pkt[k].cnt, err_ref, ftime_ref, err_new, ftime_new);
+                    }
+                    nb_diff += 1;
+                }
+                nb_ok += (err_ref == 0) ? 1 : 0;
+            }
+
+            /* measure */
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (k = 0; k < NB_PKT; k++) {
+                ref_precise_timestamp_calculate(pkt[k].nb, pkt[k].metrics, pkt[k].cnt, pps[NB_PPS_HISTORY - 1], sf, pkt[k].if_freq_hz, pkt[k].freq_error, &ftime_ref);
+                sink += ftime_ref;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            t_ref += diff_s(&start, &end);
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (k = 0; k < NB_PKT; k++) {
+                precise_timestamp_calculate(pkt[k].nb, pkt[k].metrics, pkt[k].cnt, pps[NB_PPS_HISTORY - 1], sf, pkt[k].if_freq_hz, pkt[k].freq_error, &ftime_new);
+                sink += ftime_new;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            t_new += diff_s(&start, &end);
+
+            nb_calc += NB_PKT;
+        }
+        printf("%2u  | %17.1f | %12.1f | %8lu | %lu\n", sf, t_ref * 1e9 / nb_calc, t_new * 1e9 / nb_calc, nb_ok, nb_diff - nb_diff_sf);
+    }
+
+    printf("=========== Test End ===========\n");
+
+    return (nb_diff == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
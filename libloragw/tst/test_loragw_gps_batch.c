@@ -0,0 +1,200 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Benchmark of the conversion of uplink timestamps to absolute time, per
+    packet (lgw_cnt2utc + gmtime + snprintf + lgw_cnt2gps, as the packet
+    forwarder used to do) versus lgw_cnt2time_batch, on batches of packets.
+    The results of both methods are compared.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* rand */
+#include <string.h>     /* strcmp */
+#include <unistd.h>     /* getopt */
+#include <time.h>       /* clock_gettime, gmtime */
+
+#include "loragw_gps.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_PKT_MAX          255     /* same as packet forwarder */
+#define DEFAULT_NB_BATCH    20000
+#define DEFAULT_BATCH_SIZE  NB_PKT_MAX
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint32_t count_us[NB_PKT_MAX];
+static struct timespec utc_ref[NB_PKT_MAX], gps_ref[NB_PKT_MAX];
+static char iso_ref[NB_PKT_MAX][64]; /* large enough for any struct tm, as snprintf cannot assume its ranges */
+static struct timespec utc_bat[NB_PKT_MAX], gps_bat[NB_PKT_MAX];
+static char iso_bat[NB_PKT_MAX][LGW_GPS_ISO8601_SIZE];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -n <uint> number of batches\n");
+    printf(" -b <uint> number of packets per batch [1..%d]\n", NB_PKT_MAX);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double diff_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int64_t diff_ns(const struct timespec *a, const struct timespec *b) {
+    return ((int64_t)(a->tv_sec - b->tv_sec) * 1000000000) + (a->tv_nsec - b->tv_nsec);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void random_batch(struct tref *ref, unsigned int nb) {
+    unsigned int i;
+
+    ref->systime = time(NULL);
+    ref->count_us = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    ref->utc.tv_sec = 1577836800 + (rand() % (10 * 365 * 86400)); /* 2020 - 2030 */
+    ref->utc.tv_nsec = rand() % 1000000000;
+    ref->gps.tv_sec = ref->utc.tv_sec - 315964800 + 18;
+    ref->gps.tv_nsec = ref->utc.tv_nsec;
+    ref->xtal_err = 1.0 + ((double)(rand() % 20001) - 10000.0) * 1E-9; /* +/-10ppm */
+
+    /* packets received up to a few seconds after the PPS reference */
+    for (i = 0; i < nb; i++) {
+        count_us[i] = ref->count_us + (uint32_t)(rand() % 3000000);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void convert_per_packet(struct tref ref, unsigned int nb) {
+    struct tm * x;
+    unsigned int i;
+
+    for (i = 0; i < nb; i++) {
+        if (lgw_cnt2utc(ref, count_us[i], &utc_ref[i]) == LGW_GPS_SUCCESS) {
+            x = gmtime(&(utc_ref[i].tv_sec));
+            snprintf(iso_ref[i], sizeof iso_ref[i], "%04i-%02i-%02iT%02i:%02i:%02i.%06liZ", (x->tm_year)+1900, (x->tm_mon)+1, x->tm_mday, x->tm_hour, x->tm_min, x->tm_sec, (utc_ref[i].tv_nsec)/1000);
+        }
+        lgw_cnt2gps(ref, count_us[i], &gps_ref[i]);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i;
+    unsigned int arg_u;
+    unsigned int nb_batch = DEFAULT_NB_BATCH;
+    unsigned int batch_size = DEFAULT_BATCH_SIZE;
+    unsigned int n, k;
+    struct tref ref;
+    struct timespec start, end;
+    double t_pkt = 0.0, t_bat = 0.0;
+    int64_t d, max_utc_ns = 0, max_gps_ns = 0;
+    unsigned long nb_iso_diff = 0, nb_tmms_diff = 0;
+    int x;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hn:b:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 'n':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_batch = arg_u;
+                break;
+            case 'b':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1) || (arg_u > NB_PKT_MAX)) {
+                    printf("ERROR: argument parsing of -b argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                batch_size = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    printf("Converting %u batches of %u packets\n", nb_batch, batch_size);
+    srand(time(NULL));
+
+    for (n = 0; n < nb_batch; n++) {
+        random_batch(&ref, batch_size);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        convert_per_packet(ref, batch_size);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        t_pkt += diff_s(&start, &end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        x = lgw_cnt2time_batch(ref, count_us, batch_size, utc_bat, gps_bat, iso_bat);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        t_bat += diff_s(&start, &end);
+        if (x != LGW_GPS_SUCCESS) {
+            printf("ERROR: lgw_cnt2time_batch failed\n");
+            return EXIT_FAILURE;
+        }
+
+        /* compare */
+        for (k = 0; k < batch_size; k++) {
+            d = llabs(diff_ns(&utc_bat[k], &utc_ref[k]));
+            max_utc_ns = (d > max_utc_ns) ? d : max_utc_ns;
+            d = llabs(diff_ns(&gps_bat[k], &gps_ref[k]));
+            max_gps_ns = (d > max_gps_ns) ? d : max_gps_ns;
+            if (strcmp(iso_bat[k], iso_ref[k]) != 0) {
+                nb_iso_diff += 1;
+            }
+            if ((uint64_t)(gps_bat[k].tv_sec * 1E3 + gps_bat[k].tv_nsec / 1E6) != (uint64_t)(gps_ref[k].tv_sec * 1E3 + gps_ref[k].tv_nsec / 1E6)) {
+                nb_tmms_diff += 1;
+            }
+        }
+    }
+
+    printf("per packet: %8.1f ns/packet, %8.1f us/batch\n", t_pkt * 1e9 / ((double)nb_batch * batch_size), t_pkt * 1e6 / nb_batch);
+    printf("batch:      %8.1f ns/packet, %8.1f us/batch\n", t_bat * 1e9 / ((double)nb_batch * batch_size), t_bat * 1e6 / nb_batch);
+    printf("max difference: UTC %lld ns, GPS %lld ns\n", (long long)max_utc_ns, (long long)max_gps_ns);
+    printf("different results: %lu ISO 8601 strings, %lu GPS times in ms (out of %lu)\n", nb_iso_diff, nb_tmms_diff, (unsigned long)nb_batch * batch_size);
+    printf("=========== Test End ===========\n");
+
+    return ((max_utc_ns <= 1) && (max_gps_ns <= 1)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
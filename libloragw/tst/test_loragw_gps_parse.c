@@ -0,0 +1,402 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Throughput benchmark of the GPS serial stream parsing, comparing the
+    lgw_parse_ubx/lgw_parse_nmea frame parsers (as used with a linear buffer by
+    the packet forwarder) with the incremental lgw_gps_parse_stream parser.
+    Works on a recorded GPS log (raw bytes from the serial port), or on a
+    generated one (RMC, GGA, GSV, GSA sentences and NAV-TIMEGPS frames).
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc */
+#include <string.h>     /* memset */
+#include <unistd.h>     /* getopt */
+#include <time.h>       /* clock_gettime */
+
+#include "loragw_gps.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_NB_LOOPS    200
+#define DEFAULT_CHUNK_SIZE  LGW_GPS_MIN_MSG_SIZE
+#define GEN_NB_SECONDS      600     /* duration of the generated log */
+#define GEN_SEC_SIZE        512     /* max size of one second of generated log */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct parse_res_s {
+    unsigned nb_timegps;
+    unsigned nb_rmc;
+    unsigned nb_gga;
+    unsigned nb_ignored;
+    unsigned nb_invalid;
+    bool check;    /* get the GPS solutions (not for throughput measurement) */
+    uint32_t hash; /* hash of the GPS solutions obtained after each frame of interest */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -f <path> recorded GPS log (raw serial bytes), a log is generated otherwise\n");
+    printf(" -n <uint> number of times the log is parsed\n");
+    printf(" -c <uint> size of the chunks given by read(), in bytes\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double diff_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t fnv1a(uint32_t h, const void *data, size_t size) {
+    const uint8_t *d = (const uint8_t *)data;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        h = (h ^ d[i]) * 16777619u;
+    }
+
+    return h;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void account(struct parse_res_s *res, enum gps_msg msg) {
+    struct timespec utc, gps_time;
+    struct coord_s loc, err;
+    int x;
+
+    switch (msg) {
+        case UBX_NAV_TIMEGPS:   res->nb_timegps += 1; break;
+        case NMEA_RMC:          res->nb_rmc += 1; break;
+        case NMEA_GGA:          res->nb_gga += 1; break;
+        case INVALID:           res->nb_invalid += 1; return;
+        default:                res->nb_ignored += 1; return;
+    }
+    if (res->check == false) {
+        return;
+    }
+
+    memset(&utc, 0, sizeof utc);
+    memset(&gps_time, 0, sizeof gps_time);
+    memset(&loc, 0, sizeof loc);
+    memset(&err, 0, sizeof err);
+    x = lgw_gps_get(&utc, &gps_time, NULL, NULL);
+    res->hash = fnv1a(res->hash, &x, sizeof x);
+    if (x == LGW_GPS_SUCCESS) {
+        res->hash = fnv1a(res->hash, &utc, sizeof utc);
+        res->hash = fnv1a(res->hash, &gps_time, sizeof gps_time);
+    }
+    x = lgw_gps_get(NULL, NULL, &loc, &err);
+    res->hash = fnv1a(res->hash, &x, sizeof x);
+    if (x == LGW_GPS_SUCCESS) {
+        res->hash = fnv1a(res->hash, &loc.lat, sizeof loc.lat);
+        res->hash = fnv1a(res->hash, &loc.lon, sizeof loc.lon);
+        res->hash = fnv1a(res->hash, &loc.alt, sizeof loc.alt);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Same buffer management as the packet forwarder GPS thread used to have */
+static void parse_frames(const uint8_t *log, size_t log_size, size_t chunk, struct parse_res_s *res) {
+    char serial_buff[128];
+    size_t wr_idx = 0;
+    size_t log_idx = 0;
+    enum gps_msg latest_msg;
+
+    while (log_idx < log_size) {
+        size_t rd_idx = 0;
+        size_t frame_end_idx = 0;
+        size_t nb_char = ((log_size - log_idx) < chunk) ? (log_size - log_idx) : chunk;
+
+        memcpy(serial_buff + wr_idx, log + log_idx, nb_char); /* read() */
+        log_idx += nb_char;
+        wr_idx += nb_char;
+
+        while (rd_idx < wr_idx) {
+            size_t frame_size = 0;
+
+            if (serial_buff[rd_idx] == (char)LGW_GPS_UBX_SYNC_CHAR) {
+                latest_msg = lgw_parse_ubx(&serial_buff[rd_idx], (wr_idx - rd_idx), &frame_size);
+                if (frame_size > 0) {
+                    if ((latest_msg == INCOMPLETE) || (latest_msg == INVALID)) {
+                        frame_size = 0;
+                    }
+                    if (latest_msg != INCOMPLETE) {
+                        account(res, latest_msg);
+                    }
+                }
+            } else if (serial_buff[rd_idx] == (char)LGW_GPS_NMEA_SYNC_CHAR) {
+                char* nmea_end_ptr = memchr(&serial_buff[rd_idx],(int)0x0a, (wr_idx - rd_idx));
+                if (nmea_end_ptr) {
+                    frame_size = nmea_end_ptr - &serial_buff[rd_idx] + 1;
+                    latest_msg = lgw_parse_nmea(&serial_buff[rd_idx], frame_size);
+                    if ((latest_msg == INVALID) || (latest_msg == UNKNOWN)) {
+                        frame_size = 0;
+                    }
+                    account(res, latest_msg);
+                }
+            }
+
+            if (frame_size > 0) {
+                rd_idx += frame_size;
+                frame_end_idx = rd_idx;
+            } else {
+                rd_idx++;
+            }
+        }
+
+        if (frame_end_idx) {
+            memcpy(serial_buff, &serial_buff[frame_end_idx], wr_idx - frame_end_idx);
+            wr_idx -= frame_end_idx;
+        }
+
+        if ((sizeof(serial_buff) - wr_idx) < chunk) {
+            size_t drop = chunk - (sizeof(serial_buff) - wr_idx);
+            memcpy(serial_buff, &serial_buff[drop], wr_idx - drop);
+            wr_idx -= drop;
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void parse_stream(const uint8_t *log, size_t log_size, size_t chunk, struct parse_res_s *res) {
+    static struct lgw_gps_parser_s parser; /* state kept from one pass to the next, as the log loops */
+    size_t log_idx = 0;
+    size_t nb_parsed;
+    enum gps_msg latest_msg;
+
+    while (log_idx < log_size) {
+        size_t rd_idx = 0;
+        size_t nb_char = ((log_size - log_idx) < chunk) ? (log_size - log_idx) : chunk;
+        const uint8_t *serial_buff = log + log_idx; /* read() */
+
+        log_idx += nb_char;
+        while (rd_idx < nb_char) {
+            latest_msg = lgw_gps_parse_stream(&parser, &serial_buff[rd_idx], nb_char - rd_idx, &nb_parsed);
+            rd_idx += nb_parsed;
+            if (latest_msg != INCOMPLETE) {
+                account(res, latest_msg);
+            }
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static size_t nmea_append(char *dst, const char *body) {
+    uint8_t cs = 0;
+    const char *c;
+
+    for (c = body; *c != '\0'; c++) {
+        cs ^= (uint8_t)*c;
+    }
+
+    return (size_t)sprintf(dst, "$%s*%02X\r\n", body, cs);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static size_t ubx_timegps_append(uint8_t *dst, uint32_t itow, int32_t ftow, int16_t week) {
+    uint8_t ck_a = 0, ck_b = 0;
+    int i;
+
+    dst[0] = 0xB5; dst[1] = 0x62; /* sync */
+    dst[2] = 0x01; dst[3] = 0x20; /* NAV-TIMEGPS */
+    dst[4] = 16; dst[5] = 0;
+    dst[6] = itow; dst[7] = itow >> 8; dst[8] = itow >> 16; dst[9] = itow >> 24;
+    dst[10] = ftow; dst[11] = ftow >> 8; dst[12] = ftow >> 16; dst[13] = ftow >> 24;
+    dst[14] = week; dst[15] = week >> 8;
+    dst[16] = 18; /* leap seconds */
+    dst[17] = 0x07; /* towValid, weekValid, leapSValid */
+    dst[18] = 0x10; dst[19] = 0x00; dst[20] = 0x00; dst[21] = 0x00; /* tAcc */
+    for (i = 2; i < 22; i++) {
+        ck_a += dst[i];
+        ck_b += ck_a;
+    }
+    dst[22] = ck_a;
+    dst[23] = ck_b;
+
+    return 24;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t * generate_log(size_t *log_size) {
+    uint8_t *log = malloc(GEN_NB_SECONDS * GEN_SEC_SIZE);
+    char body[128];
+    size_t size = 0;
+    int s;
+
+    if (log == NULL) {
+        return NULL;
+    }
+
+    for (s = 0; s < GEN_NB_SECONDS; s++) {
+        int hh = 8 + (s / 3600), mm = (s / 60) % 60, ss = s % 60;
+
+        sprintf(body, "GPRMC,%02d%02d%02d.00,A,4717.%05d,N,00833.%05d,E,0.004,77.52,091202,,,A", hh, mm, ss, 11437 + s, 91522 - s);
+        size += nmea_append((char *)log + size, body);
+        sprintf(body, "GPGGA,%02d%02d%02d.00,4717.%05d,N,00833.%05d,E,1,08,1.01,%d.6,M,48.0,M,,", hh, mm, ss, 11437 + s, 91522 - s, 499 - (s % 10));
+        size += nmea_append((char *)log + size, body);
+        size += nmea_append((char *)log + size, "GPGSA,A,3,23,29,07,08,09,18,26,28,,,,,1.94,1.18,1.54");
+        size += nmea_append((char *)log + size, "GPGSV,3,1,12,03,06,181,,07,41,247,34,08,36,300,28,09,29,108,23");
+        size += ubx_timegps_append(log + size, 378000000 + (s * 1000), -12345 + s, 2123);
+    }
+
+    *log_size = size;
+    return log;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i;
+    unsigned int arg_u;
+    unsigned int nb_loops = DEFAULT_NB_LOOPS;
+    unsigned int chunk = DEFAULT_CHUNK_SIZE;
+    char *log_path = NULL;
+    uint8_t *log;
+    size_t log_size = 0;
+    struct parse_res_s res_frames, res_stream, res_check;
+    struct timespec start, end;
+    double t_frames, t_stream, nb_mb;
+    unsigned int l;
+    FILE *fp;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hf:n:c:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 'f':
+                log_path = optarg;
+                break;
+            case 'n':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_loops = arg_u;
+                break;
+            case 'c':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1) || (arg_u > 64)) {
+                    printf("ERROR: argument parsing of -c argument, [1..64]. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                chunk = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    /* load or generate the GPS log */
+    if (log_path != NULL) {
+        fp = fopen(log_path, "rb");
+        if (fp == NULL) {
+            printf("ERROR: failed to open %s\n", log_path);
+            return EXIT_FAILURE;
+        }
+        fseek(fp, 0, SEEK_END);
+        log_size = (size_t)ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        log = malloc(log_size > 0 ? log_size : 1);
+        if ((log == NULL) || (fread(log, 1, log_size, fp) != log_size)) {
+            printf("ERROR: failed to read %s\n", log_path);
+            fclose(fp);
+            return EXIT_FAILURE;
+        }
+        fclose(fp);
+    } else {
+        log = generate_log(&log_size);
+        if (log == NULL) {
+            printf("ERROR: failed to generate GPS log\n");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("GPS log: %zu bytes (%s), parsed %u times by chunks of %u bytes\n", log_size, (log_path != NULL) ? log_path : "generated", nb_loops, chunk);
+
+    /* check that both parsers give the same GPS solutions, from the same initial state */
+    memset(&res_frames, 0, sizeof res_frames);
+    memset(&res_stream, 0, sizeof res_stream);
+    memset(&res_check, 0, sizeof res_check);
+    res_frames.check = true;
+    res_stream.check = true;
+    res_check.check = true;
+    parse_frames(log, log_size, chunk, &res_frames);
+    parse_stream(log, log_size, chunk, &res_stream);
+    parse_frames(log, log_size, chunk, &res_check);
+    printf("frames: %u NAV-TIMEGPS, %u RMC, %u GGA, %u ignored, %u invalid\n", res_check.nb_timegps, res_check.nb_rmc, res_check.nb_gga, res_check.nb_ignored, res_check.nb_invalid);
+    printf("stream: %u NAV-TIMEGPS, %u RMC, %u GGA, %u ignored, %u invalid\n", res_stream.nb_timegps, res_stream.nb_rmc, res_stream.nb_gga, res_stream.nb_ignored, res_stream.nb_invalid);
+    if ((res_check.nb_timegps != res_stream.nb_timegps) || (res_check.nb_rmc != res_stream.nb_rmc) || (res_check.nb_gga != res_stream.nb_gga) || (res_check.hash != res_stream.hash)) {
+        printf("WARNING: GPS solutions differ between parsers (corrupted frames in the log, or frames dropped by the linear buffer)\n");
+    } else {
+        printf("GPS solutions: identical\n");
+    }
+
+    /* throughput */
+    res_frames.check = false;
+    res_stream.check = false;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loops; l++) {
+        parse_frames(log, log_size, chunk, &res_frames);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_frames = diff_s(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loops; l++) {
+        parse_stream(log, log_size, chunk, &res_stream);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_stream = diff_s(&start, &end);
+
+    nb_mb = (double)log_size * nb_loops / 1e6;
+    printf("lgw_parse_ubx/nmea:   %8.2f MB/s, %6.2f ns/byte\n", nb_mb / t_frames, t_frames * 1e3 / nb_mb);
+    printf("lgw_gps_parse_stream: %8.2f MB/s, %6.2f ns/byte\n", nb_mb / t_stream, t_stream * 1e3 / nb_mb);
+
+    free(log);
+    printf("=========== Test End ===========\n");
+
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
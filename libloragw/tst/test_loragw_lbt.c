@@ -0,0 +1,218 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Benchmark of the LBT arming cost per downlink, using the software (SIM)
+    COM interface: SX1261 commands and bytes sent by lgw_lbt_start for
+    back-to-back downlinks on the same channel and on alternating channels,
+    with and without reuse of the SX1261 RX configuration.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_com.h"
+#include "loragw_sim.h"
+#include "loragw_sx1261.h"
+#include "loragw_lbt.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_NB_DOWNLINK     1000
+#define NB_LBT_CHANNEL          8
+#define LBT_FREQ_START          923200000
+#define LBT_FREQ_STEP           200000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -n <uint> number of downlinks per run\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* arm and disarm LBT for nb_dl downlinks, return the number of errors */
+static int run(const char * name, const struct lgw_conf_sx1261_s * conf, unsigned int nb_dl, unsigned int nb_chan, bool reuse) {
+    struct lgw_pkt_tx_s pkt;
+    struct lgw_sim_stats_s stats;
+    struct timespec start, stop;
+    double elapsed_us;
+    uint32_t nb_cmd;
+    unsigned int i;
+    int nb_err = 0;
+
+    memset(&pkt, 0, sizeof pkt);
+    pkt.modulation = MOD_LORA;
+    pkt.bandwidth = BW_125KHZ;
+    pkt.datarate = DR_LORA_SF10;
+    pkt.coderate = CR_LORA_4_5;
+    pkt.preamble = 8;
+    pkt.size = 20;
+
+    lgw_lbt_rx_params_changed();
+    lgw_sim_reset_stats(lgw_com_target());
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < nb_dl; i++) {
+        pkt.freq_hz = LBT_FREQ_START + (i % nb_chan) * LBT_FREQ_STEP;
+        if (reuse == false) {
+            lgw_lbt_rx_params_changed();
+        }
+        if (lgw_lbt_start(conf, &pkt) != 0) {
+            nb_err += 1;
+        }
+        if (lgw_lbt_stop() != 0) {
+            nb_err += 1;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    lgw_sim_get_stats(lgw_com_target(), &stats);
+    elapsed_us = (double)(stop.tv_sec - start.tv_sec) * 1e6 + (double)(stop.tv_nsec - start.tv_nsec) / 1e3;
+
+    nb_cmd = stats.nb_w + stats.nb_r + stats.nb_rmw + stats.nb_wb + stats.nb_rb;
+    printf("%-22s | %-5s | %12.2f | %13.1f | %13.1f\n", name, (reuse == true) ? "yes" : "no",
+            (double)nb_cmd / nb_dl,
+            (double)stats.nb_bytes_w / nb_dl,
+            elapsed_us / nb_dl);
+
+    return nb_err;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x;
+    unsigned int arg_u;
+    unsigned int nb_dl = DEFAULT_NB_DOWNLINK;
+    int nb_err = 0;
+    struct lgw_pkt_tx_s pkt;
+    static struct lgw_conf_sx1261_s conf;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hn:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_dl = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    printf("===== LBT arming benchmark (SIM) =====\n");
+
+    x = lgw_connect(LGW_COM_SIM, "sim");
+    if (x != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to connect to the SIM interface\n");
+        return EXIT_FAILURE;
+    }
+    x = sx1261_connect(LGW_COM_SIM, NULL);
+    if (x != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to connect the sx1261 to the SIM interface\n");
+        return EXIT_FAILURE;
+    }
+
+    /* AS923-like LBT configuration */
+    conf.enable = true;
+    conf.rssi_offset = 0;
+    conf.lbt_conf.enable = true;
+    conf.lbt_conf.rssi_target = -80;
+    conf.lbt_conf.nb_channel = NB_LBT_CHANNEL;
+    for (i = 0; i < NB_LBT_CHANNEL; i++) {
+        conf.lbt_conf.channels[i].freq_hz = LBT_FREQ_START + i * LBT_FREQ_STEP;
+        conf.lbt_conf.channels[i].bandwidth = BW_125KHZ;
+        conf.lbt_conf.channels[i].scan_time_us = LGW_LBT_SCAN_TIME_128_US;
+        conf.lbt_conf.channels[i].transmit_time_ms = 400;
+    }
+    if (lgw_lbt_init(&conf) != 0) {
+        printf("ERROR: failed to initialize LBT\n");
+        return EXIT_FAILURE;
+    }
+
+    /* channels outside of the configuration are still rejected */
+    memset(&pkt, 0, sizeof pkt);
+    pkt.modulation = MOD_LORA;
+    pkt.bandwidth = BW_125KHZ;
+    pkt.datarate = DR_LORA_SF10;
+    pkt.coderate = CR_LORA_4_5;
+    pkt.preamble = 8;
+    pkt.size = 20;
+    pkt.freq_hz = LBT_FREQ_START - LBT_FREQ_STEP;
+    if (lgw_lbt_start(&conf, &pkt) != -1) {
+        printf("ERROR: LBT started on a channel not configured\n");
+        nb_err += 1;
+    }
+    pkt.freq_hz = LBT_FREQ_START;
+    pkt.bandwidth = BW_250KHZ;
+    if (lgw_lbt_start(&conf, &pkt) != -1) {
+        printf("ERROR: LBT started with a bandwidth not configured\n");
+        nb_err += 1;
+    }
+    pkt.bandwidth = BW_125KHZ;
+    pkt.datarate = DR_LORA_SF12;
+    pkt.size = 255; /* ~9s time on air */
+    if (lgw_lbt_start(&conf, &pkt) != -1) {
+        printf("ERROR: LBT started with a time on air above the transmit time\n");
+        nb_err += 1;
+    }
+
+    printf("%u downlinks per run\n", nb_dl);
+    printf("downlinks              | reuse | commands/dl | bytes sent/dl | host time/dl (us)\n");
+    nb_err += run("same channel", &conf, nb_dl, 1, false);
+    nb_err += run("same channel", &conf, nb_dl, 1, true);
+    nb_err += run("alternating channels", &conf, nb_dl, 2, false);
+    nb_err += run("alternating channels", &conf, nb_dl, 2, true);
+
+    sx1261_disconnect();
+    lgw_disconnect();
+
+    printf("errors: %d\n", nb_err);
+    printf("=========== Test End ===========\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
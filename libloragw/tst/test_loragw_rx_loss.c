@@ -0,0 +1,206 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Check the RX buffer losses counters, using the software (SIM) COM
+    interface: corrupted RX buffers are fetched and parsed, and the packets
+    salvaged around the corrupted regions, the number of resync, checksum
+    errors, bytes discarded and packets lost are checked.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_com.h"
+#include "loragw_sim.h"
+#include "loragw_sx1302_rx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PKT_HEAD_METADATA   9
+#define PKT_TAIL_METADATA   14
+#define PAYLOAD_SIZE        20
+#define PKT_SIZE            (PKT_HEAD_METADATA + PAYLOAD_SIZE + PKT_TAIL_METADATA)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static rx_buffer_t rx_buffer;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* Format a packet as stored by the SX1302 in its RX buffer, without fine timestamp metrics */
+static void build_packet(uint8_t * buff, uint8_t seed) {
+    int i, idx;
+    uint8_t checksum = 0;
+
+    memset(buff, 0, PKT_SIZE);
+    buff[0] = 0xA5; /* syncword */
+    buff[1] = 0xC0;
+    buff[2] = PAYLOAD_SIZE;
+    buff[4] = (uint8_t)((7 << 4) | (1 << 1) | 0x01); /* sf7, cr 4/5, crc_en */
+    for (i = 0; i < PAYLOAD_SIZE; i++) {
+        buff[PKT_HEAD_METADATA + i] = (uint8_t)(seed + i);
+    }
+    idx = PKT_HEAD_METADATA + PAYLOAD_SIZE;
+    buff[idx + 0] = (1 << 4); /* timing_set, no error */
+    buff[idx + 12] = 0; /* no fine timestamp metrics */
+    for (i = 0; i < (PKT_SIZE - 1); i++) {
+        checksum += buff[i];
+    }
+    buff[PKT_SIZE - 1] = checksum;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* fetch and parse the RX buffer, check the packets returned and the counters increase */
+static int run(const char * name, const uint8_t * data, uint16_t size, int nb_ok, uint32_t resync, uint32_t cerr, uint32_t disc, uint32_t lost) {
+    rx_buffer_stats_t before = rx_buffer.stats;
+    rx_packet_t pkt;
+    int nb_pop = 0;
+    int x;
+
+    lgw_sim_rx_push(lgw_com_target(), data, size);
+    rx_buffer_new(&rx_buffer);
+    if (rx_buffer_fetch(&rx_buffer) != LGW_REG_SUCCESS) {
+        printf("ERROR: %s: failed to fetch\n", name);
+        return 1;
+    }
+    while (rx_buffer.buffer_pkt_nb > 0) {
+        x = rx_buffer_pop(&rx_buffer, &pkt);
+        if (x != LGW_REG_SUCCESS) {
+            break;
+        }
+        nb_pop += 1;
+    }
+
+    printf("%-22s | %3d | %6u | %9u | %9u | %4u\n", name, nb_pop,
+            rx_buffer.stats.nb_resync - before.nb_resync,
+            rx_buffer.stats.nb_checksum_err - before.nb_checksum_err,
+            rx_buffer.stats.nb_bytes_discarded - before.nb_bytes_discarded,
+            rx_buffer.stats.nb_pkt_lost - before.nb_pkt_lost);
+
+    if ((nb_pop != nb_ok) ||
+        ((rx_buffer.stats.nb_resync - before.nb_resync) != resync) ||
+        ((rx_buffer.stats.nb_checksum_err - before.nb_checksum_err) != cerr) ||
+        ((rx_buffer.stats.nb_bytes_discarded - before.nb_bytes_discarded) != disc) ||
+        ((rx_buffer.stats.nb_pkt_lost - before.nb_pkt_lost) != lost)) {
+        printf("ERROR: %s: unexpected counters\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+    static uint8_t buff[LGW_SIM_RX_FIFO_SIZE];
+    int i, x;
+    int nb_err = 0;
+
+    printf("===== RX buffer losses counters (SIM) =====\n");
+
+    x = lgw_connect(LGW_COM_SIM, "sim");
+    if (x != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to connect to the SIM interface\n");
+        return EXIT_FAILURE;
+    }
+    memset(&rx_buffer, 0, sizeof rx_buffer);
+    rx_buffer_reset_stats(&rx_buffer);
+
+    printf("RX buffer              | pkt | resync | checksum | discarded | lost\n");
+
+    /* 3 valid packets */
+    for (i = 0; i < 3; i++) {
+        build_packet(&buff[i * PKT_SIZE], i);
+    }
+    nb_err += run("clean", buff, 3 * PKT_SIZE, 3, 0, 0, 0, 0);
+
+    /* 5 bytes of garbage before 2 packets: tail of a lost packet */
+    memset(buff, 0x55, 5);
+    build_packet(&buff[5], 0);
+    build_packet(&buff[5 + PKT_SIZE], 1);
+    nb_err += run("garbage head", buff, 5 + 2 * PKT_SIZE, 2, 1, 0, 5, 1);
+
+    /* 7 bytes of garbage, starting with a syncword, between 2 packets */
+    build_packet(&buff[0], 0);
+    buff[PKT_SIZE + 0] = 0xA5;
+    buff[PKT_SIZE + 1] = 0xC0;
+    memset(&buff[PKT_SIZE + 2], 0x55, 5);
+    build_packet(&buff[PKT_SIZE + 7], 1);
+    build_packet(&buff[2 * PKT_SIZE + 7], 2);
+    nb_err += run("garbage middle", buff, 3 * PKT_SIZE + 7, 3, 1, 1, 7, 1);
+
+    /* wrong checksum on the first of 3 packets: only that packet is lost */
+    for (i = 0; i < 3; i++) {
+        build_packet(&buff[i * PKT_SIZE], i);
+    }
+    buff[PKT_SIZE - 1] ^= 0xFF;
+    nb_err += run("checksum error", buff, 3 * PKT_SIZE, 2, 1, 1, PKT_SIZE, 1);
+
+    /* wrong checksum on the last of 3 packets */
+    for (i = 0; i < 3; i++) {
+        build_packet(&buff[i * PKT_SIZE], i);
+    }
+    buff[3 * PKT_SIZE - 1] ^= 0xFF;
+    nb_err += run("checksum error (last)", buff, 3 * PKT_SIZE, 2, 1, 1, PKT_SIZE, 1);
+
+    /* no syncword at all */
+    memset(buff, 0x55, 2 * PKT_SIZE);
+    nb_err += run("no syncword", buff, 2 * PKT_SIZE, 0, 1, 0, 2 * PKT_SIZE, 1);
+
+    /* length of the first packet corrupted: checksum error, the next packets are kept */
+    for (i = 0; i < 3; i++) {
+        build_packet(&buff[i * PKT_SIZE], i);
+    }
+    buff[2] = PAYLOAD_SIZE + 1;
+    nb_err += run("corrupted length", buff, 3 * PKT_SIZE, 2, 1, 1, PKT_SIZE, 1);
+
+    /* full buffer, ending with garbage: only the garbage is discarded */
+    for (i = 0; i < (int)(sizeof buff / PKT_SIZE); i++) {
+        build_packet(&buff[i * PKT_SIZE], i);
+    }
+    memset(&buff[i * PKT_SIZE], 0x55, sizeof buff - (i * PKT_SIZE));
+    x = rx_buffer.stats.nb_buffer_full;
+    nb_err += run("full", buff, sizeof buff, i, 1, 0, sizeof buff - (i * PKT_SIZE), 1);
+    if (rx_buffer.stats.nb_buffer_full != (uint32_t)(x + 1)) {
+        printf("ERROR: full RX buffer not counted\n");
+        nb_err += 1;
+    }
+
+    lgw_disconnect();
+
+    printf("errors: %d\n", nb_err);
+    printf("=========== Test End ===========\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,349 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Benchmark of the RX buffer packet decoding (rx_buffer_pop, and
+    rx_buffer_pop_ref without payload copy) versus the previous byte by byte
+    implementation, on an RX buffer filled with mixed-size packets (up to its
+    4096 bytes) fetched through the software (SIM) COM interface. The packets
+    decoded by all of them must be identical. The fetch, which checks the
+    packets once for all, is timed separately.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* rand */
+#include <string.h>     /* memcmp */
+#include <unistd.h>     /* getopt */
+#include <time.h>       /* clock_gettime */
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_com.h"
+#include "loragw_sim.h"
+#include "loragw_sx1302_rx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_NB_LOOP     20000
+#define PKT_HEAD_METADATA   9
+#define PKT_TAIL_METADATA   14
+#define NB_PKT_MAX          255
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static rx_buffer_t rx_buffer;
+static rx_packet_t pkt_ref[NB_PKT_MAX];
+static rx_packet_t pkt_new[NB_PKT_MAX];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -n <uint> number of times the RX buffer is decoded\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double diff_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + 1e-9 * (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Format a packet as stored by the SX1302 in its RX buffer, return its size */
+static int build_packet(uint8_t * buff, uint8_t size, uint8_t nb_ts) {
+    int i, n;
+    uint8_t checksum = 0;
+    uint8_t * meta = buff + size;
+
+    n = PKT_HEAD_METADATA + size + PKT_TAIL_METADATA + (2 * nb_ts);
+    for (i = 0; i < n; i++) {
+        buff[i] = (uint8_t)rand();
+    }
+    buff[0] = 0xA5; /* syncword */
+    buff[1] = 0xC0;
+    buff[2] = size;
+    buff[3] = (uint8_t)(rand() % 8);                                  /* channel */
+    buff[4] = (uint8_t)(((5 + (rand() % 8)) << 4) | (buff[4] & 0x0F));  /* SF, CR, CRC_EN */
+    buff[5] = (uint8_t)(rand() % 16);                                 /* modem id */
+    buff[8] &= 0x0F;
+    meta[21] = nb_ts;
+    for (i = 0; i < (n - 1); i++) {
+        checksum += buff[i];
+    }
+    buff[n - 1] = checksum;
+
+    return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Reference: the previous implementation of rx_buffer_pop, without the losses counters */
+static int ref_rx_buffer_pop(rx_buffer_t * self, rx_packet_t * pkt) {
+    const uint8_t * b = self->buffer;
+    int i, x;
+    uint8_t checksum_rcv, checksum_calc = 0;
+    uint16_t pkt_num_bytes;
+
+    if (self->buffer_index >= self->buffer_size) {
+        return LGW_REG_ERROR;
+    }
+    x = self->buffer_index;
+    if ((b[x] != 0xA5) || (b[x + 1] != 0xC0)) {
+        return LGW_REG_ERROR;
+    }
+    pkt->rxbytenb_modem = b[x + 2];
+    pkt->num_ts_metrics_stored = b[self->buffer_index + pkt->rxbytenb_modem + 21];
+    pkt_num_bytes = PKT_HEAD_METADATA + pkt->rxbytenb_modem + PKT_TAIL_METADATA + (2 * pkt->num_ts_metrics_stored);
+    if ((self->buffer_index + pkt_num_bytes) > self->buffer_size) {
+        return LGW_REG_WARNING;
+    }
+    checksum_rcv = b[self->buffer_index + pkt_num_bytes - 1];
+    for (i = 0; i < (int)(pkt_num_bytes - 1); i++) {
+        checksum_calc += b[self->buffer_index + i];
+    }
+    if (checksum_rcv != checksum_calc) {
+        return LGW_REG_WARNING;
+    }
+    pkt->packet_checksum = checksum_rcv;
+
+    pkt->modem_id = b[self->buffer_index + 5];
+    pkt->rx_channel_in = b[self->buffer_index + 3];
+    pkt->crc_en = b[self->buffer_index + 4] & 0x01;
+    pkt->payload_crc_error = (b[self->buffer_index + pkt->rxbytenb_modem + 9] >> 0) & 0x01;
+    pkt->sync_error = (b[self->buffer_index + pkt->rxbytenb_modem + 9] >> 2) & 0x01;
+    pkt->header_error = (b[self->buffer_index + pkt->rxbytenb_modem + 9] >> 3) & 0x01;
+    pkt->timing_set = (b[self->buffer_index + pkt->rxbytenb_modem + 9] >> 4) & 0x01;
+    pkt->coding_rate = (b[self->buffer_index + 4] >> 1) & 0x07;
+    pkt->rx_rate_sf = (b[self->buffer_index + 4] >> 4) & 0x0F;
+    pkt->rssi_chan_avg = b[self->buffer_index + pkt->rxbytenb_modem + 11];
+    pkt->rssi_signal_avg = b[self->buffer_index + pkt->rxbytenb_modem + 12];
+    pkt->rx_crc16_value  = (uint16_t)(b[self->buffer_index + pkt->rxbytenb_modem + 19] << 0);
+    pkt->rx_crc16_value |= (uint16_t)(b[self->buffer_index + pkt->rxbytenb_modem + 20] << 8);
+    pkt->snr_average = (int8_t)b[self->buffer_index + pkt->rxbytenb_modem + 10];
+    pkt->frequency_offset_error = (int32_t)(((b[self->buffer_index + 8] & 0x0F) << 16) | (b[self->buffer_index + 7] << 8) | b[self->buffer_index + 6]);
+    if (pkt->frequency_offset_error >= (1<<19)) {
+        pkt->frequency_offset_error = (pkt->frequency_offset_error - (1<<20));
+    }
+    pkt->timestamp_cnt  = (uint32_t)(b[self->buffer_index + pkt->rxbytenb_modem + 15] << 0);
+    pkt->timestamp_cnt |= (uint32_t)(b[self->buffer_index + pkt->rxbytenb_modem + 16] << 8);
+    pkt->timestamp_cnt |= (uint32_t)(b[self->buffer_index + pkt->rxbytenb_modem + 17] << 16);
+    pkt->timestamp_cnt |= (uint32_t)(b[self->buffer_index + pkt->rxbytenb_modem + 18] << 24);
+    for (i = 0; i < (pkt->num_ts_metrics_stored * 2); i++) {
+        pkt->timestamp_avg[i] = (int8_t)b[self->buffer_index + pkt->rxbytenb_modem + 22 + i];
+        pkt->timestamp_stddev[i] = 0;
+    }
+    memcpy((void *)pkt->payload, (void *)(&(self->buffer[self->buffer_index + PKT_HEAD_METADATA])), pkt->rxbytenb_modem);
+    self->buffer_index += pkt_num_bytes;
+    self->buffer_pkt_nb -= 1;
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* decode all the packets of the fetched buffer, return the number of packets decoded */
+static int pop_all(int (*pop)(rx_buffer_t *, rx_packet_t *), rx_packet_t * pkt, uint8_t nb_pkt) {
+    int n = 0;
+
+    rx_buffer.buffer_index = 0;
+    rx_buffer.buffer_pkt_nb = nb_pkt;
+    while (rx_buffer.buffer_pkt_nb > 0) {
+        if (pop(&rx_buffer, &pkt[n]) != LGW_REG_SUCCESS) {
+            break;
+        }
+        n += 1;
+    }
+
+    return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* compare the fields decoded by both implementations */
+static bool pkt_equal(const rx_packet_t * a, const rx_packet_t * b, bool payload_ref) {
+    int nb_ts = 2 * a->num_ts_metrics_stored;
+
+    return (a->rxbytenb_modem == b->rxbytenb_modem) &&
+           (a->rx_channel_in == b->rx_channel_in) &&
+           (a->crc_en == b->crc_en) &&
+           (a->coding_rate == b->coding_rate) &&
+           (a->rx_rate_sf == b->rx_rate_sf) &&
+           (a->modem_id == b->modem_id) &&
+           (a->frequency_offset_error == b->frequency_offset_error) &&
+           (a->payload_crc_error == b->payload_crc_error) &&
+           (a->sync_error == b->sync_error) &&
+           (a->header_error == b->header_error) &&
+           (a->timing_set == b->timing_set) &&
+           (a->snr_average == b->snr_average) &&
+           (a->rssi_chan_avg == b->rssi_chan_avg) &&
+           (a->rssi_signal_avg == b->rssi_signal_avg) &&
+           (a->timestamp_cnt == b->timestamp_cnt) &&
+           (a->rx_crc16_value == b->rx_crc16_value) &&
+           (a->num_ts_metrics_stored == b->num_ts_metrics_stored) &&
+           (a->packet_checksum == b->packet_checksum) &&
+           (memcmp(a->timestamp_avg, b->timestamp_avg, nb_ts) == 0) &&
+           (memcmp(a->timestamp_stddev, b->timestamp_stddev, nb_ts) == 0) &&
+           (memcmp(a->payload, (payload_ref == true) ? b->payload_ref : b->payload, a->rxbytenb_modem) == 0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char ** argv)
+{
+    static uint8_t buff[LGW_SIM_RX_FIFO_SIZE];
+    struct timespec start, end;
+    double t_ref, t_pop, t_pop_ref, t_fetch;
+    unsigned long nb_loop = DEFAULT_NB_LOOP;
+    unsigned long l;
+    int size = 0, n, nb_ref = 0, nb_new;
+    uint8_t nb_pkt = 0;
+    uint8_t payload_size;
+    int i, x;
+    int nb_err = 0;
+
+    while ((i = getopt(argc, argv, "hn:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'n':
+                nb_loop = strtoul(optarg, NULL, 10);
+                if (nb_loop == 0) {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    printf("===== RX buffer decoding benchmark (SIM) =====\n");
+
+    /* full RX buffer of mixed-size packets, a third of them with fine timestamp metrics */
+    srand(1);
+    while (true) {
+        payload_size = (uint8_t)(rand() % 256);
+        x = ((rand() % 3) == 0) ? (1 + (rand() % 32)) : 0;
+        if ((size + PKT_HEAD_METADATA + payload_size + PKT_TAIL_METADATA + (2 * x)) > (int)sizeof buff) {
+            break;
+        }
+        size += build_packet(&buff[size], payload_size, (uint8_t)x);
+        nb_pkt += 1;
+    }
+
+    x = lgw_connect(LGW_COM_SIM, "sim");
+    if (x != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to connect to the SIM interface\n");
+        return EXIT_FAILURE;
+    }
+    memset(&rx_buffer, 0, sizeof rx_buffer);
+    lgw_sim_rx_push(lgw_com_target(), buff, (uint16_t)size);
+    if ((rx_buffer_fetch(&rx_buffer) != LGW_REG_SUCCESS) || (rx_buffer.buffer_pkt_nb != nb_pkt)) {
+        printf("ERROR: failed to fetch the %u packets\n", nb_pkt);
+        lgw_disconnect();
+        return EXIT_FAILURE;
+    }
+    printf("RX buffer: %d bytes, %u packets\n", size, nb_pkt);
+
+    /* same results */
+    nb_ref = pop_all(ref_rx_buffer_pop, pkt_ref, nb_pkt);
+    nb_new = pop_all(rx_buffer_pop, pkt_new, nb_pkt);
+    for (n = 0; n < nb_new; n++) {
+        if (pkt_equal(&pkt_ref[n], &pkt_new[n], false) == false) {
+            printf("ERROR: rx_buffer_pop: packet %d differs\n", n);
+            nb_err += 1;
+        }
+    }
+    if ((nb_ref != nb_pkt) || (nb_new != nb_pkt)) {
+        printf("ERROR: rx_buffer_pop: %d/%d packets decoded\n", nb_new, nb_pkt);
+        nb_err += 1;
+    }
+    nb_new = pop_all(rx_buffer_pop_ref, pkt_new, nb_pkt);
+    for (n = 0; n < nb_new; n++) {
+        if (pkt_equal(&pkt_ref[n], &pkt_new[n], true) == false) {
+            printf("ERROR: rx_buffer_pop_ref: packet %d differs\n", n);
+            nb_err += 1;
+        }
+    }
+    if (nb_new != nb_pkt) {
+        printf("ERROR: rx_buffer_pop_ref: %d/%d packets decoded\n", nb_new, nb_pkt);
+        nb_err += 1;
+    }
+
+    /* timing */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loop; l++) {
+        pop_all(ref_rx_buffer_pop, pkt_ref, nb_pkt);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_ref = diff_s(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loop; l++) {
+        pop_all(rx_buffer_pop, pkt_new, nb_pkt);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_pop = diff_s(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loop; l++) {
+        pop_all(rx_buffer_pop_ref, pkt_new, nb_pkt);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_pop_ref = diff_s(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loop; l++) {
+        lgw_sim_rx_push(lgw_com_target(), buff, (uint16_t)size);
+        rx_buffer_new(&rx_buffer);
+        rx_buffer_fetch(&rx_buffer);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_fetch = diff_s(&start, &end);
+    if (rx_buffer.buffer_pkt_nb != nb_pkt) {
+        printf("ERROR: rx_buffer_fetch: %u/%u packets\n", rx_buffer.buffer_pkt_nb, nb_pkt);
+        nb_err += 1;
+    }
+    lgw_disconnect();
+
+    printf("decoder           | us/buffer | ns/packet | MB/s\n");
+    printf("reference         | %9.3f | %9.1f | %6.0f\n", t_ref * 1e6 / nb_loop, t_ref * 1e9 / nb_loop / nb_pkt, size * nb_loop / t_ref / 1e6);
+    printf("rx_buffer_pop     | %9.3f | %9.1f | %6.0f\n", t_pop * 1e6 / nb_loop, t_pop * 1e9 / nb_loop / nb_pkt, size * nb_loop / t_pop / 1e6);
+    printf("rx_buffer_pop_ref | %9.3f | %9.1f | %6.0f\n", t_pop_ref * 1e6 / nb_loop, t_pop_ref * 1e9 / nb_loop / nb_pkt, size * nb_loop / t_pop_ref / 1e6);
+    printf("rx_buffer_fetch   | %9.3f | %9.1f | %6.0f  (SIM read and packets check)\n", t_fetch * 1e6 / nb_loop, t_fetch * 1e9 / nb_loop / nb_pkt, size * nb_loop / t_fetch / 1e6);
+
+    printf("errors: %d\n", nb_err);
+    printf("=========== Test End ===========\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,292 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Benchmark of the number of bus transactions needed to fetch and parse
+    packets with fine timestamp metrics, using the software (SIM) COM interface.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_com.h"
+#include "loragw_sim.h"
+#include "loragw_sx1302.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SIM_ADDR_TIMESTAMP_PPS      0x6101  /* TIMESTAMP_PPS_MSB2, followed by the freerun counter */
+
+#define PKT_HEAD_METADATA           9
+#define PKT_TAIL_METADATA           14
+
+#define DEFAULT_NB_PKT              32
+#define DEFAULT_NB_FETCH            100
+#define DEFAULT_PAYLOAD_SIZE        16
+#define DEFAULT_NB_METRICS          32
+#define DEFAULT_SF                  7
+
+#define PPS_PERIOD_32MHZ            32000000U
+#define PPS_HISTORY_FILL            20      /* more than the PPS history size */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -n <uint> number of packets per fetch [1..255]\n");
+    printf(" -f <uint> number of fetches\n");
+    printf(" -s <uint> payload size [1..255]\n");
+    printf(" -m <uint> number of fine timestamp metrics per packet [1..127]\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void set_counters(uint32_t pps, uint32_t inst) {
+    uint8_t buff[8];
+
+    buff[0] = (uint8_t)(pps >> 24);
+    buff[1] = (uint8_t)(pps >> 16);
+    buff[2] = (uint8_t)(pps >> 8);
+    buff[3] = (uint8_t)(pps >> 0);
+    buff[4] = (uint8_t)(inst >> 24);
+    buff[5] = (uint8_t)(inst >> 16);
+    buff[6] = (uint8_t)(inst >> 8);
+    buff[7] = (uint8_t)(inst >> 0);
+
+    lgw_sim_mem_set(lgw_com_target(), SIM_ADDR_TIMESTAMP_PPS, buff, sizeof buff);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Format a packet as stored by the SX1302 in its RX buffer, return its size */
+static int build_packet(uint8_t * buff, uint8_t sf, uint8_t size, uint8_t nb_metrics, uint32_t tmst, uint32_t seed) {
+    int i, idx;
+    uint16_t crc;
+    uint8_t checksum = 0;
+
+    buff[0] = 0xA5; /* syncword */
+    buff[1] = 0xC0;
+    buff[2] = size;
+    buff[3] = 0; /* channel */
+    buff[4] = (uint8_t)((sf << 4) | (1 << 1) | 0x01); /* sf, cr 4/5, crc_en */
+    buff[5] = 0; /* modem_id */
+    buff[6] = 0; /* frequency offset */
+    buff[7] = 0;
+    buff[8] = 0;
+    for (i = 0; i < size; i++) {
+        buff[PKT_HEAD_METADATA + i] = (uint8_t)(seed + i);
+    }
+    crc = sx1302_lora_payload_crc(&buff[PKT_HEAD_METADATA], size);
+
+    idx = PKT_HEAD_METADATA + size;
+    buff[idx + 0] = (1 << 4); /* timing_set, no error */
+    buff[idx + 1] = 40; /* snr */
+    buff[idx + 2] = 60; /* rssi chan */
+    buff[idx + 3] = 60; /* rssi sig */
+    buff[idx + 4] = 0;
+    buff[idx + 5] = 0;
+    buff[idx + 6] = (uint8_t)(tmst >> 0);
+    buff[idx + 7] = (uint8_t)(tmst >> 8);
+    buff[idx + 8] = (uint8_t)(tmst >> 16);
+    buff[idx + 9] = (uint8_t)(tmst >> 24);
+    buff[idx + 10] = (uint8_t)(crc >> 0);
+    buff[idx + 11] = (uint8_t)(crc >> 8);
+    buff[idx + 12] = nb_metrics;
+    for (i = 0; i < (2 * nb_metrics); i++) {
+        buff[idx + 13 + i] = (uint8_t)((i % 3) - 1); /* small metrics around 0 */
+    }
+    idx += 13 + (2 * nb_metrics);
+
+    for (i = 0; i < idx; i++) {
+        checksum += buff[i];
+    }
+    buff[idx] = checksum;
+
+    return idx + 1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, j, x;
+    unsigned int arg_u;
+    unsigned int nb_pkt = DEFAULT_NB_PKT;
+    unsigned int nb_fetch = DEFAULT_NB_FETCH;
+    unsigned int payload_size = DEFAULT_PAYLOAD_SIZE;
+    unsigned int nb_metrics = DEFAULT_NB_METRICS;
+    uint8_t nb_pkt_fetched;
+    uint8_t pkt_buff[PKT_HEAD_METADATA + 255 + PKT_TAIL_METADATA + 255];
+    int pkt_size;
+    uint32_t pps = 0;
+    uint32_t nb_pkt_total = 0, nb_ftime = 0;
+    uint32_t nb_transactions;
+    struct lgw_pkt_rx_s pkt;
+    struct lgw_sim_stats_s stats;
+    struct timespec start, stop;
+    double elapsed_us;
+    static lgw_context_t ctx;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hn:f:s:m:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1) || (arg_u > 255)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_pkt = arg_u;
+                break;
+            case 'f':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -f argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_fetch = arg_u;
+                break;
+            case 's':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1) || (arg_u > 255)) {
+                    printf("ERROR: argument parsing of -s argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                payload_size = arg_u;
+                break;
+            case 'm':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1) || (arg_u > 127)) {
+                    printf("ERROR: argument parsing of -m argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_metrics = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    pkt_size = PKT_HEAD_METADATA + payload_size + PKT_TAIL_METADATA + (2 * nb_metrics);
+    if ((nb_pkt * pkt_size) > LGW_SIM_RX_FIFO_SIZE) {
+        printf("ERROR: %u packets of %d bytes do not fit in the RX buffer (%d bytes)\n", nb_pkt, pkt_size, LGW_SIM_RX_FIFO_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    printf("===== sx1302 fine timestamp bus transactions benchmark (SIM) =====\n");
+
+    x = lgw_connect(LGW_COM_SIM, "sim");
+    if (x != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to connect to the SIM interface\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Minimal context: all packets received on LoRa multi-SF channel 0, fine timestamp enabled */
+    memset(&ctx, 0, sizeof ctx);
+    ctx.rf_chain_cfg[0].freq_hz = 868500000;
+    ctx.if_chain_cfg[0].enable = true;
+    ctx.if_chain_cfg[0].rf_chain = 0;
+    ctx.if_chain_cfg[0].freq_hz = -400000;
+    ctx.ftime_cfg.enable = true;
+    ctx.ftime_cfg.mode = LGW_FTIME_MODE_ALL_SF;
+
+    /* Fill the PPS history with one PPS per second */
+    for (i = 0; i < PPS_HISTORY_FILL; i++) {
+        pps += PPS_PERIOD_32MHZ;
+        set_counters(pps, pps + 1000);
+        sx1302_update();
+    }
+
+    lgw_sim_reset_stats(lgw_com_target());
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < (int)nb_fetch; i++) {
+        /* New PPS, and packets received half a second after it */
+        pps += PPS_PERIOD_32MHZ;
+        for (j = 0; j < (int)nb_pkt; j++) {
+            pkt_size = build_packet(pkt_buff, DEFAULT_SF, payload_size, nb_metrics, pps + (PPS_PERIOD_32MHZ / 2) + (j * 1000), i + j);
+            lgw_sim_rx_push(lgw_com_target(), pkt_buff, pkt_size);
+        }
+        set_counters(pps, pps + (PPS_PERIOD_32MHZ / 2) + (nb_pkt * 1000) + 32000);
+
+        /* Same sequence as lgw_receive() */
+        x = sx1302_fetch(&nb_pkt_fetched);
+        if (x != LGW_REG_SUCCESS) {
+            printf("ERROR: failed to fetch packets\n");
+            break;
+        }
+        sx1302_update();
+        for (j = 0; j < nb_pkt_fetched; j++) {
+            x = sx1302_parse(&ctx, &pkt);
+            if (x != LGW_REG_SUCCESS) {
+                printf("ERROR: failed to parse packet %d\n", j);
+                break;
+            }
+            nb_pkt_total += 1;
+            if (pkt.ftime_received == true) {
+                nb_ftime += 1;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    lgw_sim_get_stats(lgw_com_target(), &stats);
+    elapsed_us = (double)(stop.tv_sec - start.tv_sec) * 1e6 + (double)(stop.tv_nsec - start.tv_nsec) / 1e3;
+
+    nb_transactions = stats.nb_w + stats.nb_r + stats.nb_rmw + stats.nb_wb + stats.nb_rb;
+    printf("fetches:           %u\n", nb_fetch);
+    printf("packets parsed:    %u (%u with fine timestamp)\n", nb_pkt_total, nb_ftime);
+    printf("bus transactions:  %u (w:%u r:%u rmw:%u wb:%u rb:%u)\n", nb_transactions, stats.nb_w, stats.nb_r, stats.nb_rmw, stats.nb_wb, stats.nb_rb);
+    printf("bytes transferred: %llu written, %llu read\n", (unsigned long long)stats.nb_bytes_w, (unsigned long long)stats.nb_bytes_r);
+    if (nb_pkt_total > 0) {
+        printf("transactions/pkt:  %.3f\n", (double)nb_transactions / (double)nb_pkt_total);
+        printf("host time/pkt:     %.3f us\n", elapsed_us / (double)nb_pkt_total);
+    }
+
+    lgw_disconnect();
+
+    printf("=========== Test End ===========\n");
+
+    return ((nb_pkt_total == (nb_pkt * nb_fetch)) && (nb_ftime == nb_pkt_total)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
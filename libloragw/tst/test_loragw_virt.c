@@ -0,0 +1,278 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Functional test of the virtual concentrator through the HAL API: uplink
+    rate and content of the traffic model, RX buffer overflow, TX status
+    and TX timing counters. No hardware is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_DEV              100
+#define DEV_ADDR            0x26000000
+#define DEFAULT_DURATION_MS 2000
+#define POLL_MS             10
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_pkt_rx_s rxpkt[255];
+
+static const int32_t if_freq[LGW_MULTI_NB] = {-400000, -200000, 0, -400000, -200000, 0, 200000, 400000};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -d <uint> duration of the uplink test, in ms\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int configure(uint32_t nb_dev, float period_s) {
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_conf_virt_s virtconf;
+    int i;
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.type = LGW_RADIO_TYPE_SX1250;
+    rfconf.tx_enable = true;
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        rfconf.freq_hz = (i == 0) ? 867500000 : 868500000;
+        if (lgw_rxrf_setconf(i, &rfconf) != LGW_HAL_SUCCESS) {
+            return -1;
+        }
+    }
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    for (i = 0; i < LGW_MULTI_NB; i++) {
+        ifconf.rf_chain = (i < 3) ? 1 : 0;
+        ifconf.freq_hz = if_freq[i];
+        if (lgw_rxif_setconf(i, &ifconf) != LGW_HAL_SUCCESS) {
+            return -1;
+        }
+    }
+
+    memset(&virtconf, 0, sizeof virtconf);
+    virtconf.enable = true;
+    virtconf.nb_dev = nb_dev;
+    virtconf.period_s = period_s;
+    for (i = 0; i < LGW_VIRT_SF_NB; i++) {
+        virtconf.sf_weight[i] = (i >= 2) ? 1 : 0; /* SF7 to SF12 */
+    }
+    virtconf.size_min = 12;
+    virtconf.size_max = 51;
+    virtconf.rssi_mean = -100;
+    virtconf.rssi_std = 10;
+    virtconf.snr_mean = 5;
+    virtconf.snr_std = 5;
+    virtconf.crc_error_ratio = 0.1;
+    virtconf.dev_addr = DEV_ADDR;
+    virtconf.seed = 1;
+
+    return (lgw_virt_setconf(&virtconf) == LGW_HAL_SUCCESS) ? 0 : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int check_packet(const struct lgw_pkt_rx_s * p) {
+    uint32_t dev_addr;
+
+    if ((p->modulation != MOD_LORA) || (p->datarate < DR_LORA_SF7) || (p->datarate > DR_LORA_SF12) || (p->if_chain >= LGW_MULTI_NB)) {
+        printf("ERROR: wrong modulation parameters (IF%u SF%u)\n", p->if_chain, p->datarate);
+        return 1;
+    }
+    if (p->freq_hz != (uint32_t)((p->if_chain < 3 ? 868500000 : 867500000) + if_freq[p->if_chain])) {
+        printf("ERROR: wrong frequency %u Hz on IF%u\n", p->freq_hz, p->if_chain);
+        return 1;
+    }
+    if ((p->size < 12) || (p->size > 51) || (p->payload[0] != 0x40)) {
+        printf("ERROR: wrong payload (%u bytes, MHDR 0x%02X)\n", p->size, p->payload[0]);
+        return 1;
+    }
+    dev_addr = p->payload[1] | (p->payload[2] << 8) | (p->payload[3] << 16) | ((uint32_t)p->payload[4] << 24);
+    if ((dev_addr < DEV_ADDR) || (dev_addr >= (DEV_ADDR + NB_DEV))) {
+        printf("ERROR: DevAddr 0x%08X out of the population\n", dev_addr);
+        return 1;
+    }
+    if ((p->count_us != (uint32_t)p->count_us64) || (p->snr < -20) || (p->snr > 15)) {
+        printf("ERROR: wrong metadata (count_us %u, SNR %.1f)\n", p->count_us, p->snr);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x, n;
+    unsigned int arg_u;
+    unsigned int duration_ms = DEFAULT_DURATION_MS;
+    unsigned int nb_pkt = 0, nb_crc_bad = 0;
+    double expected;
+    uint64_t last_us = 0, now_us;
+    uint8_t status;
+    struct lgw_pkt_tx_s txpkt;
+    struct lgw_rx_stats_s rx_stats;
+    struct lgw_virt_tx_stats_s tx_stats;
+    int nb_err = 0;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hd:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 'd':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 100)) {
+                    printf("ERROR: argument parsing of -d argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                duration_ms = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    printf("===== Virtual concentrator test =====\n");
+
+    /* uplinks: 100 end-devices, one uplink per second each */
+    if ((configure(NB_DEV, 1.0) != 0) || (lgw_start() != LGW_HAL_SUCCESS)) {
+        printf("ERROR: failed to start the virtual concentrator\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < (int)(duration_ms / POLL_MS); i++) {
+        wait_ms(POLL_MS);
+        n = lgw_receive(255, rxpkt);
+        if (n < 0) {
+            printf("ERROR: lgw_receive failed\n");
+            nb_err += 1;
+            break;
+        }
+        for (x = 0; x < n; x++) {
+            nb_err += check_packet(&rxpkt[x]);
+            if (rxpkt[x].count_us64 < last_us) {
+                printf("ERROR: count_us going backward\n");
+                nb_err += 1;
+            }
+            last_us = rxpkt[x].count_us64;
+            nb_crc_bad += (rxpkt[x].status == STAT_CRC_BAD) ? 1 : 0;
+        }
+        nb_pkt += n;
+    }
+    lgw_get_instcnt64(&now_us); /* the counter starts at 0 */
+    expected = NB_DEV * now_us / 1E6;
+    printf("uplinks: %u received (%.0f expected), %u with a bad CRC\n", nb_pkt, expected, nb_crc_bad);
+    if ((nb_pkt < 0.7 * expected) || (nb_pkt > 1.3 * expected) || (nb_crc_bad == 0) || (nb_crc_bad > nb_pkt / 4)) {
+        printf("ERROR: uplink rate or CRC error ratio out of the traffic model\n");
+        nb_err += 1;
+    }
+
+    /* downlinks: one on time, one late */
+    memset(&txpkt, 0, sizeof txpkt);
+    txpkt.freq_hz = 869525000;
+    txpkt.tx_mode = TIMESTAMPED;
+    txpkt.rf_chain = 0;
+    txpkt.rf_power = 14;
+    txpkt.modulation = MOD_LORA;
+    txpkt.bandwidth = BW_125KHZ;
+    txpkt.datarate = DR_LORA_SF7;
+    txpkt.coderate = CR_LORA_4_5;
+    txpkt.invert_pol = true;
+    txpkt.preamble = 8;
+    txpkt.size = 12;
+    lgw_get_instcnt64(&now_us);
+    txpkt.count_us = (uint32_t)(now_us + 100000);
+    x = lgw_send(&txpkt);
+    lgw_status(0, TX_STATUS, &status);
+    if ((x != LGW_HAL_SUCCESS) || (status != TX_SCHEDULED)) {
+        printf("ERROR: TX not scheduled (status %u)\n", status);
+        nb_err += 1;
+    }
+    wait_ms(100);
+    lgw_status(0, TX_STATUS, &status);
+    if (status != TX_EMITTING) {
+        printf("ERROR: TX not emitting (status %u)\n", status);
+        nb_err += 1;
+    }
+    wait_ms(100);
+    lgw_status(0, TX_STATUS, &status);
+    if (status != TX_FREE) {
+        printf("ERROR: TX not done (status %u)\n", status);
+        nb_err += 1;
+    }
+    lgw_get_instcnt64(&now_us);
+    txpkt.count_us = (uint32_t)(now_us + 1000); /* less than TX_START_DELAY */
+    lgw_send(&txpkt);
+    lgw_virt_get_tx_stats(&tx_stats);
+    printf("downlinks: %u sent, %u late, slack %d..%d us\n", tx_stats.nb_tx, tx_stats.nb_tx_late, tx_stats.slack_min_us, tx_stats.slack_max_us);
+    if ((tx_stats.nb_tx != 1) || (tx_stats.nb_tx_late != 1) || (tx_stats.nb_tstamp != 2) || (tx_stats.slack_min_us >= 0) || (tx_stats.slack_max_us < 90000) || (tx_stats.airtime_us == 0)) {
+        printf("ERROR: wrong TX timing counters\n");
+        nb_err += 1;
+    }
+    lgw_stop();
+
+    /* RX buffer overflow: 100000 uplinks/s for 100 ms */
+    if ((configure(NB_DEV, 0.001) != 0) || (lgw_start() != LGW_HAL_SUCCESS)) {
+        printf("ERROR: failed to restart the virtual concentrator\n");
+        return EXIT_FAILURE;
+    }
+    wait_ms(100);
+    n = lgw_receive(255, rxpkt);
+    lgw_get_rx_stats(&rx_stats);
+    printf("overflow: %d received, %u lost, %u buffer full\n", n, rx_stats.nb_pkt_lost, rx_stats.nb_buffer_full);
+    if ((n <= 0) || (n > 255) || (rx_stats.nb_pkt_lost == 0) || (rx_stats.nb_buffer_full != 1)) {
+        printf("ERROR: RX buffer overflow not emulated\n");
+        nb_err += 1;
+    }
+    lgw_stop();
+
+    printf("errors: %d\n", nb_err);
+    printf("=========== Test End ===========\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
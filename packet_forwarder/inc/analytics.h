@@ -0,0 +1,152 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : RX analytics. The metadata of the received packets are
+    aggregated per IF chain and per spreading factor over a statistics
+    interval: packet rate, airtime occupancy and RSSI/SNR histograms from which
+    quantiles are derived. The RX losses counters of the HAL are accumulated
+    alongside: packets lost on the RX buffer, and detections which did not get
+    a demodulator. All the statistics are kept in fixed memory.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_ANALYTICS_H
+#define _LORA_PKTFWD_ANALYTICS_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define ANALYTICS_SF_NB         8       /* SF5 to SF12, FSK packets are counted as SF index 0 */
+#define ANALYTICS_PREAMBLE_NB   8       /* preamble length assumed for the airtime of LoRa uplinks */
+
+#define ANALYTICS_RSSI_MIN      -150    /* dBm, lower edge of the first RSSI bin */
+#define ANALYTICS_RSSI_STEP     2       /* dB */
+#define ANALYTICS_RSSI_BIN_NB   64      /* up to -22 dBm, out of range values go in the first/last bin */
+
+#define ANALYTICS_SNR_MIN       -30     /* dB, lower edge of the first SNR bin */
+#define ANALYTICS_SNR_STEP      1       /* dB */
+#define ANALYTICS_SNR_BIN_NB    48      /* up to +18 dB */
+
+#define ANALYTICS_Q_NB          3       /* quantiles reported */
+#define ANALYTICS_Q_PCT         {10, 50, 90}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* statistics of one spreading factor on one IF chain */
+struct analytics_sf_s {
+    uint32_t    nb_pkt;     /* packets received */
+    uint32_t    nb_crc_ok;  /* packets received with a valid CRC */
+    uint64_t    airtime_us; /* sum of the time on air of the packets */
+    uint32_t    snr_hist[ANALYTICS_SNR_BIN_NB];
+};
+
+struct analytics_chan_s {
+    uint32_t    freq_hz;    /* center frequency of the IF chain, from the last packet */
+    uint8_t     modulation;
+    uint32_t    rssi_hist[ANALYTICS_RSSI_BIN_NB]; /* channel RSSI */
+    struct analytics_sf_s sf[ANALYTICS_SF_NB];
+};
+
+/* packet statistics of the current interval, reset by analytics_reset */
+struct analytics_s {
+    struct analytics_chan_s chan[LGW_IF_CHAIN_NB];
+};
+
+/* RX losses, accumulated from the counters of lgw_get_rx_stats() */
+struct analytics_loss_s {
+    bool        last_ok;
+    struct lgw_rx_stats_s last;     /* counters at the last update */
+    struct lgw_rx_stats_s delta;    /* increase of the counters since the last reset */
+};
+
+/* per spreading factor statistics, for reporting */
+struct analytics_sf_summary_s {
+    uint8_t     sf;         /* spreading factor, 0 for FSK */
+    uint32_t    nb_pkt;
+    uint32_t    nb_crc_ok;
+    float       rate;       /* packets per second */
+    float       occ;        /* airtime occupancy, in percent */
+    int8_t      snr[ANALYTICS_Q_NB]; /* SNR quantiles, in dB */
+};
+
+/* per IF chain statistics, for reporting */
+struct analytics_summary_s {
+    uint8_t     if_chain;
+    uint32_t    freq_hz;
+    uint32_t    nb_pkt;
+    uint32_t    nb_crc_ok;
+    float       rate;       /* packets per second */
+    float       occ;        /* airtime occupancy, in percent */
+    int16_t     rssi[ANALYTICS_Q_NB]; /* channel RSSI quantiles, in dBm */
+    int8_t      snr[ANALYTICS_Q_NB];  /* SNR quantiles, in dB */
+    bool        demod_ok;   /* multi-SF channel, demodulator counters available */
+    uint32_t    nb_detect;
+    uint32_t    nb_alloc;
+    uint8_t     nb_sf;      /* number of spreading factors with packets */
+    struct analytics_sf_summary_s sf[ANALYTICS_SF_NB];
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Clear the packet statistics, for a new interval
+
+@param an[out] RX analytics
+*/
+void analytics_reset(struct analytics_s *an);
+
+/**
+@brief Aggregate the metadata of a received packet
+
+@param an[in,out] RX analytics
+@param pkt[in] Packet received, as given by lgw_receive()
+*/
+void analytics_update(struct analytics_s *an, const struct lgw_pkt_rx_s *pkt);
+
+/**
+@brief Accumulate the RX losses counters
+
+@param ls[in,out] RX losses, the first call only takes the reference
+@param stats[in] Counters, as given by lgw_get_rx_stats()
+*/
+void analytics_loss_update(struct analytics_loss_s *ls, const struct lgw_rx_stats_s *stats);
+
+/**
+@brief Clear the accumulated RX losses, keeping the reference
+
+@param ls[in,out] RX losses
+*/
+void analytics_loss_reset(struct analytics_loss_s *ls);
+
+/**
+@brief Get the statistics of an IF chain over an interval
+
+@param an[in] RX analytics
+@param ls[in] RX losses, for the demodulator counters, can be NULL
+@param if_chain[in] IF chain
+@param interval_ms[in] Duration of the interval, for the rates and occupancy
+@param summary[out] IF chain statistics
+@return false if nothing was received or detected on that IF chain
+*/
+bool analytics_summary(const struct analytics_s *an, const struct analytics_loss_s *ls, uint8_t if_chain, uint32_t interval_ms, struct analytics_summary_s *summary);
+
+#endif
+/* --- EOF ------------------------------------------------------------------ */
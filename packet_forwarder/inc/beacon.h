@@ -0,0 +1,98 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : Class B beacon engine. The beacon frames of the next
+    beaconing slots are prepared in advance, only their counter time is
+    refreshed when the GPS time reference changes.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_BEACON_H
+#define _LORA_PKTFWD_BEACON_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <time.h>       /* time_t */
+
+#include "loragw_hal.h"
+#include "loragw_gps.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define BEACON_PRECOMP_NB   16  /* Number of beacon frames prepared in one go */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+struct beacon_conf_s {
+    uint32_t    period;     /* beaconing period, in seconds */
+    uint32_t    freq_hz;    /* TX frequency of the first beacon channel, in Hz */
+    uint8_t     freq_nb;    /* number of beacon channels */
+    uint32_t    freq_step;  /* frequency step between beacon channels, in Hz */
+    uint8_t     datarate;   /* beacon datarate (SF) */
+    uint32_t    bw_hz;      /* beacon bandwidth, in Hz */
+    int8_t      power;      /* TX power, in dBm */
+    uint8_t     infodesc;   /* information descriptor */
+    struct coord_s coord;   /* gateway coordinates reported in the beacon */
+};
+
+struct beacon_engine_s {
+    uint32_t    period;
+    uint32_t    freq_hz;
+    uint8_t     freq_nb;
+    uint32_t    freq_step;
+    uint8_t     rfu1_size;      /* RFU bytes before the time field */
+    struct lgw_pkt_tx_s tmpl;   /* fields common to all the beacons */
+    time_t      first_gps_sec;  /* GPS time of frame[0] */
+    unsigned int nb_frame;      /* number of frames prepared */
+    unsigned int next_idx;      /* frame following the last one given */
+    struct lgw_pkt_tx_s frame[BEACON_PRECOMP_NB];
+    bool        ref_ok;         /* the frames counter time is computed on ref */
+    struct tref ref;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Initialize the beacon engine, and build the fields common to all the beacons
+
+@param be[out] Beacon engine
+@param conf[in] Beaconing configuration
+@return 0 on success, -1 if the bandwidth or datarate is not supported for beaconing
+*/
+int beacon_engine_init(struct beacon_engine_s *be, const struct beacon_conf_s *conf);
+
+/**
+@brief Refresh the counter time of the prepared beacons, if the time reference changed
+@brief When all the prepared beacons have been given, the following ones are prepared
+
+@param be[in,out] Beacon engine
+@param ref[in] GPS time reference
+*/
+void beacon_engine_refresh(struct beacon_engine_s *be, const struct tref *ref);
+
+/**
+@brief Get the beacon to be sent at a given GPS time, ready to be enqueued
+
+@param be[in,out] Beacon engine
+@param gps_sec[in] GPS time of the beacon, multiple of the beaconing period
+@param ref[in] GPS time reference
+@return the beacon packet, valid until the next call
+*/
+const struct lgw_pkt_tx_s * beacon_engine_get(struct beacon_engine_s *be, time_t gps_sec, const struct tref *ref);
+
+#endif
+/* --- EOF ------------------------------------------------------------------ */
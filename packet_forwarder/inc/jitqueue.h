@@ -61,6 +61,7 @@ struct jit_node_s {
     enum jit_pkt_type_e pkt_type;   /* Packet type: Downlink, Beacon... */
 
     /* Internal fields */
+    uint64_t count_us64;            /* Packet timestamp on the 64-bits concentrator counter (never wraps) */
     uint32_t pre_delay;             /* Amount of time before packet timestamp to be reserved */
     uint32_t post_delay;            /* Amount of time after packet timestamp to be reserved (time on air) */
 };
@@ -68,6 +69,7 @@ struct jit_node_s {
 struct jit_queue_s {
     uint8_t num_pkt;                /* Total number of packets in the queue (downlinks, beacons...) */
     uint8_t num_beacon;             /* Number of beacons in the queue */
+    uint32_t nb_dropped;            /* Packets dropped by jit_peek because their time was missed */
     struct jit_node_s nodes[JIT_QUEUE_MAX]; /* Nodes/packets array in the queue */
 };
 
@@ -103,7 +105,7 @@ void jit_queue_init(struct jit_queue_s *queue);
 @brief Add a packet in a Just-in-Time queue
 
 @param queue[in/out] Just in Time queue in which the packet should be inserted
-@param time_us[in] Current concentrator time
+@param time_us[in] Current concentrator time, 64-bits (see lgw_get_instcnt64)
 @param packet[in] Packet to be queued in JiT queue
 @param pkt_type[in] Type of packet to be queued: Downlink, Beacon
 @return success if the function was able to queue the packet
@@ -111,8 +113,9 @@ void jit_queue_init(struct jit_queue_s *queue);
 This function is typically used when a packet is received from server for downlink.
 It will check if packet can be queued, with several criterias. Once the packet is queued, it has to be
 sent over the air. So all checks should happen before the packet being actually in the queue.
+The packet 32-bits count_us is placed on the 64-bits concentrator timeline, as the closest value to time_us.
 */
-enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type);
+enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint64_t time_us, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type);
 
 /**
 @brief Dequeue a packet from a Just-in-Time queue
@@ -132,7 +135,7 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
 @brief Check if there is a packet soon to be sent from the JiT queue.
 
 @param queue[in] Just in Time queue to parse for peeking a packet
-@param time_us[in] Current concentrator time
+@param time_us[in] Current concentrator time, 64-bits (see lgw_get_instcnt64)
 @param pkt_idx[out] Packet index which is soon to be dequeued.
 @return success if the function was able to parse the queue. pkt_idx is set to -1 if no packet found.
 
@@ -140,7 +143,7 @@ This function is typically used to check in JiT queue if there is a packet soon
 It search the packet with the highest priority in queue, and check if its timestamp is near
 enough the current concentrator time.
 */
-enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, int *pkt_idx);
+enum jit_error_e jit_peek(struct jit_queue_s *queue, uint64_t time_us, int *pkt_idx);
 
 /**
 @brief Debug function to print the queue's content on console
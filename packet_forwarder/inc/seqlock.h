@@ -0,0 +1,78 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : Sequence lock, to publish data written rarely and read
+    often by several threads. Readers never block, and never write the shared
+    cache line; they retry their copy if a writer was active meanwhile.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_SEQLOCK_H
+#define _LORA_PKTFWD_SEQLOCK_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <pthread.h>    /* writers serialization */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define SEQLOCK_INITIALIZER { 0, PTHREAD_MUTEX_INITIALIZER }
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct seqlock_s {
+    uint32_t seq;               /* sequence counter, odd while a writer is active */
+    pthread_mutex_t mx_write;   /* serialize writers */
+} seqlock_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start modifying the data protected by a sequence lock (blocks other writers only)
+
+@param sl[in] Sequence lock
+*/
+void seqlock_write_lock(seqlock_t *sl);
+
+/**
+@brief Publish the data modified since seqlock_write_lock()
+
+@param sl[in] Sequence lock
+*/
+void seqlock_write_unlock(seqlock_t *sl);
+
+/**
+@brief Start reading the data protected by a sequence lock
+
+@param sl[in] Sequence lock
+@return the sequence number to be given to seqlock_read_retry()
+
+Typical usage: do { seq = seqlock_read_begin(&sl); copy = data; } while (seqlock_read_retry(&sl, seq));
+*/
+uint32_t seqlock_read_begin(const seqlock_t *sl);
+
+/**
+@brief Check if the data read since seqlock_read_begin() is consistent
+
+@param sl[in] Sequence lock
+@param seq[in] Sequence number returned by seqlock_read_begin()
+@return true if a writer modified the data meanwhile, and the copy must be done again
+*/
+bool seqlock_read_retry(const seqlock_t *sl, uint32_t seq);
+
+#endif
+/* --- EOF ------------------------------------------------------------------ */
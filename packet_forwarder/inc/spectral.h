@@ -0,0 +1,119 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : spectral monitoring engine. The RSSI histograms given
+    by the background spectral scan are aggregated per channel in a rolling
+    histogram, from which the noise floor and the channel occupancy above a
+    threshold are derived. The summary of the last scans of each channel is
+    kept in a ring to follow the interference trends.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_SPECTRAL_H
+#define _LORA_PKTFWD_SPECTRAL_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define SPECTRAL_CHAN_NB_MAX    64      /* Maximum number of channels monitored */
+#define SPECTRAL_CHAN_STEP_HZ   200000  /* Frequency step between 2 channels */
+#define SPECTRAL_BIN_NB         LGW_SPECTRAL_SCAN_RESULT_SIZE
+#define SPECTRAL_TREND_NB       32      /* Number of scan summaries kept per channel */
+#define SPECTRAL_AVG_NB         8       /* Rolling histogram: weight of a new scan is 1/SPECTRAL_AVG_NB */
+#define SPECTRAL_ONE            65535   /* Fixed-point representation of a 100% fraction */
+
+#define SPECTRAL_NOISE_FLOOR_PCT    10  /* Noise floor is the 10th percentile of the RSSI */
+#define SPECTRAL_HIGH_PCT           90
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* summary of one scan */
+struct spectral_trend_s {
+    int16_t     nf_dbm;     /* noise floor, in dBm */
+    int16_t     high_dbm;   /* SPECTRAL_HIGH_PCT percentile, in dBm */
+    uint16_t    occ;        /* fraction of the points above the threshold, 0 to SPECTRAL_ONE */
+};
+
+struct spectral_chan_s {
+    uint32_t    nb_scan;    /* number of scans aggregated */
+    uint16_t    hist[SPECTRAL_BIN_NB]; /* rolling histogram, fraction of the points per bin */
+    uint8_t     trend_idx;  /* next slot in the trend ring */
+    struct spectral_trend_s trend[SPECTRAL_TREND_NB];
+};
+
+struct spectral_engine_s {
+    uint32_t    freq_hz_start;  /* frequency of the first channel, in Hz */
+    uint8_t     nb_chan;        /* number of channels monitored */
+    int16_t     threshold_dbm;  /* occupancy threshold, in dBm */
+    bool        levels_ok;
+    int16_t     levels[SPECTRAL_BIN_NB]; /* RSSI level of each bin, in dBm */
+    struct spectral_chan_s chan[SPECTRAL_CHAN_NB_MAX];
+};
+
+/* per channel statistics, for reporting */
+struct spectral_summary_s {
+    uint32_t    freq_hz;    /* channel frequency, in Hz */
+    uint32_t    nb_scan;    /* number of scans aggregated */
+    int16_t     nf_dbm;     /* noise floor of the rolling histogram, in dBm */
+    int16_t     med_dbm;    /* median RSSI of the rolling histogram, in dBm */
+    int16_t     high_dbm;   /* SPECTRAL_HIGH_PCT percentile of the rolling histogram, in dBm */
+    uint16_t    occ;        /* occupancy of the rolling histogram, 0 to SPECTRAL_ONE */
+    uint16_t    occ_max;    /* highest occupancy of the scans in the trend ring */
+    int16_t     nf_min_dbm; /* lowest noise floor of the scans in the trend ring */
+    int16_t     nf_max_dbm; /* highest noise floor of the scans in the trend ring */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Initialize the spectral monitoring engine
+
+@param se[out] Spectral monitoring engine
+@param freq_hz_start[in] Frequency of the first channel, in Hz
+@param nb_chan[in] Number of channels, SPECTRAL_CHAN_STEP_HZ apart
+@param threshold_dbm[in] RSSI above which a channel is considered as occupied
+@return 0 on success, -1 if the number of channels is not supported
+*/
+int spectral_engine_init(struct spectral_engine_s *se, uint32_t freq_hz_start, uint8_t nb_chan, int16_t threshold_dbm);
+
+/**
+@brief Aggregate the result of a spectral scan
+
+@param se[in,out] Spectral monitoring engine
+@param freq_hz[in] Frequency of the scan, in Hz
+@param levels[in] RSSI level of each bin, as given by lgw_spectral_scan_get_results()
+@param results[in] Number of points of each bin, as given by lgw_spectral_scan_get_results()
+@return the channel index on success, -1 if the frequency is not monitored or the scan is empty
+*/
+int spectral_engine_update(struct spectral_engine_s *se, uint32_t freq_hz, const int16_t levels[SPECTRAL_BIN_NB], const uint16_t results[SPECTRAL_BIN_NB]);
+
+/**
+@brief Get the statistics of a channel
+
+@param se[in] Spectral monitoring engine
+@param chan[in] Channel index
+@param summary[out] Channel statistics
+@return false if the channel has not been scanned yet
+*/
+bool spectral_engine_summary(const struct spectral_engine_s *se, uint8_t chan, struct spectral_summary_s *summary);
+
+#endif
+/* --- EOF ------------------------------------------------------------------ */
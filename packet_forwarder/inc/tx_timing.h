@@ -0,0 +1,79 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : downlink timing. The time left before the TX deadline
+    of the timestamped downlinks, when dequeued from the JiT queue and when
+    lgw_send returned, is aggregated over a statistics interval in fixed size
+    histograms.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_TX_TIMING_H
+#define _LORA_PKTFWD_TX_TIMING_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define TX_TIMING_BIN_NB    10      /* time left before a TX deadline, first bin for negative values */
+#define TX_TIMING_BIN_US    {0, 1000, 2000, 5000, 10000, 20000, 30000, 40000, 50000} /* upper edges of the first 9 bins */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* timing of the timestamped downlinks over the current interval, reset by tx_timing_reset */
+struct tx_timing_s {
+    uint32_t    nb_tx;      /* packets given to lgw_send */
+    uint32_t    nb_miss;    /* lgw_send returned after the TX trigger (start delay before count_us) */
+    uint32_t    nb_jit_miss; /* dequeued less than the start delay before count_us, or dropped by the JiT queue */
+    int32_t     slack_min_us;
+    int64_t     slack_sum_us;
+    uint32_t    send_max_us; /* duration of lgw_send */
+    uint64_t    send_sum_us;
+    uint32_t    jit_hist[TX_TIMING_BIN_NB];     /* time left before count_us when dequeued */
+    uint32_t    slack_hist[TX_TIMING_BIN_NB];   /* time left before the TX trigger when lgw_send returned */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Clear the downlink timing statistics, for a new interval
+
+@param tx[out] TX timing statistics
+*/
+void tx_timing_reset(struct tx_timing_s *tx);
+
+/**
+@brief Aggregate the timing of a timestamped downlink
+
+@param tx[in,out] TX timing statistics
+@param start_delay_us[in] Time between the TX trigger and count_us, a packet dequeued later than that is a JiT miss
+@param jit_us[in] Time left before count_us when the packet was dequeued
+@param slack_us[in] Time left before the TX trigger when lgw_send returned, negative if missed
+@param send_us[in] Duration of lgw_send
+*/
+void tx_timing_update(struct tx_timing_s *tx, int32_t start_delay_us, int32_t jit_us, int32_t slack_us, uint32_t send_us);
+
+/**
+@brief Get the histogram bin of a time left before a TX deadline
+
+@param us[in] Time left, in microseconds, negative if the deadline was missed
+@return bin index, 0 for negative values
+*/
+unsigned int tx_timing_bin(int32_t us);
+
+#endif
+/* --- EOF ------------------------------------------------------------------ */
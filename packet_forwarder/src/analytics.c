@@ -0,0 +1,222 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : RX analytics
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <string.h>     /* memset */
+#include <math.h>       /* floorf */
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "analytics.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/* FSK frame around the payload: preamble, sync word, length and CRC, in bytes */
+#define FSK_OVERHEAD_BYTES  (5 + 3 + 1 + 2)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static unsigned int hist_bin(float value, int min, int step, unsigned int nb_bin) {
+    int b;
+
+    if (value < (float)min) {
+        return 0;
+    }
+    b = ((int)floorf(value) - min) / step;
+    return ((unsigned int)b >= nb_bin) ? (nb_bin - 1) : (unsigned int)b;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* bins of width step from min, the first and last ones also hold the out of range values (unlike the spectral scan
+   histograms of spectral.c, binned on the HAL RSSI levels): lower edge of the bin where pct percent of total is reached */
+static int linear_hist_percentile(const uint32_t *hist, unsigned int nb_bin, int min, int step, uint32_t total, unsigned int pct) {
+    uint64_t cumul = 0;
+    unsigned int i;
+
+    for (i = 0; i < (nb_bin - 1); i++) {
+        cumul += hist[i];
+        if ((cumul * 100) >= ((uint64_t)total * pct)) {
+            break;
+        }
+    }
+    return min + (int)i * step;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t time_on_air_us(const struct lgw_pkt_rx_s *pkt) {
+    if (pkt->modulation == MOD_LORA) {
+        return lora_packet_time_on_air(pkt->bandwidth, pkt->datarate, pkt->coderate, ANALYTICS_PREAMBLE_NB, false, (pkt->status == STAT_NO_CRC), (uint8_t)pkt->size, NULL, NULL, NULL);
+    }
+    if ((pkt->modulation == MOD_FSK) && (pkt->datarate != 0)) {
+        return (uint32_t)(((uint64_t)(FSK_OVERHEAD_BYTES + pkt->size) * 8 * 1000000) / pkt->datarate);
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static float occupancy(uint64_t airtime_us, uint32_t interval_ms) {
+    return (interval_ms == 0) ? 0.0 : (float)((double)airtime_us / ((double)interval_ms * 10.0));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void analytics_reset(struct analytics_s *an) {
+    memset(an, 0, sizeof *an);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void analytics_update(struct analytics_s *an, const struct lgw_pkt_rx_s *pkt) {
+    struct analytics_chan_s *ch;
+    struct analytics_sf_s *sf;
+    unsigned int sf_idx = 0;
+
+    if (pkt->if_chain >= LGW_IF_CHAIN_NB) {
+        return;
+    }
+    if (pkt->modulation == MOD_LORA) {
+        if ((pkt->datarate < DR_LORA_SF5) || (pkt->datarate > DR_LORA_SF12)) {
+            return;
+        }
+        sf_idx = pkt->datarate - DR_LORA_SF5;
+    }
+
+    ch = &(an->chan[pkt->if_chain]);
+    ch->freq_hz = pkt->freq_hz;
+    ch->modulation = pkt->modulation;
+    ch->rssi_hist[hist_bin(pkt->rssic, ANALYTICS_RSSI_MIN, ANALYTICS_RSSI_STEP, ANALYTICS_RSSI_BIN_NB)] += 1;
+
+    sf = &(ch->sf[sf_idx]);
+    sf->nb_pkt += 1;
+    if (pkt->status == STAT_CRC_OK) {
+        sf->nb_crc_ok += 1;
+    }
+    sf->airtime_us += time_on_air_us(pkt);
+    if (pkt->modulation == MOD_LORA) {
+        sf->snr_hist[hist_bin(pkt->snr, ANALYTICS_SNR_MIN, ANALYTICS_SNR_STEP, ANALYTICS_SNR_BIN_NB)] += 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void analytics_loss_update(struct analytics_loss_s *ls, const struct lgw_rx_stats_s *stats) {
+    int i;
+
+    if (ls->last_ok == true) {
+        ls->delta.nb_fetch += stats->nb_fetch - ls->last.nb_fetch;
+        ls->delta.nb_buffer_full += stats->nb_buffer_full - ls->last.nb_buffer_full;
+        ls->delta.nb_resync += stats->nb_resync - ls->last.nb_resync;
+        ls->delta.nb_checksum_err += stats->nb_checksum_err - ls->last.nb_checksum_err;
+        ls->delta.nb_bytes_discarded += stats->nb_bytes_discarded - ls->last.nb_bytes_discarded;
+        ls->delta.nb_pkt_lost += stats->nb_pkt_lost - ls->last.nb_pkt_lost;
+        for (i = 0; i < LGW_MULTI_NB; i++) {
+            ls->delta.nb_detect[i] += stats->nb_detect[i] - ls->last.nb_detect[i];
+            ls->delta.nb_alloc[i] += stats->nb_alloc[i] - ls->last.nb_alloc[i];
+        }
+    }
+    ls->last = *stats;
+    ls->last_ok = true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void analytics_loss_reset(struct analytics_loss_s *ls) {
+    memset(&(ls->delta), 0, sizeof ls->delta);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool analytics_summary(const struct analytics_s *an, const struct analytics_loss_s *ls, uint8_t if_chain, uint32_t interval_ms, struct analytics_summary_s *summary) {
+    static const unsigned int q_pct[ANALYTICS_Q_NB] = ANALYTICS_Q_PCT;
+    const struct analytics_chan_s *ch;
+    const struct analytics_sf_s *sf;
+    struct analytics_sf_summary_s *ss;
+    uint32_t snr_hist[ANALYTICS_SNR_BIN_NB] = {0};
+    uint32_t nb_snr = 0;
+    uint32_t nb_sf_snr;
+    uint64_t airtime_us = 0;
+    unsigned int i, j, q;
+
+    memset(summary, 0, sizeof *summary);
+    if (if_chain >= LGW_IF_CHAIN_NB) {
+        return false;
+    }
+    ch = &(an->chan[if_chain]);
+    summary->if_chain = if_chain;
+    summary->freq_hz = ch->freq_hz;
+
+    for (i = 0; i < ANALYTICS_SF_NB; i++) {
+        sf = &(ch->sf[i]);
+        if (sf->nb_pkt == 0) {
+            continue;
+        }
+        ss = &(summary->sf[summary->nb_sf]);
+        ss->sf = (ch->modulation == MOD_LORA) ? (uint8_t)(DR_LORA_SF5 + i) : 0;
+        ss->nb_pkt = sf->nb_pkt;
+        ss->nb_crc_ok = sf->nb_crc_ok;
+        ss->rate = (interval_ms == 0) ? 0.0 : (float)sf->nb_pkt * 1000 / interval_ms;
+        ss->occ = occupancy(sf->airtime_us, interval_ms);
+        nb_sf_snr = 0;
+        for (j = 0; j < ANALYTICS_SNR_BIN_NB; j++) {
+            nb_sf_snr += sf->snr_hist[j];
+            snr_hist[j] += sf->snr_hist[j];
+        }
+        if (nb_sf_snr > 0) {
+            for (q = 0; q < ANALYTICS_Q_NB; q++) {
+                ss->snr[q] = (int8_t)linear_hist_percentile(sf->snr_hist, ANALYTICS_SNR_BIN_NB, ANALYTICS_SNR_MIN, ANALYTICS_SNR_STEP, nb_sf_snr, q_pct[q]);
+            }
+        }
+        summary->nb_sf += 1;
+        summary->nb_pkt += sf->nb_pkt;
+        summary->nb_crc_ok += sf->nb_crc_ok;
+        nb_snr += nb_sf_snr;
+        airtime_us += sf->airtime_us;
+    }
+
+    if ((ls != NULL) && (ls->last_ok == true) && (if_chain < LGW_MULTI_NB)) {
+        summary->demod_ok = true;
+        summary->nb_detect = ls->delta.nb_detect[if_chain];
+        summary->nb_alloc = ls->delta.nb_alloc[if_chain];
+    }
+    if ((summary->nb_pkt == 0) && (summary->nb_detect == 0)) {
+        return false;
+    }
+
+    summary->rate = (interval_ms == 0) ? 0.0 : (float)summary->nb_pkt * 1000 / interval_ms;
+    summary->occ = occupancy(airtime_us, interval_ms);
+    if (summary->nb_pkt > 0) {
+        for (q = 0; q < ANALYTICS_Q_NB; q++) {
+            summary->rssi[q] = (int16_t)linear_hist_percentile(ch->rssi_hist, ANALYTICS_RSSI_BIN_NB, ANALYTICS_RSSI_MIN, ANALYTICS_RSSI_STEP, summary->nb_pkt, q_pct[q]);
+        }
+    }
+    if (nb_snr > 0) {
+        for (q = 0; q < ANALYTICS_Q_NB; q++) {
+            summary->snr[q] = (int8_t)linear_hist_percentile(snr_hist, ANALYTICS_SNR_BIN_NB, ANALYTICS_SNR_MIN, ANALYTICS_SNR_STEP, nb_snr, q_pct[q]);
+        }
+    }
+
+    return true;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,241 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : Class B beacon engine
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <string.h>     /* memset, memcpy */
+
+#include "trace.h"
+#include "beacon.h"
+#include "loragw_crc.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool tref_equal(const struct tref *a, const struct tref *b) {
+    return (a->systime == b->systime) && (a->count_us == b->count_us) &&
+           (a->gps.tv_sec == b->gps.tv_sec) && (a->gps.tv_nsec == b->gps.tv_nsec) &&
+           (a->xtal_err == b->xtal_err);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* prepare the beacons of the BEACON_PRECOMP_NB slots starting at gps_sec */
+static void beacon_engine_prepare(struct beacon_engine_s *be, time_t gps_sec) {
+    struct lgw_pkt_tx_s *pkt;
+    time_t t;
+    uint8_t chan;
+    uint8_t idx;
+    uint16_t field_crc1;
+    unsigned int k;
+
+    for (k = 0; k < BEACON_PRECOMP_NB; k++) {
+        pkt = &(be->frame[k]);
+        t = gps_sec + ((time_t)k * be->period);
+        memcpy(pkt, &(be->tmpl), sizeof *pkt);
+
+        /* frequency hopping */
+        if (be->freq_nb > 1) {
+            chan = (t / be->period) % be->freq_nb; /* floor rounding */
+        } else {
+            chan = 0;
+        }
+        pkt->freq_hz = be->freq_hz + (chan * be->freq_step);
+
+        /* time field and CRC of the network common part */
+        idx = be->rfu1_size;
+        pkt->payload[idx++] = 0xFF &  t;
+        pkt->payload[idx++] = 0xFF & (t >>  8);
+        pkt->payload[idx++] = 0xFF & (t >> 16);
+        pkt->payload[idx++] = 0xFF & (t >> 24);
+        field_crc1 = lgw_crc16_ccitt(pkt->payload, 4 + be->rfu1_size);
+        pkt->payload[idx++] = 0xFF &  field_crc1;
+        pkt->payload[idx++] = 0xFF & (field_crc1 >> 8);
+    }
+
+    be->first_gps_sec = gps_sec;
+    be->nb_frame = BEACON_PRECOMP_NB;
+    be->next_idx = 0;
+    be->ref_ok = false;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int beacon_engine_init(struct beacon_engine_s *be, const struct beacon_conf_s *conf) {
+    struct lgw_pkt_tx_s *pkt = &(be->tmpl);
+    uint8_t rfu2_size;
+    uint8_t idx = 0;
+    int32_t field_latitude; /* 3 bytes, derived from reference latitude */
+    int32_t field_longitude; /* 3 bytes, derived from reference longitude */
+    uint16_t field_crc2;
+    int i;
+
+    memset(be, 0, sizeof *be);
+    be->period = conf->period;
+    be->freq_hz = conf->freq_hz;
+    be->freq_nb = conf->freq_nb;
+    be->freq_step = conf->freq_step;
+
+    /* beacon packet parameters */
+    pkt->tx_mode = ON_GPS; /* send on PPS pulse */
+    pkt->rf_chain = 0; /* antenna A */
+    pkt->rf_power = conf->power;
+    pkt->modulation = MOD_LORA;
+    switch (conf->bw_hz) {
+        case 125000:
+            pkt->bandwidth = BW_125KHZ;
+            break;
+        case 500000:
+            pkt->bandwidth = BW_500KHZ;
+            break;
+        default:
+            MSG("ERROR: unsupported bandwidth for beacon\n");
+            return -1;
+    }
+    switch (conf->datarate) {
+        case 8:
+            pkt->datarate = DR_LORA_SF8;
+            be->rfu1_size = 1;
+            rfu2_size = 3;
+            break;
+        case 9:
+            pkt->datarate = DR_LORA_SF9;
+            be->rfu1_size = 2;
+            rfu2_size = 0;
+            break;
+        case 10:
+            pkt->datarate = DR_LORA_SF10;
+            be->rfu1_size = 3;
+            rfu2_size = 1;
+            break;
+        case 12:
+            pkt->datarate = DR_LORA_SF12;
+            be->rfu1_size = 5;
+            rfu2_size = 3;
+            break;
+        default:
+            MSG("ERROR: unsupported datarate for beacon\n");
+            return -1;
+    }
+    pkt->size = be->rfu1_size + 4 + 2 + 7 + rfu2_size + 2;
+    pkt->coderate = CR_LORA_4_5;
+    pkt->invert_pol = false;
+    pkt->preamble = 10;
+    pkt->no_crc = true;
+    pkt->no_header = true;
+
+    /* network common part beacon fields (little endian) */
+    for (i = 0; i < (int)be->rfu1_size; i++) {
+        pkt->payload[idx++] = 0x0;
+    }
+    idx += 4; /* time (variable), filled when preparing the beacons */
+    idx += 2; /* crc1 (variable), filled when preparing the beacons */
+
+    /* calculate the latitude and longitude that must be publicly reported */
+    field_latitude = (int32_t)((conf->coord.lat / 90.0) * (double)(1<<23));
+    if (field_latitude > (int32_t)0x007FFFFF) {
+        field_latitude = (int32_t)0x007FFFFF; /* +90 N is represented as 89.99999 N */
+    } else if (field_latitude < (int32_t)0xFF800000) {
+        field_latitude = (int32_t)0xFF800000;
+    }
+    field_longitude = (int32_t)((conf->coord.lon / 180.0) * (double)(1<<23));
+    if (field_longitude > (int32_t)0x007FFFFF) {
+        field_longitude = (int32_t)0x007FFFFF; /* +180 E is represented as 179.99999 E */
+    } else if (field_longitude < (int32_t)0xFF800000) {
+        field_longitude = (int32_t)0xFF800000;
+    }
+
+    /* gateway specific beacon fields */
+    pkt->payload[idx++] = conf->infodesc;
+    pkt->payload[idx++] = 0xFF &  field_latitude;
+    pkt->payload[idx++] = 0xFF & (field_latitude >>  8);
+    pkt->payload[idx++] = 0xFF & (field_latitude >> 16);
+    pkt->payload[idx++] = 0xFF &  field_longitude;
+    pkt->payload[idx++] = 0xFF & (field_longitude >>  8);
+    pkt->payload[idx++] = 0xFF & (field_longitude >> 16);
+
+    /* RFU */
+    for (i = 0; i < (int)rfu2_size; i++) {
+        pkt->payload[idx++] = 0x0;
+    }
+
+    /* CRC of the beacon gateway specific part fields */
+    field_crc2 = lgw_crc16_ccitt((pkt->payload + 6 + be->rfu1_size), 7 + rfu2_size);
+    pkt->payload[idx++] = 0xFF &  field_crc2;
+    pkt->payload[idx++] = 0xFF & (field_crc2 >> 8);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void beacon_engine_refresh(struct beacon_engine_s *be, const struct tref *ref) {
+    struct timespec gps_time;
+    unsigned int k;
+
+    if (be->nb_frame == 0) {
+        return;
+    }
+
+    /* all the prepared beacons have been given, prepare the next ones */
+    if (be->next_idx >= be->nb_frame) {
+        beacon_engine_prepare(be, be->first_gps_sec + ((time_t)be->nb_frame * be->period));
+    }
+
+    if ((be->ref_ok == true) && tref_equal(&(be->ref), ref)) {
+        return;
+    }
+
+    /* convert GPS time to concentrator time, and set packet counter for JiT trigger */
+    gps_time.tv_nsec = 0;
+    for (k = 0; k < be->nb_frame; k++) {
+        gps_time.tv_sec = be->first_gps_sec + ((time_t)k * be->period);
+        lgw_gps2cnt(*ref, gps_time, &(be->frame[k].count_us));
+    }
+
+    be->ref = *ref;
+    be->ref_ok = true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+const struct lgw_pkt_tx_s * beacon_engine_get(struct beacon_engine_s *be, time_t gps_sec, const struct tref *ref) {
+    time_t k;
+
+    /* prepare the next beacons if that one is not ready */
+    k = (gps_sec - be->first_gps_sec) / (time_t)be->period;
+    if ((be->nb_frame == 0) || (gps_sec < be->first_gps_sec) || (k >= (time_t)be->nb_frame) || (be->first_gps_sec + (k * be->period) != gps_sec)) {
+        beacon_engine_prepare(be, gps_sec);
+        k = 0;
+    }
+
+    beacon_engine_refresh(be, ref);
+    be->next_idx = k + 1;
+
+    return &(be->frame[k]);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -18,6 +18,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define _GNU_SOURCE     /* needed for qsort_r to be defined */
 #include <stdlib.h>     /* qsort_r */
 #include <stdio.h>      /* printf, fprintf, snprintf, fopen, fputs */
+#include <inttypes.h>   /* PRIu64 */
 #include <string.h>     /* memset, memcpy */
 #include <pthread.h>
 #include <assert.h>
@@ -93,15 +94,15 @@ int compare(const void *a, const void *b, void *arg)
     struct jit_node_s *p = (struct jit_node_s *)a;
     struct jit_node_s *q = (struct jit_node_s *)b;
     int *counter = (int *)arg;
-    int p_count, q_count;
+    uint64_t p_count, q_count;
 
-    p_count = p->pkt.count_us;
-    q_count = q->pkt.count_us;
+    p_count = p->count_us64;
+    q_count = q->count_us64;
 
     if (p_count > q_count)
         *counter = *counter + 1;
 
-    return p_count - q_count;
+    return (p_count > q_count) - (p_count < q_count);
 }
 
 void jit_sort_queue(struct jit_queue_s *queue) {
@@ -116,24 +117,24 @@ void jit_sort_queue(struct jit_queue_s *queue) {
     MSG_DEBUG(DEBUG_JIT, "sorting queue done - swapped:%d\n", counter);
 }
 
-bool jit_collision_test(uint32_t p1_count_us, uint32_t p1_pre_delay, uint32_t p1_post_delay, uint32_t p2_count_us, uint32_t p2_pre_delay, uint32_t p2_post_delay) {
-    if (((p1_count_us - p2_count_us) <= (p1_pre_delay + p2_post_delay + TX_MARGIN_DELAY)) ||
-        ((p2_count_us - p1_count_us) <= (p2_pre_delay + p1_post_delay + TX_MARGIN_DELAY))) {
-        return true;
+bool jit_collision_test(uint64_t p1_count_us, uint32_t p1_pre_delay, uint32_t p1_post_delay, uint64_t p2_count_us, uint32_t p2_pre_delay, uint32_t p2_post_delay) {
+    if (p1_count_us >= p2_count_us) {
+        return ((p1_count_us - p2_count_us) <= ((uint64_t)p1_pre_delay + p2_post_delay + TX_MARGIN_DELAY));
     } else {
-        return false;
+        return ((p2_count_us - p1_count_us) <= ((uint64_t)p2_pre_delay + p1_post_delay + TX_MARGIN_DELAY));
     }
 }
 
-enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type) {
+enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint64_t time_us, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type) {
     int i = 0;
     uint32_t packet_post_delay = 0;
     uint32_t packet_pre_delay = 0;
     uint32_t target_pre_delay = 0;
     enum jit_error_e err_collision;
-    uint32_t asap_count_us;
+    uint64_t asap_count_us;
+    uint64_t packet_count_us;
 
-    MSG_DEBUG(DEBUG_JIT, "Current concentrator time is %u, pkt_type=%d\n", time_us, pkt_type);
+    MSG_DEBUG(DEBUG_JIT, "Current concentrator time is %" PRIu64 ", pkt_type=%d\n", time_us, pkt_type);
 
     if (packet == NULL) {
         MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: invalid parameter\n");
@@ -174,7 +175,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
         asap_count_us = time_us + 2 * TX_JIT_DELAY; /* margin */
         if (queue->num_pkt == 0) {
             /* If the jit queue is empty, we can insert this packet */
-            MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink, first in JiT queue (count_us=%u)\n", asap_count_us);
+            MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink, first in JiT queue (count_us=%" PRIu64 ")\n", asap_count_us);
         } else {
             /* Else we can try to insert it:
                 - ASAP meaning NOW + MARGIN
@@ -184,29 +185,29 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
 
             /* First, try if the ASAP time collides with an already enqueued downlink */
             for (i=0; i<queue->num_pkt; i++) {
-                if (jit_collision_test(asap_count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].pkt.count_us, queue->nodes[i].pre_delay, queue->nodes[i].post_delay) == true) {
-                    MSG_DEBUG(DEBUG_JIT, "DEBUG: cannot insert IMMEDIATE downlink at count_us=%u, collides with %u (index=%d)\n", asap_count_us, queue->nodes[i].pkt.count_us, i);
+                if (jit_collision_test(asap_count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].count_us64, queue->nodes[i].pre_delay, queue->nodes[i].post_delay) == true) {
+                    MSG_DEBUG(DEBUG_JIT, "DEBUG: cannot insert IMMEDIATE downlink at count_us=%" PRIu64 ", collides with %" PRIu64 " (index=%d)\n", asap_count_us, queue->nodes[i].count_us64, i);
                     break;
                 }
             }
             if (i == queue->num_pkt) {
                 /* No collision with ASAP time, we can insert it */
-                MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink ASAP at %u (no collision)\n", asap_count_us);
+                MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink ASAP at %" PRIu64 " (no collision)\n", asap_count_us);
             } else {
                 /* Search for the best slot then */
                 for (i=0; i<queue->num_pkt; i++) {
-                    asap_count_us = queue->nodes[i].pkt.count_us + queue->nodes[i].post_delay + packet_pre_delay + TX_JIT_DELAY + TX_MARGIN_DELAY;
+                    asap_count_us = queue->nodes[i].count_us64 + queue->nodes[i].post_delay + packet_pre_delay + TX_JIT_DELAY + TX_MARGIN_DELAY;
                     if (i == (queue->num_pkt - 1)) {
                         /* Last packet index, we can insert after this one */
-                        MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink, last in JiT queue (count_us=%u)\n", asap_count_us);
+                        MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink, last in JiT queue (count_us=%" PRIu64 ")\n", asap_count_us);
                     } else {
                         /* Check if packet can be inserted between this index and the next one */
-                        MSG_DEBUG(DEBUG_JIT, "DEBUG: try to insert IMMEDIATE downlink (count_us=%u) between index %d and index %d?\n", asap_count_us, i, i+1);
-                        if (jit_collision_test(asap_count_us, packet_pre_delay, packet_post_delay, queue->nodes[i+1].pkt.count_us, queue->nodes[i+1].pre_delay, queue->nodes[i+1].post_delay) == true) {
-                            MSG_DEBUG(DEBUG_JIT, "DEBUG: failed to insert IMMEDIATE downlink (count_us=%u), continue...\n", asap_count_us);
+                        MSG_DEBUG(DEBUG_JIT, "DEBUG: try to insert IMMEDIATE downlink (count_us=%" PRIu64 ") between index %d and index %d?\n", asap_count_us, i, i+1);
+                        if (jit_collision_test(asap_count_us, packet_pre_delay, packet_post_delay, queue->nodes[i+1].count_us64, queue->nodes[i+1].pre_delay, queue->nodes[i+1].post_delay) == true) {
+                            MSG_DEBUG(DEBUG_JIT, "DEBUG: failed to insert IMMEDIATE downlink (count_us=%" PRIu64 "), continue...\n", asap_count_us);
                             continue;
                         } else {
-                            MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink (count_us=%u)\n", asap_count_us);
+                            MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink (count_us=%" PRIu64 ")\n", asap_count_us);
                             break;
                         }
                     }
@@ -214,7 +215,11 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
             }
         }
         /* Set packet with ASAP timestamp */
-        packet->count_us = asap_count_us;
+        packet_count_us = asap_count_us;
+        packet->count_us = (uint32_t)asap_count_us;
+    } else {
+        /* Place the 32-bits packet timestamp on the 64-bits concentrator timeline: closest value to current time */
+        packet_count_us = (uint64_t)((int64_t)time_us + (int32_t)(packet->count_us - (uint32_t)time_us));
     }
 
     /* Check criteria_1: is it already too late to send this packet ?
@@ -222,11 +227,10 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
      *  Note: - Also add some margin, to be checked how much is needed, if needed
      *        - Valid for both Downlinks and Beacon packets
      *
-     *  Warning: unsigned arithmetic (handle roll-over)
      *      t_packet < t_current + TX_START_DELAY + MARGIN
      */
-    if ((packet->count_us - time_us) <= (TX_START_DELAY + TX_MARGIN_DELAY + TX_JIT_DELAY)) {
-        MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: Packet REJECTED, already too late to send it (current=%u, packet=%u, type=%d)\n", time_us, packet->count_us, pkt_type);
+    if (packet_count_us <= (time_us + TX_START_DELAY + TX_MARGIN_DELAY + TX_JIT_DELAY)) {
+        MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: Packet REJECTED, already too late to send it (current=%" PRIu64 ", packet=%" PRIu64 ", type=%d)\n", time_us, packet_count_us, pkt_type);
         pthread_mutex_unlock(&mx_jit_queue);
         return JIT_ERROR_TOO_LATE;
     }
@@ -239,12 +243,11 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
      *  So let's define a safe delay above which we can say that the packet is out of bound: TX_MAX_ADVANCE_DELAY
      *  Note: - Valid for Downlinks only, not for Beacon packets
      *
-     *  Warning: unsigned arithmetic (handle roll-over)
-                t_packet > t_current + TX_MAX_ADVANCE_DELAY
+     *      t_packet > t_current + TX_MAX_ADVANCE_DELAY
      */
     if ((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_B)) {
-        if ((packet->count_us - time_us) > TX_MAX_ADVANCE_DELAY) {
-            MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: Packet REJECTED, timestamp seems wrong, too much in advance (current=%u, packet=%u, type=%d)\n", time_us, packet->count_us, pkt_type);
+        if ((packet_count_us - time_us) > TX_MAX_ADVANCE_DELAY) {
+            MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: Packet REJECTED, timestamp seems wrong, too much in advance (current=%" PRIu64 ", packet=%" PRIu64 ", type=%d)\n", time_us, packet_count_us, pkt_type);
             pthread_mutex_unlock(&mx_jit_queue);
             return JIT_ERROR_TOO_EARLY;
         }
@@ -264,11 +267,10 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
         }
 
         /* Check if there is a collision
-         *  Warning: unsigned arithmetic (handle roll-over)
          *      t_packet_new - pre_delay_packet_new < t_packet_prev + post_delay_packet_prev (OVERLAP on post delay)
          *      t_packet_new + post_delay_packet_new > t_packet_prev - pre_delay_packet_prev (OVERLAP on pre delay)
          */
-        if (jit_collision_test(packet->count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].pkt.count_us, target_pre_delay, queue->nodes[i].post_delay) == true) {
+        if (jit_collision_test(packet_count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].count_us64, target_pre_delay, queue->nodes[i].post_delay) == true) {
             switch (queue->nodes[i].pkt_type) {
                 case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
                 case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
@@ -296,6 +298,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
     /* Finally enqueue it */
     /* Insert packet at the end of the queue */
     memcpy(&(queue->nodes[queue->num_pkt].pkt), packet, sizeof(struct lgw_pkt_tx_s));
+    queue->nodes[queue->num_pkt].count_us64 = packet_count_us;
     queue->nodes[queue->num_pkt].pre_delay = packet_pre_delay;
     queue->nodes[queue->num_pkt].post_delay = packet_post_delay;
     queue->nodes[queue->num_pkt].pkt_type = pkt_type;
@@ -360,7 +363,7 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
     return JIT_ERROR_OK;
 }
 
-enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, int *pkt_idx) {
+enum jit_error_e jit_peek(struct jit_queue_s *queue, uint64_t time_us, int *pkt_idx) {
     /* Return index of node containing a packet inline with given time */
     int i = 0;
     int idx_highest_priority = -1;
@@ -381,17 +384,17 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, int *pkt_
          *  If a packet seems too much in advance, and was not rejected at enqueue time,
          *  it means that we missed it for peeking, we need to drop it
          *
-         *  Warning: unsigned arithmetic
-         *      t_packet > t_current + TX_MAX_ADVANCE_DELAY
+         *      t_packet < t_current or t_packet > t_current + TX_MAX_ADVANCE_DELAY
          */
-        if ((queue->nodes[i].pkt.count_us - time_us) >= TX_MAX_ADVANCE_DELAY) {
+        if ((queue->nodes[i].count_us64 < time_us) || ((queue->nodes[i].count_us64 - time_us) >= TX_MAX_ADVANCE_DELAY)) {
             /* We drop the packet to avoid lock-up */
             queue->num_pkt--;
+            queue->nb_dropped++;
             if (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON) {
                 queue->num_beacon--;
-                MSG("WARNING: --- Beacon dropped (current_time=%u, packet_time=%u) ---\n", time_us, queue->nodes[i].pkt.count_us);
+                MSG("WARNING: --- Beacon dropped (current_time=%" PRIu64 ", packet_time=%" PRIu64 ") ---\n", time_us, queue->nodes[i].count_us64);
             } else {
-                MSG("WARNING: --- Packet dropped (current_time=%u, packet_time=%u) ---\n", time_us, queue->nodes[i].pkt.count_us);
+                MSG("WARNING: --- Packet dropped (current_time=%" PRIu64 ", packet_time=%" PRIu64 ") ---\n", time_us, queue->nodes[i].count_us64);
             }
 
             /* Replace dropped packet with last packet of the queue */
@@ -407,19 +410,17 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, int *pkt_
         }
 
         /* Then look for highest priority packet to be sent:
-         *  Warning: unsigned arithmetic (handle roll-over)
          *      t_packet < t_highest
          */
-        if ((idx_highest_priority == -1) || (((queue->nodes[i].pkt.count_us - time_us) < (queue->nodes[idx_highest_priority].pkt.count_us - time_us)))) {
+        if ((idx_highest_priority == -1) || (queue->nodes[i].count_us64 < queue->nodes[idx_highest_priority].count_us64)) {
             idx_highest_priority = i;
         }
     }
 
     /* Peek criteria 1: look for a packet to be sent in next TX_JIT_DELAY ms timeframe
-     *  Warning: unsigned arithmetic (handle roll-over)
      *      t_packet < t_current + TX_JIT_DELAY
      */
-    if ((queue->nodes[idx_highest_priority].pkt.count_us - time_us) < TX_JIT_DELAY) {
+    if (queue->nodes[idx_highest_priority].count_us64 < (time_us + TX_JIT_DELAY)) {
         *pkt_idx = idx_highest_priority;
         MSG_DEBUG(DEBUG_JIT, "peek packet with count_us=%u at index %d\n",
             queue->nodes[idx_highest_priority].pkt.count_us, idx_highest_priority);
@@ -27,7 +27,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include <stdint.h>         /* C99 types */
 #include <stdbool.h>        /* bool type */
-#include <stdio.h>          /* printf, fprintf, snprintf, fopen, fputs */
+#include <stdio.h>          /* printf, fprintf, snprintf, vsnprintf, fopen, fputs */
+#include <stdarg.h>         /* va_list */
 #include <inttypes.h>       /* PRIx64, PRIu64... */
 
 #include <string.h>         /* memset */
@@ -48,11 +49,17 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include "trace.h"
 #include "jitqueue.h"
+#include "seqlock.h"
+#include "beacon.h"
+#include "spectral.h"
+#include "analytics.h"
+#include "tx_timing.h"
 #include "parson.h"
 #include "base64.h"
 #include "loragw_hal.h"
 #include "loragw_aux.h"
 #include "loragw_reg.h"
+#include "loragw_sx1302.h"   /* TX_START_DELAY_DEFAULT */
 #include "loragw_gps.h"
 
 /* -------------------------------------------------------------------------- */
@@ -82,13 +89,13 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define PULL_TIMEOUT_MS     200
 #define GPS_REF_MAX_AGE     30          /* maximum admitted delay in seconds of GPS loss before considering latest GPS sync unusable */
 #define FETCH_SLEEP_MS      10          /* nb of ms waited when a fetch return no packets */
+#define CONCENT_TIME_ERR_MAX_US 1000    /* max error accepted on the concentrator time estimate, read it above */
 #define BEACON_POLL_MS      50          /* time in ms between polling of beacon TX status */
 
 #define PROTOCOL_VERSION    2           /* v1.6 */
 #define PROTOCOL_JSON_RXPK_FRAME_FORMAT 1
 
-#define XERR_INIT_AVG       16          /* nb of measurements the XTAL correction is averaged on as initial value */
-#define XERR_FILT_COEF      256         /* coefficient for low-pass XTAL error tracking */
+#define XERR_STD_MAX        5E-8        /* XTAL correction is used once the clock discipline error is below */
 
 #define PKT_PUSH_DATA   0
 #define PKT_PUSH_ACK    1
@@ -104,7 +111,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define MIN_FSK_PREAMB  3 /* minimum FSK preamble length for this application */
 #define STD_FSK_PREAMB  5
 
-#define STATUS_SIZE     200
+/* worst case of the stat JSON object: 699 bytes for the header, RX buffer losses, TX timing and framing, 133 bytes
+   per spectral scan channel, 845 bytes per IF chain (integers at their full width, rates below 1E10 pkt/s, SF occupancy below 100%) */
+#define STATUS_SIZE     (704 + (SPECTRAL_CHAN_NB_MAX * 136) + (LGW_IF_CHAIN_NB * 848))
 #define TX_BUFF_SIZE    ((540 * NB_PKT_MAX) + 30 + STATUS_SIZE)
 #define ACK_BUFF_SIZE   64
 
@@ -119,6 +128,12 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define DEFAULT_BEACON_POWER        14
 #define DEFAULT_BEACON_INFODESC     0
 
+#define DEFAULT_SPECTRAL_THRESHOLD  -90 /* dBm */
+#define SPECTRAL_TX_BACKOFF_MS      1000 /* pause before scanning again when a downlink is programmed */
+#define SPECTRAL_WAIT_STEP_MS       100 /* the scan thread checks for exit at this interval while pacing */
+#define SPECTRAL_POLL_MS            2 /* status polling interval, once the scan should be completed */
+#define SPECTRAL_TIMEOUT_MS         2000 /* scan timeout, after the estimated scan duration */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
 
@@ -129,6 +144,8 @@ typedef struct spectral_scan_s {
     uint8_t nb_chan;        /* number of channels to scan (200kHz between each channel) */
     uint16_t nb_scan;       /* number of scan points for each frequency scan */
     uint32_t pace_s;        /* number of seconds between 2 scans in the thread */
+    uint32_t pace_ms;       /* number of milliseconds between 2 scans in the thread, overrides pace_s if not 0 */
+    int16_t threshold_dbm;  /* RSSI above which a channel is considered as occupied */
 } spectral_scan_t;
 
 /* -------------------------------------------------------------------------- */
@@ -167,7 +184,9 @@ static struct timeval pull_timeout = {0, (PULL_TIMEOUT_MS * 1000)}; /* non criti
 
 /* hardware access control and correction */
 pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER; /* control access to the concentrator */
-static pthread_mutex_t mx_xcorr = PTHREAD_MUTEX_INITIALIZER; /* control access to the XTAL correction */
+static pthread_mutex_t mx_sx1261_spi = PTHREAD_MUTEX_INITIALIZER; /* control access to the SX1261 radio, when it has its own SPI link */
+static pthread_mutex_t *mx_sx1261 = &mx_concent; /* lock domain of the SX1261 radio, shared with the concentrator on USB (same MCU link) */
+static seqlock_t sl_xcorr = SEQLOCK_INITIALIZER; /* publication of the XTAL correction, readers never block */
 static bool xtal_correct_ok = false; /* set true when XTAL correction is stable enough */
 static double xtal_correct = 1.0;
 
@@ -177,7 +196,7 @@ static int gps_tty_fd = -1; /* file descriptor of the GPS TTY port */
 static bool gps_enabled = false; /* is GPS enabled on that gateway ? */
 
 /* GPS time reference */
-static pthread_mutex_t mx_timeref = PTHREAD_MUTEX_INITIALIZER; /* control access to GPS time reference */
+static seqlock_t sl_timeref = SEQLOCK_INITIALIZER; /* publication of GPS time reference, readers never block */
 static bool gps_ref_valid; /* is GPS reference acceptable (ie. not too old) */
 static struct tref time_reference_gps; /* time reference used for GPS <-> timestamp conversion */
 
@@ -198,6 +217,7 @@ static uint32_t meas_up_network_byte = 0; /* sum of UDP bytes sent for upstream
 static uint32_t meas_up_payload_byte = 0; /* sum of radio payload bytes sent for upstream traffic */
 static uint32_t meas_up_dgram_sent = 0; /* number of datagrams sent for upstream traffic */
 static uint32_t meas_up_ack_rcv = 0; /* number of datagrams acknowledged for upstream traffic */
+static struct analytics_s meas_up_analytics; /* per IF chain and SF statistics of the packets received */
 
 static pthread_mutex_t mx_meas_dw = PTHREAD_MUTEX_INITIALIZER; /* control access to the downstream measurements */
 static uint32_t meas_dw_pull_sent = 0; /* number of PULL requests sent for downstream traffic */
@@ -215,6 +235,7 @@ static uint32_t meas_nb_tx_rejected_too_early = 0; /* count packets were TX requ
 static uint32_t meas_nb_beacon_queued = 0; /* count beacon inserted in jit queue */
 static uint32_t meas_nb_beacon_sent = 0; /* count beacon actually sent to concentrator */
 static uint32_t meas_nb_beacon_rejected = 0; /* count beacon rejected for queuing */
+static struct tx_timing_s meas_tx_timing; /* time left before the TX deadline of the timestamped downlinks */
 
 static pthread_mutex_t mx_meas_gps = PTHREAD_MUTEX_INITIALIZER; /* control access to the GPS statistics */
 static bool gps_coord_valid; /* could we get valid GPS coordinates ? */
@@ -260,15 +281,25 @@ static uint32_t nb_pkt_received_ref[16];
 /* Interface type */
 static lgw_com_type_t com_type = LGW_COM_SPI;
 
+/* Virtual concentrator (synthetic traffic, no hardware access) */
+static bool virt_enabled = false;
+static const uint8_t virt_sf_weight_default[LGW_VIRT_SF_NB] = {0, 0, 30, 20, 15, 15, 10, 10}; /* SF5 to SF12, typical LoRaWAN network */
+
 /* Spectral Scan */
 static spectral_scan_t spectral_scan_params = {
     .enable = false,
     .freq_hz_start = 0,
     .nb_chan = 0,
     .nb_scan = 0,
-    .pace_s = 10
+    .pace_s = 10,
+    .pace_ms = 0,
+    .threshold_dbm = DEFAULT_SPECTRAL_THRESHOLD
 };
 
+/* Spectral monitoring */
+static pthread_mutex_t mx_spectral = PTHREAD_MUTEX_INITIALIZER; /* control access to the spectral monitoring engine */
+static struct spectral_engine_s spectral_engine;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
@@ -282,10 +313,12 @@ static int parse_gateway_configuration(const char * conf_file);
 
 static int parse_debug_configuration(const char * conf_file);
 
-static uint16_t crc16(const uint8_t * data, unsigned size);
-
 static double difftimespec(struct timespec end, struct timespec beginning);
 
+static int status_append(int len, const char * fmt, ...);
+
+static void get_concentrator_time(uint64_t * count_us);
+
 static void gps_process_sync(void);
 
 static void gps_process_coords(void);
@@ -336,9 +369,11 @@ static int parse_SX130x_configuration(const char * conf_file) {
     JSON_Object *conf_scan_obj = NULL;
     JSON_Object *conf_lbt_obj = NULL;
     JSON_Object *conf_lbtchan_obj = NULL;
+    JSON_Object *conf_virt_obj = NULL;
     JSON_Array *conf_txlut_array = NULL;
     JSON_Array *conf_lbtchan_array = NULL;
     JSON_Array *conf_demod_array = NULL;
+    JSON_Array *conf_sfw_array = NULL;
 
     struct lgw_conf_board_s boardconf;
     struct lgw_conf_rxrf_s rfconf;
@@ -346,6 +381,7 @@ static int parse_SX130x_configuration(const char * conf_file) {
     struct lgw_conf_demod_s demodconf;
     struct lgw_conf_ftime_s tsconf;
     struct lgw_conf_sx1261_s sx1261conf;
+    struct lgw_conf_virt_s virtconf;
     uint32_t sf, bw, fdev;
     bool sx1250_tx_lut;
     size_t size;
@@ -530,6 +566,22 @@ static int parse_SX130x_configuration(const char * conf_file) {
                 } else {
                     MSG("WARNING: Data type for spectral_scan.pace_s seems wrong, please check\n");
                 }
+                val = json_object_get_value(conf_scan_obj, "pace_ms"); /* fetch value (if possible) */
+                if (json_value_get_type(val) == JSONNumber) {
+                    spectral_scan_params.pace_ms = (uint32_t)json_value_get_number(val);
+                } else if (val != NULL) {
+                    MSG("WARNING: Data type for spectral_scan.pace_ms seems wrong, please check\n");
+                }
+                val = json_object_get_value(conf_scan_obj, "threshold_dbm"); /* fetch value (if possible) */
+                if (json_value_get_type(val) == JSONNumber) {
+                    spectral_scan_params.threshold_dbm = (int16_t)json_value_get_number(val);
+                } else if (val != NULL) {
+                    MSG("WARNING: Data type for spectral_scan.threshold_dbm seems wrong, please check\n");
+                }
+                if (spectral_scan_params.nb_chan > SPECTRAL_CHAN_NB_MAX) {
+                    MSG("WARNING: spectral_scan.nb_chan limited to %u\n", SPECTRAL_CHAN_NB_MAX);
+                    spectral_scan_params.nb_chan = SPECTRAL_CHAN_NB_MAX;
+                }
             }
         }
 
@@ -650,6 +702,103 @@ static int parse_SX130x_configuration(const char * conf_file) {
         }
     }
 
+    /* set virtual concentrator configuration */
+    memset(&virtconf, 0, sizeof virtconf); /* initialize configuration structure */
+    conf_virt_obj = json_object_get_object(conf_obj, "virtual_conf"); /* fetch value (if possible) */
+    if (conf_virt_obj == NULL) {
+        MSG("INFO: no configuration for virtual concentrator\n");
+    } else {
+        val = json_object_get_value(conf_virt_obj, "enable"); /* fetch value (if possible) */
+        if (json_value_get_type(val) == JSONBoolean) {
+            virtconf.enable = (bool)json_value_get_boolean(val);
+        } else {
+            MSG("WARNING: Data type for virtual_conf.enable seems wrong, please check\n");
+            virtconf.enable = false;
+        }
+        if (virtconf.enable == true) {
+            /* default traffic model */
+            virtconf.nb_dev = 1000;
+            virtconf.period_s = 300;
+            memcpy(virtconf.sf_weight, virt_sf_weight_default, sizeof virtconf.sf_weight);
+            virtconf.size_min = 12;
+            virtconf.size_max = 51;
+            virtconf.rssi_mean = -100;
+            virtconf.rssi_std = 10;
+            virtconf.snr_mean = 5;
+            virtconf.snr_std = 5;
+            virtconf.crc_error_ratio = 0;
+            virtconf.dev_addr = 0x26000000;
+            virtconf.seed = (uint32_t)getpid();
+
+            val = json_object_get_value(conf_virt_obj, "nb_dev");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.nb_dev = (uint32_t)json_value_get_number(val);
+            }
+            val = json_object_get_value(conf_virt_obj, "period_s");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.period_s = (float)json_value_get_number(val);
+            }
+            conf_sfw_array = json_object_get_array(conf_virt_obj, "sf_weights");
+            if (conf_sfw_array != NULL) {
+                if (json_array_get_count(conf_sfw_array) != LGW_VIRT_SF_NB) {
+                    MSG("ERROR: virtual_conf.sf_weights must have %d values, for SF5 to SF12\n", LGW_VIRT_SF_NB);
+                    return -1;
+                }
+                for (i = 0; i < LGW_VIRT_SF_NB; i++) {
+                    virtconf.sf_weight[i] = (uint8_t)json_array_get_number(conf_sfw_array, i);
+                }
+            }
+            val = json_object_get_value(conf_virt_obj, "size_min");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.size_min = (uint8_t)json_value_get_number(val);
+            }
+            val = json_object_get_value(conf_virt_obj, "size_max");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.size_max = (uint8_t)json_value_get_number(val);
+            }
+            val = json_object_get_value(conf_virt_obj, "rssi_mean");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.rssi_mean = (float)json_value_get_number(val);
+            }
+            val = json_object_get_value(conf_virt_obj, "rssi_std");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.rssi_std = (float)json_value_get_number(val);
+            }
+            val = json_object_get_value(conf_virt_obj, "snr_mean");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.snr_mean = (float)json_value_get_number(val);
+            }
+            val = json_object_get_value(conf_virt_obj, "snr_std");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.snr_std = (float)json_value_get_number(val);
+            }
+            val = json_object_get_value(conf_virt_obj, "crc_error_ratio");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.crc_error_ratio = (float)json_value_get_number(val);
+            }
+            str = json_object_get_string(conf_virt_obj, "dev_addr");
+            if (str != NULL) {
+                virtconf.dev_addr = (uint32_t)strtoul(str, NULL, 16);
+            }
+            val = json_object_get_value(conf_virt_obj, "seed");
+            if (json_value_get_type(val) == JSONNumber) {
+                virtconf.seed = (uint32_t)json_value_get_number(val);
+            }
+            val = json_object_get_value(conf_virt_obj, "host_counter");
+            if (json_value_get_type(val) == JSONBoolean) {
+                virtconf.host_counter = (bool)json_value_get_boolean(val);
+            }
+            MSG("INFO: virtual concentrator enabled: %u end-devices, uplink period %.1f s, payload %u-%u bytes, RSSI %.1f/%.1f dBm, SNR %.1f/%.1f dB, seed %u\n", virtconf.nb_dev, virtconf.period_s, virtconf.size_min, virtconf.size_max, virtconf.rssi_mean, virtconf.rssi_std, virtconf.snr_mean, virtconf.snr_std, virtconf.seed);
+        }
+
+        /* all parameters parsed, submitting configuration to the HAL */
+        if (lgw_virt_setconf(&virtconf) != LGW_HAL_SUCCESS) {
+            MSG("ERROR: Failed to configure the virtual concentrator\n");
+            return -1;
+        }
+        virt_enabled = virtconf.enable;
+    }
+
     /* set configuration for RF chains */
     for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
         memset(&rfconf, 0, sizeof rfconf); /* initialize configuration structure */
@@ -1278,26 +1427,6 @@ static int parse_debug_configuration(const char * conf_file) {
     return 0;
 }
 
-static uint16_t crc16(const uint8_t * data, unsigned size) {
-    const uint16_t crc_poly = 0x1021;
-    const uint16_t init_val = 0x0000;
-    uint16_t x = init_val;
-    unsigned i, j;
-
-    if (data == NULL)  {
-        return 0;
-    }
-
-    for (i=0; i<size; ++i) {
-        x ^= (uint16_t)data[i] << 8;
-        for (j=0; j<8; ++j) {
-            x = (x & 0x8000) ? (x<<1) ^ crc_poly : (x<<1);
-        }
-    }
-
-    return x;
-}
-
 static double difftimespec(struct timespec end, struct timespec beginning) {
     double x;
 
@@ -1307,6 +1436,35 @@ static double difftimespec(struct timespec end, struct timespec beginning) {
     return x;
 }
 
+/* append to the status report, returns the new length or STATUS_SIZE once it is truncated, nothing is appended after that */
+static int status_append(int len, const char * fmt, ...) {
+    va_list args;
+    int n;
+
+    if ((len < 0) || (len >= STATUS_SIZE)) {
+        return STATUS_SIZE;
+    }
+    va_start(args, fmt);
+    n = vsnprintf(status_report + len, STATUS_SIZE - len, fmt, args);
+    va_end(args);
+    if ((n < 0) || (n >= (STATUS_SIZE - len))) {
+        return STATUS_SIZE;
+    }
+
+    return len + n;
+}
+
+static void get_concentrator_time(uint64_t * count_us) {
+    uint32_t err_us;
+
+    /* Use the HAL estimate (no bus access, no lock), read the counter only if not accurate enough */
+    if ((lgw_get_instcnt_estimate(count_us, &err_us) != LGW_HAL_SUCCESS) || (err_us > CONCENT_TIME_ERR_MAX_US)) {
+        pthread_mutex_lock(&mx_concent);
+        lgw_get_instcnt64(count_us);
+        pthread_mutex_unlock(&mx_concent);
+    }
+}
+
 static int send_tx_ack(uint8_t token_h, uint8_t token_l, enum jit_error_e error, int32_t error_value) {
     uint8_t buff_ack[ACK_BUFF_SIZE]; /* buffer to give feedback to server */
     int buff_index;
@@ -1477,6 +1635,24 @@ int main(int argc, char ** argv)
     bool coord_ok = false;
     struct coord_s cp_gps_coord = {0.0, 0.0, 0};
 
+    /* spectral monitoring variables */
+    struct spectral_summary_s cp_spectral[SPECTRAL_CHAN_NB_MAX];
+    bool cp_spectral_ok[SPECTRAL_CHAN_NB_MAX];
+
+    /* RX analytics */
+    static struct analytics_s cp_analytics;
+    static struct analytics_loss_s rx_loss;
+    struct lgw_rx_stats_s rx_stats;
+    struct lgw_virt_tx_stats_s virt_tx_stats;
+    struct analytics_summary_s rx_sum[LGW_IF_CHAIN_NB];
+    bool rx_sum_ok[LGW_IF_CHAIN_NB];
+    struct tx_timing_s cp_tx_timing;
+    struct timespec meas_start, meas_end;
+    uint32_t meas_interval_ms;
+    bool sep;
+    int j;
+    int status_len;
+
     /* SX1302 data variables */
     uint32_t trig_tstamp;
     uint32_t inst_tstamp;
@@ -1546,6 +1722,18 @@ int main(int argc, char ** argv)
         exit(EXIT_FAILURE);
     }
 
+    /* Virtual concentrator: no GPS nor SX1261 to be used */
+    if (virt_enabled == true) {
+        if (gps_tty_path[0] != '\0') {
+            MSG("INFO: [main] virtual concentrator, GPS sync disabled\n");
+            gps_tty_path[0] = '\0';
+        }
+        if (spectral_scan_params.enable == true) {
+            MSG("INFO: [main] virtual concentrator, spectral scan disabled\n");
+            spectral_scan_params.enable = false;
+        }
+    }
+
     /* Start GPS a.s.a.p., to allow it to lock */
     if (gps_tty_path[0] != '\0') { /* do not try to open GPS device if no path set */
         i = lgw_gps_enable(gps_tty_path, "ubx7", 0, &gps_tty_fd); /* HAL only supports u-blox 7 for now */
@@ -1639,7 +1827,7 @@ int main(int argc, char ** argv)
     }
     freeaddrinfo(result);
 
-    if (com_type == LGW_COM_SPI) {
+    if ((com_type == LGW_COM_SPI) && (virt_enabled == false)) {
         /* Board reset */
         if (system("./reset_lgw.sh start") != 0) {
             printf("ERROR: failed to reset SX1302, check your reset_lgw.sh script\n");
@@ -1671,6 +1859,7 @@ int main(int argc, char ** argv)
     }
 
     /* spawn threads to manage upstream and downstream */
+    tx_timing_reset(&meas_tx_timing);
     i = pthread_create(&thrid_up, NULL, (void * (*)(void *))thread_up, NULL);
     if (i != 0) {
         MSG("ERROR: [main] impossible to create upstream thread\n");
@@ -1689,6 +1878,14 @@ int main(int argc, char ** argv)
 
     /* spawn thread for background spectral scan */
     if (spectral_scan_params.enable == true) {
+        if (com_type == LGW_COM_SPI) {
+            mx_sx1261 = &mx_sx1261_spi;
+        }
+        i = spectral_engine_init(&spectral_engine, spectral_scan_params.freq_hz_start, spectral_scan_params.nb_chan, spectral_scan_params.threshold_dbm);
+        if (i != 0) {
+            MSG("ERROR: [main] failed to initialize spectral monitoring\n");
+            exit(EXIT_FAILURE);
+        }
         i = pthread_create(&thrid_ss, NULL, (void * (*)(void *))thread_spectral_scan, NULL);
         if (i != 0) {
             MSG("ERROR: [main] impossible to create Spectral Scan thread\n");
@@ -1719,6 +1916,12 @@ int main(int argc, char ** argv)
     sigaction(SIGTERM, &sigact, NULL); /* default "kill" command */
 
     /* main loop task : statistics collection */
+    pthread_mutex_lock(&mx_concent);
+    if (lgw_get_rx_stats(&rx_stats) == LGW_HAL_SUCCESS) {
+        analytics_loss_update(&rx_loss, &rx_stats); /* reference for the first interval */
+    }
+    pthread_mutex_unlock(&mx_concent);
+    clock_gettime(CLOCK_MONOTONIC, &meas_start);
     while (!exit_sig && !quit_sig) {
         /* wait for next reporting interval */
         wait_ms(1000 * stat_interval);
@@ -1747,7 +1950,12 @@ int main(int argc, char ** argv)
         meas_up_payload_byte = 0;
         meas_up_dgram_sent = 0;
         meas_up_ack_rcv = 0;
+        cp_analytics = meas_up_analytics;
+        analytics_reset(&meas_up_analytics);
         pthread_mutex_unlock(&mx_meas_up);
+        clock_gettime(CLOCK_MONOTONIC, &meas_end);
+        meas_interval_ms = (uint32_t)((meas_end.tv_sec - meas_start.tv_sec) * 1000 + (meas_end.tv_nsec - meas_start.tv_nsec) / 1000000);
+        meas_start = meas_end;
         if (cp_nb_rx_rcv > 0) {
             rx_ok_ratio = (float)cp_nb_rx_ok / (float)cp_nb_rx_rcv;
             rx_bad_ratio = (float)cp_nb_rx_bad / (float)cp_nb_rx_rcv;
@@ -1795,6 +2003,8 @@ int main(int argc, char ** argv)
         meas_nb_beacon_queued = 0;
         meas_nb_beacon_sent = 0;
         meas_nb_beacon_rejected = 0;
+        cp_tx_timing = meas_tx_timing;
+        tx_timing_reset(&meas_tx_timing);
         pthread_mutex_unlock(&mx_meas_dw);
         if (cp_dw_pull_sent > 0) {
             dw_ack_ratio = (float)cp_dw_ack_rcv / (float)cp_dw_pull_sent;
@@ -1815,6 +2025,27 @@ int main(int argc, char ** argv)
             cp_gps_coord = reference_coord;
         }
 
+        /* access spectral monitoring statistics, copy them */
+        if (spectral_scan_params.enable == true) {
+            pthread_mutex_lock(&mx_spectral);
+            for (i = 0; i < spectral_engine.nb_chan; i++) {
+                cp_spectral_ok[i] = spectral_engine_summary(&spectral_engine, i, &cp_spectral[i]);
+            }
+            pthread_mutex_unlock(&mx_spectral);
+        }
+
+        /* access RX losses counters, then get the RX analytics per IF chain */
+        pthread_mutex_lock(&mx_concent);
+        i = lgw_get_rx_stats(&rx_stats);
+        pthread_mutex_unlock(&mx_concent);
+        analytics_loss_reset(&rx_loss);
+        if (i == LGW_HAL_SUCCESS) {
+            analytics_loss_update(&rx_loss, &rx_stats);
+        }
+        for (i = 0; i < LGW_IF_CHAIN_NB; i++) {
+            rx_sum_ok[i] = analytics_summary(&cp_analytics, &rx_loss, i, meas_interval_ms, &rx_sum[i]);
+        }
+
         /* display a report */
         printf("\n##### %s #####\n", stat_timestamp);
         printf("### [UPSTREAM] ###\n");
@@ -1823,6 +2054,21 @@ int main(int argc, char ** argv)
         printf("# RF packets forwarded: %u (%u bytes)\n", cp_up_pkt_fwd, cp_up_payload_byte);
         printf("# PUSH_DATA datagrams sent: %u (%u bytes)\n", cp_up_dgram_sent, cp_up_network_byte);
         printf("# PUSH_DATA acknowledged: %.2f%%\n", 100.0 * up_ack_ratio);
+        printf("### [RX ANALYTICS] ###\n");
+        printf("# RX buffer: %u fetches, %u full, %u resync, %u checksum errors, %u bytes discarded, %u packets lost\n", rx_loss.delta.nb_fetch, rx_loss.delta.nb_buffer_full, rx_loss.delta.nb_resync, rx_loss.delta.nb_checksum_err, rx_loss.delta.nb_bytes_discarded, rx_loss.delta.nb_pkt_lost);
+        for (i = 0; i < LGW_IF_CHAIN_NB; i++) {
+            if (rx_sum_ok[i] == false) {
+                continue;
+            }
+            printf("# IF%d %u Hz: %u pkt (%u CRC_OK), %.2f pkt/s, occupancy %.2f%%, RSSI %d/%d/%d dBm, SNR %d/%d/%d dB", i, rx_sum[i].freq_hz, rx_sum[i].nb_pkt, rx_sum[i].nb_crc_ok, rx_sum[i].rate, rx_sum[i].occ, rx_sum[i].rssi[0], rx_sum[i].rssi[1], rx_sum[i].rssi[2], rx_sum[i].snr[0], rx_sum[i].snr[1], rx_sum[i].snr[2]);
+            if (rx_sum[i].demod_ok == true) {
+                printf(", SF7 demod %u/%u", rx_sum[i].nb_alloc, rx_sum[i].nb_detect);
+            }
+            printf("\n");
+            for (j = 0; j < rx_sum[i].nb_sf; j++) {
+                printf("#   SF%u: %u pkt (%u CRC_OK), occupancy %.2f%%, SNR %d/%d/%d dB\n", rx_sum[i].sf[j].sf, rx_sum[i].sf[j].nb_pkt, rx_sum[i].sf[j].nb_crc_ok, rx_sum[i].sf[j].occ, rx_sum[i].sf[j].snr[0], rx_sum[i].sf[j].snr[1], rx_sum[i].sf[j].snr[2]);
+            }
+        }
         printf("### [DOWNSTREAM] ###\n");
         printf("# PULL_DATA sent: %u (%.2f%% acknowledged)\n", cp_dw_pull_sent, 100.0 * dw_ack_ratio);
         printf("# PULL_RESP(onse) datagrams received: %u (%u bytes)\n", cp_dw_dgram_rcv, cp_dw_network_byte);
@@ -1834,6 +2080,19 @@ int main(int argc, char ** argv)
             printf("# TX rejected (too late): %.2f%% (req:%u, rej:%u)\n", 100.0 * cp_nb_tx_rejected_too_late / cp_nb_tx_requested, cp_nb_tx_requested, cp_nb_tx_rejected_too_late);
             printf("# TX rejected (too early): %.2f%% (req:%u, rej:%u)\n", 100.0 * cp_nb_tx_rejected_too_early / cp_nb_tx_requested, cp_nb_tx_requested, cp_nb_tx_rejected_too_early);
         }
+        if ((cp_tx_timing.nb_tx > 0) || (cp_tx_timing.nb_jit_miss > 0)) {
+            printf("# TX timing: %u timestamped, %u missed, %u missed by JiT, slack min/avg %d/%.0f us, lgw_send avg/max %.0f/%u us\n", cp_tx_timing.nb_tx, cp_tx_timing.nb_miss, cp_tx_timing.nb_jit_miss, (cp_tx_timing.nb_tx > 0) ? cp_tx_timing.slack_min_us : 0, (cp_tx_timing.nb_tx > 0) ? (double)cp_tx_timing.slack_sum_us / cp_tx_timing.nb_tx : 0.0, (cp_tx_timing.nb_tx > 0) ? (double)cp_tx_timing.send_sum_us / cp_tx_timing.nb_tx : 0.0, cp_tx_timing.send_max_us);
+        }
+        if (virt_enabled == true) {
+            pthread_mutex_lock(&mx_concent);
+            i = lgw_virt_get_tx_stats(&virt_tx_stats);
+            pthread_mutex_unlock(&mx_concent);
+            if ((i == LGW_HAL_SUCCESS) && (virt_tx_stats.nb_tstamp > 0)) {
+                printf("# [VIRTUAL] TX: %u sent, %u late, %u overlapping, airtime %.1f s, slack %d/%.0f/%d us\n", virt_tx_stats.nb_tx, virt_tx_stats.nb_tx_late, virt_tx_stats.nb_tx_overlap, virt_tx_stats.airtime_us / 1E6, virt_tx_stats.slack_min_us, (double)virt_tx_stats.slack_sum_us / virt_tx_stats.nb_tstamp, virt_tx_stats.slack_max_us);
+            } else if (i == LGW_HAL_SUCCESS) {
+                printf("# [VIRTUAL] TX: %u sent, %u overlapping, airtime %.1f s\n", virt_tx_stats.nb_tx, virt_tx_stats.nb_tx_overlap, virt_tx_stats.airtime_us / 1E6);
+            }
+        }
         printf("### SX1302 Status ###\n");
         pthread_mutex_lock(&mx_concent);
         i  = lgw_get_instcnt(&inst_tstamp);
@@ -1871,6 +2130,16 @@ int main(int argc, char ** argv)
         } else {
             printf("# GPS sync is disabled\n");
         }
+        if (spectral_scan_params.enable == true) {
+            printf("### [SPECTRAL SCAN] ###\n");
+            for (i = 0; i < spectral_engine.nb_chan; i++) {
+                if (cp_spectral_ok[i] == true) {
+                    printf("# %u Hz: noise floor %d dBm (%d..%d), median %d dBm, p%d %d dBm, occupancy %.1f%% (max %.1f%%), %u scans\n", cp_spectral[i].freq_hz, cp_spectral[i].nf_dbm, cp_spectral[i].nf_min_dbm, cp_spectral[i].nf_max_dbm, cp_spectral[i].med_dbm, SPECTRAL_HIGH_PCT, cp_spectral[i].high_dbm, 100.0 * cp_spectral[i].occ / SPECTRAL_ONE, 100.0 * cp_spectral[i].occ_max / SPECTRAL_ONE, cp_spectral[i].nb_scan);
+                } else {
+                    printf("# %u Hz: not scanned yet\n", cp_spectral[i].freq_hz);
+                }
+            }
+        }
         pthread_mutex_lock(&mx_concent);
         i = lgw_get_temperature(&temperature);
         pthread_mutex_unlock(&mx_concent);
@@ -1884,11 +2153,55 @@ int main(int argc, char ** argv)
         /* generate a JSON report (will be sent to server by upstream thread) */
         pthread_mutex_lock(&mx_stat_rep);
         if (((gps_enabled == true) && (coord_ok == true)) || (gps_fake_enable == true)) {
-            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f}", stat_timestamp, cp_gps_coord.lat, cp_gps_coord.lon, cp_gps_coord.alt, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
+            status_len = status_append(0, "\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f", stat_timestamp, cp_gps_coord.lat, cp_gps_coord.lon, cp_gps_coord.alt, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
         } else {
-            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f}", stat_timestamp, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
+            status_len = status_append(0, "\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f", stat_timestamp, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
+        }
+        if (spectral_scan_params.enable == true) {
+            status_len = status_append(status_len, ",\"spec\":[");
+            for (i = 0; i < spectral_engine.nb_chan; i++) {
+                if (cp_spectral_ok[i] == true) {
+                    status_len = status_append(status_len, "%s{\"freq\":%u,\"scan\":%u,\"nf\":%d,\"nfmin\":%d,\"nfmax\":%d,\"med\":%d,\"p%d\":%d,\"occ\":%.1f,\"occmax\":%.1f}", (i == 0) ? "" : ",", cp_spectral[i].freq_hz, cp_spectral[i].nb_scan, cp_spectral[i].nf_dbm, cp_spectral[i].nf_min_dbm, cp_spectral[i].nf_max_dbm, cp_spectral[i].med_dbm, SPECTRAL_HIGH_PCT, cp_spectral[i].high_dbm, 100.0 * cp_spectral[i].occ / SPECTRAL_ONE, 100.0 * cp_spectral[i].occ_max / SPECTRAL_ONE);
+                } else {
+                    status_len = status_append(status_len, "%s{\"freq\":%u,\"scan\":0}", (i == 0) ? "" : ",", cp_spectral[i].freq_hz);
+                }
+            }
+            status_len = status_append(status_len, "]");
+        }
+        status_len = status_append(status_len, ",\"rxbf\":{\"full\":%u,\"rsyn\":%u,\"cerr\":%u,\"disc\":%u,\"lost\":%u}", rx_loss.delta.nb_buffer_full, rx_loss.delta.nb_resync, rx_loss.delta.nb_checksum_err, rx_loss.delta.nb_bytes_discarded, rx_loss.delta.nb_pkt_lost);
+        status_len = status_append(status_len, ",\"txsl\":{\"nb\":%u,\"miss\":%u,\"jmis\":%u,\"min\":%d,\"avg\":%.0f,\"send\":[%.0f,%u]", cp_tx_timing.nb_tx, cp_tx_timing.nb_miss, cp_tx_timing.nb_jit_miss, (cp_tx_timing.nb_tx > 0) ? cp_tx_timing.slack_min_us : 0, (cp_tx_timing.nb_tx > 0) ? (double)cp_tx_timing.slack_sum_us / cp_tx_timing.nb_tx : 0.0, (cp_tx_timing.nb_tx > 0) ? (double)cp_tx_timing.send_sum_us / cp_tx_timing.nb_tx : 0.0, cp_tx_timing.send_max_us);
+        for (i = 0; i < TX_TIMING_BIN_NB; i++) {
+            status_len = status_append(status_len, "%s%u", (i == 0) ? ",\"jit\":[" : ",", cp_tx_timing.jit_hist[i]);
+        }
+        for (i = 0; i < TX_TIMING_BIN_NB; i++) {
+            status_len = status_append(status_len, "%s%u", (i == 0) ? "],\"slack\":[" : ",", cp_tx_timing.slack_hist[i]);
+        }
+        status_len = status_append(status_len, "]}");
+        status_len = status_append(status_len, ",\"chan\":[");
+        sep = false;
+        for (i = 0; i < LGW_IF_CHAIN_NB; i++) {
+            if (rx_sum_ok[i] == false) {
+                continue;
+            }
+            status_len = status_append(status_len, "%s{\"if\":%d,\"freq\":%u,\"rxnb\":%u,\"rxok\":%u,\"rate\":%.2f,\"occ\":%.2f,\"rssi\":[%d,%d,%d],\"snr\":[%d,%d,%d]", (sep == true) ? "," : "", i, rx_sum[i].freq_hz, rx_sum[i].nb_pkt, rx_sum[i].nb_crc_ok, rx_sum[i].rate, rx_sum[i].occ, rx_sum[i].rssi[0], rx_sum[i].rssi[1], rx_sum[i].rssi[2], rx_sum[i].snr[0], rx_sum[i].snr[1], rx_sum[i].snr[2]);
+            if (rx_sum[i].demod_ok == true) {
+                status_len = status_append(status_len, ",\"dmd\":[%u,%u]", rx_sum[i].nb_detect, rx_sum[i].nb_alloc);
+            }
+            status_len = status_append(status_len, ",\"sf\":[");
+            for (j = 0; j < rx_sum[i].nb_sf; j++) {
+                status_len = status_append(status_len, "%s{\"sf\":%u,\"rxnb\":%u,\"rxok\":%u,\"occ\":%.2f,\"snr\":[%d,%d,%d]}", (j == 0) ? "" : ",", rx_sum[i].sf[j].sf, rx_sum[i].sf[j].nb_pkt, rx_sum[i].sf[j].nb_crc_ok, rx_sum[i].sf[j].occ, rx_sum[i].sf[j].snr[0], rx_sum[i].sf[j].snr[1], rx_sum[i].sf[j].snr[2]);
+            }
+            status_len = status_append(status_len, "]}");
+            sep = true;
+        }
+        status_len = status_append(status_len, "]");
+        status_len = status_append(status_len, "}");
+        if (status_len < STATUS_SIZE) {
+            report_ready = true;
+        } else {
+            report_ready = false;
+            printf("ERROR: status report larger than %d bytes, not sent\n", STATUS_SIZE);
         }
-        report_ready = true;
         pthread_mutex_unlock(&mx_stat_rep);
     }
 
@@ -1937,7 +2250,7 @@ int main(int argc, char ** argv)
         }
     }
 
-    if (com_type == LGW_COM_SPI) {
+    if ((com_type == LGW_COM_SPI) && (virt_enabled == false)) {
         /* Board reset */
         if (system("./reset_lgw.sh stop") != 0) {
             printf("ERROR: failed to reset SX1302, check your reset_lgw.sh script\n");
@@ -1966,6 +2279,7 @@ void thread_up(void) {
     /* local copy of GPS time reference */
     bool ref_ok = false; /* determine if GPS time reference must be used or not */
     struct tref local_ref; /* time reference used for UTC <-> timestamp conversion */
+    uint32_t seq; /* sequence number of the time reference copy */
 
     /* data buffers */
     uint8_t buff_up[TX_BUFF_SIZE]; /* buffer to compose the upstream packet */
@@ -1981,9 +2295,10 @@ void thread_up(void) {
     struct timespec recv_time;
 
     /* GPS synchronization variables */
-    struct timespec pkt_utc_time;
-    struct tm * x; /* broken-up UTC time */
-    struct timespec pkt_gps_time;
+    bool time_ok = false; /* packets timestamps converted to absolute time */
+    uint32_t pkt_count_us[NB_PKT_MAX];
+    char pkt_utc_iso[NB_PKT_MAX][LGW_GPS_ISO8601_SIZE]; /* ISO 8601 UTC time of packets */
+    struct timespec pkt_gps_time[NB_PKT_MAX];
     uint64_t pkt_gps_time_ms;
 
     /* report management variable */
@@ -2027,16 +2342,26 @@ void thread_up(void) {
             continue;
         }
 
-        /* get a copy of GPS time reference (avoid 1 mutex per packet) */
+        /* get a copy of GPS time reference (avoid 1 access per packet) */
         if ((nb_pkt > 0) && (gps_enabled == true)) {
-            pthread_mutex_lock(&mx_timeref);
-            ref_ok = gps_ref_valid;
-            local_ref = time_reference_gps;
-            pthread_mutex_unlock(&mx_timeref);
+            do {
+                seq = seqlock_read_begin(&sl_timeref);
+                ref_ok = gps_ref_valid;
+                local_ref = time_reference_gps;
+            } while (seqlock_read_retry(&sl_timeref, seq));
         } else {
             ref_ok = false;
         }
 
+        /* convert all packets timestamps to absolute time at once */
+        time_ok = false;
+        if (ref_ok == true) {
+            for (i = 0; i < nb_pkt; ++i) {
+                pkt_count_us[i] = rxpkt[i].count_us;
+            }
+            time_ok = (lgw_cnt2time_batch(local_ref, pkt_count_us, nb_pkt, NULL, pkt_gps_time, pkt_utc_iso) == LGW_GPS_SUCCESS);
+        }
+
         /* get timestamp for statistics */
         t = time(NULL);
         strftime(stat_timestamp, sizeof stat_timestamp, "%F %T %Z", gmtime(&t));
@@ -2076,6 +2401,7 @@ void thread_up(void) {
             /* basic packet filtering */
             pthread_mutex_lock(&mx_meas_up);
             meas_nb_rx_rcv += 1;
+            analytics_update(&meas_up_analytics, p);
             switch(p->status) {
                 case STAT_CRC_OK:
                     meas_nb_rx_ok += 1;
@@ -2138,31 +2464,23 @@ void thread_up(void) {
             }
 
             /* Packet RX time (GPS based), 37 useful chars */
-            if (ref_ok == true) {
-                /* convert packet timestamp to UTC absolute time */
-                j = lgw_cnt2utc(local_ref, p->count_us, &pkt_utc_time);
-                if (j == LGW_GPS_SUCCESS) {
-                    /* split the UNIX timestamp to its calendar components */
-                    x = gmtime(&(pkt_utc_time.tv_sec));
-                    j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"time\":\"%04i-%02i-%02iT%02i:%02i:%02i.%06liZ\"", (x->tm_year)+1900, (x->tm_mon)+1, x->tm_mday, x->tm_hour, x->tm_min, x->tm_sec, (pkt_utc_time.tv_nsec)/1000); /* ISO 8601 format */
-                    if (j > 0) {
-                        buff_index += j;
-                    } else {
-                        MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                        exit(EXIT_FAILURE);
-                    }
+            if (time_ok == true) {
+                /* UTC absolute time, ISO 8601 format */
+                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"time\":\"%s\"", pkt_utc_iso[i]);
+                if (j > 0) {
+                    buff_index += j;
+                } else {
+                    MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
+                    exit(EXIT_FAILURE);
                 }
-                /* convert packet timestamp to GPS absolute time */
-                j = lgw_cnt2gps(local_ref, p->count_us, &pkt_gps_time);
-                if (j == LGW_GPS_SUCCESS) {
-                    pkt_gps_time_ms = pkt_gps_time.tv_sec * 1E3 + pkt_gps_time.tv_nsec / 1E6;
-                    j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"tmms\":%" PRIu64 "", pkt_gps_time_ms); /* GPS time in milliseconds since 06.Jan.1980 */
-                    if (j > 0) {
-                        buff_index += j;
-                    } else {
-                        MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                        exit(EXIT_FAILURE);
-                    }
+                /* GPS absolute time */
+                pkt_gps_time_ms = pkt_gps_time[i].tv_sec * 1E3 + pkt_gps_time[i].tv_nsec / 1E6;
+                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"tmms\":%" PRIu64 "", pkt_gps_time_ms); /* GPS time in milliseconds since 06.Jan.1980 */
+                if (j > 0) {
+                    buff_index += j;
+                } else {
+                    MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
+                    exit(EXIT_FAILURE);
                 }
             }
 
@@ -2562,29 +2880,25 @@ void thread_down(void) {
     /* variables to send on GPS timestamp */
     struct tref local_ref; /* time reference used for GPS <-> timestamp conversion */
     struct timespec gps_tx; /* GPS time that needs to be converted to timestamp */
+    bool ref_ok; /* copy of GPS time reference validity */
+    bool xtal_ok; /* copy of XTAL correction validity */
+    uint32_t seq; /* sequence number of the time reference / XTAL correction copy */
 
     /* beacon variables */
+    struct beacon_conf_s beacon_conf;
+    struct beacon_engine_s beacon_engine;
     struct lgw_pkt_tx_s beacon_pkt;
-    uint8_t beacon_chan;
     uint8_t beacon_loop;
-    size_t beacon_RFU1_size = 0;
-    size_t beacon_RFU2_size = 0;
-    uint8_t beacon_pyld_idx = 0;
     time_t diff_beacon_time;
     struct timespec next_beacon_gps_time; /* gps time of next beacon packet */
     struct timespec last_beacon_gps_time; /* gps time of last enqueued beacon packet */
     int retry;
 
-    /* beacon data fields, byte 0 is Least Significant Byte */
-    int32_t field_latitude; /* 3 bytes, derived from reference latitude */
-    int32_t field_longitude; /* 3 bytes, derived from reference longitude */
-    uint16_t field_crc1, field_crc2;
-
     /* auto-quit variable */
     uint32_t autoquit_cnt = 0; /* count the number of PULL_DATA sent since the latest PULL_ACK */
 
     /* Just In Time downlink */
-    uint32_t current_concentrator_time;
+    uint64_t current_concentrator_time;
     enum jit_error_e jit_result = JIT_ERROR_OK;
     enum jit_pkt_type_e downlink_type;
     enum jit_error_e warning_result = JIT_ERROR_OK;
@@ -2608,98 +2922,21 @@ void thread_down(void) {
     last_beacon_gps_time.tv_sec = 0;
     last_beacon_gps_time.tv_nsec = 0;
 
-    /* beacon packet parameters */
-    beacon_pkt.tx_mode = ON_GPS; /* send on PPS pulse */
-    beacon_pkt.rf_chain = 0; /* antenna A */
-    beacon_pkt.rf_power = beacon_power;
-    beacon_pkt.modulation = MOD_LORA;
-    switch (beacon_bw_hz) {
-        case 125000:
-            beacon_pkt.bandwidth = BW_125KHZ;
-            break;
-        case 500000:
-            beacon_pkt.bandwidth = BW_500KHZ;
-            break;
-        default:
-            /* should not happen */
-            MSG("ERROR: unsupported bandwidth for beacon\n");
-            exit(EXIT_FAILURE);
-    }
-    switch (beacon_datarate) {
-        case 8:
-            beacon_pkt.datarate = DR_LORA_SF8;
-            beacon_RFU1_size = 1;
-            beacon_RFU2_size = 3;
-            break;
-        case 9:
-            beacon_pkt.datarate = DR_LORA_SF9;
-            beacon_RFU1_size = 2;
-            beacon_RFU2_size = 0;
-            break;
-        case 10:
-            beacon_pkt.datarate = DR_LORA_SF10;
-            beacon_RFU1_size = 3;
-            beacon_RFU2_size = 1;
-            break;
-        case 12:
-            beacon_pkt.datarate = DR_LORA_SF12;
-            beacon_RFU1_size = 5;
-            beacon_RFU2_size = 3;
-            break;
-        default:
-            /* should not happen */
-            MSG("ERROR: unsupported datarate for beacon\n");
-            exit(EXIT_FAILURE);
-    }
-    beacon_pkt.size = beacon_RFU1_size + 4 + 2 + 7 + beacon_RFU2_size + 2;
-    beacon_pkt.coderate = CR_LORA_4_5;
-    beacon_pkt.invert_pol = false;
-    beacon_pkt.preamble = 10;
-    beacon_pkt.no_crc = true;
-    beacon_pkt.no_header = true;
-
-    /* network common part beacon fields (little endian) */
-    for (i = 0; i < (int)beacon_RFU1_size; i++) {
-        beacon_pkt.payload[beacon_pyld_idx++] = 0x0;
-    }
-
-    /* network common part beacon fields (little endian) */
-    beacon_pyld_idx += 4; /* time (variable), filled later */
-    beacon_pyld_idx += 2; /* crc1 (variable), filled later */
-
-    /* calculate the latitude and longitude that must be publicly reported */
-    field_latitude = (int32_t)((reference_coord.lat / 90.0) * (double)(1<<23));
-    if (field_latitude > (int32_t)0x007FFFFF) {
-        field_latitude = (int32_t)0x007FFFFF; /* +90 N is represented as 89.99999 N */
-    } else if (field_latitude < (int32_t)0xFF800000) {
-        field_latitude = (int32_t)0xFF800000;
-    }
-    field_longitude = (int32_t)((reference_coord.lon / 180.0) * (double)(1<<23));
-    if (field_longitude > (int32_t)0x007FFFFF) {
-        field_longitude = (int32_t)0x007FFFFF; /* +180 E is represented as 179.99999 E */
-    } else if (field_longitude < (int32_t)0xFF800000) {
-        field_longitude = (int32_t)0xFF800000;
-    }
-
-    /* gateway specific beacon fields */
-    beacon_pkt.payload[beacon_pyld_idx++] = beacon_infodesc;
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF &  field_latitude;
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_latitude >>  8);
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_latitude >> 16);
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF &  field_longitude;
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_longitude >>  8);
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_longitude >> 16);
-
-    /* RFU */
-    for (i = 0; i < (int)beacon_RFU2_size; i++) {
-        beacon_pkt.payload[beacon_pyld_idx++] = 0x0;
+    /* beacon engine: fields common to all beacons are built once */
+    beacon_conf.period = beacon_period;
+    beacon_conf.freq_hz = beacon_freq_hz;
+    beacon_conf.freq_nb = beacon_freq_nb;
+    beacon_conf.freq_step = beacon_freq_step;
+    beacon_conf.datarate = beacon_datarate;
+    beacon_conf.bw_hz = beacon_bw_hz;
+    beacon_conf.power = beacon_power;
+    beacon_conf.infodesc = beacon_infodesc;
+    beacon_conf.coord = reference_coord;
+    if (beacon_engine_init(&beacon_engine, &beacon_conf) != 0) {
+        /* should not happen */
+        exit(EXIT_FAILURE);
     }
 
-    /* CRC of the beacon gateway specific part fields */
-    field_crc2 = crc16((beacon_pkt.payload + 6 + beacon_RFU1_size), 7 + beacon_RFU2_size);
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF &  field_crc2;
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_crc2 >> 8);
-
     /* JIT queue initialization */
     jit_queue_init(&jit_queue[0]);
     jit_queue_init(&jit_queue[1]);
@@ -2740,17 +2977,27 @@ void thread_down(void) {
             beacon_loop = JIT_NUM_BEACON_IN_QUEUE - jit_queue[0].num_beacon;
             retry = 0;
             while (beacon_loop && (beacon_period != 0)) {
-                pthread_mutex_lock(&mx_timeref);
+                /* get a copy of GPS time reference and XTAL correction status */
+                do {
+                    seq = seqlock_read_begin(&sl_timeref);
+                    ref_ok = gps_ref_valid;
+                    local_ref = time_reference_gps;
+                } while (seqlock_read_retry(&sl_timeref, seq));
+                do {
+                    seq = seqlock_read_begin(&sl_xcorr);
+                    xtal_ok = xtal_correct_ok;
+                } while (seqlock_read_retry(&sl_xcorr, seq));
+
                 /* Wait for GPS to be ready before inserting beacons in JiT queue */
-                if ((gps_ref_valid == true) && (xtal_correct_ok == true)) {
+                if ((ref_ok == true) && (xtal_ok == true)) {
 
                     /* compute GPS time for next beacon to come      */
                     /*   LoRaWAN: T = k*beacon_period + TBeaconDelay */
                     /*            with TBeaconDelay = [1.5ms +/- 1µs]*/
                     if (last_beacon_gps_time.tv_sec == 0) {
                         /* if no beacon has been queued, get next slot from current GPS time */
-                        diff_beacon_time = time_reference_gps.gps.tv_sec % ((time_t)beacon_period);
-                        next_beacon_gps_time.tv_sec = time_reference_gps.gps.tv_sec +
+                        diff_beacon_time = local_ref.gps.tv_sec % ((time_t)beacon_period);
+                        next_beacon_gps_time.tv_sec = local_ref.gps.tv_sec +
                                                         ((time_t)beacon_period - diff_beacon_time);
                     } else {
                         /* if there is already a beacon, take it as reference */
@@ -2764,7 +3011,7 @@ void thread_down(void) {
                     {
                     time_t time_unix;
 
-                    time_unix = time_reference_gps.gps.tv_sec + UNIX_GPS_EPOCH_OFFSET;
+                    time_unix = local_ref.gps.tv_sec + UNIX_GPS_EPOCH_OFFSET;
                     MSG_DEBUG(DEBUG_BEACON, "GPS-now : %s", ctime(&time_unix));
                     time_unix = last_beacon_gps_time.tv_sec + UNIX_GPS_EPOCH_OFFSET;
                     MSG_DEBUG(DEBUG_BEACON, "GPS-last: %s", ctime(&time_unix));
@@ -2773,35 +3020,11 @@ void thread_down(void) {
                     }
 #endif
 
-                    /* convert GPS time to concentrator time, and set packet counter for JiT trigger */
-                    lgw_gps2cnt(time_reference_gps, next_beacon_gps_time, &(beacon_pkt.count_us));
-                    pthread_mutex_unlock(&mx_timeref);
-
-                    /* apply frequency correction to beacon TX frequency */
-                    if (beacon_freq_nb > 1) {
-                        beacon_chan = (next_beacon_gps_time.tv_sec / beacon_period) % beacon_freq_nb; /* floor rounding */
-                    } else {
-                        beacon_chan = 0;
-                    }
-                    /* Compute beacon frequency */
-                    beacon_pkt.freq_hz = beacon_freq_hz + (beacon_chan * beacon_freq_step);
-
-                    /* load time in beacon payload */
-                    beacon_pyld_idx = beacon_RFU1_size;
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF &  next_beacon_gps_time.tv_sec;
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (next_beacon_gps_time.tv_sec >>  8);
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (next_beacon_gps_time.tv_sec >> 16);
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (next_beacon_gps_time.tv_sec >> 24);
-
-                    /* calculate CRC */
-                    field_crc1 = crc16(beacon_pkt.payload, 4 + beacon_RFU1_size); /* CRC for the network common part */
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & field_crc1;
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_crc1 >> 8);
+                    /* get the prepared beacon, its counter time follows the current time reference */
+                    beacon_pkt = *beacon_engine_get(&beacon_engine, next_beacon_gps_time.tv_sec, &local_ref);
 
                     /* Insert beacon packet in JiT queue */
-                    pthread_mutex_lock(&mx_concent);
-                    lgw_get_instcnt(&current_concentrator_time);
-                    pthread_mutex_unlock(&mx_concent);
+                    get_concentrator_time(&current_concentrator_time);
                     jit_result = jit_enqueue(&jit_queue[0], current_concentrator_time, &beacon_pkt, JIT_PKT_TYPE_BEACON);
                     if (jit_result == JIT_ERROR_OK) {
                         /* update stats */
@@ -2836,7 +3059,6 @@ void thread_down(void) {
                         MSG_DEBUG(DEBUG_BEACON, "--> beacon queuing retry=%d\n", retry);
                     }
                 } else {
-                    pthread_mutex_unlock(&mx_timeref);
                     break;
                 }
             }
@@ -2844,6 +3066,18 @@ void thread_down(void) {
             /* if no network message was received, got back to listening sock_down socket */
             if (msg_len == -1) {
                 //MSG("WARNING: [down] recv returned %s\n", strerror(errno)); /* too verbose */
+
+                /* meanwhile, follow the time reference updates in the prepared beacons */
+                if (beacon_period != 0) {
+                    do {
+                        seq = seqlock_read_begin(&sl_timeref);
+                        ref_ok = gps_ref_valid;
+                        local_ref = time_reference_gps;
+                    } while (seqlock_read_retry(&sl_timeref, seq));
+                    if (ref_ok == true) {
+                        beacon_engine_refresh(&beacon_engine, &local_ref);
+                    }
+                }
                 continue;
             }
 
@@ -2919,12 +3153,12 @@ void thread_down(void) {
                         continue;
                     }
                     if (gps_enabled == true) {
-                        pthread_mutex_lock(&mx_timeref);
-                        if (gps_ref_valid == true) {
+                        do {
+                            seq = seqlock_read_begin(&sl_timeref);
+                            ref_ok = gps_ref_valid;
                             local_ref = time_reference_gps;
-                            pthread_mutex_unlock(&mx_timeref);
-                        } else {
-                            pthread_mutex_unlock(&mx_timeref);
+                        } while (seqlock_read_retry(&sl_timeref, seq));
+                        if (ref_ok == false) {
                             MSG("WARNING: [down] no valid GPS time reference yet, impossible to send packet on specific GPS time, TX aborted\n");
                             json_value_free(root_val);
 
@@ -3194,9 +3428,7 @@ void thread_down(void) {
 
             /* insert packet to be sent into JIT queue */
             if (jit_result == JIT_ERROR_OK) {
-                pthread_mutex_lock(&mx_concent);
-                lgw_get_instcnt(&current_concentrator_time);
-                pthread_mutex_unlock(&mx_concent);
+                get_concentrator_time(&current_concentrator_time);
                 jit_result = jit_enqueue(&jit_queue[txpkt.rf_chain], current_concentrator_time, &txpkt, downlink_type);
                 if (jit_result != JIT_ERROR_OK) {
                     printf("ERROR: Packet REJECTED (jit error=%d)\n", jit_result);
@@ -3244,21 +3476,32 @@ void thread_jit(void) {
     int result = LGW_HAL_SUCCESS;
     struct lgw_pkt_tx_s pkt;
     int pkt_index = -1;
-    uint32_t current_concentrator_time;
+    uint64_t current_concentrator_time;
     enum jit_error_e jit_result;
     enum jit_pkt_type_e pkt_type;
     uint8_t tx_status;
     int i;
+    double xtal_correct_cpy;
+    uint32_t seq;
+    uint32_t nb_dropped;
+    uint32_t inst_cnt;
+    int32_t jit_us, slack_us;
+    bool timing_ok;
+    struct timespec send_start, send_end;
 
     while (!exit_sig && !quit_sig) {
         wait_ms(10);
 
         for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
             /* transfer data and metadata to the concentrator, and schedule TX */
-            pthread_mutex_lock(&mx_concent);
-            lgw_get_instcnt(&current_concentrator_time);
-            pthread_mutex_unlock(&mx_concent);
+            get_concentrator_time(&current_concentrator_time);
+            nb_dropped = jit_queue[i].nb_dropped; /* only updated by jit_peek, in this thread */
             jit_result = jit_peek(&jit_queue[i], current_concentrator_time, &pkt_index);
+            if (jit_queue[i].nb_dropped > nb_dropped) {
+                pthread_mutex_lock(&mx_meas_dw);
+                meas_tx_timing.nb_jit_miss += jit_queue[i].nb_dropped - nb_dropped;
+                pthread_mutex_unlock(&mx_meas_dw);
+            }
             if (jit_result == JIT_ERROR_OK) {
                 if (pkt_index > -1) {
                     jit_result = jit_dequeue(&jit_queue[i], pkt_index, &pkt, &pkt_type);
@@ -3266,10 +3509,12 @@ void thread_jit(void) {
                         /* update beacon stats */
                         if (pkt_type == JIT_PKT_TYPE_BEACON) {
                             /* Compensate breacon frequency with xtal error */
-                            pthread_mutex_lock(&mx_xcorr);
-                            pkt.freq_hz = (uint32_t)(xtal_correct * (double)pkt.freq_hz);
-                            MSG_DEBUG(DEBUG_BEACON, "beacon_pkt.freq_hz=%u (xtal_correct=%.15lf)\n", pkt.freq_hz, xtal_correct);
-                            pthread_mutex_unlock(&mx_xcorr);
+                            do {
+                                seq = seqlock_read_begin(&sl_xcorr);
+                                xtal_correct_cpy = xtal_correct;
+                            } while (seqlock_read_retry(&sl_xcorr, seq));
+                            pkt.freq_hz = (uint32_t)(xtal_correct_cpy * (double)pkt.freq_hz);
+                            MSG_DEBUG(DEBUG_BEACON, "beacon_pkt.freq_hz=%u (xtal_correct=%.15lf)\n", pkt.freq_hz, xtal_correct_cpy);
 
                             /* Update statistics */
                             pthread_mutex_lock(&mx_meas_dw);
@@ -3299,14 +3544,33 @@ void thread_jit(void) {
 
                         /* send packet to concentrator */
                         pthread_mutex_lock(&mx_concent); /* may have to wait for a fetch to finish */
+                        if (mx_sx1261 != &mx_concent) {
+                            pthread_mutex_lock(mx_sx1261); /* SX1261 is used for scan abort and LBT */
+                        }
                         if (spectral_scan_params.enable == true) {
                             result = lgw_spectral_scan_abort();
                             if (result != LGW_HAL_SUCCESS) {
                                 MSG("WARNING: [jit%d] lgw_spectral_scan_abort failed\n", i);
                             }
                         }
+                        clock_gettime(CLOCK_MONOTONIC, &send_start);
                         result = lgw_send(&pkt);
+                        clock_gettime(CLOCK_MONOTONIC, &send_end);
+                        /* time left before the TX trigger, on the concentrator counter */
+                        timing_ok = (result == LGW_HAL_SUCCESS) && (pkt.tx_mode == TIMESTAMPED) && (lgw_get_instcnt(&inst_cnt) == LGW_HAL_SUCCESS);
+                        if (mx_sx1261 != &mx_concent) {
+                            pthread_mutex_unlock(mx_sx1261);
+                        }
                         pthread_mutex_unlock(&mx_concent); /* free concentrator ASAP */
+                        if (timing_ok == true) {
+                            jit_us = (int32_t)(pkt.count_us - (uint32_t)current_concentrator_time);
+                            /* the SX1302 triggers a LoRa TX a few us later than TX_START_DELAY_DEFAULT before count_us (radio, filter
+                               and modem delays of sx1302_tx_set_start_delay), and a FSK TX at count_us: the slack is a lower bound */
+                            slack_us = (int32_t)((pkt.count_us - TX_START_DELAY_DEFAULT) - inst_cnt);
+                            pthread_mutex_lock(&mx_meas_dw);
+                            tx_timing_update(&meas_tx_timing, TX_START_DELAY_DEFAULT, jit_us, slack_us, (uint32_t)(1E6 * difftimespec(send_end, send_start)));
+                            pthread_mutex_unlock(&mx_meas_dw);
+                        }
                         if (result != LGW_HAL_SUCCESS) {
                             pthread_mutex_lock(&mx_meas_dw);
                             meas_nb_tx_fail += 1;
@@ -3359,9 +3623,9 @@ static void gps_process_sync(void) {
     }
 
     /* try to update time reference with the new GPS time & timestamp */
-    pthread_mutex_lock(&mx_timeref);
+    seqlock_write_lock(&sl_timeref);
     i = lgw_gps_sync(&time_reference_gps, trig_tstamp, utc, gps_time);
-    pthread_mutex_unlock(&mx_timeref);
+    seqlock_write_unlock(&sl_timeref);
     if (i != LGW_GPS_SUCCESS) {
         MSG("WARNING: [gps] GPS out of sync, keeping previous time reference\n");
     }
@@ -3388,95 +3652,36 @@ static void gps_process_coords(void) {
 
 void thread_gps(void) {
     /* serial variables */
-    char serial_buff[128]; /* buffer to receive GPS data */
-    size_t wr_idx = 0;     /* pointer to end of chars in buffer */
+    uint8_t serial_buff[128]; /* buffer to receive GPS data */
+    struct lgw_gps_parser_s gps_parser; /* frames may span several reads */
 
     /* variables for PPM pulse GPS synchronization */
     enum gps_msg latest_msg; /* keep track of latest NMEA message parsed */
 
     /* initialize some variables before loop */
-    memset(serial_buff, 0, sizeof serial_buff);
+    lgw_gps_parser_init(&gps_parser);
 
     while (!exit_sig && !quit_sig) {
         size_t rd_idx = 0;
-        size_t frame_end_idx = 0;
+        size_t nb_parsed;
 
-        /* blocking non-canonical read on serial port */
-        ssize_t nb_char = read(gps_tty_fd, serial_buff + wr_idx, LGW_GPS_MIN_MSG_SIZE);
+        /* blocking non-canonical read on serial port, returns as soon as LGW_GPS_MIN_MSG_SIZE bytes are available */
+        ssize_t nb_char = read(gps_tty_fd, serial_buff, sizeof serial_buff);
         if (nb_char <= 0) {
             MSG("WARNING: [gps] read() returned value %zd\n", nb_char);
             continue;
         }
-        wr_idx += (size_t)nb_char;
-
-        /*******************************************
-         * Scan buffer for UBX/NMEA sync chars and *
-         * attempt to decode frame if one is found *
-         *******************************************/
-        while (rd_idx < wr_idx) {
-            size_t frame_size = 0;
-
-            /* Scan buffer for UBX sync char */
-            if (serial_buff[rd_idx] == (char)LGW_GPS_UBX_SYNC_CHAR) {
-
-                /***********************
-                 * Found UBX sync char *
-                 ***********************/
-                latest_msg = lgw_parse_ubx(&serial_buff[rd_idx], (wr_idx - rd_idx), &frame_size);
-
-                if (frame_size > 0) {
-                    if (latest_msg == INCOMPLETE) {
-                        /* UBX header found but frame appears to be missing bytes */
-                        frame_size = 0;
-                    } else if (latest_msg == INVALID) {
-                        /* message header received but message appears to be corrupted */
-                        MSG("WARNING: [gps] could not get a valid message from GPS (no time)\n");
-                        frame_size = 0;
-                    } else if (latest_msg == UBX_NAV_TIMEGPS) {
-                        gps_process_sync();
-                    }
-                }
-            } else if (serial_buff[rd_idx] == (char)LGW_GPS_NMEA_SYNC_CHAR) {
-                /************************
-                 * Found NMEA sync char *
-                 ************************/
-                /* scan for NMEA end marker (LF = 0x0a) */
-                char* nmea_end_ptr = memchr(&serial_buff[rd_idx],(int)0x0a, (wr_idx - rd_idx));
-
-                if(nmea_end_ptr) {
-                    /* found end marker */
-                    frame_size = nmea_end_ptr - &serial_buff[rd_idx] + 1;
-                    latest_msg = lgw_parse_nmea(&serial_buff[rd_idx], frame_size);
-
-                    if(latest_msg == INVALID || latest_msg == UNKNOWN) {
-                        /* checksum failed */
-                        frame_size = 0;
-                    } else if (latest_msg == NMEA_RMC) { /* Get location from RMC frames */
-                        gps_process_coords();
-                    }
-                }
-            }
-
-            if (frame_size > 0) {
-                /* At this point message is a checksum verified frame
-                   we're processed or ignored. Remove frame from buffer */
-                rd_idx += frame_size;
-                frame_end_idx = rd_idx;
-            } else {
-                rd_idx++;
-            }
-        } /* ...for(rd_idx = 0... */
 
-        if (frame_end_idx) {
-          /* Frames have been processed. Remove bytes to end of last processed frame */
-          memcpy(serial_buff, &serial_buff[frame_end_idx], wr_idx - frame_end_idx);
-          wr_idx -= frame_end_idx;
-        } /* ...for(rd_idx = 0... */
+        /* parse the received bytes in place, process each frame as soon as it is complete */
+        while (rd_idx < (size_t)nb_char) {
+            latest_msg = lgw_gps_parse_stream(&gps_parser, &serial_buff[rd_idx], (size_t)nb_char - rd_idx, &nb_parsed);
+            rd_idx += nb_parsed;
 
-        /* Prevent buffer overflow */
-        if ((sizeof(serial_buff) - wr_idx) < LGW_GPS_MIN_MSG_SIZE) {
-            memcpy(serial_buff, &serial_buff[LGW_GPS_MIN_MSG_SIZE], wr_idx - LGW_GPS_MIN_MSG_SIZE);
-            wr_idx -= LGW_GPS_MIN_MSG_SIZE;
+            if (latest_msg == UBX_NAV_TIMEGPS) {
+                gps_process_sync();
+            } else if (latest_msg == NMEA_RMC) { /* Get location from RMC frames */
+                gps_process_coords();
+            }
         }
     }
     MSG("\nINFO: End of GPS thread\n");
@@ -3491,11 +3696,7 @@ void thread_valid(void) {
     long gps_ref_age = 0;
     bool ref_valid_local = false;
     double xtal_err_cpy;
-
-    /* variables for XTAL correction averaging */
-    unsigned init_cpt = 0;
-    double init_acc = 0.0;
-    double x;
+    double xtal_err_std_cpy = 1.0;
 
     /* correction debug */
     // FILE * log_file = NULL;
@@ -3507,60 +3708,41 @@ void thread_valid(void) {
     // strftime(log_name,sizeof log_name,"xtal_err_%Y%m%dT%H%M%SZ.csv",localtime(&now_time));
     // log_file = fopen(log_name, "w");
     // setbuf(log_file, NULL);
-    // fprintf(log_file,"\"xtal_correct\",\"XERR_INIT_AVG %u XERR_FILT_COEF %u\"\n", XERR_INIT_AVG, XERR_FILT_COEF); // DEBUG
+    // fprintf(log_file,"\"xtal_correct\",\"xtal_err_std\"\n"); // DEBUG
 
     /* main loop task */
     while (!exit_sig && !quit_sig) {
         wait_ms(1000);
 
         /* calculate when the time reference was last updated */
-        pthread_mutex_lock(&mx_timeref);
+        seqlock_write_lock(&sl_timeref);
         gps_ref_age = (long)difftime(time(NULL), time_reference_gps.systime);
         if ((gps_ref_age >= 0) && (gps_ref_age <= GPS_REF_MAX_AGE)) {
             /* time ref is ok, validate and  */
             gps_ref_valid = true;
             ref_valid_local = true;
             xtal_err_cpy = time_reference_gps.xtal_err;
+            xtal_err_std_cpy = time_reference_gps.xtal_err_std;
             //printf("XTAL err: %.15lf (1/XTAL_err:%.15lf)\n", xtal_err_cpy, 1/xtal_err_cpy); // DEBUG
         } else {
             /* time ref is too old, invalidate */
             gps_ref_valid = false;
             ref_valid_local = false;
         }
-        pthread_mutex_unlock(&mx_timeref);
+        seqlock_write_unlock(&sl_timeref);
 
-        /* manage XTAL correction */
+        /* manage XTAL correction, filtered by the GPS clock discipline (see lgw_gps_sync) */
+        seqlock_write_lock(&sl_xcorr);
         if (ref_valid_local == false) {
             /* couldn't sync, or sync too old -> invalidate XTAL correction */
-            pthread_mutex_lock(&mx_xcorr);
             xtal_correct_ok = false;
             xtal_correct = 1.0;
-            pthread_mutex_unlock(&mx_xcorr);
-            init_cpt = 0;
-            init_acc = 0.0;
         } else {
-            if (init_cpt < XERR_INIT_AVG) {
-                /* initial accumulation */
-                init_acc += xtal_err_cpy;
-                ++init_cpt;
-            } else if (init_cpt == XERR_INIT_AVG) {
-                /* initial average calculation */
-                pthread_mutex_lock(&mx_xcorr);
-                xtal_correct = (double)(XERR_INIT_AVG) / init_acc;
-                //printf("XERR_INIT_AVG=%d, init_acc=%.15lf\n", XERR_INIT_AVG, init_acc);
-                xtal_correct_ok = true;
-                pthread_mutex_unlock(&mx_xcorr);
-                ++init_cpt;
-                // fprintf(log_file,"%.18lf,\"average\"\n", xtal_correct); // DEBUG
-            } else {
-                /* tracking with low-pass filter */
-                x = 1 / xtal_err_cpy;
-                pthread_mutex_lock(&mx_xcorr);
-                xtal_correct = xtal_correct - xtal_correct/XERR_FILT_COEF + x/XERR_FILT_COEF;
-                pthread_mutex_unlock(&mx_xcorr);
-                // fprintf(log_file,"%.18lf,\"track\"\n", xtal_correct); // DEBUG
-            }
+            xtal_correct = 1.0 / xtal_err_cpy;
+            xtal_correct_ok = (xtal_err_std_cpy < XERR_STD_MAX);
+            // fprintf(log_file,"%.18lf,%.3e\n", xtal_correct, xtal_err_std_cpy); // DEBUG
         }
+        seqlock_write_unlock(&sl_xcorr);
 
         //printf("Time ref: %s, XTAL correct: %s (%.15lf)\n", ref_valid_local?"valid":"invalid", xtal_correct_ok?"valid":"invalid", xtal_correct); // DEBUG
     }
@@ -3580,21 +3762,31 @@ void thread_spectral_scan(void) {
     lgw_spectral_scan_status_t status;
     uint8_t tx_status = TX_FREE;
     bool spectral_scan_started;
-    bool exit_thread = false;
+    uint32_t pace_ms;
+    uint32_t wait_left_ms = 0;
+    uint32_t w;
+    uint32_t scan_duration_ms;
+
+    /* the status is only polled once the scan should be completed */
+    scan_duration_ms = (lgw_spectral_scan_duration_us(spectral_scan_params.nb_scan) + 999) / 1000;
+
+    /* sub-second pacing if configured, 1 sec min otherwise */
+    if (spectral_scan_params.pace_ms != 0) {
+        pace_ms = spectral_scan_params.pace_ms;
+    } else {
+        pace_ms = 1000 * (spectral_scan_params.pace_s ? spectral_scan_params.pace_s : 1);
+    }
 
     /* main loop task */
     while (!exit_sig && !quit_sig) {
-        /* Pace the scan thread (1 sec min), and avoid waiting several seconds when exit */
-        for (i = 0; i < (int)(spectral_scan_params.pace_s ? spectral_scan_params.pace_s : 1); i++) {
-            if (exit_sig || quit_sig) {
-                exit_thread = true;
-                break;
-            }
-            wait_ms(1000);
-        }
-        if (exit_thread == true) {
-            break;
+        /* Pace the scan thread, and avoid waiting several seconds when exit */
+        if (wait_left_ms > 0) {
+            w = (wait_left_ms < SPECTRAL_WAIT_STEP_MS) ? wait_left_ms : SPECTRAL_WAIT_STEP_MS;
+            wait_ms(w);
+            wait_left_ms -= w;
+            continue;
         }
+        wait_left_ms = pace_ms;
 
         spectral_scan_started = false;
 
@@ -3608,65 +3800,75 @@ void thread_spectral_scan(void) {
                     printf("ERROR: failed to get TX status on chain %d\n", i);
                 } else {
                     if (tx_status == TX_SCHEDULED || tx_status == TX_EMITTING) {
-                        printf("INFO: skip spectral scan (downlink programmed on RF chain %d)\n", i);
+                        MSG_DEBUG(DEBUG_LOG, "INFO: skip spectral scan (downlink programmed on RF chain %d)\n", i);
+                        if (wait_left_ms < SPECTRAL_TX_BACKOFF_MS) {
+                            wait_left_ms = SPECTRAL_TX_BACKOFF_MS;
+                        }
                         break; /* exit for loop */
                     }
                 }
             }
         }
         if (tx_status != TX_SCHEDULED && tx_status != TX_EMITTING) {
+            /* -- The concentrator is released as soon as the SX1261 is held */
+            if (mx_sx1261 != &mx_concent) {
+                pthread_mutex_lock(mx_sx1261);
+                pthread_mutex_unlock(&mx_concent);
+            }
             x = lgw_spectral_scan_start(freq_hz, spectral_scan_params.nb_scan);
+            pthread_mutex_unlock(mx_sx1261);
             if (x != 0) {
                 printf("ERROR: spectral scan start failed\n");
-                pthread_mutex_unlock(&mx_concent);
                 continue; /* main while loop */
             }
             spectral_scan_started = true;
+        } else {
+            pthread_mutex_unlock(&mx_concent);
         }
-        pthread_mutex_unlock(&mx_concent);
 
         if (spectral_scan_started == true) {
             /* Wait for scan to be completed */
             status = LGW_SPECTRAL_SCAN_STATUS_UNKNOWN;
             timeout_start(&tm_start);
+            wait_ms(scan_duration_ms);
             do {
                 /* handle timeout */
-                if (timeout_check(tm_start, 2000) != 0) {
+                if (timeout_check(tm_start, scan_duration_ms + SPECTRAL_TIMEOUT_MS) != 0) {
                     printf("ERROR: %s: TIMEOUT on Spectral Scan\n", __FUNCTION__);
                     break;  /* do while */
                 }
 
                 /* get spectral scan status */
-                pthread_mutex_lock(&mx_concent);
+                pthread_mutex_lock(mx_sx1261);
                 x = lgw_spectral_scan_get_status(&status);
-                pthread_mutex_unlock(&mx_concent);
+                pthread_mutex_unlock(mx_sx1261);
                 if (x != 0) {
                     printf("ERROR: spectral scan status failed\n");
                     break; /* do while */
                 }
 
                 /* wait a bit before checking status again */
-                wait_ms(10);
+                if (status != LGW_SPECTRAL_SCAN_STATUS_COMPLETED && status != LGW_SPECTRAL_SCAN_STATUS_ABORTED) {
+                    wait_ms(SPECTRAL_POLL_MS);
+                }
             } while (status != LGW_SPECTRAL_SCAN_STATUS_COMPLETED && status != LGW_SPECTRAL_SCAN_STATUS_ABORTED);
 
             if (status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED) {
                 /* Get spectral scan results */
                 memset(levels, 0, sizeof levels);
                 memset(results, 0, sizeof results);
-                pthread_mutex_lock(&mx_concent);
+                pthread_mutex_lock(mx_sx1261);
                 x = lgw_spectral_scan_get_results(levels, results);
-                pthread_mutex_unlock(&mx_concent);
+                pthread_mutex_unlock(mx_sx1261);
                 if (x != 0) {
                     printf("ERROR: spectral scan get results failed\n");
                     continue; /* main while loop */
                 }
 
-                /* print results */
-                printf("SPECTRAL SCAN - %u Hz: ", freq_hz);
-                for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
-                    printf("%u ", results[i]);
-                }
-                printf("\n");
+                /* aggregate results, reported with the statistics */
+                pthread_mutex_lock(&mx_spectral);
+                spectral_engine_update(&spectral_engine, freq_hz, levels, results);
+                pthread_mutex_unlock(&mx_spectral);
 
                 /* Next frequency to scan */
                 freq_hz += 200000; /* 200kHz channels */
@@ -0,0 +1,60 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : Sequence lock, to publish data written rarely and read
+    often by several threads.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <pthread.h>
+
+#include "seqlock.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void seqlock_write_lock(seqlock_t *sl) {
+    pthread_mutex_lock(&sl->mx_write);
+
+    /* odd sequence: readers will retry */
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void seqlock_write_unlock(seqlock_t *sl) {
+    /* even sequence: data published */
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&sl->mx_write);
+}
+
+uint32_t seqlock_read_begin(const seqlock_t *sl) {
+    uint32_t seq;
+
+    /* wait for any writer to complete */
+    while (((seq = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1) != 0) {
+        /* writers hold the lock for a very short time, spin */
+    }
+
+    return seq;
+}
+
+bool seqlock_read_retry(const seqlock_t *sl, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return (__atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != seq);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,182 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : spectral monitoring engine
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <string.h>     /* memset, memcpy */
+
+#include "trace.h"
+#include "spectral.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* RSSI level below which pct percent of the points are, bin 32 holds the points below the lowest level */
+static int16_t hist_percentile(const uint16_t hist[SPECTRAL_BIN_NB], const int16_t levels[SPECTRAL_BIN_NB], unsigned int pct) {
+    uint32_t total = 0;
+    uint32_t cumul = 0;
+    int i;
+
+    for (i = 0; i < SPECTRAL_BIN_NB; i++) {
+        total += hist[i];
+    }
+    for (i = SPECTRAL_BIN_NB - 1; i > 0; i--) {
+        cumul += hist[i];
+        if ((cumul * 100) >= (total * pct)) {
+            break;
+        }
+    }
+    return levels[i];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* fraction of the points above the threshold, 0 to SPECTRAL_ONE */
+static uint16_t hist_occupancy(const uint16_t hist[SPECTRAL_BIN_NB], const int16_t levels[SPECTRAL_BIN_NB], int16_t threshold_dbm) {
+    uint32_t total = 0;
+    uint32_t above = 0;
+    int i;
+
+    for (i = 0; i < SPECTRAL_BIN_NB; i++) {
+        total += hist[i];
+        if ((i < (SPECTRAL_BIN_NB - 1)) && (levels[i] >= threshold_dbm)) {
+            above += hist[i];
+        }
+    }
+    if (total == 0) {
+        return 0;
+    }
+    return (uint16_t)(((uint64_t)above * SPECTRAL_ONE + (total / 2)) / total);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int spectral_engine_init(struct spectral_engine_s *se, uint32_t freq_hz_start, uint8_t nb_chan, int16_t threshold_dbm) {
+    if ((nb_chan == 0) || (nb_chan > SPECTRAL_CHAN_NB_MAX)) {
+        MSG("ERROR: spectral monitoring supports 1 to %u channels\n", SPECTRAL_CHAN_NB_MAX);
+        return -1;
+    }
+
+    memset(se, 0, sizeof *se);
+    se->freq_hz_start = freq_hz_start;
+    se->nb_chan = nb_chan;
+    se->threshold_dbm = threshold_dbm;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int spectral_engine_update(struct spectral_engine_s *se, uint32_t freq_hz, const int16_t levels[SPECTRAL_BIN_NB], const uint16_t results[SPECTRAL_BIN_NB]) {
+    struct spectral_chan_s *ch;
+    struct spectral_trend_s *tr;
+    uint16_t scan[SPECTRAL_BIN_NB];
+    uint32_t total = 0;
+    uint32_t idx;
+    int i;
+
+    /* find the channel */
+    if ((freq_hz < se->freq_hz_start) || (((freq_hz - se->freq_hz_start) % SPECTRAL_CHAN_STEP_HZ) != 0)) {
+        return -1;
+    }
+    idx = (freq_hz - se->freq_hz_start) / SPECTRAL_CHAN_STEP_HZ;
+    if (idx >= se->nb_chan) {
+        return -1;
+    }
+    ch = &(se->chan[idx]);
+
+    /* normalize the scan, so that scans of different lengths have the same weight */
+    for (i = 0; i < SPECTRAL_BIN_NB; i++) {
+        total += results[i];
+    }
+    if (total == 0) {
+        return -1;
+    }
+    for (i = 0; i < SPECTRAL_BIN_NB; i++) {
+        scan[i] = (uint16_t)(((uint32_t)results[i] * SPECTRAL_ONE + (total / 2)) / total);
+    }
+
+    /* the levels only depend on the RSSI offset of the radio */
+    if ((se->levels_ok == false) || (memcmp(se->levels, levels, sizeof se->levels) != 0)) {
+        memcpy(se->levels, levels, sizeof se->levels);
+        se->levels_ok = true;
+    }
+
+    /* rolling histogram */
+    if (ch->nb_scan == 0) {
+        memcpy(ch->hist, scan, sizeof ch->hist);
+    } else {
+        for (i = 0; i < SPECTRAL_BIN_NB; i++) {
+            ch->hist[i] = (uint16_t)(((uint32_t)ch->hist[i] * (SPECTRAL_AVG_NB - 1) + scan[i] + (SPECTRAL_AVG_NB / 2)) / SPECTRAL_AVG_NB);
+        }
+    }
+    ch->nb_scan += 1;
+
+    /* summary of this scan, in the trend ring */
+    tr = &(ch->trend[ch->trend_idx]);
+    tr->nf_dbm = hist_percentile(scan, se->levels, SPECTRAL_NOISE_FLOOR_PCT);
+    tr->high_dbm = hist_percentile(scan, se->levels, SPECTRAL_HIGH_PCT);
+    tr->occ = hist_occupancy(scan, se->levels, se->threshold_dbm);
+    ch->trend_idx = (ch->trend_idx + 1) % SPECTRAL_TREND_NB;
+
+    return (int)idx;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool spectral_engine_summary(const struct spectral_engine_s *se, uint8_t chan, struct spectral_summary_s *summary) {
+    const struct spectral_chan_s *ch;
+    unsigned int nb_trend;
+    unsigned int k;
+
+    memset(summary, 0, sizeof *summary);
+    if (chan >= se->nb_chan) {
+        return false;
+    }
+    ch = &(se->chan[chan]);
+    summary->freq_hz = se->freq_hz_start + (uint32_t)chan * SPECTRAL_CHAN_STEP_HZ;
+    summary->nb_scan = ch->nb_scan;
+    if (ch->nb_scan == 0) {
+        return false;
+    }
+
+    summary->nf_dbm = hist_percentile(ch->hist, se->levels, SPECTRAL_NOISE_FLOOR_PCT);
+    summary->med_dbm = hist_percentile(ch->hist, se->levels, 50);
+    summary->high_dbm = hist_percentile(ch->hist, se->levels, SPECTRAL_HIGH_PCT);
+    summary->occ = hist_occupancy(ch->hist, se->levels, se->threshold_dbm);
+
+    nb_trend = (ch->nb_scan < SPECTRAL_TREND_NB) ? ch->nb_scan : SPECTRAL_TREND_NB;
+    summary->nf_min_dbm = ch->trend[0].nf_dbm;
+    summary->nf_max_dbm = ch->trend[0].nf_dbm;
+    for (k = 0; k < nb_trend; k++) {
+        if (ch->trend[k].occ > summary->occ_max) {
+            summary->occ_max = ch->trend[k].occ;
+        }
+        if (ch->trend[k].nf_dbm < summary->nf_min_dbm) {
+            summary->nf_min_dbm = ch->trend[k].nf_dbm;
+        }
+        if (ch->trend[k].nf_dbm > summary->nf_max_dbm) {
+            summary->nf_max_dbm = ch->trend[k].nf_dbm;
+        }
+    }
+
+    return true;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
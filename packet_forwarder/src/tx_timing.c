@@ -0,0 +1,67 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    LoRa concentrator : downlink timing
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <string.h>     /* memset */
+
+#include "tx_timing.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void tx_timing_reset(struct tx_timing_s *tx) {
+    memset(tx, 0, sizeof *tx);
+    tx->slack_min_us = INT32_MAX;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void tx_timing_update(struct tx_timing_s *tx, int32_t start_delay_us, int32_t jit_us, int32_t slack_us, uint32_t send_us) {
+    tx->nb_tx += 1;
+    if (slack_us < 0) {
+        tx->nb_miss += 1;
+    }
+    if (jit_us < start_delay_us) {
+        tx->nb_jit_miss += 1;
+    }
+    if (slack_us < tx->slack_min_us) {
+        tx->slack_min_us = slack_us;
+    }
+    tx->slack_sum_us += slack_us;
+    if (send_us > tx->send_max_us) {
+        tx->send_max_us = send_us;
+    }
+    tx->send_sum_us += send_us;
+    tx->jit_hist[tx_timing_bin(jit_us)] += 1;
+    tx->slack_hist[tx_timing_bin(slack_us)] += 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+unsigned int tx_timing_bin(int32_t us) {
+    static const int32_t edges[TX_TIMING_BIN_NB - 1] = TX_TIMING_BIN_US;
+    unsigned int i;
+
+    for (i = 0; i < (TX_TIMING_BIN_NB - 1); i++) {
+        if (us < edges[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,207 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Check that the beacon engine gives the same beacons as the previous
+    per-beacon build in thread_down, for all beacon datarates, with and
+    without frequency hopping, while the time reference changes every second.
+    The time spent in the downlink thread per beacon is reported for both.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* rand */
+#include <string.h>     /* memcmp */
+#include <time.h>       /* clock_gettime */
+
+#include "beacon.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_BEACON   100000
+#define PERIOD      128
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static double diff_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint16_t crc16(const uint8_t * data, unsigned size) {
+    uint16_t x = 0;
+    unsigned i, j;
+
+    for (i=0; i<size; ++i) {
+        x ^= (uint16_t)data[i] << 8;
+        for (j=0; j<8; ++j) {
+            x = (x & 0x8000) ? (x<<1) ^ 0x1021 : (x<<1);
+        }
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* previous thread_down code: gateway part built once, time dependent part built for each beacon */
+static void ref_beacon_init(struct lgw_pkt_tx_s *pkt, const struct beacon_conf_s *conf, size_t *rfu1) {
+    size_t rfu2 = 0;
+    uint8_t idx = 0;
+    int32_t lat, lon;
+    uint16_t crc2;
+    size_t i;
+
+    memset(pkt, 0, sizeof *pkt);
+    pkt->tx_mode = ON_GPS;
+    pkt->rf_power = conf->power;
+    pkt->modulation = MOD_LORA;
+    pkt->bandwidth = (conf->bw_hz == 500000) ? BW_500KHZ : BW_125KHZ;
+    switch (conf->datarate) {
+        case 8:  pkt->datarate = DR_LORA_SF8;  *rfu1 = 1; rfu2 = 3; break;
+        case 9:  pkt->datarate = DR_LORA_SF9;  *rfu1 = 2; rfu2 = 0; break;
+        case 10: pkt->datarate = DR_LORA_SF10; *rfu1 = 3; rfu2 = 1; break;
+        default: pkt->datarate = DR_LORA_SF12; *rfu1 = 5; rfu2 = 3; break;
+    }
+    pkt->size = *rfu1 + 4 + 2 + 7 + rfu2 + 2;
+    pkt->coderate = CR_LORA_4_5;
+    pkt->preamble = 10;
+    pkt->no_crc = true;
+    pkt->no_header = true;
+
+    idx = *rfu1 + 6;
+    lat = (int32_t)((conf->coord.lat / 90.0) * (double)(1<<23));
+    lat = (lat > 0x007FFFFF) ? 0x007FFFFF : lat;
+    lon = (int32_t)((conf->coord.lon / 180.0) * (double)(1<<23));
+    lon = (lon > 0x007FFFFF) ? 0x007FFFFF : lon;
+    pkt->payload[idx++] = conf->infodesc;
+    pkt->payload[idx++] = 0xFF &  lat;
+    pkt->payload[idx++] = 0xFF & (lat >>  8);
+    pkt->payload[idx++] = 0xFF & (lat >> 16);
+    pkt->payload[idx++] = 0xFF &  lon;
+    pkt->payload[idx++] = 0xFF & (lon >>  8);
+    pkt->payload[idx++] = 0xFF & (lon >> 16);
+    for (i = 0; i < rfu2; i++) {
+        pkt->payload[idx++] = 0x0;
+    }
+    crc2 = crc16((pkt->payload + 6 + *rfu1), 7 + rfu2);
+    pkt->payload[idx++] = 0xFF &  crc2;
+    pkt->payload[idx++] = 0xFF & (crc2 >> 8);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void ref_beacon_build(struct lgw_pkt_tx_s *pkt, const struct beacon_conf_s *conf, size_t rfu1, const struct tref *ref, time_t gps_sec) {
+    struct timespec t = { gps_sec, 0 };
+    uint8_t chan, idx;
+    uint16_t crc1;
+
+    lgw_gps2cnt(*ref, t, &(pkt->count_us));
+    chan = (conf->freq_nb > 1) ? ((gps_sec / conf->period) % conf->freq_nb) : 0;
+    pkt->freq_hz = conf->freq_hz + (chan * conf->freq_step);
+    idx = rfu1;
+    pkt->payload[idx++] = 0xFF &  gps_sec;
+    pkt->payload[idx++] = 0xFF & (gps_sec >>  8);
+    pkt->payload[idx++] = 0xFF & (gps_sec >> 16);
+    pkt->payload[idx++] = 0xFF & (gps_sec >> 24);
+    crc1 = crc16(pkt->payload, 4 + rfu1);
+    pkt->payload[idx++] = 0xFF & crc1;
+    pkt->payload[idx++] = 0xFF & (crc1 >> 8);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+    static const uint8_t sf_list[4] = { 8, 9, 10, 12 };
+    static const uint8_t freq_nb_list[2] = { 1, 8 };
+    struct beacon_conf_s conf;
+    struct beacon_engine_s be;
+    struct lgw_pkt_tx_s ref_pkt, eng_pkt;
+    struct tref ref;
+    struct timespec start, end;
+    double t_ref, t_eng;
+    size_t rfu1;
+    time_t gps_sec;
+    unsigned int s, f, n;
+    unsigned long nb_diff = 0;
+
+    memset(&conf, 0, sizeof conf);
+    conf.period = PERIOD;
+    conf.freq_hz = 869525000;
+    conf.freq_step = 200000;
+    conf.bw_hz = 125000;
+    conf.power = 14;
+    conf.infodesc = 0;
+    conf.coord.lat = 45.18;
+    conf.coord.lon = 5.72;
+
+    printf("SF | channels | previous (ns/beacon) | engine (ns/beacon) | different\n");
+    for (s = 0; s < sizeof sf_list; s++) {
+        for (f = 0; f < sizeof freq_nb_list; f++) {
+            conf.datarate = sf_list[s];
+            conf.freq_nb = freq_nb_list[f];
+            if (beacon_engine_init(&be, &conf) != 0) {
+                return EXIT_FAILURE;
+            }
+            ref_beacon_init(&ref_pkt, &conf, &rfu1);
+
+            /* time reference updated every second, one beacon every period */
+            memset(&ref, 0, sizeof ref);
+            ref.xtal_err = 1.0 + 2E-6;
+            ref.gps.tv_sec = 1300000000 - (1300000000 % PERIOD);
+            t_ref = 0.0;
+            t_eng = 0.0;
+            for (n = 0; n < NB_BEACON; n++) {
+                ref.gps.tv_sec += PERIOD;
+                ref.count_us += (uint32_t)(PERIOD * 1000000 * ref.xtal_err);
+                ref.systime = ref.gps.tv_sec;
+                gps_sec = ref.gps.tv_sec + PERIOD;
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                ref_beacon_build(&ref_pkt, &conf, rfu1, &ref, gps_sec);
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                t_ref += diff_s(&start, &end);
+
+                /* the engine follows the time reference while the downlink thread is idle */
+                beacon_engine_refresh(&be, &ref);
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                eng_pkt = *beacon_engine_get(&be, gps_sec, &ref);
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                t_eng += diff_s(&start, &end);
+
+                if ((eng_pkt.count_us != ref_pkt.count_us) || (eng_pkt.freq_hz != ref_pkt.freq_hz) || (eng_pkt.size != ref_pkt.size) || (memcmp(eng_pkt.payload, ref_pkt.payload, ref_pkt.size) != 0)) {
+                    nb_diff += 1;
+                }
+            }
+            printf("%2u | %8u | %20.1f | %18.1f | %lu\n", conf.datarate, conf.freq_nb, t_ref * 1e9 / NB_BEACON, t_eng * 1e9 / NB_BEACON, nb_diff);
+        }
+    }
+
+    printf("=========== Test End ===========\n");
+
+    return (nb_diff == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
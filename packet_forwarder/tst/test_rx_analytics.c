@@ -0,0 +1,205 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Feed the RX analytics with synthetic packets: a busy multi-SF channel with
+    a spread of RSSI and SNR, a quiet channel and a FSK channel. The rates,
+    occupancy and quantiles reported are checked, as well as the wrapping of
+    the RX losses counters, and the time spent per packet is reported.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* rand */
+#include <string.h>     /* memset */
+#include <time.h>       /* clock_gettime */
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "analytics.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define INTERVAL_MS     30000
+#define NB_PKT_BUSY     3000        /* on IF0, SF7 to SF12 */
+#define NB_PKT_QUIET    10          /* on IF3, SF9 */
+#define NB_PKT_FSK      100         /* on IF9, 50 kbps */
+#define PAYLOAD_SIZE    20
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static double diff_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void make_pkt(struct lgw_pkt_rx_s *pkt, uint8_t if_chain, uint8_t modulation, uint32_t datarate, float rssi, float snr) {
+    memset(pkt, 0, sizeof *pkt);
+    pkt->freq_hz = 867100000 + if_chain * 200000;
+    pkt->if_chain = if_chain;
+    pkt->status = STAT_CRC_OK;
+    pkt->modulation = modulation;
+    pkt->bandwidth = BW_125KHZ;
+    pkt->datarate = datarate;
+    pkt->coderate = CR_LORA_4_5;
+    pkt->rssic = rssi;
+    pkt->snr = snr;
+    pkt->size = PAYLOAD_SIZE;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+    static struct analytics_s an;
+    struct analytics_loss_s ls;
+    struct lgw_rx_stats_s rx_stats;
+    struct analytics_summary_s sum;
+    struct lgw_pkt_rx_s pkt;
+    struct timespec start, end;
+    double t_update = 0.0;
+    uint64_t airtime_us = 0;
+    float occ;
+    unsigned int n;
+    int nb_err = 0;
+
+    srand(1);
+    analytics_reset(&an);
+    memset(&ls, 0, sizeof ls);
+
+    /* busy channel: RSSI uniform in [-120,-60[ dBm, SNR uniform in [-15,5[ dB */
+    for (n = 0; n < NB_PKT_BUSY; n++) {
+        make_pkt(&pkt, 0, MOD_LORA, DR_LORA_SF7 + (n % 6), -120.0 + (float)(rand() % 600) / 10, -15.0 + (float)(rand() % 200) / 10);
+        if ((n % 10) == 0) {
+            pkt.status = STAT_CRC_BAD;
+        }
+        airtime_us += lora_packet_time_on_air(BW_125KHZ, DR_LORA_SF7 + (n % 6), CR_LORA_4_5, ANALYTICS_PREAMBLE_NB, false, false, PAYLOAD_SIZE, NULL, NULL, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        analytics_update(&an, &pkt);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        t_update += diff_s(&start, &end);
+    }
+    for (n = 0; n < NB_PKT_QUIET; n++) {
+        make_pkt(&pkt, 3, MOD_LORA, DR_LORA_SF9, -110.5, -3.5);
+        analytics_update(&an, &pkt);
+    }
+    for (n = 0; n < NB_PKT_FSK; n++) {
+        make_pkt(&pkt, 9, MOD_FSK, 50000, -90.0, 0.0);
+        analytics_update(&an, &pkt);
+    }
+
+    /* packets with an unknown IF chain or datarate are ignored */
+    make_pkt(&pkt, LGW_IF_CHAIN_NB, MOD_LORA, DR_LORA_SF7, -100.0, 0.0);
+    analytics_update(&an, &pkt);
+    make_pkt(&pkt, 1, MOD_LORA, 13, -100.0, 0.0);
+    analytics_update(&an, &pkt);
+    if (analytics_summary(&an, NULL, 1, INTERVAL_MS, &sum) == true) {
+        printf("ERROR: invalid packet was aggregated\n");
+        nb_err += 1;
+    }
+
+    /* RX losses: 250 detections on IF0 across a wrap of the counters, 200 allocated, 3 packets lost */
+    memset(&rx_stats, 0, sizeof rx_stats);
+    rx_stats.nb_detect[0] = 0xFFFFFFF0;
+    rx_stats.nb_alloc[0] = 0xFFFFFF00;
+    rx_stats.nb_pkt_lost = 10;
+    analytics_loss_update(&ls, &rx_stats); /* reference */
+    rx_stats.nb_detect[0] += 100;
+    rx_stats.nb_alloc[0] += 80;
+    rx_stats.nb_pkt_lost += 1;
+    analytics_loss_update(&ls, &rx_stats);
+    rx_stats.nb_detect[0] += 150;
+    rx_stats.nb_alloc[0] += 120;
+    rx_stats.nb_pkt_lost += 2;
+    analytics_loss_update(&ls, &rx_stats);
+    if (ls.delta.nb_pkt_lost != 3) {
+        printf("ERROR: wrong number of packets lost\n");
+        nb_err += 1;
+    }
+
+    printf("IF | freq      | pkt  | CRC_OK | pkt/s  | occ (%%) | RSSI p10/p50/p90 | SNR p10/p50/p90 | demod\n");
+    for (n = 0; n < LGW_IF_CHAIN_NB; n++) {
+        if (analytics_summary(&an, &ls, n, INTERVAL_MS, &sum) == false) {
+            continue;
+        }
+        printf("%2u | %u | %4u | %6u | %6.2f | %7.2f | %4d/%4d/%4d | %3d/%3d/%3d | %u/%u\n", n, sum.freq_hz, sum.nb_pkt, sum.nb_crc_ok, sum.rate, sum.occ,
+                sum.rssi[0], sum.rssi[1], sum.rssi[2], sum.snr[0], sum.snr[1], sum.snr[2], sum.nb_alloc, sum.nb_detect);
+
+        switch (n) {
+            case 0:
+                occ = (float)((double)airtime_us / (INTERVAL_MS * 10.0));
+                if ((sum.nb_pkt != NB_PKT_BUSY) || (sum.nb_crc_ok != (NB_PKT_BUSY - NB_PKT_BUSY / 10)) || (sum.nb_sf != 6) ||
+                    (sum.occ < (occ - 0.01)) || (sum.occ > (occ + 0.01))) {
+                    printf("ERROR: wrong counters or occupancy on IF0 (expected %.2f%%)\n", occ);
+                    nb_err += 1;
+                }
+                if ((sum.rssi[0] != -114) || (sum.rssi[1] != -90) || (sum.rssi[2] != -66)) {
+                    printf("ERROR: wrong RSSI quantiles on IF0\n");
+                    nb_err += 1;
+                }
+                if ((sum.snr[0] < -14) || (sum.snr[0] > -12) || (sum.snr[1] < -6) || (sum.snr[1] > -4) || (sum.snr[2] < 2) || (sum.snr[2] > 4)) {
+                    printf("ERROR: wrong SNR quantiles on IF0\n");
+                    nb_err += 1;
+                }
+                if ((sum.demod_ok == false) || (sum.nb_detect != 250) || (sum.nb_alloc != 200)) {
+                    printf("ERROR: wrong demodulator counters on IF0\n");
+                    nb_err += 1;
+                }
+                break;
+            case 3:
+                if ((sum.nb_pkt != NB_PKT_QUIET) || (sum.nb_sf != 1) || (sum.sf[0].sf != 9) || (sum.rssi[1] != -112) || (sum.snr[1] != -4) || (sum.nb_detect != 0)) {
+                    printf("ERROR: wrong statistics on IF3\n");
+                    nb_err += 1;
+                }
+                break;
+            case 9:
+                /* 31 bytes at 50 kbps: 4960 us per packet */
+                if ((sum.nb_pkt != NB_PKT_FSK) || (sum.sf[0].sf != 0) || (sum.demod_ok == true) || (sum.occ < 1.65) || (sum.occ > 1.66)) {
+                    printf("ERROR: wrong statistics on IF9\n");
+                    nb_err += 1;
+                }
+                break;
+            default:
+                printf("ERROR: unexpected statistics on IF%u\n", n);
+                nb_err += 1;
+                break;
+        }
+    }
+
+    analytics_loss_reset(&ls);
+    analytics_reset(&an);
+    if (analytics_summary(&an, &ls, 0, INTERVAL_MS, &sum) == true) {
+        printf("ERROR: statistics not cleared\n");
+        nb_err += 1;
+    }
+
+    printf("aggregation: %.1f ns/packet, %u bytes of state\n", t_update * 1e9 / NB_PKT_BUSY, (unsigned int)(sizeof an + sizeof ls));
+    printf("errors: %d\n", nb_err);
+    printf("=========== Test End ===========\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,320 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Contention benchmark of the GPS time reference / XTAL correction publication,
+    mutex versus sequence lock, with threads mimicking the packet forwarder ones:
+    - "gps" and "valid" writers, updating the data at a given rate
+    - "up", "down" and "jit" readers, copying the data in a loop with some synthetic load
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "loragw_gps.h"
+#include "seqlock.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_DURATION_S      2
+#define DEFAULT_WRITE_PERIOD_US 1000    /* much faster than the forwarder (1s), to stress the readers */
+#define DEFAULT_LOAD            200     /* synthetic work between 2 reads */
+
+enum mode_e {
+    MODE_MUTEX,
+    MODE_SEQLOCK
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct reader_s {
+    const char * name;
+    pthread_t thread;
+    uint64_t nb_read;
+    uint64_t nb_retry;
+    uint64_t max_latency_ns;
+    double sum_latency_ns;
+    double check; /* prevents the compiler from optimizing the copies away */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static volatile bool quit;
+static enum mode_e mode;
+static unsigned write_period_us = DEFAULT_WRITE_PERIOD_US;
+static unsigned load = DEFAULT_LOAD;
+
+/* shared data, as in lora_pkt_fwd.c */
+static pthread_mutex_t mx_timeref = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t mx_xcorr = PTHREAD_MUTEX_INITIALIZER;
+static seqlock_t sl_timeref = SEQLOCK_INITIALIZER;
+static seqlock_t sl_xcorr = SEQLOCK_INITIALIZER;
+static bool gps_ref_valid;
+static struct tref time_reference_gps;
+static bool xtal_correct_ok;
+static double xtal_correct = 1.0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void * thread_gps(void * arg) {
+    uint32_t cnt = 0;
+
+    (void)arg;
+    while (!quit) {
+        cnt += 1000000;
+        if (mode == MODE_MUTEX) {
+            pthread_mutex_lock(&mx_timeref);
+        } else {
+            seqlock_write_lock(&sl_timeref);
+        }
+        time_reference_gps.systime = time(NULL);
+        time_reference_gps.count_us = cnt;
+        time_reference_gps.utc.tv_sec += 1;
+        time_reference_gps.gps.tv_sec += 1;
+        time_reference_gps.xtal_err = 1.0 + (double)(cnt % 7) * 1e-7;
+        if (mode == MODE_MUTEX) {
+            pthread_mutex_unlock(&mx_timeref);
+        } else {
+            seqlock_write_unlock(&sl_timeref);
+        }
+        usleep(write_period_us);
+    }
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void * thread_valid(void * arg) {
+    double xtal_err_cpy;
+
+    (void)arg;
+    while (!quit) {
+        if (mode == MODE_MUTEX) {
+            pthread_mutex_lock(&mx_timeref);
+            gps_ref_valid = true;
+            xtal_err_cpy = time_reference_gps.xtal_err;
+            pthread_mutex_unlock(&mx_timeref);
+            pthread_mutex_lock(&mx_xcorr);
+            xtal_correct = xtal_correct - xtal_correct / 256 + (1 / xtal_err_cpy) / 256;
+            xtal_correct_ok = true;
+            pthread_mutex_unlock(&mx_xcorr);
+        } else {
+            seqlock_write_lock(&sl_timeref);
+            gps_ref_valid = true;
+            xtal_err_cpy = time_reference_gps.xtal_err;
+            seqlock_write_unlock(&sl_timeref);
+            seqlock_write_lock(&sl_xcorr);
+            xtal_correct = xtal_correct - xtal_correct / 256 + (1 / xtal_err_cpy) / 256;
+            xtal_correct_ok = true;
+            seqlock_write_unlock(&sl_xcorr);
+        }
+        usleep(write_period_us);
+    }
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void * thread_reader(void * arg) {
+    struct reader_s * r = (struct reader_s *)arg;
+    struct tref local_ref;
+    bool ref_ok, xtal_ok;
+    double xtal;
+    uint32_t seq;
+    uint64_t t0, dt;
+    volatile unsigned i;
+
+    while (!quit) {
+        t0 = now_ns();
+        if (mode == MODE_MUTEX) {
+            pthread_mutex_lock(&mx_timeref);
+            ref_ok = gps_ref_valid;
+            local_ref = time_reference_gps;
+            pthread_mutex_unlock(&mx_timeref);
+            pthread_mutex_lock(&mx_xcorr);
+            xtal_ok = xtal_correct_ok;
+            xtal = xtal_correct;
+            pthread_mutex_unlock(&mx_xcorr);
+        } else {
+            seq = seqlock_read_begin(&sl_timeref);
+            ref_ok = gps_ref_valid;
+            local_ref = time_reference_gps;
+            while (seqlock_read_retry(&sl_timeref, seq)) {
+                r->nb_retry += 1;
+                seq = seqlock_read_begin(&sl_timeref);
+                ref_ok = gps_ref_valid;
+                local_ref = time_reference_gps;
+            }
+            do {
+                seq = seqlock_read_begin(&sl_xcorr);
+                xtal_ok = xtal_correct_ok;
+                xtal = xtal_correct;
+            } while (seqlock_read_retry(&sl_xcorr, seq));
+        }
+        dt = now_ns() - t0;
+
+        r->nb_read += 1;
+        r->sum_latency_ns += (double)dt;
+        if (dt > r->max_latency_ns) {
+            r->max_latency_ns = dt;
+        }
+        r->check += (ref_ok && xtal_ok) ? (local_ref.xtal_err * xtal) : 0.0;
+
+        /* synthetic load (packet processing...) */
+        for (i = 0; i < load; i++);
+    }
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void run(enum mode_e m, unsigned duration_s) {
+    struct reader_s readers[] = {
+        { .name = "up" },
+        { .name = "down" },
+        { .name = "jit" }
+    };
+    pthread_t thrid_gps, thrid_valid;
+    unsigned i;
+
+    mode = m;
+    quit = false;
+
+    pthread_create(&thrid_gps, NULL, thread_gps, NULL);
+    pthread_create(&thrid_valid, NULL, thread_valid, NULL);
+    for (i = 0; i < ARRAY_SIZE(readers); i++) {
+        pthread_create(&readers[i].thread, NULL, thread_reader, &readers[i]);
+    }
+
+    sleep(duration_s);
+    quit = true;
+
+    pthread_join(thrid_gps, NULL);
+    pthread_join(thrid_valid, NULL);
+    for (i = 0; i < ARRAY_SIZE(readers); i++) {
+        pthread_join(readers[i].thread, NULL);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(readers); i++) {
+        printf("%-8s %-5s: %10.0f reads/s, mean %7.1f ns, max %9.1f us, retries %llu\n",
+                (m == MODE_MUTEX) ? "mutex" : "seqlock",
+                readers[i].name,
+                (double)readers[i].nb_read / duration_s,
+                readers[i].sum_latency_ns / (double)readers[i].nb_read,
+                (double)readers[i].max_latency_ns / 1e3,
+                (unsigned long long)readers[i].nb_retry);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -t <uint> duration of each run, in seconds\n");
+    printf(" -w <uint> writers update period, in microseconds\n");
+    printf(" -l <uint> readers synthetic load (loop iterations between 2 reads)\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i;
+    unsigned int arg_u;
+    unsigned int duration_s = DEFAULT_DURATION_S;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "ht:w:l:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 't':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -t argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                duration_s = arg_u;
+                break;
+            case 'w':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -w argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                write_period_us = arg_u;
+                break;
+            case 'l':
+                if (sscanf(optarg, "%u", &arg_u) != 1) {
+                    printf("ERROR: argument parsing of -l argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                load = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    printf("===== GPS time reference publication contention benchmark =====\n");
+    printf("duration: %us per mode, writers period: %uus, readers load: %u\n", duration_s, write_period_us, load);
+
+    run(MODE_MUTEX, duration_s);
+    run(MODE_SEQLOCK, duration_s);
+
+    printf("=========== Test End ===========\n");
+
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,158 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Feed the spectral monitoring engine with synthetic scans: a quiet channel,
+    a channel with a raised noise floor and a channel with an interferer which
+    stops after a while. The noise floor and occupancy reported are checked,
+    and the time spent per aggregated scan is reported.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* rand */
+#include <string.h>     /* memset */
+#include <time.h>       /* clock_gettime */
+
+#include "spectral.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define FREQ_START      867100000
+#define NB_CHAN         3
+#define NB_POINTS       2000
+#define NB_ROUND        200         /* each channel is scanned NB_ROUND times */
+#define INTERF_STOP     150         /* round at which the interferer stops */
+#define RSSI_OFFSET     0
+#define THRESHOLD_DBM   -90
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static double diff_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* same bins as sx1261_spectral_scan_get_results: noise spread around nf_bin, interferer in one bin */
+static void make_scan(int16_t *levels, uint16_t *results, int nf_bin, int interf_bin, unsigned int interf_pct) {
+    unsigned int n, b;
+    int r;
+
+    for (b = 0; b < SPECTRAL_BIN_NB - 1; b++) {
+        levels[b] = -(int16_t)b * 4 + RSSI_OFFSET;
+    }
+    levels[SPECTRAL_BIN_NB - 1] = levels[SPECTRAL_BIN_NB - 2];
+    memset(results, 0, SPECTRAL_BIN_NB * sizeof results[0]);
+
+    for (n = 0; n < NB_POINTS; n++) {
+        if ((interf_bin >= 0) && ((unsigned int)(rand() % 100) < interf_pct)) {
+            results[interf_bin] += 1;
+            continue;
+        }
+        r = rand() % 10; /* 20% one bin below, 60% on the floor, 20% one bin above */
+        b = nf_bin + ((r < 2) ? 1 : ((r < 8) ? 0 : -1));
+        results[b] += 1;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+    struct spectral_engine_s se;
+    struct spectral_summary_s sum[NB_CHAN];
+    int16_t levels[SPECTRAL_BIN_NB];
+    uint16_t results[SPECTRAL_BIN_NB];
+    struct timespec start, end;
+    double t_update = 0.0;
+    unsigned int r, c;
+    int nb_err = 0;
+
+    srand(1);
+    if (spectral_engine_init(&se, FREQ_START, NB_CHAN, THRESHOLD_DBM) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    /* frequencies outside of the monitored channels are ignored */
+    make_scan(levels, results, 29, -1, 0);
+    if ((spectral_engine_update(&se, FREQ_START - SPECTRAL_CHAN_STEP_HZ, levels, results) != -1) ||
+        (spectral_engine_update(&se, FREQ_START + 100000, levels, results) != -1) ||
+        (spectral_engine_update(&se, FREQ_START + NB_CHAN * SPECTRAL_CHAN_STEP_HZ, levels, results) != -1)) {
+        printf("ERROR: scan of a channel not monitored was aggregated\n");
+        nb_err += 1;
+    }
+
+    for (r = 0; r < NB_ROUND; r++) {
+        for (c = 0; c < NB_CHAN; c++) {
+            switch (c) {
+                case 0: make_scan(levels, results, 29, -1, 0); break; /* quiet, -116 dBm */
+                case 1: make_scan(levels, results, 26, -1, 0); break; /* raised floor, -104 dBm */
+                default: make_scan(levels, results, 29, 20, (r < INTERF_STOP) ? 30 : 0); break; /* 30% at -80 dBm */
+            }
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (spectral_engine_update(&se, FREQ_START + c * SPECTRAL_CHAN_STEP_HZ, levels, results) != (int)c) {
+                nb_err += 1;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            t_update += diff_s(&start, &end);
+        }
+
+        if (r == (INTERF_STOP - 1)) {
+            spectral_engine_summary(&se, 2, &sum[2]);
+            printf("interferer on: occupancy %.1f%%, p%d %d dBm\n", 100.0 * sum[2].occ / SPECTRAL_ONE, SPECTRAL_HIGH_PCT, sum[2].high_dbm);
+            if ((sum[2].occ < (SPECTRAL_ONE / 4)) || (sum[2].occ > (SPECTRAL_ONE / 100 * 35)) || (sum[2].high_dbm != -80)) {
+                nb_err += 1;
+            }
+        }
+    }
+
+    printf("channel   | scans | noise floor | median | p%d | occupancy | max occupancy\n", SPECTRAL_HIGH_PCT);
+    for (c = 0; c < NB_CHAN; c++) {
+        if (spectral_engine_summary(&se, c, &sum[c]) == false) {
+            nb_err += 1;
+            continue;
+        }
+        printf("%u | %5u | %4d (%4d..%4d) | %6d | %3d | %8.1f%% | %12.1f%%\n", sum[c].freq_hz, sum[c].nb_scan, sum[c].nf_dbm, sum[c].nf_min_dbm, sum[c].nf_max_dbm, sum[c].med_dbm, sum[c].high_dbm, 100.0 * sum[c].occ / SPECTRAL_ONE, 100.0 * sum[c].occ_max / SPECTRAL_ONE);
+    }
+
+    /* quiet channels, interferer gone from the rolling histogram but still in the trend ring */
+    if ((sum[0].nf_dbm != -120) || (sum[0].med_dbm != -116) || (sum[0].occ != 0)) {
+        nb_err += 1;
+    }
+    if ((sum[1].nf_dbm != -108) || (sum[1].med_dbm != -104) || (sum[1].occ != 0)) {
+        nb_err += 1;
+    }
+    if ((sum[2].nf_dbm != -120) || (sum[2].occ > (SPECTRAL_ONE / 100)) || (sum[2].occ_max != 0)) {
+        /* NB_ROUND - INTERF_STOP > SPECTRAL_TREND_NB, the interferer left the ring */
+        nb_err += 1;
+    }
+    printf("aggregation: %.1f ns/scan\n", t_update * 1e9 / (NB_ROUND * NB_CHAN));
+    printf("errors: %d\n", nb_err);
+    printf("=========== Test End ===========\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,305 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Uplink fetch latency benchmark, with the background spectral scan off, with
+    the SX1261 accessed under the concentrator lock (status polled every 10 ms),
+    and with the SX1261 in its own lock domain (status polled once the scan
+    should be completed). The SPI transactions are emulated by busy waits of
+    a configurable duration, the scan completes after its nominal duration.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_DURATION_S      3
+#define DEFAULT_FETCH_PERIOD_US 2000    /* busy gateway, the forwarder sleeps 10 ms only when no packet */
+#define DEFAULT_NB_SCAN         2000
+
+#define FETCH_US                400     /* RX buffer fetch */
+#define TX_STATUS_US            20      /* lgw_status, per RF chain */
+#define SCAN_START_US           250     /* sx1261_set_rx_params + start */
+#define SCAN_STATUS_US          20
+#define SCAN_RESULTS_US         150
+#define SCAN_PACE_MS            1       /* sub-second pacing, continuous scan */
+#define LEGACY_POLL_MS          10
+#define SPLIT_POLL_MS           2
+
+#define MAX_SAMPLES             100000
+
+enum mode_e {
+    MODE_OFF,
+    MODE_SHARED,
+    MODE_SPLIT
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static volatile bool quit;
+static enum mode_e mode;
+static unsigned fetch_period_us = DEFAULT_FETCH_PERIOD_US;
+static uint16_t nb_scan = DEFAULT_NB_SCAN;
+
+static pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t mx_sx1261_spi = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t *mx_sx1261;
+
+static uint64_t scan_end_ns; /* emulated SX1261 scan completion time */
+static unsigned long nb_scan_done;
+static unsigned long nb_status_poll;
+static uint64_t concent_hold_ns; /* time the scan thread holds the concentrator lock */
+
+static uint64_t fetch_wait_ns[MAX_SAMPLES];
+static unsigned long nb_fetch;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void bus_transfer(unsigned us) {
+    uint64_t end = now_ns() + (uint64_t)us * 1000;
+
+    while (now_ns() < end);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void * thread_up(void * arg) {
+    uint64_t t0;
+
+    (void)arg;
+    while (!quit) {
+        t0 = now_ns();
+        pthread_mutex_lock(&mx_concent);
+        if (nb_fetch < MAX_SAMPLES) {
+            fetch_wait_ns[nb_fetch++] = now_ns() - t0;
+        }
+        bus_transfer(FETCH_US);
+        pthread_mutex_unlock(&mx_concent);
+        usleep(fetch_period_us);
+    }
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* same sequence as thread_spectral_scan */
+static void * thread_spectral_scan(void * arg) {
+    uint32_t scan_duration_ms = (lgw_spectral_scan_duration_us(nb_scan) + 999) / 1000;
+    bool shared = (mx_sx1261 == &mx_concent);
+    bool done;
+    uint64_t t0;
+
+    (void)arg;
+    while (!quit) {
+        usleep(SCAN_PACE_MS * 1000);
+
+        /* TX status check, then scan start */
+        pthread_mutex_lock(&mx_concent);
+        t0 = now_ns();
+        bus_transfer(2 * TX_STATUS_US);
+        if (!shared) {
+            pthread_mutex_lock(mx_sx1261);
+            concent_hold_ns += now_ns() - t0;
+            pthread_mutex_unlock(&mx_concent);
+        }
+        bus_transfer(SCAN_START_US);
+        scan_end_ns = now_ns() + (uint64_t)lgw_spectral_scan_duration_us(nb_scan) * 1000;
+        if (shared) {
+            concent_hold_ns += now_ns() - t0;
+        }
+        pthread_mutex_unlock(mx_sx1261);
+
+        /* completion */
+        if (mode == MODE_SPLIT) {
+            usleep(scan_duration_ms * 1000);
+        }
+        do {
+            pthread_mutex_lock(mx_sx1261);
+            t0 = now_ns();
+            bus_transfer(SCAN_STATUS_US);
+            done = (now_ns() >= scan_end_ns);
+            if (shared) {
+                concent_hold_ns += now_ns() - t0;
+            }
+            pthread_mutex_unlock(mx_sx1261);
+            nb_status_poll += 1;
+            if (!done) {
+                usleep(((mode == MODE_SPLIT) ? SPLIT_POLL_MS : LEGACY_POLL_MS) * 1000);
+            }
+        } while (!done && !quit);
+
+        /* results */
+        pthread_mutex_lock(mx_sx1261);
+        t0 = now_ns();
+        bus_transfer(SCAN_RESULTS_US);
+        if (shared) {
+            concent_hold_ns += now_ns() - t0;
+        }
+        pthread_mutex_unlock(mx_sx1261);
+        nb_scan_done += 1;
+    }
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void run(enum mode_e m, unsigned duration_s) {
+    static const char * name[] = { "scan off", "shared lock", "own lock" };
+    pthread_t thrid_up, thrid_ss;
+    double sum = 0.0;
+    unsigned long i;
+
+    mode = m;
+    mx_sx1261 = (m == MODE_SPLIT) ? &mx_sx1261_spi : &mx_concent;
+    quit = false;
+    nb_fetch = 0;
+    nb_scan_done = 0;
+    nb_status_poll = 0;
+    concent_hold_ns = 0;
+
+    pthread_create(&thrid_up, NULL, thread_up, NULL);
+    if (m != MODE_OFF) {
+        pthread_create(&thrid_ss, NULL, thread_spectral_scan, NULL);
+    }
+
+    sleep(duration_s);
+    quit = true;
+
+    pthread_join(thrid_up, NULL);
+    if (m != MODE_OFF) {
+        pthread_join(thrid_ss, NULL);
+    }
+
+    for (i = 0; i < nb_fetch; i++) {
+        sum += (double)fetch_wait_ns[i];
+    }
+    qsort(fetch_wait_ns, nb_fetch, sizeof fetch_wait_ns[0], cmp_u64);
+    printf("%-11s | %7lu | %9.2f | %8.1f | %10.1f | %8.1f | %7.1f | %10.1f | %14.1f\n", name[m], nb_fetch,
+            sum / (double)nb_fetch / 1e3,
+            (double)fetch_wait_ns[(nb_fetch * 99) / 100] / 1e3,
+            (double)fetch_wait_ns[(nb_fetch * 999) / 1000] / 1e3,
+            (double)fetch_wait_ns[nb_fetch - 1] / 1e3,
+            (double)nb_scan_done / duration_s,
+            (nb_scan_done > 0) ? (double)nb_status_poll / nb_scan_done : 0.0,
+            (nb_scan_done > 0) ? (double)concent_hold_ns / nb_scan_done / 1e3 : 0.0);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h        print this help\n");
+    printf(" -t <uint> duration of each run, in seconds\n");
+    printf(" -p <uint> pause between 2 fetches, in microseconds\n");
+    printf(" -n <uint> number of scan points\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i;
+    unsigned int arg_u;
+    unsigned int duration_s = DEFAULT_DURATION_S;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "ht:p:n:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 't':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -t argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                duration_s = arg_u;
+                break;
+            case 'p':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -p argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                fetch_period_us = arg_u;
+                break;
+            case 'n':
+                if ((sscanf(optarg, "%u", &arg_u) != 1) || (arg_u < 1) || (arg_u > 65535)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_scan = (uint16_t)arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    printf("===== Uplink fetch latency with background spectral scan =====\n");
+    printf("duration: %us per mode, fetch every %uus, %u scan points (%u us estimated)\n", duration_s, fetch_period_us, nb_scan, lgw_spectral_scan_duration_us(nb_scan));
+    printf("SX1261 lock | fetches | wait (us) | p99 (us) | p99.9 (us) | max (us) | scans/s | polls/scan | lock/scan (us)\n");
+
+    run(MODE_OFF, duration_s);
+    run(MODE_SHARED, duration_s);
+    run(MODE_SPLIT, duration_s);
+
+    printf("=========== Test End ===========\n");
+
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
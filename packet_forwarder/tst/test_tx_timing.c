@@ -0,0 +1,102 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Check the downlink timing statistics: histogram bins at their edges, and
+    the counters, extremes and sums aggregated from a set of downlinks with
+    known timings.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_SUCCESS */
+
+#include "tx_timing.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define START_DELAY_US  1500
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+    /* time left, expected bin */
+    static const int32_t bin_us[][2] = {
+        {INT32_MIN, 0}, {-1, 0}, {0, 1}, {999, 1}, {1000, 2}, {1999, 2}, {2000, 3},
+        {19999, 5}, {20000, 6}, {49999, 8}, {50000, 9}, {INT32_MAX, 9}
+    };
+    /* jit_us, slack_us, send_us */
+    static const int32_t dn[][3] = {
+        {40000, 38000, 400},    /* on time */
+        {30000, 28200, 300},    /* on time */
+        {1200, -500, 200},      /* dequeued too late by the JiT thread, then missed */
+        {2500, -20, 2000}       /* dequeued in time, lgw_send too slow */
+    };
+    struct tx_timing_s tx;
+    unsigned int i, b, nb;
+    int nb_err = 0;
+
+    printf("===== Downlink timing statistics test =====\n");
+
+    for (i = 0; i < (sizeof bin_us / sizeof bin_us[0]); i++) {
+        b = tx_timing_bin(bin_us[i][0]);
+        if (b != (unsigned int)bin_us[i][1]) {
+            printf("ERROR: %d us in bin %u, expected %d\n", bin_us[i][0], b, bin_us[i][1]);
+            nb_err += 1;
+        }
+    }
+
+    tx_timing_reset(&tx);
+    for (i = 0; i < (sizeof dn / sizeof dn[0]); i++) {
+        tx_timing_update(&tx, START_DELAY_US, dn[i][0], dn[i][1], (uint32_t)dn[i][2]);
+    }
+    printf("nb:%u miss:%u jmis:%u slack min:%d sum:%lld send max:%u sum:%llu\n", tx.nb_tx, tx.nb_miss, tx.nb_jit_miss, tx.slack_min_us,
+            (long long)tx.slack_sum_us, tx.send_max_us, (unsigned long long)tx.send_sum_us);
+    if ((tx.nb_tx != 4) || (tx.nb_miss != 2) || (tx.nb_jit_miss != 1)) {
+        printf("ERROR: wrong counters\n");
+        nb_err += 1;
+    }
+    if ((tx.slack_min_us != -500) || (tx.slack_sum_us != 65680) || (tx.send_max_us != 2000) || (tx.send_sum_us != 2900)) {
+        printf("ERROR: wrong slack or lgw_send duration\n");
+        nb_err += 1;
+    }
+    if ((tx.jit_hist[2] != 1) || (tx.jit_hist[3] != 1) || (tx.jit_hist[7] != 1) || (tx.jit_hist[8] != 1) ||
+        (tx.slack_hist[0] != 2) || (tx.slack_hist[6] != 1) || (tx.slack_hist[7] != 1)) {
+        printf("ERROR: wrong histograms\n");
+        nb_err += 1;
+    }
+    for (i = 0, nb = 0; i < TX_TIMING_BIN_NB; i++) {
+        nb += tx.jit_hist[i] + tx.slack_hist[i];
+    }
+    if (nb != (2 * tx.nb_tx)) {
+        printf("ERROR: histograms do not add up to the number of downlinks\n");
+        nb_err += 1;
+    }
+
+    tx_timing_reset(&tx);
+    if ((tx.nb_tx != 0) || (tx.slack_min_us != INT32_MAX) || (tx.jit_hist[8] != 0)) {
+        printf("ERROR: statistics not cleared\n");
+        nb_err += 1;
+    }
+
+    printf("errors: %d\n", nb_err);
+    printf("=========== Test End ===========\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
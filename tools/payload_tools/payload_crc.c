@@ -1,14 +1,26 @@
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+
+#include "loragw_crc.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- SUBFUNCTIONS DECLARATION --------------------------------------------- */
 
 static void usage(void);
 uint16_t sx1302_lora_payload_crc(const uint8_t * data, uint8_t size);
+uint16_t ccitt_crc16(const uint8_t * data, unsigned size);
 void remove_spaces(char *str);
+int benchmark(unsigned int size, unsigned long nb_loop);
 
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
@@ -26,6 +38,21 @@ int main(int argc, char ** argv)
         return -1;
     }
 
+    /* Throughput benchmark of the bit-serial and table-driven CRCs */
+    if (strcmp(argv[1], "-b") == 0) {
+        unsigned int size = 0;
+        unsigned long nb_loop = 100000;
+        if ((argc > 2) && (sscanf(argv[2], "%u", &size) != 1 || size > 255)) {
+            usage();
+            return -1;
+        }
+        if ((argc > 3) && (sscanf(argv[3], "%lu", &nb_loop) != 1 || nb_loop == 0)) {
+            usage();
+            return -1;
+        }
+        return benchmark(size, nb_loop);
+    }
+
     /* Get payload hex string from command line */
     memcpy(hexstr, argv[1], strlen(argv[1]));
     hexstr[strlen(argv[1])] = '\0';
@@ -45,6 +72,10 @@ int main(int argc, char ** argv)
     /* Compute CRC */
     crc = sx1302_lora_payload_crc(payload, payload_size);
     printf("Payload CRC_16: %04X\n", crc);
+    if (lgw_crc16_lora(payload, payload_size) != crc) {
+        printf("ERROR: table-driven CRC differs (%04X)\n", lgw_crc16_lora(payload, payload_size));
+        return -1;
+    }
 
     return 0;
 }
@@ -52,7 +83,8 @@ int main(int argc, char ** argv)
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void usage(void) {
-    printf("Missing payload hex string\n");
+    printf("Usage: payload_crc <payload hex string>\n");
+    printf("       payload_crc -b [size] [loops]   throughput benchmark, all sizes from 1 to 255 if size is 0 or missing\n");
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -108,3 +140,103 @@ uint16_t sx1302_lora_payload_crc(const uint8_t * data, uint8_t size) {
     //printf("CRC16: 0x%02X 0x%02X (%X)\n", (uint8_t)(crc >> 8), (uint8_t)crc, crc);
     return (uint16_t)crc;
 }
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Bit-serial CRC-16/CCITT, as used by the packet forwarder for beacons */
+uint16_t ccitt_crc16(const uint8_t * data, unsigned size) {
+    const uint16_t crc_poly = 0x1021;
+    uint16_t x = 0;
+    unsigned i, j;
+
+    for (i=0; i<size; ++i) {
+        x ^= (uint16_t)data[i] << 8;
+        for (j=0; j<8; ++j) {
+            x = (x & 0x8000) ? (x<<1) ^ crc_poly : (x<<1);
+        }
+    }
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double diff_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int benchmark(unsigned int size, unsigned long nb_loop) {
+    static uint8_t buff[255];
+    unsigned int s, s_min, s_max;
+    unsigned long n, nb_diff = 0;
+    unsigned long nb_bytes = 0;
+    volatile uint16_t sink = 0;
+    struct timespec start, end;
+    double t[4] = { 0.0, 0.0, 0.0, 0.0 };
+    int i;
+
+    s_min = (size == 0) ? 1 : size;
+    s_max = (size == 0) ? 255 : size;
+    srand(time(NULL));
+
+    for (s = s_min; s <= s_max; s++) {
+        /* check results on random payloads */
+        for (n = 0; n < 16; n++) {
+            for (i = 0; i < (int)s; i++) {
+                buff[i] = (uint8_t)rand();
+            }
+            if (lgw_crc16_lora(buff, s) != sx1302_lora_payload_crc(buff, s)) {
+                nb_diff += 1;
+            }
+            if (lgw_crc16_ccitt(buff, s) != ccitt_crc16(buff, s)) {
+                nb_diff += 1;
+            }
+        }
+
+        /* measure each implementation on the same payload */
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (n = 0; n < nb_loop; n++) {
+            buff[0] = (uint8_t)n;
+            sink ^= sx1302_lora_payload_crc(buff, s);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        t[0] += diff_s(&start, &end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (n = 0; n < nb_loop; n++) {
+            buff[0] = (uint8_t)n;
+            sink ^= lgw_crc16_lora(buff, s);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        t[1] += diff_s(&start, &end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (n = 0; n < nb_loop; n++) {
+            buff[0] = (uint8_t)n;
+            sink ^= ccitt_crc16(buff, s);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        t[2] += diff_s(&start, &end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (n = 0; n < nb_loop; n++) {
+            buff[0] = (uint8_t)n;
+            sink ^= lgw_crc16_ccitt(buff, s);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        t[3] += diff_s(&start, &end);
+
+        nb_bytes += (unsigned long)s * nb_loop;
+    }
+
+    printf("Payload sizes %u to %u, %lu CRCs per size\n", s_min, s_max, nb_loop);
+    printf("LoRa payload CRC, bit-serial:     %8.1f MB/s\n", nb_bytes / t[0] / 1e6);
+    printf("LoRa payload CRC, table-driven:   %8.1f MB/s\n", nb_bytes / t[1] / 1e6);
+    printf("CRC-16/CCITT, bit-serial:         %8.1f MB/s\n", nb_bytes / t[2] / 1e6);
+    printf("CRC-16/CCITT, table-driven:       %8.1f MB/s\n", nb_bytes / t[3] / 1e6);
+    printf("Different results: %lu\n", nb_diff);
+
+    return (nb_diff == 0) ? 0 : -1;
+}
@@ -0,0 +1,486 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Utility to capture IQ samples and debug traces with the SX1302 capture RAM
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>     /* sigaction */
+#include <getopt.h>     /* getopt_long */
+#include <time.h>       /* clock_gettime, gmtime */
+
+#include "loragw_hal.h"
+#include "loragw_com.h"
+#include "loragw_reg.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define COM_TYPE_DEFAULT    LGW_COM_SPI
+#define COM_PATH_DEFAULT    "/dev/spidev0.0"
+
+#define DEFAULT_LOG_NAME    "capture"
+#define DEFAULT_NB_CAPTURE  1
+
+#define CAPTURE_RAM_SIZE    0x4000  /* 4k x 32 bits */
+#define CAPTURE_NB_SAMPLES  (CAPTURE_RAM_SIZE / 4)
+#define CAPTURE_POLL_MS     1       /* status polling, once the capture should be completed */
+#define CAPTURE_TIMEOUT_MS  1000    /* on top of the capture duration */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef enum {
+    CAPTURE_FORMAT_RAW,     /* 32-bit RAM words */
+    CAPTURE_FORMAT_IQ12,    /* 12-bit I and Q, MSB aligned on 16 bits */
+    CAPTURE_FORMAT_IQ16,
+    CAPTURE_FORMAT_IQ8
+} capture_format_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* Signal handling variables */
+static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
+static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+
+/* Sampling frequency of each capture source, 0 if not supported */
+static const uint32_t sampling_frequency[] = {4e6, 4e6, 4e6, 4e6, 4e6, 4e6, 4e6, 0, 0, 1e6, 125e3, 125e3, 125e3, 125e3, 125e3, 125e3, 125e3, 125e3, 8e6, 125e3, 125e3, 125e3, 0, 32e6, 32e6, 0, 32e6, 32e6, 0, 32e6, 32e6, 32e6};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf("Available options:\n");
+    printf(" -h         Print this help\n");
+    printf(" -u         Set COM type as USB (default is SPI)\n");
+    printf(" -d [path]  Path to the main COM interface\n");
+    printf("            => default path: " COM_PATH_DEFAULT "\n");
+    printf(" -s <uint>  Capture source [0..31]\n");
+    printf(" -n <uint>  Number of captures, 0 for continuous capture\n");
+    printf(" -l <char>  Log file name, without extension\n");
+    printf(" -m         Write a SigMF dataset (.sigmf-data/.sigmf-meta) instead of raw RAM dumps (.raw)\n");
+    printf(" -v         Print the samples of each capture\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* handle signals */
+static void sig_handler(int sigio) {
+    if (sigio == SIGQUIT) {
+        quit_sig = 1;
+    } else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
+        exit_sig = 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t time_us(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return ((uint64_t)t.tv_sec * 1000000) + ((uint64_t)t.tv_nsec / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static capture_format_t capture_format(uint8_t source) {
+    if (((source >= 2) && (source <= 3)) || (source == 9)) {
+        return CAPTURE_FORMAT_IQ12;
+    } else if ((source >= 4) && (source <= 6)) {
+        return CAPTURE_FORMAT_IQ16;
+    } else if ((source >= 10) && (source <= 17)) {
+        return CAPTURE_FORMAT_IQ8;
+    } else {
+        return CAPTURE_FORMAT_RAW;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* convert the RAM words to interleaved I/Q, return the number of bytes to be written */
+static size_t capture_decode(capture_format_t format, const uint8_t * ram, uint8_t * out) {
+    int16_t real, imag;
+    int i;
+
+    if (format == CAPTURE_FORMAT_RAW) {
+        memcpy(out, ram, CAPTURE_RAM_SIZE); /* already 32-bit little endian words */
+        return CAPTURE_RAM_SIZE;
+    }
+
+    for (i = 0; i < CAPTURE_RAM_SIZE; i += 4) {
+        if (format == CAPTURE_FORMAT_IQ8) {
+            real = (int8_t)(ram[i+3]); /* 8 bits I */
+            imag = (int8_t)(ram[i+1]); /* 8 bits Q */
+        } else {
+            real = (int16_t)(((uint16_t)ram[i+3] << 8) | ram[i+2]);
+            imag = (int16_t)(((uint16_t)ram[i+1] << 8) | ram[i+0]);
+            if (format == CAPTURE_FORMAT_IQ12) {
+                real >>= 4; /* 12 bits I */
+                imag >>= 4; /* 12 bits Q */
+            }
+        }
+        out[i+0] = (uint8_t)((uint16_t)real);
+        out[i+1] = (uint8_t)((uint16_t)real >> 8);
+        out[i+2] = (uint8_t)((uint16_t)imag);
+        out[i+3] = (uint8_t)((uint16_t)imag >> 8);
+    }
+
+    return CAPTURE_RAM_SIZE;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void capture_print(capture_format_t format, const uint8_t * ram, const uint8_t * iq) {
+    int16_t real, imag;
+    int i;
+
+    printf("Data:\n");
+    for (i = 0; i < CAPTURE_RAM_SIZE; i += 4) {
+        if (format == CAPTURE_FORMAT_RAW) {
+            printf("%02X ", ram[i]);
+            continue;
+        }
+        real = (int16_t)(((uint16_t)iq[i+1] << 8) | iq[i+0]);
+        imag = (int16_t)(((uint16_t)iq[i+3] << 8) | iq[i+2]);
+        printf("%d%s%di\n", real, (imag >= 0) ? "+" : "", imag);
+    }
+    printf("End of Data\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* UTC time, ISO 8601 as expected by SigMF */
+static void iso8601_now(char * str, size_t size) {
+    struct timespec t;
+    struct tm tm_utc;
+
+    clock_gettime(CLOCK_REALTIME, &t);
+    gmtime_r(&t.tv_sec, &tm_utc);
+    snprintf(str, size, "%04d-%02d-%02dT%02d:%02d:%02d.%06ldZ", tm_utc.tm_year + 1900, tm_utc.tm_mon + 1, tm_utc.tm_mday,
+                tm_utc.tm_hour, tm_utc.tm_min, tm_utc.tm_sec, t.tv_nsec / 1000);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x;
+    int32_t val = 0;
+    unsigned int arg_u;
+    char arg_s[64];
+
+    static struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+
+    /* COM interface */
+    const char com_path_default[] = COM_PATH_DEFAULT;
+    const char * com_path = com_path_default;
+    lgw_com_type_t com_type = COM_TYPE_DEFAULT;
+
+    /* Capture */
+    uint8_t capture_source = 0;
+    capture_format_t format;
+    uint16_t period_value = 0;
+    uint32_t duration_us;
+    uint32_t nb_capture = DEFAULT_NB_CAPTURE;
+    uint32_t nb_done = 0;
+    bool verbose = false;
+    static uint8_t capture_ram_buffer[CAPTURE_RAM_SIZE];
+    static uint8_t samples[CAPTURE_RAM_SIZE];
+    size_t size;
+
+    /* Output files */
+    bool sigmf = false;
+    bool capture_ok = true; /* false if a capture failed, the interruption by a signal is not a failure */
+    char log_name[64] = DEFAULT_LOG_NAME;
+    char file_name[80];
+    char datetime[64];
+    FILE * data_file = NULL;
+    FILE * meta_file = NULL;
+
+    /* Throughput */
+    uint64_t t_start, t0, t1;
+    uint64_t t_capture = 0, t_read = 0, t_write = 0;
+    uint64_t nb_bytes = 0;
+
+    /* Parameter parsing */
+    int option_index = 0;
+    static struct option long_options[] = {
+        {0, 0, 0, 0}
+    };
+
+    /* parse command line options */
+    while ((i = getopt_long (argc, argv, "hud:s:n:l:mv", long_options, &option_index)) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+
+            case 'u':
+                com_type = LGW_COM_USB;
+                break;
+
+            case 'd':
+                if (optarg != NULL) {
+                    com_path = optarg;
+                }
+                break;
+
+            case 's': /* <uint> Capture Source */
+                i = sscanf(optarg, "%u", &arg_u);
+                if ((i != 1) || (arg_u > 31)) {
+                    printf("ERROR: argument parsing of -s argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                capture_source = arg_u;
+                break;
+
+            case 'n': /* <uint> Number of captures */
+                i = sscanf(optarg, "%u", &arg_u);
+                if (i != 1) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_capture = arg_u;
+                break;
+
+            case 'l': /* <char> Log file name */
+                i = sscanf(optarg, "%63s", arg_s);
+                if (i != 1) {
+                    printf("ERROR: argument parsing of -l argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                sprintf(log_name, "%s", arg_s);
+                break;
+
+            case 'm':
+                sigmf = true;
+                break;
+
+            case 'v':
+                verbose = true;
+                break;
+
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    if (sampling_frequency[capture_source] == 0) {
+        printf("ERROR: Sampling frequency is null for capture source %u\n", capture_source);
+        return EXIT_FAILURE;
+    }
+    period_value = (32e6 / sampling_frequency[capture_source]) - 1;
+    duration_us = (uint32_t)(((uint64_t)CAPTURE_NB_SAMPLES * (period_value + 1) + 31) / 32);
+    format = capture_format(capture_source);
+
+    printf("==\n");
+    printf("== Capture RAM: source=%u, sampling frequency=%uHz, %u samples (%u us) per capture\n", capture_source, sampling_frequency[capture_source], CAPTURE_NB_SAMPLES, duration_us);
+    if (nb_capture == 0) {
+        printf("== continuous capture\n");
+    } else {
+        printf("== %u capture(s)\n", nb_capture);
+    }
+    printf("==\n");
+
+    /* Configure signal handling */
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = sig_handler;
+    sigaction(SIGQUIT, &sigact, NULL);
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
+    /* create output files */
+    snprintf(file_name, sizeof file_name, "%s.%s", log_name, (sigmf == true) ? "sigmf-data" : "raw");
+    data_file = fopen(file_name, "wb");
+    if (data_file == NULL) {
+        printf("ERROR: impossible to create data file %s\n", file_name);
+        return EXIT_FAILURE;
+    }
+    if (sigmf == true) {
+        snprintf(file_name, sizeof file_name, "%s.sigmf-meta", log_name);
+        meta_file = fopen(file_name, "w");
+        if (meta_file == NULL) {
+            printf("ERROR: impossible to create metadata file %s\n", file_name);
+            fclose(data_file);
+            return EXIT_FAILURE;
+        }
+        fprintf(meta_file, "{\n    \"global\": {\n");
+        fprintf(meta_file, "        \"core:datatype\": \"%s\",\n", (format == CAPTURE_FORMAT_RAW) ? "ru32_le" : "ci16_le");
+        fprintf(meta_file, "        \"core:sample_rate\": %u,\n", sampling_frequency[capture_source]);
+        fprintf(meta_file, "        \"core:version\": \"1.0.0\",\n");
+        fprintf(meta_file, "        \"core:hw\": \"SX1302 capture RAM\",\n");
+        fprintf(meta_file, "        \"core:description\": \"capture source %u, %u samples per capture\"\n", capture_source, CAPTURE_NB_SAMPLES);
+        fprintf(meta_file, "    },\n    \"captures\": [");
+    }
+
+    x = lgw_connect(com_type, com_path);
+    if (x == LGW_REG_ERROR) {
+        printf("ERROR: FAIL TO CONNECT BOARD\n");
+        fclose(data_file);
+        if (sigmf == true) {
+            fclose(meta_file);
+        }
+        return EXIT_FAILURE;
+    }
+    printf("INFO: max burst size %u bytes\n", lgw_com_chunk_size());
+
+    /* Configure the Capture Ram block, the writes are grouped in a single transfer on USB */
+    lgw_com_set_write_mode(LGW_COM_WRITE_MODE_BULK);
+    lgw_reg_w(SX1302_REG_CAPTURE_RAM_CAPTURE_CFG_ENABLE, 1);    /* Enable Capture RAM */
+    lgw_reg_w(SX1302_REG_CAPTURE_RAM_CAPTURE_CFG_CAPTUREWRAP, 0);   /* Capture once, and stop when memory is full */
+    lgw_reg_w(SX1302_REG_CAPTURE_RAM_CAPTURE_CFG_RAMCONFIG, 0);   /* RAM configuration, 0: 4kx32, 1: 2kx64 */
+    lgw_reg_w(SX1302_REG_CAPTURE_RAM_CAPTURE_SOURCE_A_SOURCEMUX, capture_source);
+    lgw_reg_w(SX1302_REG_CAPTURE_RAM_CAPTURE_PERIOD_0_CAPTUREPERIOD, period_value & 0xFF);  /* LSB */
+    lgw_reg_w(SX1302_REG_CAPTURE_RAM_CAPTURE_PERIOD_1_CAPTUREPERIOD, (period_value >> 8) & 0xFF); /* MSB */
+    lgw_com_flush();
+    lgw_com_set_write_mode(LGW_COM_WRITE_MODE_SINGLE);
+
+    t_start = time_us();
+    while ((quit_sig != 1) && (exit_sig != 1) && ((nb_capture == 0) || (nb_done < nb_capture))) {
+        /* Launch capture, back on the registers page */
+        t0 = time_us();
+        iso8601_now(datetime, sizeof datetime);
+        lgw_com_set_write_mode(LGW_COM_WRITE_MODE_BULK);
+        if (nb_done > 0) {
+            lgw_reg_w(SX1302_REG_COMMON_PAGE_PAGE, 0);
+        }
+        lgw_reg_w(SX1302_REG_CAPTURE_RAM_CAPTURE_CFG_CAPTURESTART, 1);
+        lgw_com_flush();
+        lgw_com_set_write_mode(LGW_COM_WRITE_MODE_SINGLE);
+
+        /* Poll Status.CapComplete once the RAM should be full */
+        wait_ms((duration_us + 999) / 1000);
+        do {
+            x = lgw_reg_r(SX1302_REG_CAPTURE_RAM_STATUS_CAPCOMPLETE, &val);
+            if (x != LGW_REG_SUCCESS) {
+                printf("ERROR: failed to read the capture status\n");
+                capture_ok = false;
+                break;
+            }
+            if (val == 1) {
+                break;
+            }
+            if ((time_us() - t0) > (duration_us + (CAPTURE_TIMEOUT_MS * 1000))) {
+                printf("ERROR: TIMEOUT on capture\n");
+                capture_ok = false;
+                break;
+            }
+            wait_ms(CAPTURE_POLL_MS);
+        } while ((quit_sig != 1) && (exit_sig != 1));
+        if (val != 1) {
+            break;
+        }
+
+        /* Read the RAM, in bursts of the maximum size of the COM interface */
+        t1 = time_us();
+        t_capture += t1 - t0;
+        lgw_com_set_write_mode(LGW_COM_WRITE_MODE_BULK);
+        lgw_reg_w(SX1302_REG_CAPTURE_RAM_CAPTURE_CFG_CAPTURESTART, 0);
+        lgw_reg_w(SX1302_REG_COMMON_PAGE_PAGE, 1);
+        lgw_com_flush();
+        lgw_com_set_write_mode(LGW_COM_WRITE_MODE_SINGLE);
+        x = lgw_mem_rb(0, capture_ram_buffer, CAPTURE_RAM_SIZE, false);
+        if (x != LGW_REG_SUCCESS) {
+            printf("ERROR: failed to read the capture RAM\n");
+            capture_ok = false;
+            break;
+        }
+        t0 = time_us();
+        t_read += t0 - t1;
+
+        /* Stream to file */
+        size = capture_decode(format, capture_ram_buffer, samples);
+        if (fwrite(samples, size, 1, data_file) != 1) {
+            printf("ERROR: failed to write data file\n");
+            capture_ok = false;
+            break;
+        }
+        if (sigmf == true) {
+            fprintf(meta_file, "%s\n        {\n", (nb_done > 0) ? "," : "");
+            fprintf(meta_file, "            \"core:sample_start\": %llu,\n", (unsigned long long)nb_done * CAPTURE_NB_SAMPLES);
+            fprintf(meta_file, "            \"core:datetime\": \"%s\"\n        }", datetime);
+        }
+        t_write += time_us() - t0;
+        nb_bytes += size;
+        nb_done += 1;
+
+        if (verbose == true) {
+            capture_print(format, capture_ram_buffer, samples);
+        }
+    }
+    lgw_reg_w(SX1302_REG_CAPTURE_RAM_CAPTURE_CFG_CAPTURESTART, 0);
+    lgw_reg_w(SX1302_REG_COMMON_PAGE_PAGE, 0);
+    t1 = time_us();
+
+    /* close output files, the buffered data is written there */
+    if (fclose(data_file) != 0) {
+        printf("ERROR: failed to write data file\n");
+        capture_ok = false;
+    }
+    if (sigmf == true) {
+        fprintf(meta_file, "\n    ],\n    \"annotations\": []\n}\n");
+        if (fclose(meta_file) != 0) {
+            printf("ERROR: failed to write metadata file\n");
+            capture_ok = false;
+        }
+    }
+
+    lgw_disconnect();
+
+    /* report the capture-to-disk throughput */
+    printf("==\n");
+    printf("== %u capture(s), %llu bytes written in %.3f s\n", nb_done, (unsigned long long)nb_bytes, (double)(t1 - t_start) / 1e6);
+    if (nb_done > 0) {
+        printf("== per capture: %.1f us capture, %.1f us RAM readout (%.1f kB/s), %.1f us disk write\n",
+                (double)t_capture / nb_done,
+                (double)t_read / nb_done, (t_read > 0) ? (double)nb_done * CAPTURE_RAM_SIZE * 1e3 / (double)t_read : 0.0,
+                (double)t_write / nb_done);
+        printf("== capture-to-disk: %.2f captures/s, %.1f kB/s\n",
+                (double)nb_done * 1e6 / (double)(t1 - t_start),
+                (double)nb_bytes * 1e3 / (double)(t1 - t_start));
+    }
+    printf("==\n");
+
+    return (capture_ok == true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -10,6 +10,8 @@
  Description:
     Network packet sender, sends UDP packets to a running packet forwarder
     Network packet receiver, receives UDP packets from a running packet forwarder.
+    Network server load tester, serves many packet forwarders at given downlink
+    rates and measures the acknowledge latencies per gateway.
 
  License: Revised BSD License, see LICENSE.TXT file include in the project
  */
@@ -31,6 +33,7 @@
 #endif /* __GNUC__ >= 7 */
 
 #include <stdint.h>     /* C99 types */
+#include <inttypes.h>   /* PRIx64 */
 #include <stdio.h>      /* printf, fprintf, sprintf, fopen, fputs */
 #include <stdlib.h>     /* EXIT_* */
 #include <unistd.h>     /* usleep */
@@ -48,6 +51,12 @@
 
 #include <signal.h>     /* sigaction */
 
+#include <sys/epoll.h>  /* epoll_create1, epoll_ctl, epoll_wait */
+#include <poll.h>       /* poll */
+#include <sys/timerfd.h> /* timerfd_create, timerfd_settime */
+#include <sys/wait.h>   /* waitpid */
+#include <sys/resource.h> /* getrusage */
+
 #include <pthread.h>
 
 #include "parson.h"
@@ -82,6 +91,25 @@
 #define DEFAULT_LORA_PREAMBLE_SIZE  8       /* LoRa preamble size */
 #define DEFAULT_PAYLOAD_SIZE        4       /* payload size, bytes */
 #define PUSH_TIMEOUT_MS             100
+#define DEFAULT_ACK_DELAY_MS        30      /* artificial latency before sending ACKs */
+
+/* Load tester */
+#define LT_GW_NB_MAX                1024    /* max number of gateways tracked, power of 2 */
+#define LT_PENDING_NB               64      /* PULL_RESP waiting for TX_ACK, per gateway */
+#define LT_ACK_QUEUE_SIZE           4096    /* ACKs waiting for the artificial latency */
+#define LT_HIST_BIN_NB              240     /* 1us bins up to 16us, then 8 bins per power of 2 */
+#define LT_TX_ACK_TIMEOUT_US        2000000 /* PULL_RESP without TX_ACK after that are counted as lost */
+#define LT_LATE_TICKS_MAX           1000    /* max number of downlinks sent to catch up after a late timer tick */
+
+/* Benchmark */
+#define UB_RECV_TIMEOUT_MS          100     /* to check the end of the benchmark while no datagram is received */
+#define UB_FWD_STOP_TIMEOUT_MS      5000    /* the forwarder is killed if still running after that */
+#define UB_DRAIN_TIMEOUT_S          60      /* max wait for the status report following the end of the benchmark */
+#define UB_DEFAULT_DN_DELAY_MS      1000    /* downlinks timestamped like RX1 of the last uplink */
+#define UB_TX_BIN_NB                10      /* bins of the "txsl" histograms of the packet forwarder */
+#define UB_TX_BIN_US                {0, 1000, 2000, 5000, 10000, 20000, 30000, 40000, 50000}
+#define UB_TX_ACK_ERR_NB            8
+#define UB_TX_ACK_ERR               {"NONE", "TOO_LATE", "TOO_EARLY", "COLLISION_PACKET", "COLLISION_BEACON", "TX_FREQ", "GPS_UNLOCKED", "UNKNOWN"}
 
 /* -------------------------------------------------------------------------- */
 /* --- CUSTOM TYPES --------------------------------------------------------- */
@@ -118,6 +146,68 @@ typedef struct
     bool        ipol;
 } thread_params_t;
 
+/* latency histogram, in microseconds */
+typedef struct
+{
+    uint32_t    count;
+    uint32_t    bin[LT_HIST_BIN_NB];
+    uint32_t    max_us;
+    uint64_t    sum_us;
+} lat_hist_t;
+
+/* PULL_RESP sent, waiting for the TX_ACK */
+typedef struct
+{
+    bool        valid;
+    uint16_t    token;
+    uint64_t    t_sent_us;
+} pending_dn_t;
+
+/* gateway tracked by the load tester */
+typedef struct
+{
+    bool        used;
+    uint64_t    mac;
+    bool        addr_valid; /* a PULL_DATA was received, downlinks can be sent */
+    struct sockaddr_storage addr_down;
+    socklen_t   addr_len_down;
+    uint32_t    nb_push;
+    uint32_t    nb_pull;
+    uint32_t    nb_dn;
+    uint32_t    nb_tx_ack_ok;
+    uint32_t    nb_tx_ack_err;
+    uint32_t    nb_tx_ack_lost;
+    uint16_t    token_dn;
+    pending_dn_t pending[LT_PENDING_NB];
+    lat_hist_t  push_ack; /* PUSH_DATA received -> PUSH_ACK sent */
+    lat_hist_t  tx_ack; /* PULL_RESP sent -> TX_ACK received */
+} gw_entry_t;
+
+/* timing of the timestamped downlinks, from the "txsl" status reports of the packet forwarder */
+typedef struct
+{
+    uint32_t    nb;
+    uint32_t    miss;
+    uint32_t    jmis;
+    int32_t     slack_min_us;
+    double      slack_sum_us;
+    double      send_sum_us;
+    uint32_t    send_max_us;
+    uint32_t    jit[UB_TX_BIN_NB];
+    uint32_t    slack[UB_TX_BIN_NB];
+} bench_txsl_t;
+
+/* ACK waiting for the artificial latency */
+typedef struct
+{
+    uint64_t    t_due_us;
+    uint64_t    t_rx_us;
+    gw_entry_t  *gw; /* for the PUSH_ACK latency, NULL for PULL_ACK */
+    struct sockaddr_storage addr;
+    socklen_t   addr_len;
+    uint8_t     ack[4];
+} pending_ack_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- GLOBAL VARIABLES ----------------------------------------------------- */
 
@@ -141,6 +231,8 @@ static void usage( void );
 static void * thread_down_rf0( const void * arg );
 static void * thread_down_rf1( const void * arg );
 static void log_csv(FILE * file, uint8_t * buf);
+static int load_test( int sock, int sock_fwd, FILE * log_file, const thread_params_t * params, double rate, uint32_t ack_delay_ms, uint32_t report_s );
+static int bench_run( int sock, const thread_params_t * params, uint32_t duration_s, double dn_rate, uint32_t dn_delay_ms, const char * fwd_cmd, const char * json_fname );
 
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
@@ -159,6 +251,18 @@ int main( int argc, char **argv )
     char arg_s[8];
     char arg_s2[8];
     bool parse_err = false;
+    uint32_t ack_delay_ms = DEFAULT_ACK_DELAY_MS;
+
+    /* Load tester */
+    double lt_rate = 0.0; /* downlinks per second per gateway, 0 when not load testing */
+    uint32_t lt_report_s = 10;
+
+    /* Benchmark */
+    uint32_t ub_duration_s = 0; /* 0 when not benchmarking */
+    double ub_dn_rate = 0.0; /* timestamped downlinks per second, 0 for uplinks only */
+    uint32_t ub_dn_delay_ms = UB_DEFAULT_DN_DELAY_MS;
+    const char * ub_fwd_cmd = NULL;
+    const char * ub_json_fname = NULL;
 
     /* Logging file variables */
     const char * log_fname = NULL; /* pointer to a string we won't touch */
@@ -219,7 +323,7 @@ int main( int argc, char **argv )
     pthread_t thrid_down_rf1;
 
     /* Parse command line options */
-    while( ( i = getopt( argc, argv, "b:c:f:hij:l:p:r:s:t:x:z:A:F:P:m:d:q:" ) ) != -1 )
+    while( ( i = getopt( argc, argv, "b:c:f:hij:l:p:r:s:t:x:z:A:F:P:m:d:q:D:R:S:U:T:X:J:" ) ) != -1 )
     {
         switch( i )
         {
@@ -577,6 +681,73 @@ int main( int argc, char **argv )
                 }
                 break;
 
+            case 'D': /* -D <uint> ACK latency (ms) */
+                j = sscanf( optarg, "%u", &arg_u );
+                if( (j != 1) || (arg_u > 10000) )
+                {
+                    printf( "ERROR: argument parsing of -D argument\n" );
+                    usage( );
+                    return EXIT_FAILURE;
+                }
+                ack_delay_ms = (uint32_t)arg_u;
+                break;
+
+            case 'R': /* -R <float> load test, downlinks per second per gateway */
+                j = sscanf( optarg, "%lf", &arg_f );
+                if( (j != 1) || (arg_f < 0.0) || (arg_f > 10000.0) )
+                {
+                    printf( "ERROR: argument parsing of -R argument\n" );
+                    usage( );
+                    return EXIT_FAILURE;
+                }
+                lt_rate = arg_f;
+                break;
+
+            case 'S': /* -S <uint> load test report interval (s) */
+                j = sscanf( optarg, "%u", &arg_u );
+                if( (j != 1) || (arg_u == 0) )
+                {
+                    printf( "ERROR: argument parsing of -S argument\n" );
+                    usage( );
+                    return EXIT_FAILURE;
+                }
+                lt_report_s = (uint32_t)arg_u;
+                break;
+
+            case 'U': /* -U <uint> uplink benchmark duration (s) */
+                j = sscanf( optarg, "%u", &arg_u );
+                if( (j != 1) || (arg_u == 0) )
+                {
+                    printf( "ERROR: argument parsing of -U argument\n" );
+                    usage( );
+                    return EXIT_FAILURE;
+                }
+                ub_duration_s = (uint32_t)arg_u;
+                break;
+
+            case 'T': /* -T <float,uint> benchmark downlinks per second, delay after the last uplink (ms) */
+                j = sscanf( optarg, "%lf,%u", &arg_f, &arg_u );
+                if( (j < 1) || (arg_f <= 0.0) || (arg_f > 1000.0) || ((j == 2) && ((arg_u < 100) || (arg_u > 10000))) )
+                {
+                    printf( "ERROR: argument parsing of -T argument\n" );
+                    usage( );
+                    return EXIT_FAILURE;
+                }
+                ub_dn_rate = arg_f;
+                if( j == 2 )
+                {
+                    ub_dn_delay_ms = (uint32_t)arg_u;
+                }
+                break;
+
+            case 'X': /* -X <command> forwarder started by the benchmark */
+                ub_fwd_cmd = optarg;
+                break;
+
+            case 'J': /* -J <filename> benchmark JSON report */
+                ub_json_fname = optarg;
+                break;
+
             default:
                 printf( "ERROR: argument parsing options, use -h option for help\n" );
                 usage( );
@@ -593,7 +764,18 @@ int main( int argc, char **argv )
     }
 
     /* Start message */
-    printf( "+++ Start of network uplink logger (30ms delay) +++\n" );
+    if( ub_duration_s > 0 )
+    {
+        printf( "+++ Start of benchmark (%u s, %.3f downlinks/s) +++\n", ub_duration_s, ub_dn_rate );
+    }
+    else if( lt_rate > 0.0 )
+    {
+        printf( "+++ Start of network server load tester (%u ms ACK delay, %.3f downlinks/s per gateway) +++\n", ack_delay_ms, lt_rate );
+    }
+    else
+    {
+        printf( "+++ Start of network uplink logger (%u ms delay) +++\n", ack_delay_ms );
+    }
 
     /* Configure socket for uplink forwarding if required */
     if( fwd_uplink == true )
@@ -722,6 +904,25 @@ int main( int argc, char **argv )
     sigaction( SIGINT, &sigact, NULL );
     sigaction( SIGTERM, &sigact, NULL );
 
+    /* Benchmark: ACK without delay, measure the uplinks latency, optionally send timestamped downlinks */
+    if( ub_duration_s > 0 )
+    {
+        x = bench_run( sock, &thread_params, ub_duration_s, ub_dn_rate, ub_dn_delay_ms, ub_fwd_cmd, ub_json_fname );
+        return (x == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /* Load tester: single event loop for all gateways */
+    if( lt_rate > 0.0 )
+    {
+        x = load_test( sock, sock_fwd, log_file, &thread_params, lt_rate, ack_delay_ms, lt_report_s );
+        if( log_file != NULL )
+        {
+            fclose( log_file );
+            log_file = NULL;
+        }
+        return (x == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     i = pthread_create( &thrid_down_rf0, NULL, (void * (*)( void * ))thread_down_rf0, (void*)&thread_params );
     if( i != 0 )
     {
@@ -823,7 +1024,7 @@ int main( int argc, char **argv )
         }
 
         /* Add some artificial latency */
-        usleep( 30000 ); /* 30 ms */
+        usleep( ack_delay_ms * 1000 );
 
         /* Send acknowledge and check return value */
         if( no_ack == false )
@@ -1148,6 +1349,13 @@ static void usage( void )
     printf( " -F <udp port>      UDP port to be used for uplink forwarding (optional)\n" );
     printf( " -l <filename>      uplink logging CSV filename (optional)\n" );
     printf( " -B                 Bypass downlink, for uplink logging only (optional)\n" );
+    printf( " -D <uint>          Latency added before sending PUSH_ACK and PULL_ACK, in ms (default %u)\n", DEFAULT_ACK_DELAY_MS );
+    printf( " -R <float>         Load test: serve all the gateways, sending RF0 downlinks at that rate (per second per gateway)\n" );
+    printf( " -S <uint>          Load test: report interval in seconds (default 10)\n" );
+    printf( " -U <uint>          Benchmark: duration in seconds, uplink latency measured from the rxpk tmst (host counter)\n" );
+    printf( " -T <float,uint>    Benchmark: timestamped RF0 downlinks per second, sent <uint> ms after the last uplink (default %u)\n", UB_DEFAULT_DN_DELAY_MS );
+    printf( " -X <command>       Benchmark: forwarder command line, started and stopped by the benchmark (optional)\n" );
+    printf( " -J <filename>      Benchmark: JSON report filename (default stdout)\n" );
     printf( "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n" );
     printf( "~~~ Examples ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n" );
     printf( " Log uplinks into a CSV file, no downlink:\n" );
@@ -1162,6 +1370,12 @@ static void usage( void )
     printf( "   ./net_downlink -f 865.1,865.9 -s 11,12 -x 1,1 -r 65535,65535 -P 1730\n" );
     printf( " Log uplinks into CSV file while continuous TX is running (full_duplex testing):\n" );
     printf( "   ./net_downlink -f 864.5 -s 12 -x 1 -r 65535 -P 1730 -l log.csv\n" );
+    printf( " Load test: 2 downlinks/s to each gateway, 100 ms ACK latency, report every 5 seconds:\n" );
+    printf( "   ./net_downlink -f 869.525 -s 9 -z 12 -R 2 -D 100 -S 5 -P 1730\n" );
+    printf( " Uplink benchmark of a virtual concentrator forwarder during 30 seconds:\n" );
+    printf( "   ./net_downlink -P 1790 -U 30 -J bench.json -X \"./lora_pkt_fwd -c global_conf.json.virtual.bench > fwd.log\"\n" );
+    printf( " Downlink scheduling benchmark, 10 downlinks/s at SF7 1 s after the last uplink, during 30 seconds:\n" );
+    printf( "   ./net_downlink -f 869.525 -s 7 -z 12 -i -P 1790 -U 30 -T 10,1000 -J bench.json -X \"./lora_pkt_fwd -c global_conf.json.virtual.bench > fwd.log\"\n" );
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -1446,4 +1660,1010 @@ static void * thread_down_rf1( const void * arg )
     return NULL;
 }
 
+/* -------------------------------------------------------------------------- */
+/* --- LOAD TESTER ---------------------------------------------------------- */
+
+static uint64_t time_us( void )
+{
+    struct timespec t;
+
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return ( (uint64_t)t.tv_sec * 1000000 ) + ( (uint64_t)t.tv_nsec / 1000 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int hist_bin( uint32_t us )
+{
+    int e;
+
+    if( us < 16 )
+    {
+        return (int)us;
+    }
+    e = 31 - __builtin_clz( us ); /* us in [2^e, 2^(e+1)[ */
+    return 16 + ( ( e - 4 ) * 8 ) + (int)( ( us >> ( e - 3 ) ) & 0x07 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* lower bound of the values counted in a bin */
+static uint32_t hist_bin_us( int bin )
+{
+    int e;
+
+    if( bin < 16 )
+    {
+        return (uint32_t)bin;
+    }
+    e = 4 + ( ( bin - 16 ) / 8 );
+    return ( 1U << e ) + ( (uint32_t)( ( bin - 16 ) % 8 ) << ( e - 3 ) );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void hist_add( lat_hist_t * h, uint64_t us )
+{
+    uint32_t v = ( us > 0xFFFFFFFF ) ? 0xFFFFFFFF : (uint32_t)us;
+
+    h->bin[hist_bin( v )] += 1;
+    h->count += 1;
+    h->sum_us += v;
+    if( v > h->max_us )
+    {
+        h->max_us = v;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void hist_merge( lat_hist_t * dst, const lat_hist_t * src )
+{
+    int i;
+
+    for( i = 0; i < LT_HIST_BIN_NB; i++ )
+    {
+        dst->bin[i] += src->bin[i];
+    }
+    dst->count += src->count;
+    dst->sum_us += src->sum_us;
+    if( src->max_us > dst->max_us )
+    {
+        dst->max_us = src->max_us;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* quantile in per mille, as the lower bound of the bin in which it falls */
+static uint32_t hist_quantile( const lat_hist_t * h, unsigned int q_pm )
+{
+    uint64_t target, acc = 0;
+    int i;
+
+    if( h->count == 0 )
+    {
+        return 0;
+    }
+    target = ( ( (uint64_t)h->count * q_pm ) + 999 ) / 1000;
+    for( i = 0; i < LT_HIST_BIN_NB; i++ )
+    {
+        acc += h->bin[i];
+        if( acc >= target )
+        {
+            return hist_bin_us( i );
+        }
+    }
+    return h->max_us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void hist_print( const lat_hist_t * h )
+{
+    if( h->count == 0 )
+    {
+        printf( " %8s %8s %8s %8s", "-", "-", "-", "-" );
+    }
+    else
+    {
+        printf( " %8u %8u %8u %8u", hist_quantile( h, 500 ), hist_quantile( h, 990 ), hist_quantile( h, 999 ), h->max_us );
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* find a gateway by MAC address, add it if not known yet (open addressing) */
+static gw_entry_t * gw_lookup( gw_entry_t * table, uint64_t mac, bool add )
+{
+    uint32_t idx = (uint32_t)( ( mac * 0x9E3779B97F4A7C15ULL ) >> 54 ) & ( LT_GW_NB_MAX - 1 );
+    int n;
+
+    for( n = 0; n < LT_GW_NB_MAX; n++ )
+    {
+        if( table[idx].used == false )
+        {
+            if( add == false )
+            {
+                return NULL;
+            }
+            memset( &table[idx], 0, sizeof table[idx] );
+            table[idx].used = true;
+            table[idx].mac = mac;
+            table[idx].token_dn = (uint16_t)rand( );
+            return &table[idx];
+        }
+        if( table[idx].mac == mac )
+        {
+            return &table[idx];
+        }
+        idx = ( idx + 1 ) & ( LT_GW_NB_MAX - 1 );
+    }
+    return NULL; /* table full */
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int timer_arm( int fd, uint64_t first_ns, uint64_t period_ns )
+{
+    struct itimerspec its;
+
+    its.it_value.tv_sec = (time_t)( first_ns / 1000000000 );
+    its.it_value.tv_nsec = (long)( first_ns % 1000000000 );
+    its.it_interval.tv_sec = (time_t)( period_ns / 1000000000 );
+    its.it_interval.tv_nsec = (long)( period_ns % 1000000000 );
+    return timerfd_settime( fd, 0, &its, NULL );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* PULL_RESP with a RF0 txpk to a gateway, recorded for the TX_ACK latency */
+static void load_test_send_downlink( int sock, const thread_params_t * params, gw_entry_t * gw )
+{
+    static uint8_t databuf_down[4096];
+    JSON_Value *root_val = NULL;
+    char *serialized_string = NULL;
+    pending_dn_t * pd;
+    size_t len;
+    int byte_nb;
+
+    root_val = json_value_init_object( );
+    if( root_val == NULL )
+    {
+        printf( "ERROR: failed to initialize JSON root object\n" );
+        return;
+    }
+    prepare_downlink_json( params, 0, gw->nb_dn, root_val );
+    serialized_string = json_serialize_to_string( root_val );
+    len = ( serialized_string != NULL ) ? strlen( serialized_string ) : 0;
+    if( (len == 0) || (len > (sizeof databuf_down - 4)) )
+    {
+        printf( "ERROR: failed to serialize downlink\n" );
+        json_free_serialized_string( serialized_string );
+        json_value_free( root_val );
+        return;
+    }
+
+    gw->token_dn += 1;
+    databuf_down[0] = PROTOCOL_VERSION;
+    databuf_down[1] = (uint8_t)( gw->token_dn >> 8 );
+    databuf_down[2] = (uint8_t)( gw->token_dn & 0xFF );
+    databuf_down[3] = PKT_PULL_RESP;
+    memcpy( &databuf_down[4], serialized_string, len );
+    json_free_serialized_string( serialized_string );
+    json_value_free( root_val );
+
+    byte_nb = sendto( sock, (void *)databuf_down, len + 4, 0, (struct sockaddr *)&gw->addr_down, gw->addr_len_down );
+    if( byte_nb == -1 )
+    {
+        printf( "ERROR: failed to send downlink to gateway 0x%016" PRIx64 " - %s\n", gw->mac, strerror( errno ) );
+        return;
+    }
+
+    /* an older PULL_RESP still waiting in that slot never got its TX_ACK */
+    pd = &gw->pending[gw->token_dn % LT_PENDING_NB];
+    if( pd->valid == true )
+    {
+        gw->nb_tx_ack_lost += 1;
+    }
+    pd->valid = true;
+    pd->token = gw->token_dn;
+    pd->t_sent_us = time_us( );
+    gw->nb_dn += 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void load_test_tx_ack( gw_entry_t * gw, uint8_t * buf, int byte_nb, uint64_t t_rx_us )
+{
+    uint16_t token = (uint16_t)( ( buf[1] << 8 ) | buf[2] );
+    pending_dn_t * pd = &gw->pending[token % LT_PENDING_NB];
+    JSON_Value * root_val;
+    JSON_Object * ack_obj;
+    bool error = false;
+
+    if( (pd->valid == false) || (pd->token != token) )
+    {
+        return; /* unknown or already timed out */
+    }
+    pd->valid = false;
+    hist_add( &gw->tx_ack, t_rx_us - pd->t_sent_us );
+
+    /* A JSON object is only present on error or warning */
+    if( byte_nb > 12 )
+    {
+        buf[byte_nb] = 0;
+        root_val = json_parse_string( (const char *)( buf + 12 ) );
+        ack_obj = json_object_get_object( json_value_get_object( root_val ), "txpk_ack" );
+        if( (ack_obj != NULL) && (json_object_get_string( ack_obj, "error" ) != NULL) && (strcmp( json_object_get_string( ack_obj, "error" ), "NONE" ) != 0) )
+        {
+            error = true;
+        }
+        json_value_free( root_val );
+    }
+    if( error == true )
+    {
+        gw->nb_tx_ack_err += 1;
+    }
+    else
+    {
+        gw->nb_tx_ack_ok += 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void load_test_report( gw_entry_t * table, uint64_t t_start_us, double rate, uint32_t nb_dn_late, uint32_t nb_ack_overflow )
+{
+    uint64_t now = time_us( );
+    double elapsed_s = (double)( now - t_start_us ) / 1E6;
+    lat_hist_t all_push, all_tx;
+    uint32_t nb_gw = 0, nb_push = 0, nb_pull = 0, nb_dn = 0, nb_ok = 0, nb_err = 0, nb_lost = 0;
+    gw_entry_t * gw;
+    int i, j;
+
+    memset( &all_push, 0, sizeof all_push );
+    memset( &all_tx, 0, sizeof all_tx );
+
+    printf( "\n##### load test: %.1f s #####\n", elapsed_s );
+    printf( "                 |        |        |         |         TX_ACK        |       PUSH_DATA -> PUSH_ACK (us)      |       PULL_RESP -> TX_ACK (us)\n" );
+    printf( "gateway          |   PUSH |   PULL | DN sent |     ok    err   lost |      p50      p99     p999      max |      p50      p99     p999      max\n" );
+    for( i = 0; i < LT_GW_NB_MAX; i++ )
+    {
+        gw = &table[i];
+        if( gw->used == false )
+        {
+            continue;
+        }
+        /* PULL_RESP without TX_ACK for too long */
+        for( j = 0; j < LT_PENDING_NB; j++ )
+        {
+            if( (gw->pending[j].valid == true) && ((now - gw->pending[j].t_sent_us) > LT_TX_ACK_TIMEOUT_US) )
+            {
+                gw->pending[j].valid = false;
+                gw->nb_tx_ack_lost += 1;
+            }
+        }
+        printf( "%016" PRIx64 " | %6u | %6u | %7u | %6u %6u %6u |", gw->mac, gw->nb_push, gw->nb_pull, gw->nb_dn, gw->nb_tx_ack_ok, gw->nb_tx_ack_err, gw->nb_tx_ack_lost );
+        hist_print( &gw->push_ack );
+        printf( " |" );
+        hist_print( &gw->tx_ack );
+        printf( "\n" );
+        nb_gw += 1;
+        nb_push += gw->nb_push;
+        nb_pull += gw->nb_pull;
+        nb_dn += gw->nb_dn;
+        nb_ok += gw->nb_tx_ack_ok;
+        nb_err += gw->nb_tx_ack_err;
+        nb_lost += gw->nb_tx_ack_lost;
+        hist_merge( &all_push, &gw->push_ack );
+        hist_merge( &all_tx, &gw->tx_ack );
+    }
+    printf( "all (%4u gw)    | %6u | %6u | %7u | %6u %6u %6u |", nb_gw, nb_push, nb_pull, nb_dn, nb_ok, nb_err, nb_lost );
+    hist_print( &all_push );
+    printf( " |" );
+    hist_print( &all_tx );
+    printf( "\n" );
+    printf( "downlinks: target %.1f/s, actual %.1f/s, %u sent late by the pacing timer; %u ACKs sent without delay (queue full)\n",
+            rate * nb_gw, ( elapsed_s > 0.0 ) ? (double)nb_dn / elapsed_s : 0.0, nb_dn_late, nb_ack_overflow );
+    printf( "##### END #####\n" );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int load_test( int sock, int sock_fwd, FILE * log_file, const thread_params_t * params, double rate, uint32_t ack_delay_ms, uint32_t report_s )
+{
+    static gw_entry_t gw_table[LT_GW_NB_MAX];
+    static pending_ack_t ack_queue[LT_ACK_QUEUE_SIZE];
+    static uint8_t databuf_up[32768];
+    struct sockaddr_storage dist_addr;
+    socklen_t addr_len;
+    struct epoll_event ev, events[8];
+    int epfd, fd_dn, fd_ack, fd_report;
+    int watched[4]; /* file descriptors polled: socket and timers */
+    bool setup_ok;
+    int ack_head = 0, ack_nb = 0; /* FIFO, all ACKs have the same delay */
+    int dn_cursor = 0;
+    int nb_gw_dn = 0, nb_gw_dn_armed = 0;
+    uint32_t nb_dn_late = 0, nb_ack_overflow = 0;
+    uint64_t t_start_us, now, expirations, period_ns;
+    uint32_t raw_mac_h, raw_mac_l;
+    uint64_t gw_mac;
+    bool is_first = true;
+    pending_ack_t * pa;
+    gw_entry_t * gw;
+    int byte_nb, n, i;
+
+    epfd = epoll_create1( 0 );
+    fd_dn = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+    fd_ack = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+    fd_report = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+    setup_ok = (epfd != -1) && (fd_dn != -1) && (fd_ack != -1) && (fd_report != -1);
+    if( setup_ok == false )
+    {
+        printf( "ERROR: failed to create epoll or timer file descriptors - %s\n", strerror( errno ) );
+    }
+
+    /* without any of them, epoll_wait would block forever */
+    watched[0] = sock;
+    watched[1] = fd_dn;
+    watched[2] = fd_ack;
+    watched[3] = fd_report;
+    ev.events = EPOLLIN;
+    for( i = 0; ( setup_ok == true ) && ( i < (int)ARRAY_SIZE( watched ) ); i++ )
+    {
+        ev.data.fd = watched[i];
+        if( epoll_ctl( epfd, EPOLL_CTL_ADD, watched[i], &ev ) == -1 )
+        {
+            printf( "ERROR: failed to add file descriptor %d to epoll - %s\n", watched[i], strerror( errno ) );
+            setup_ok = false;
+        }
+    }
+    if( ( setup_ok == true ) && ( timer_arm( fd_report, (uint64_t)report_s * 1000000000, (uint64_t)report_s * 1000000000 ) == -1 ) )
+    {
+        printf( "ERROR: failed to arm the report timer - %s\n", strerror( errno ) );
+        setup_ok = false;
+    }
+    if( setup_ok == false )
+    {
+        for( i = 1; i < (int)ARRAY_SIZE( watched ); i++ ) /* not the socket, owned by the caller */
+        {
+            if( watched[i] != -1 )
+            {
+                close( watched[i] );
+            }
+        }
+        if( epfd != -1 )
+        {
+            close( epfd );
+        }
+        return -1;
+    }
+
+    t_start_us = time_us( );
+    while( ( quit_sig != 1 ) && ( exit_sig != 1 ) )
+    {
+        n = epoll_wait( epfd, events, ARRAY_SIZE( events ), -1 );
+        if( n == -1 )
+        {
+            if( errno != EINTR )
+            {
+                printf( "ERROR: epoll_wait returned %s\n", strerror( errno ) );
+            }
+            continue;
+        }
+
+        for( i = 0; i < n; i++ )
+        {
+            if( events[i].data.fd == sock )
+            {
+                addr_len = sizeof dist_addr;
+                byte_nb = recvfrom( sock, databuf_up, sizeof databuf_up - 1, MSG_DONTWAIT, (struct sockaddr *)&dist_addr, &addr_len );
+                now = time_us( );
+                if( (byte_nb < 12) || (databuf_up[0] != PROTOCOL_VERSION) )
+                {
+                    continue; /* nothing, or not a gateway datagram */
+                }
+                memcpy( &raw_mac_h, databuf_up + 4, 4 );
+                memcpy( &raw_mac_l, databuf_up + 8, 4 );
+                gw_mac = ( (uint64_t)ntohl( raw_mac_h ) << 32 ) + (uint64_t)ntohl( raw_mac_l );
+                gw = gw_lookup( gw_table, gw_mac, true );
+                if( gw == NULL )
+                {
+                    printf( "WARNING: too many gateways, 0x%016" PRIx64 " ignored\n", gw_mac );
+                    continue;
+                }
+
+                switch( databuf_up[3] )
+                {
+                    case PKT_PUSH_DATA:
+                    case PKT_PULL_DATA:
+                        if( databuf_up[3] == PKT_PUSH_DATA )
+                        {
+                            gw->nb_push += 1;
+                            if( sock_fwd != -1 )
+                            {
+                                send( sock_fwd, (void *)databuf_up, byte_nb, 0 );
+                            }
+                            if( log_file != NULL )
+                            {
+                                if( is_first == true )
+                                {
+                                    fprintf( log_file, "tmst,ftime,chan,rfch,freq,mid,stat,modu,datr,bw,codr,rssic,rssis,lsnr,size,data\n" );
+                                    is_first = false;
+                                }
+                                databuf_up[byte_nb] = 0;
+                                log_csv( log_file, &databuf_up[12] );
+                            }
+                        }
+                        else
+                        {
+                            gw->nb_pull += 1;
+                            if( gw->addr_valid == false )
+                            {
+                                nb_gw_dn += 1;
+                            }
+                            memcpy( &gw->addr_down, &dist_addr, sizeof dist_addr );
+                            gw->addr_len_down = addr_len;
+                            gw->addr_valid = true;
+                        }
+
+                        /* queue the ACK, or send it now if the queue is full */
+                        if( ack_nb == LT_ACK_QUEUE_SIZE )
+                        {
+                            nb_ack_overflow += 1;
+                            pa = &ack_queue[ack_head];
+                            sendto( sock, (void *)pa->ack, 4, 0, (struct sockaddr *)&pa->addr, pa->addr_len );
+                            if( pa->gw != NULL )
+                            {
+                                hist_add( &pa->gw->push_ack, now - pa->t_rx_us );
+                            }
+                            ack_head = ( ack_head + 1 ) % LT_ACK_QUEUE_SIZE;
+                            ack_nb -= 1;
+                        }
+                        pa = &ack_queue[( ack_head + ack_nb ) % LT_ACK_QUEUE_SIZE];
+                        pa->t_rx_us = now;
+                        pa->t_due_us = now + ( (uint64_t)ack_delay_ms * 1000 );
+                        pa->gw = ( databuf_up[3] == PKT_PUSH_DATA ) ? gw : NULL;
+                        memcpy( &pa->addr, &dist_addr, sizeof dist_addr );
+                        pa->addr_len = addr_len;
+                        pa->ack[0] = PROTOCOL_VERSION;
+                        pa->ack[1] = databuf_up[1];
+                        pa->ack[2] = databuf_up[2];
+                        pa->ack[3] = ( databuf_up[3] == PKT_PUSH_DATA ) ? PKT_PUSH_ACK : PKT_PULL_ACK;
+                        ack_nb += 1;
+                        if( ack_nb == 1 )
+                        {
+                            timer_arm( fd_ack, ( ack_delay_ms > 0 ) ? ( (uint64_t)ack_delay_ms * 1000000 ) : 1, 0 );
+                        }
+                        break;
+
+                    case PKT_TX_ACK:
+                        load_test_tx_ack( gw, databuf_up, byte_nb, now );
+                        break;
+
+                    default:
+                        break;
+                }
+
+                /* new gateway able to receive downlinks: adapt the pacing to the aggregate rate */
+                if( nb_gw_dn != nb_gw_dn_armed )
+                {
+                    nb_gw_dn_armed = nb_gw_dn;
+                    period_ns = (uint64_t)( 1E9 / ( rate * nb_gw_dn ) ); /* above 2^31 ns for rates below 0.47/s */
+                    if( period_ns == 0 )
+                    {
+                        period_ns = 1;
+                    }
+                    timer_arm( fd_dn, period_ns, period_ns );
+                }
+            }
+            else if( events[i].data.fd == fd_ack )
+            {
+                if( read( fd_ack, &expirations, sizeof expirations ) != sizeof expirations )
+                {
+                    continue;
+                }
+                now = time_us( );
+                while( ack_nb > 0 )
+                {
+                    pa = &ack_queue[ack_head];
+                    if( pa->t_due_us > now )
+                    {
+                        break;
+                    }
+                    sendto( sock, (void *)pa->ack, 4, 0, (struct sockaddr *)&pa->addr, pa->addr_len );
+                    if( pa->gw != NULL )
+                    {
+                        hist_add( &pa->gw->push_ack, time_us( ) - pa->t_rx_us );
+                    }
+                    ack_head = ( ack_head + 1 ) % LT_ACK_QUEUE_SIZE;
+                    ack_nb -= 1;
+                }
+                if( ack_nb > 0 )
+                {
+                    timer_arm( fd_ack, ( ack_queue[ack_head].t_due_us - now ) * 1000, 0 );
+                }
+            }
+            else if( events[i].data.fd == fd_dn )
+            {
+                if( (read( fd_dn, &expirations, sizeof expirations ) != sizeof expirations) || (nb_gw_dn == 0) )
+                {
+                    continue;
+                }
+                if( expirations > 1 )
+                {
+                    nb_dn_late += (uint32_t)( expirations - 1 );
+                }
+                if( expirations > LT_LATE_TICKS_MAX )
+                {
+                    expirations = LT_LATE_TICKS_MAX;
+                }
+                /* one downlink per tick, round robin over the gateways */
+                while( expirations > 0 )
+                {
+                    do
+                    {
+                        dn_cursor = ( dn_cursor + 1 ) & ( LT_GW_NB_MAX - 1 );
+                    } while( gw_table[dn_cursor].addr_valid == false );
+                    load_test_send_downlink( sock, params, &gw_table[dn_cursor] );
+                    expirations -= 1;
+                }
+            }
+            else if( events[i].data.fd == fd_report )
+            {
+                if( read( fd_report, &expirations, sizeof expirations ) == sizeof expirations )
+                {
+                    load_test_report( gw_table, t_start_us, rate, nb_dn_late, nb_ack_overflow );
+                }
+            }
+        }
+    }
+
+    load_test_report( gw_table, t_start_us, rate, nb_dn_late, nb_ack_overflow );
+    printf( "INFO: Exiting load tester\n" );
+
+    close( fd_report );
+    close( fd_ack );
+    close( fd_dn );
+    close( epfd );
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BENCHMARK ------------------------------------------------------------ */
+
+/* start the forwarder in a child process, the shell is replaced by the forwarder */
+static pid_t bench_fwd_start( const char * cmd )
+{
+    char cmd_exec[1024];
+    pid_t pid;
+
+    snprintf( cmd_exec, sizeof cmd_exec, "exec %s", cmd );
+    pid = fork( );
+    if( pid == 0 )
+    {
+        execl( "/bin/sh", "sh", "-c", cmd_exec, (char *)NULL );
+        _exit( 127 );
+    }
+    return pid;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* stop the forwarder and get the CPU time it used during its whole life, user and system */
+static int bench_fwd_stop( pid_t pid, int * status, uint64_t * cpu_us )
+{
+    struct rusage ru;
+    pid_t x = 0;
+    int i;
+
+    kill( pid, SIGTERM );
+    for( i = 0; (i < (UB_FWD_STOP_TIMEOUT_MS / 10)) && (x == 0); i++ )
+    {
+        usleep( 10000 );
+        x = waitpid( pid, status, WNOHANG );
+    }
+    if( x != pid )
+    {
+        printf( "WARNING: forwarder still running after %u ms, killed\n", UB_FWD_STOP_TIMEOUT_MS );
+        kill( pid, SIGKILL );
+        if( waitpid( pid, status, 0 ) != pid )
+        {
+            return -1;
+        }
+    }
+
+    /* the forwarder is the only child waited for */
+    getrusage( RUSAGE_CHILDREN, &ru );
+    *cpu_us = ( (uint64_t)ru.ru_utime.tv_sec * 1000000 ) + (uint64_t)ru.ru_utime.tv_usec + ( (uint64_t)ru.ru_stime.tv_sec * 1000000 ) + (uint64_t)ru.ru_stime.tv_usec;
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* PULL_RESP with a RF0 txpk timestamped like a class A downlink */
+static int bench_send_downlink( int sock, const thread_params_t * params, const struct sockaddr_storage * addr, socklen_t addr_len, uint32_t nb_dn, uint32_t tmst )
+{
+    static uint8_t databuf_down[4096];
+    JSON_Value * root_val;
+    char * serialized_string;
+    size_t len;
+
+    root_val = json_value_init_object( );
+    if( root_val == NULL )
+    {
+        printf( "ERROR: failed to initialize JSON root object\n" );
+        return -1;
+    }
+    prepare_downlink_json( params, 0, nb_dn, root_val );
+    json_object_dotset_boolean( json_value_get_object( root_val ), "txpk.imme", false );
+    json_object_dotset_number( json_value_get_object( root_val ), "txpk.tmst", tmst );
+    serialized_string = json_serialize_to_string( root_val );
+    len = ( serialized_string != NULL ) ? strlen( serialized_string ) : 0;
+    if( (len == 0) || (len > (sizeof databuf_down - 4)) )
+    {
+        printf( "ERROR: failed to serialize downlink\n" );
+        json_free_serialized_string( serialized_string );
+        json_value_free( root_val );
+        return -1;
+    }
+
+    databuf_down[0] = PROTOCOL_VERSION;
+    databuf_down[1] = (uint8_t)( nb_dn >> 8 );
+    databuf_down[2] = (uint8_t)( nb_dn & 0xFF );
+    databuf_down[3] = PKT_PULL_RESP;
+    memcpy( &databuf_down[4], serialized_string, len );
+    json_free_serialized_string( serialized_string );
+    json_value_free( root_val );
+
+    if( sendto( sock, (void *)databuf_down, len + 4, 0, (const struct sockaddr *)addr, addr_len ) == -1 )
+    {
+        printf( "ERROR: failed to send downlink - %s\n", strerror( errno ) );
+        return -1;
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* index of the TX_ACK error in UB_TX_ACK_ERR, 0 when there is none */
+static int bench_tx_ack_error( uint8_t * buf, int byte_nb )
+{
+    static const char * err_name[UB_TX_ACK_ERR_NB] = UB_TX_ACK_ERR;
+    JSON_Value * root_val;
+    const char * str;
+    int i = 0;
+
+    if( byte_nb > 12 )
+    {
+        buf[byte_nb] = 0;
+        root_val = json_parse_string( (const char *)( buf + 12 ) );
+        str = json_object_dotget_string( json_value_get_object( root_val ), "txpk_ack.error" );
+        if( str != NULL )
+        {
+            for( i = 0; i < (UB_TX_ACK_ERR_NB - 1); i++ )
+            {
+                if( strcmp( str, err_name[i] ) == 0 )
+                {
+                    break;
+                }
+            }
+        }
+        json_value_free( root_val );
+    }
+    return i;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void bench_txsl_add( bench_txsl_t * t, const JSON_Object * txsl_obj )
+{
+    JSON_Array * send_arr = json_object_get_array( txsl_obj, "send" );
+    JSON_Array * jit_arr = json_object_get_array( txsl_obj, "jit" );
+    JSON_Array * slack_arr = json_object_get_array( txsl_obj, "slack" );
+    uint32_t nb = (uint32_t)json_object_get_number( txsl_obj, "nb" );
+    int i;
+
+    t->nb += nb;
+    t->miss += (uint32_t)json_object_get_number( txsl_obj, "miss" );
+    t->jmis += (uint32_t)json_object_get_number( txsl_obj, "jmis" );
+    if( nb > 0 )
+    {
+        if( (int32_t)json_object_get_number( txsl_obj, "min" ) < t->slack_min_us )
+        {
+            t->slack_min_us = (int32_t)json_object_get_number( txsl_obj, "min" );
+        }
+        t->slack_sum_us += json_object_get_number( txsl_obj, "avg" ) * nb;
+        t->send_sum_us += json_array_get_number( send_arr, 0 ) * nb;
+        if( (uint32_t)json_array_get_number( send_arr, 1 ) > t->send_max_us )
+        {
+            t->send_max_us = (uint32_t)json_array_get_number( send_arr, 1 );
+        }
+    }
+    for( i = 0; i < UB_TX_BIN_NB; i++ )
+    {
+        t->jit[i] += (uint32_t)json_array_get_number( jit_arr, i );
+        t->slack[i] += (uint32_t)json_array_get_number( slack_arr, i );
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static JSON_Value * bench_json_array( const uint32_t * v, int nb )
+{
+    JSON_Value * arr_val = json_value_init_array( );
+    int i;
+
+    for( i = 0; i < nb; i++ )
+    {
+        json_array_append_number( json_value_get_array( arr_val ), v[i] );
+    }
+    return arr_val;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int bench_run( int sock, const thread_params_t * params, uint32_t duration_s, double dn_rate, uint32_t dn_delay_ms, const char * fwd_cmd, const char * json_fname )
+{
+    static uint8_t databuf_up[32768];
+    static const uint32_t tx_bin_us[UB_TX_BIN_NB - 1] = UB_TX_BIN_US;
+    static const char * tx_ack_err[UB_TX_ACK_ERR_NB] = UB_TX_ACK_ERR;
+    struct sockaddr_storage dist_addr, addr_down;
+    socklen_t addr_len, addr_len_down = 0;
+    struct pollfd pfd;
+    uint8_t databuf_ack[4];
+    lat_hist_t lat;
+    bench_txsl_t txsl;
+    uint32_t nb_push = 0, nb_pull = 0, nb_pkt = 0, nb_future = 0, nb_stat = 0;
+    uint32_t stat_rxnb = 0, stat_rxfw = 0, stat_lost = 0;
+    uint32_t nb_dn = 0, nb_dn_skip = 0, nb_tx_ack = 0;
+    uint32_t tx_ack_cnt[UB_TX_ACK_ERR_NB];
+    uint32_t last_tmst = 0;
+    bool tmst_valid = false, running = true, drained = false;
+    uint64_t t_start_us, t_end_us, t_first_us = 0, t_last_us = 0, now, cpu_us = 0;
+    uint64_t dn_period_us, t_next_dn_us;
+    double window_s;
+    int32_t delta;
+    pid_t fwd_pid = -1;
+    int fwd_status = 0;
+    int timeout_ms;
+    JSON_Value * root_val;
+    JSON_Object * root_obj;
+    JSON_Array * rxpk_arr;
+    JSON_Object * stat_obj;
+    JSON_Object * txsl_obj;
+    char * json_str;
+    char name[64];
+    int byte_nb, j, n;
+
+    memset( &lat, 0, sizeof lat );
+    memset( &txsl, 0, sizeof txsl );
+    txsl.slack_min_us = INT32_MAX;
+    memset( tx_ack_cnt, 0, sizeof tx_ack_cnt );
+
+    if( fwd_cmd != NULL )
+    {
+        fwd_pid = bench_fwd_start( fwd_cmd );
+        if( fwd_pid == -1 )
+        {
+            printf( "ERROR: failed to start the forwarder - %s\n", strerror( errno ) );
+            return -1;
+        }
+        printf( "INFO: forwarder started, pid %d: %s\n", (int)fwd_pid, fwd_cmd );
+    }
+
+    t_start_us = time_us( );
+    t_end_us = t_start_us + ( (uint64_t)duration_s * 1000000 );
+    dn_period_us = ( dn_rate > 0.0 ) ? (uint64_t)( 1E6 / dn_rate ) : 0;
+    t_next_dn_us = t_start_us + dn_period_us;
+    while( ( quit_sig != 1 ) && ( exit_sig != 1 ) && ( drained == false ) )
+    {
+        now = time_us( );
+        if( now >= ( t_end_us + ( (uint64_t)UB_DRAIN_TIMEOUT_S * 1000000 ) ) )
+        {
+            printf( "WARNING: no status report received after the end of the benchmark\n" );
+            break;
+        }
+        running = ( now < t_end_us );
+
+        /* timestamped downlink, on the last uplink received */
+        if( (running == true) && (dn_period_us > 0) && (now >= t_next_dn_us) )
+        {
+            t_next_dn_us += dn_period_us;
+            if( (addr_len_down == 0) || (tmst_valid == false) )
+            {
+                nb_dn_skip += 1; /* no PULL_DATA or no uplink yet */
+            }
+            else if( bench_send_downlink( sock, params, &addr_down, addr_len_down, nb_dn, last_tmst + ( dn_delay_ms * 1000 ) ) == 0 )
+            {
+                nb_dn += 1;
+            }
+            continue;
+        }
+
+        timeout_ms = UB_RECV_TIMEOUT_MS;
+        if( (running == true) && (dn_period_us > 0) && ( ( ( t_next_dn_us - now ) / 1000 ) < (uint64_t)timeout_ms ) )
+        {
+            timeout_ms = (int)( ( t_next_dn_us - now ) / 1000 );
+        }
+        pfd.fd = sock;
+        pfd.events = POLLIN;
+        if( poll( &pfd, 1, timeout_ms ) <= 0 )
+        {
+            continue; /* timeout, or interrupted by a signal */
+        }
+        addr_len = sizeof dist_addr;
+        byte_nb = recvfrom( sock, databuf_up, sizeof databuf_up - 1, MSG_DONTWAIT, (struct sockaddr *)&dist_addr, &addr_len );
+        now = time_us( ); /* departure of the datagram, the loopback latency is negligible */
+        if( (byte_nb < 12) || (databuf_up[0] != PROTOCOL_VERSION) )
+        {
+            continue; /* nothing, or not a gateway datagram */
+        }
+        if( databuf_up[3] == PKT_TX_ACK )
+        {
+            nb_tx_ack += 1;
+            tx_ack_cnt[bench_tx_ack_error( databuf_up, byte_nb )] += 1;
+            continue;
+        }
+        if( (databuf_up[3] != PKT_PUSH_DATA) && (databuf_up[3] != PKT_PULL_DATA) )
+        {
+            continue;
+        }
+
+        /* ACK right away, the forwarder waits for the PUSH_ACK before fetching again */
+        databuf_ack[0] = PROTOCOL_VERSION;
+        databuf_ack[1] = databuf_up[1];
+        databuf_ack[2] = databuf_up[2];
+        databuf_ack[3] = ( databuf_up[3] == PKT_PUSH_DATA ) ? PKT_PUSH_ACK : PKT_PULL_ACK;
+        sendto( sock, (void *)databuf_ack, 4, 0, (struct sockaddr *)&dist_addr, addr_len );
+        if( databuf_up[3] == PKT_PULL_DATA )
+        {
+            nb_pull += 1;
+            memcpy( &addr_down, &dist_addr, sizeof dist_addr );
+            addr_len_down = addr_len;
+            continue;
+        }
+        nb_push += 1;
+
+        databuf_up[byte_nb] = 0;
+        root_val = json_parse_string( (const char *)( databuf_up + 12 ) );
+        root_obj = json_value_get_object( root_val );
+        rxpk_arr = json_object_get_array( root_obj, "rxpk" );
+        n = (int)json_array_get_count( rxpk_arr );
+        if( n > 0 )
+        {
+            last_tmst = (uint32_t)json_object_get_number( json_array_get_object( rxpk_arr, n - 1 ), "tmst" );
+            tmst_valid = true;
+        }
+        if( (running == true) && (n > 0) )
+        {
+            for( j = 0; j < n; j++ )
+            {
+                /* tmst is the concentrator counter, running on the host monotonic clock */
+                delta = (int32_t)( (uint32_t)now - (uint32_t)json_object_get_number( json_array_get_object( rxpk_arr, j ), "tmst" ) );
+                if( delta < 0 )
+                {
+                    nb_future += 1;
+                }
+                else
+                {
+                    hist_add( &lat, (uint64_t)delta );
+                }
+            }
+            if( nb_pkt == 0 )
+            {
+                t_first_us = now;
+            }
+            t_last_us = now;
+            nb_pkt += n;
+        }
+
+        /* the statistics of the end of the run come with the next report, after the last downlink */
+        stat_obj = json_object_get_object( root_obj, "stat" );
+        if( stat_obj != NULL )
+        {
+            nb_stat += 1;
+            stat_rxnb += (uint32_t)json_object_get_number( stat_obj, "rxnb" );
+            stat_rxfw += (uint32_t)json_object_get_number( stat_obj, "rxfw" );
+            stat_lost += (uint32_t)json_object_dotget_number( stat_obj, "rxbf.lost" );
+            txsl_obj = json_object_get_object( stat_obj, "txsl" );
+            if( txsl_obj != NULL )
+            {
+                bench_txsl_add( &txsl, txsl_obj );
+            }
+            if( now > ( t_end_us + ( dn_delay_ms * 1000 ) ) )
+            {
+                drained = true;
+            }
+        }
+        json_value_free( root_val );
+    }
+
+    if( fwd_pid != -1 )
+    {
+        if( bench_fwd_stop( fwd_pid, &fwd_status, &cpu_us ) != 0 )
+        {
+            printf( "ERROR: failed to stop the forwarder - %s\n", strerror( errno ) );
+        }
+    }
+
+    /* report */
+    window_s = (double)( t_last_us - t_first_us ) / 1E6;
+    root_val = json_value_init_object( );
+    root_obj = json_value_get_object( root_val );
+    json_object_set_string( root_obj, "bench", ( dn_rate > 0.0 ) ? "downlink" : "uplink" );
+    json_object_set_number( root_obj, "duration_s", duration_s );
+    json_object_set_number( root_obj, "push_data", nb_push );
+    json_object_set_number( root_obj, "pull_data", nb_pull );
+    json_object_set_number( root_obj, "rxpk", nb_pkt );
+    json_object_set_number( root_obj, "rxpk_per_s", ( window_s > 0.0 ) ? ( (double)nb_pkt / window_s ) : 0.0 );
+    json_object_set_number( root_obj, "rxpk_per_push", ( nb_push > 0 ) ? ( (double)nb_pkt / nb_push ) : 0.0 );
+    json_object_dotset_number( root_obj, "latency_us.count", lat.count );
+    json_object_dotset_number( root_obj, "latency_us.mean", ( lat.count > 0 ) ? ( (double)lat.sum_us / lat.count ) : 0.0 );
+    json_object_dotset_number( root_obj, "latency_us.p50", hist_quantile( &lat, 500 ) );
+    json_object_dotset_number( root_obj, "latency_us.p99", hist_quantile( &lat, 990 ) );
+    json_object_dotset_number( root_obj, "latency_us.p999", hist_quantile( &lat, 999 ) );
+    json_object_dotset_number( root_obj, "latency_us.max", lat.max_us );
+    json_object_dotset_number( root_obj, "latency_us.future", nb_future );
+    if( dn_rate > 0.0 )
+    {
+        json_object_dotset_number( root_obj, "downlink.rate", dn_rate );
+        json_object_dotset_number( root_obj, "downlink.delay_ms", dn_delay_ms );
+        json_object_dotset_number( root_obj, "downlink.sent", nb_dn );
+        json_object_dotset_number( root_obj, "downlink.skipped", nb_dn_skip );
+        json_object_dotset_number( root_obj, "downlink.tx_ack", nb_tx_ack );
+        for( j = 0; j < UB_TX_ACK_ERR_NB; j++ )
+        {
+            snprintf( name, sizeof name, "downlink.tx_ack_error.%s", tx_ack_err[j] );
+            json_object_dotset_number( root_obj, name, tx_ack_cnt[j] );
+        }
+    }
+    json_object_dotset_number( root_obj, "stat.reports", nb_stat );
+    json_object_dotset_number( root_obj, "stat.rxnb", stat_rxnb );
+    json_object_dotset_number( root_obj, "stat.rxfw", stat_rxfw );
+    json_object_dotset_number( root_obj, "stat.lost", stat_lost );
+    json_object_dotset_number( root_obj, "stat.txsl.nb", txsl.nb );
+    json_object_dotset_number( root_obj, "stat.txsl.miss", txsl.miss );
+    json_object_dotset_number( root_obj, "stat.txsl.jit_miss", txsl.jmis );
+    json_object_dotset_number( root_obj, "stat.txsl.slack_min_us", ( txsl.nb > 0 ) ? txsl.slack_min_us : 0 );
+    json_object_dotset_number( root_obj, "stat.txsl.slack_mean_us", ( txsl.nb > 0 ) ? ( txsl.slack_sum_us / txsl.nb ) : 0.0 );
+    json_object_dotset_number( root_obj, "stat.txsl.send_mean_us", ( txsl.nb > 0 ) ? ( txsl.send_sum_us / txsl.nb ) : 0.0 );
+    json_object_dotset_number( root_obj, "stat.txsl.send_max_us", txsl.send_max_us );
+    json_object_dotset_value( root_obj, "stat.txsl.bins_us", bench_json_array( tx_bin_us, UB_TX_BIN_NB - 1 ) );
+    json_object_dotset_value( root_obj, "stat.txsl.jit", bench_json_array( txsl.jit, UB_TX_BIN_NB ) );
+    json_object_dotset_value( root_obj, "stat.txsl.slack", bench_json_array( txsl.slack, UB_TX_BIN_NB ) );
+    if( fwd_pid != -1 )
+    {
+        json_object_dotset_number( root_obj, "forwarder.exit_status", WIFEXITED( fwd_status ) ? WEXITSTATUS( fwd_status ) : -1 );
+        json_object_dotset_number( root_obj, "forwarder.cpu_s", (double)cpu_us / 1E6 );
+        json_object_dotset_number( root_obj, "forwarder.cpu_us_per_rxpk", ( nb_pkt > 0 ) ? ( (double)cpu_us / nb_pkt ) : 0.0 );
+    }
+    if( json_fname != NULL )
+    {
+        if( json_serialize_to_file_pretty( root_val, json_fname ) != JSONSuccess )
+        {
+            printf( "ERROR: failed to write the benchmark report to %s\n", json_fname );
+        }
+        else
+        {
+            printf( "INFO: benchmark report written to %s\n", json_fname );
+        }
+    }
+    else
+    {
+        json_str = json_serialize_to_string_pretty( root_val );
+        if( json_str != NULL )
+        {
+            printf( "%s\n", json_str );
+            json_free_serialized_string( json_str );
+        }
+    }
+    json_value_free( root_val );
+    printf( "INFO: Exiting benchmark\n" );
+
+    return 0;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
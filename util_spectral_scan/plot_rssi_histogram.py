@@ -18,8 +18,11 @@
 import pylab as pl
 import numpy as np
 import csv
+import struct
 import sys
 
+NB_BINS = 33
+
 #Read argument
 if len(sys.argv) >= 2:
     filename = sys.argv[1]
@@ -30,19 +33,41 @@ else:
 #Initiate array
 rssi = []
 freq = []
+hist = {} #histogram per frequency, summed over the sweeps
 
-#Process .csv file
-with open(filename, 'r') as csvfile:
-    reader = csv.reader(csvfile, delimiter=',', quotechar='|')
-    for row in reader:
-        f=int(row[0])//1000 #frequency
+def add_scan(f, levels, counts):
+    global rssi_val
+    rssi_val = levels[:NB_BINS-1]
+    if f not in hist:
         freq.append(f)
-        rssi_line=[]
-        rssi_val=[]
-        for k in range(1,(len(row)-1)//2):
-            rssi_line.append(int(row[k*2]))
-            rssi_val.append(int(row[k*2-1]))
-        rssi.append(rssi_line)
+        hist[f] = [0] * (NB_BINS-1)
+    for k in range(NB_BINS-1):
+        hist[f][k] += counts[k]
+
+if filename.endswith('.bin'):
+    #Process binary stream: header, then one record per channel scanned
+    with open(filename, 'rb') as binfile:
+        magic, version, nb_bins, rec_size = struct.unpack('<4sBBH', binfile.read(8))
+        if magic != b'SSCN' or nb_bins != NB_BINS:
+            print ("Unsupported binary file")
+            sys.exit()
+        fmt = '<QIIH%dh%dH' % (nb_bins, nb_bins)
+        while True:
+            rec = binfile.read(rec_size)
+            if len(rec) < rec_size:
+                break
+            val = struct.unpack(fmt, rec)
+            add_scan(val[2]//1000, list(val[4:4+nb_bins]), list(val[4+nb_bins:]))
+else:
+    #Process .csv file: frequency, then (level,count) for each bin, then sweep and timestamp
+    with open(filename, 'r') as csvfile:
+        reader = csv.reader(csvfile, delimiter=',', quotechar='|')
+        for row in reader:
+            f=int(row[0])//1000 #frequency
+            add_scan(f, [int(row[k*2+1]) for k in range(NB_BINS)], [int(row[k*2+2]) for k in range(NB_BINS)])
+
+for f in freq:
+    rssi.append(hist[f])
 
 #Set x to frequency axis and y to signal level axis
 A = np.array(rssi).T
@@ -25,6 +25,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #endif
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>   /* PRIx64, PRIu64... */
@@ -33,6 +34,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <math.h>
 #include <signal.h>     /* sigaction */
 #include <getopt.h>     /* getopt_long */
+#include <time.h>       /* clock_gettime */
 
 #include "loragw_hal.h"
 #include "loragw_aux.h"
@@ -55,10 +57,36 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define DEFAULT_RSSI_OFFSET -11 /* RSSI offset of SX1261 */
 
 #define DEFAULT_LOG_NAME    "rssi_histogram"
+#define DEFAULT_NB_SWEEP    1
+
+#define CHAN_STEP_HZ        200000  /* 200kHz channels */
+#define SCAN_POLL_MS        1       /* status polling, once the scan should be completed */
+#define SCAN_TIMEOUT_MS     2000    /* on top of the scan duration */
+
+/* Binary stream: file header, then one record per channel scanned (little endian) */
+#define BIN_MAGIC           "SSCN"
+#define BIN_VERSION         1
+#define BIN_HEADER_SIZE     8       /* magic, version, number of bins, record size */
+#define BIN_RECORD_SIZE     (8 + 4 + 4 + 2 + (4 * LGW_SPECTRAL_SCAN_RESULT_SIZE))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct scan_result_s {
+    uint64_t time_us;   /* UTC time of the scan start, in microseconds */
+    uint32_t sweep;     /* sweep index */
+    uint32_t freq_hz;
+    uint16_t nb_scan;
+    int16_t levels[LGW_SPECTRAL_SCAN_RESULT_SIZE];
+    uint16_t results[LGW_SPECTRAL_SCAN_RESULT_SIZE];
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
+static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
+static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
 
@@ -77,6 +105,128 @@ void usage(void) {
     printf(" -s <uint>  Number of scan points per frequency step [1..65535]\n");
     printf(" -o <int>   RSSI Offset of the sx1261 path, in dB [-127..128]\n");
     printf(" -l <char>  Log file name\n");
+    printf(" -B         Log a binary stream instead of CSV\n");
+    printf(" -c <uint>  Number of sweeps, 0 for continuous sweeping\n");
+    printf(" -p <uint>  Target sweep period, in ms (0: as fast as possible)\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sig_handler(int sigio) {
+    if (sigio == SIGQUIT) {
+        quit_sig = 1;
+    } else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
+        exit_sig = 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t time_us(clockid_t clk) {
+    struct timespec t;
+
+    clock_gettime(clk, &t);
+
+    return ((uint64_t)t.tv_sec * 1000000) + ((uint64_t)t.tv_nsec / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* wait for the end of the scan started at start_us, polled once its nominal duration has elapsed */
+static int scan_wait(uint64_t start_us, uint16_t nb_scan, lgw_spectral_scan_status_t * status) {
+    uint32_t duration_ms = (lgw_spectral_scan_duration_us(nb_scan) + 999) / 1000;
+    uint64_t end_us = start_us + ((uint64_t)duration_ms * 1000);
+    uint64_t now = time_us(CLOCK_MONOTONIC);
+
+    if (now < end_us) {
+        wait_ms((end_us - now + 999) / 1000);
+    }
+    while (1) {
+        *status = LGW_SPECTRAL_SCAN_STATUS_UNKNOWN;
+        if (lgw_spectral_scan_get_status(status) != 0) {
+            printf("ERROR: spectral scan status failed\n");
+            return -1;
+        }
+        if ((*status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED) || (*status == LGW_SPECTRAL_SCAN_STATUS_ABORTED)) {
+            return 0;
+        }
+        if (time_us(CLOCK_MONOTONIC) > (end_us + (SCAN_TIMEOUT_MS * 1000))) {
+            printf("ERROR: TIMEOUT on Spectral Scan\n");
+            return -1;
+        }
+        wait_ms(SCAN_POLL_MS);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void put_le(uint8_t * buf, uint64_t val, int size) {
+    int i;
+
+    for (i = 0; i < size; i++) {
+        buf[i] = (uint8_t)(val >> (8 * i));
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int log_header(FILE * log_file, bool binary) {
+    uint8_t buf[BIN_HEADER_SIZE];
+
+    if (binary == false) {
+        return 0; /* no header, the CSV lines are self-describing */
+    }
+    memcpy(buf, BIN_MAGIC, 4);
+    buf[4] = BIN_VERSION;
+    buf[5] = LGW_SPECTRAL_SCAN_RESULT_SIZE;
+    put_le(&buf[6], BIN_RECORD_SIZE, 2);
+
+    return (fwrite(buf, sizeof buf, 1, log_file) == 1) ? 0 : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int log_result(FILE * log_file, bool binary, bool verbose, const struct scan_result_s * res) {
+    uint8_t buf[BIN_RECORD_SIZE];
+    int idx = 0;
+    int i;
+
+    /* print results */
+    if (verbose == true) {
+        printf("%u: ", res->freq_hz);
+        for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+            printf("%u ", res->results[i]);
+        }
+        printf("\n");
+    }
+
+    if (binary == false) {
+        /* frequency and histogram first, as expected by plot_rssi_histogram.py */
+        fprintf(log_file, "%u", res->freq_hz);
+        for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+            fprintf(log_file, ",%d,%u", res->levels[i], res->results[i]);
+        }
+        return (fprintf(log_file, ",%u,%" PRIu64 "\n", res->sweep, res->time_us) > 0) ? 0 : -1;
+    }
+
+    put_le(&buf[idx], res->time_us, 8);
+    idx += 8;
+    put_le(&buf[idx], res->sweep, 4);
+    idx += 4;
+    put_le(&buf[idx], res->freq_hz, 4);
+    idx += 4;
+    put_le(&buf[idx], res->nb_scan, 2);
+    idx += 2;
+    for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+        put_le(&buf[idx], (uint16_t)res->levels[i], 2);
+        idx += 2;
+    }
+    for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+        put_le(&buf[idx], res->results[i], 2);
+        idx += 2;
+    }
+
+    return (fwrite(buf, sizeof buf, 1, log_file) == 1) ? 0 : -1;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -106,13 +256,22 @@ int main(int argc, char **argv)
     uint8_t nb_channels = DEFAULT_NB_CHAN;
     uint16_t nb_scan = DEFAULT_NB_SCAN;
     int8_t rssi_offset = DEFAULT_RSSI_OFFSET;
-    int16_t levels[LGW_SPECTRAL_SCAN_RESULT_SIZE];
-    uint16_t results[LGW_SPECTRAL_SCAN_RESULT_SIZE];
     char log_file_name[64] = DEFAULT_LOG_NAME;
     FILE * log_file = NULL;
-
-    struct timeval tm_start;
+    bool log_binary = false;
+
+    /* Sweep planner */
+    uint32_t nb_sweep = DEFAULT_NB_SWEEP;
+    uint32_t sweep_period_ms = 0;
+    uint32_t sweep = 0;
+    uint8_t chan = 0;
+    uint32_t nb_scan_ok = 0, nb_scan_err = 0;
+    uint64_t scan_start_us, sweep_start_us, run_start_us, now_us;
+    bool scan_running, scan_ok, next;
+    struct scan_result_s res[2]; /* scan in progress, previous scan being logged */
+    int cur = 0;
     lgw_spectral_scan_status_t status;
+    static struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
 
     /* Parameter parsing */
     int option_index = 0;
@@ -121,7 +280,7 @@ int main(int argc, char **argv)
     };
 
     /* parse command line options */
-    while ((i = getopt_long (argc, argv, "hud:f:n:o:s:l:D:", long_options, &option_index)) != -1) {
+    while ((i = getopt_long (argc, argv, "hud:f:n:o:s:l:D:Bc:p:", long_options, &option_index)) != -1) {
         switch (i) {
             case 'h':
                 usage();
@@ -202,6 +361,28 @@ int main(int argc, char **argv)
                 }
                 break;
 
+            case 'B':
+                log_binary = true;
+                break;
+
+            case 'c': /* <uint> Number of sweeps */
+                i = sscanf(optarg, "%u", &arg_u);
+                if (i != 1) {
+                    printf("ERROR: argument parsing of -c argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_sweep = arg_u;
+                break;
+
+            case 'p': /* <uint> Target sweep period in ms */
+                i = sscanf(optarg, "%u", &arg_u);
+                if (i != 1) {
+                    printf("ERROR: argument parsing of -p argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                sweep_period_ms = arg_u;
+                break;
+
             default:
                 printf("ERROR: argument parsing\n");
                 usage();
@@ -209,10 +390,28 @@ int main(int argc, char **argv)
         }
     }
 
+    if ((nb_channels == 0) || (nb_scan == 0)) {
+        printf("ERROR: at least 1 channel and 1 scan point are needed\n");
+        return EXIT_FAILURE;
+    }
+
     printf("==\n");
     printf("== Spectral Scan: freq_hz=%uHz, nb_channels=%u, nb_scan=%u, rssi_offset=%ddB\n", freq_hz, nb_channels, nb_scan, rssi_offset);
+    if (nb_sweep == 0) {
+        printf("== continuous sweeping, period=%ums\n", sweep_period_ms);
+    } else {
+        printf("== %u sweep(s), period=%ums\n", nb_sweep, sweep_period_ms);
+    }
     printf("==\n");
 
+    /* Configure signal handling */
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = sig_handler;
+    sigaction(SIGQUIT, &sigact, NULL);
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
     if (com_type == LGW_COM_SPI) {
         /* Board reset */
         if (system("./reset_lgw.sh start") != 0) {
@@ -276,76 +475,127 @@ int main(int argc, char **argv)
     }
 
     /* create log file */
-    strcat(log_file_name,".csv");
-    log_file = fopen(log_file_name, "w");
+    strcat(log_file_name, (log_binary == true) ? ".bin" : ".csv");
+    log_file = fopen(log_file_name, (log_binary == true) ? "wb" : "w");
     if (log_file == NULL) {
         printf("ERROR: impossible to create log file %s\n", log_file_name);
         return EXIT_FAILURE;
     }
+    if (log_header(log_file, log_binary) != 0) {
+        printf("ERROR: failed to write log file %s\n", log_file_name);
+        return EXIT_FAILURE;
+    }
 
-    /* Launch Spectral Scan on each channels */
-    for (j = 0; j < nb_channels; j++) {
-        x = lgw_spectral_scan_start(freq_hz, nb_scan);
-        if (x != 0) {
+    /* Sweep the channels: the next channel is scanned while the results of the previous one are logged */
+    run_start_us = time_us(CLOCK_MONOTONIC);
+    sweep_start_us = run_start_us;
+    res[cur].time_us = time_us(CLOCK_REALTIME);
+    res[cur].sweep = sweep;
+    res[cur].freq_hz = freq_hz;
+    res[cur].nb_scan = nb_scan;
+    scan_start_us = time_us(CLOCK_MONOTONIC);
+    scan_running = (lgw_spectral_scan_start(res[cur].freq_hz, nb_scan) == 0);
+    while ((quit_sig != 1) && (exit_sig != 1)) {
+        /* results of the scan in progress */
+        scan_ok = false;
+        if (scan_running == true) {
+            x = scan_wait(scan_start_us, nb_scan, &status);
+            if ((x == 0) && (status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED)) {
+                memset(res[cur].levels, 0, sizeof res[cur].levels);
+                memset(res[cur].results, 0, sizeof res[cur].results);
+                x = lgw_spectral_scan_get_results(res[cur].levels, res[cur].results);
+                if (x != 0) {
+                    printf("ERROR: spectral scan get results failed\n");
+                } else {
+                    scan_ok = true;
+                }
+            } else {
+                if ((x == 0) && (status == LGW_SPECTRAL_SCAN_STATUS_ABORTED)) {
+                    printf("INFO: spectral scan has been aborted\n");
+                }
+                lgw_spectral_scan_abort();
+            }
+        } else {
             printf("ERROR: spectral scan start failed\n");
-            continue;
+        }
+        scan_running = false;
+        if (scan_ok == true) {
+            nb_scan_ok += 1;
+        } else {
+            nb_scan_err += 1;
         }
 
-        /* Wait for scan to be completed */
-        timeout_start(&tm_start);
-        do {
-            /* handle timeout */
-            if (timeout_check(tm_start, 2000) != 0) {
-                printf("ERROR: %s: TIMEOUT on Spectral Scan\n", __FUNCTION__);
-                continue;
-            }
+        /* plan the next scan */
+        chan += 1;
+        if (chan == nb_channels) {
+            now_us = time_us(CLOCK_MONOTONIC);
+            printf("INFO: sweep %u: %u channels in %.1f ms\n", sweep, nb_channels, (double)(now_us - sweep_start_us) / 1e3);
+            chan = 0;
+            sweep += 1;
+        }
+        next = (nb_sweep == 0) || (sweep < nb_sweep);
 
-            /* get spectral scan status */
-            status = LGW_SPECTRAL_SCAN_STATUS_UNKNOWN;
-            x = lgw_spectral_scan_get_status(&status);
-            if (x != 0) {
-                printf("ERROR: spectral scan status failed\n");
+        /* the results of the last channel of a sweep are logged before waiting for the next sweep */
+        if ((scan_ok == true) && ((next == false) || ((chan == 0) && (sweep_period_ms > 0)))) {
+            if (log_result(log_file, log_binary, (nb_sweep == 1), &res[cur]) != 0) {
+                printf("ERROR: failed to write log file %s\n", log_file_name);
                 break;
             }
-
-            wait_ms(10);
-        } while (status != LGW_SPECTRAL_SCAN_STATUS_COMPLETED && status != LGW_SPECTRAL_SCAN_STATUS_ABORTED);
-
-        if (status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED) {
-            memset(levels, 0, sizeof levels);
-            memset(results, 0, sizeof results);
-            x = lgw_spectral_scan_get_results(levels, results);
-            if (x != 0) {
-                printf("ERROR: spectral scan get results failed\n");
-                continue;
-            }
-
-            /* log results */
-            fprintf(log_file, "%u", freq_hz);
-            for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
-                fprintf(log_file, ",%d,%u", levels[i], results[i]);
+            scan_ok = false;
+        }
+        if (next == false) {
+            break;
+        }
+        if (chan == 0) {
+            if (sweep_period_ms > 0) {
+                sweep_start_us += (uint64_t)sweep_period_ms * 1000;
+                now_us = time_us(CLOCK_MONOTONIC);
+                while ((quit_sig != 1) && (exit_sig != 1) && (now_us < sweep_start_us)) {
+                    wait_ms(((sweep_start_us - now_us) > 100000) ? 100 : ((sweep_start_us - now_us + 999) / 1000));
+                    now_us = time_us(CLOCK_MONOTONIC);
+                }
+                if (now_us > (sweep_start_us + ((uint64_t)sweep_period_ms * 1000))) {
+                    sweep_start_us = now_us; /* more than a period late, do not try to catch up */
+                }
+            } else {
+                sweep_start_us = time_us(CLOCK_MONOTONIC);
             }
-            fprintf(log_file, "\n");
+        }
 
-            /* print results */
-            printf("%u: ", freq_hz);
-            for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
-                printf("%u ", results[i]);
+        /* retune and start the next scan, then log the previous results while scanning */
+        cur ^= 1;
+        res[cur].time_us = time_us(CLOCK_REALTIME);
+        res[cur].sweep = sweep;
+        res[cur].freq_hz = freq_hz + ((uint32_t)chan * CHAN_STEP_HZ);
+        res[cur].nb_scan = nb_scan;
+        scan_start_us = time_us(CLOCK_MONOTONIC);
+        scan_running = (lgw_spectral_scan_start(res[cur].freq_hz, nb_scan) == 0);
+        if (scan_ok == true) {
+            if (log_result(log_file, log_binary, (nb_sweep == 1), &res[cur ^ 1]) != 0) {
+                printf("ERROR: failed to write log file %s\n", log_file_name);
+                break;
             }
-            printf("\n");
-
-            /* Next frequency to scan */
-            freq_hz += 200000; /* 200kHz channels */
-        } else if (status == LGW_SPECTRAL_SCAN_STATUS_ABORTED) {
-            printf("INFO: spectral scan has been aborted\n");
-        } else {
-            printf("ERROR: spectral scan status us unexpected 0x%02X\n", status);
         }
     }
+    if (scan_running == true) {
+        lgw_spectral_scan_abort(); /* interrupted, or stopped on a log error */
+    }
 
     /* close log file */
     fclose(log_file);
 
+    /* report the sweep rate achieved */
+    now_us = time_us(CLOCK_MONOTONIC);
+    printf("==\n");
+    printf("== %u sweep(s) of %u channels in %.3f s: %.3f sweeps/s\n", sweep, nb_channels,
+            (double)(now_us - run_start_us) / 1e6,
+            (double)sweep * 1e6 / (double)(now_us - run_start_us));
+    printf("== %u scans ok, %u failed: %.1f channels/s, %.1f us per channel (scan duration %u us)\n", nb_scan_ok, nb_scan_err,
+            (double)(nb_scan_ok + nb_scan_err) * 1e6 / (double)(now_us - run_start_us),
+            (double)(now_us - run_start_us) / (double)(nb_scan_ok + nb_scan_err),
+            lgw_spectral_scan_duration_us(nb_scan));
+    printf("==\n");
+
     /* Stop the gateway */
     x = lgw_stop();
     if (x != 0) {